@@ -0,0 +1,675 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#include "portab.h"
+
+/**
+ * @file
+ * Server burst
+ *
+ * When a new server has been registered, it is informed about all servers,
+ * users, and channels of the network (the "burst"). Except for the servers,
+ * this is done incrementally: a cursor into the lists of clients and
+ * channels is kept for each server link, and the burst is continued by the
+ * main loop whenever the write buffer of the link has been drained below
+ * WRITEBUFFER_BURST_LEN bytes, see Conn_Handler().
+ *
+ * The burst describes the state of the network at the time it is sent, and
+ * all other messages are forwarded to the new server as usual in the
+ * meantime: messages of clients not announced yet are ignored by the peer,
+ * as their prefix is still unknown to it, and clients registered in the
+ * meantime are announced to the new server right away. Clients created in
+ * the meantime are never reached by the cursor, as they are added to the
+ * head of the list, and the cursor skips clients which already existed but
+ * registered after the burst has started (see Client_Serial()).
+ *
+ * But messages changing the state of channels not announced yet are
+ * dropped, see Burst_Forward(): the peer would create the channel or add
+ * members twice otherwise. This includes all channels until all users have
+ * been announced, which is why the channel cursor starts at the head of
+ * the channel list only then; and channels created afterwards are
+ * "announced" by the regular JOIN messages of their members.
+ *
+ * The new server can join its own users to existing channels during the
+ * burst, too, so clients known via the new server are never announced back
+ * to it.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "conn-func.h"
+#include "conf.h"
+#include "channel.h"
+#include "class.h"
+#include "irc-write.h"
+#include "lists.h"
+#include "log.h"
+
+#include "burst.h"
+
+/** Phases of a server burst. */
+#define BURST_USERS	1		/* announcing users and services */
+#define BURST_CHANNELS	2		/* announcing channels */
+#define BURST_LISTS	3		/* synchronizing channel lists */
+#define BURST_DONE	4		/* burst complete */
+
+/** Server burst in progress. */
+typedef struct _Burst
+{
+	struct _Burst *next;		/* next burst in progress */
+	CLIENT *client;			/* server receiving the burst */
+	int phase;			/* current phase, see above */
+	CLIENT *next_client;		/* next client to announce */
+	unsigned long serial;		/* clients registered up to then */
+	CHANNEL *next_channel;		/* next channel to announce */
+} BURST;
+
+static BURST *My_Bursts;
+
+static BURST *Find_Burst PARAMS((CONN_ID Idx));
+static bool Channel_Announced PARAMS((BURST *b, const char *Name, size_t Len));
+static void Free_Burst PARAMS((BURST *b));
+static bool Burst_Step PARAMS((BURST *b));
+
+/**
+ * Announce a channel and its users in the network.
+ *
+ * The NJOIN commands are built in a single pass over the members of the
+ * channel, appending each member (and its prefix) to the end of the line,
+ * which is sent whenever the next member doesn't fit into it any more.
+ */
+static bool
+Announce_Channel(CLIENT *Client, CHANNEL *Chan)
+{
+	CL2CHAN *cl2chan;
+	CLIENT *cl;
+	char str[COMMAND_LEN], prefix[8];
+	const char *modes, *id, *ptr;
+	size_t len, start, max_len, prefix_len, id_len;
+	bool njoin, xop;
+
+	/* Check features of remote server */
+	njoin = Conn_Options(Client_Conn(Client)) & CONN_RFC1459 ? false : true;
+	xop = Client_HasFlag(Client, 'X') ? true : false;
+
+	/* Maximum length of a NJOIN command: it is prefixed with the ID of
+	 * this server, and CR+LF is appended when sending it */
+	max_len = COMMAND_LEN - 3 - strlen(Client_ID(Client_ThisServer())) - 2;
+
+	snprintf(str, sizeof(str), "NJOIN %s :", Channel_Name(Chan));
+	start = len = strlen(str);
+
+	/* Get all the members of this channel */
+	for (cl2chan = Channel_FirstMember(Chan); cl2chan;
+	     cl2chan = Channel_NextMember(Chan, cl2chan)) {
+		cl = Channel_GetClient(cl2chan);
+		assert(cl != NULL);
+
+		if (Client_NextHop(cl) == Client)
+			continue;	/* known via the new server already */
+
+		modes = Channel_GetModes(cl2chan);
+
+		if (!njoin) {
+			/* RFC 1459: no NJOIN, send JOIN and MODE */
+			if (!IRC_WriteStrClientPrefix(Client, cl, "JOIN %s",
+						Channel_Name(Chan)))
+				return DISCONNECTED;
+			for (ptr = modes; *ptr; ptr++) {
+				if (!IRC_WriteStrClientPrefix(Client, cl,
+						   "MODE %s +%c %s",
+						   Channel_Name(Chan), ptr[0],
+						   Client_ID(cl)))
+					return DISCONNECTED;
+			}
+			continue;
+		}
+
+		/* RFC 2813: send NJOIN with nicknames and modes
+		 * (if user is channel operator or has voice) */
+		prefix_len = 0;
+		if (*modes) {
+			if (xop && strchr(modes, 'q'))
+				prefix[prefix_len++] = '~';
+			if (xop && strchr(modes, 'a'))
+				prefix[prefix_len++] = '&';
+			if (strchr(modes, 'o'))
+				prefix[prefix_len++] = '@';
+			if (xop && strchr(modes, 'h'))
+				prefix[prefix_len++] = '%';
+			if (strchr(modes, 'v'))
+				prefix[prefix_len++] = '+';
+		}
+		id = Client_ID(cl);
+		id_len = strlen(id);
+
+		/* Send the data if the member doesn't fit into the line */
+		if (len > start && len + 1 + prefix_len + id_len > max_len) {
+			str[len] = '\0';
+			if (!IRC_WriteStrClient(Client, "%s", str))
+				return DISCONNECTED;
+			len = start;
+		}
+
+		if (len > start)
+			str[len++] = ',';
+		memcpy(str + len, prefix, prefix_len);
+		len += prefix_len;
+		memcpy(str + len, id, id_len);
+		len += id_len;
+	}
+
+	/* Data left in the buffer? */
+	if (len > start) {
+		/* Yes, send it ... */
+		str[len] = '\0';
+		if (!IRC_WriteStrClient(Client, "%s", str))
+			return DISCONNECTED;
+	}
+
+	return CONNECTED;
+} /* Announce_Channel */
+
+/**
+ * Announce new server in the network
+ * @param Client New server
+ * @param Server Existing server in the network
+ */
+static bool
+Announce_Server(CLIENT * Client, CLIENT * Server)
+{
+	CLIENT *c;
+
+	if (Client_Conn(Server) > NONE) {
+		/* Announce the new server to the one already registered
+		 * which is directly connected to the local server */
+		if (!IRC_WriteStrClient
+		    (Server, "SERVER %s %d %d :%s", Client_ID(Client),
+		     Client_Hops(Client) + 1, Client_MyToken(Client),
+		     Client_Info(Client)))
+			return DISCONNECTED;
+	}
+
+	if (Client_Hops(Server) == 1)
+		c = Client_ThisServer();
+	else
+		c = Client_TopServer(Server);
+
+	/* Inform new server about the one already registered in the network */
+	return IRC_WriteStrClientPrefix(Client, c, "SERVER %s %d %d :%s",
+		Client_ID(Server), Client_Hops(Server) + 1,
+		Client_MyToken(Server), Client_Info(Server));
+} /* Announce_Server */
+
+#ifdef IRCPLUS
+
+/**
+ * Send a specific list to a remote server.
+ */
+static bool
+Send_List(CLIENT *Client, CHANNEL *Chan, struct list_head *Head, char Type)
+{
+	struct list_elem *elem;
+
+	elem = Lists_GetFirst(Head);
+	while (elem) {
+		if (!IRC_WriteStrClient(Client, "MODE %s +%c %s",
+					Channel_Name(Chan), Type,
+					Lists_GetMask(elem))) {
+			return DISCONNECTED;
+		}
+		elem = Lists_GetNext(elem);
+	}
+	return CONNECTED;
+}
+
+/**
+ * Synchronize the G-Line list between servers.
+ *
+ * @param Client New server.
+ * @return CONNECTED or DISCONNECTED.
+ */
+static bool
+Send_GLines(CLIENT * Client)
+{
+	struct list_head *head;
+	struct list_elem *elem;
+	time_t t;
+
+	assert(Client != NULL);
+
+	head = Class_GetList(CLASS_GLINE);
+	elem = Lists_GetFirst(head);
+	while (elem) {
+		t = Lists_GetValidity(elem) - time(NULL);
+		if (!IRC_WriteStrClient(Client, "GLINE %s %ld :%s",
+					Lists_GetMask(elem),
+					t > 0 ? (long)t : 0,
+					Lists_GetReason(elem)))
+			return DISCONNECTED;
+		elem = Lists_GetNext(elem);
+	}
+	return CONNECTED;
+} /* Send_GLines */
+
+/**
+ * Synchronize invite, ban, and except lists of a channel between servers.
+ *
+ * @param Client New server.
+ * @param Chan Channel.
+ * @return CONNECTED or DISCONNECTED.
+ */
+static bool
+Synchronize_Lists(CLIENT * Client, CHANNEL * Chan)
+{
+	assert(Client != NULL);
+	assert(Chan != NULL);
+
+	if (!Send_List(Client, Chan, Channel_GetListExcepts(Chan), 'e'))
+		return DISCONNECTED;
+	if (!Send_List(Client, Chan, Channel_GetListBans(Chan), 'b'))
+		return DISCONNECTED;
+	return Send_List(Client, Chan, Channel_GetListInvites(Chan), 'I');
+} /* Synchronize_Lists */
+
+/**
+ * Send CHANINFO commands to a new server (inform it about existing channels).
+ * @param Client New server
+ * @param Chan Channel
+ */
+static bool
+Send_CHANINFO(CLIENT * Client, CHANNEL * Chan)
+{
+	char *modes, *topic, *key;
+	bool has_k, has_l;
+
+	Log(LOG_DEBUG, "Sending CHANINFO commands for \"%s\" ...",
+	    Channel_Name(Chan));
+
+	modes = Channel_Modes(Chan);
+	topic = Channel_Topic(Chan);
+
+	if (!*modes && !*topic)
+		return CONNECTED;
+
+	has_k = Channel_HasMode(Chan, 'k');
+	has_l = Channel_HasMode(Chan, 'l');
+
+	/* send CHANINFO */
+	if (!has_k && !has_l) {
+		if (!*topic) {
+			/* "CHANINFO <chan> +<modes>" */
+			return IRC_WriteStrClient(Client, "CHANINFO %s +%s",
+						  Channel_Name(Chan), modes);
+		}
+		/* "CHANINFO <chan> +<modes> :<topic>" */
+		return IRC_WriteStrClient(Client, "CHANINFO %s +%s :%s",
+					  Channel_Name(Chan), modes, topic);
+	}
+	/* "CHANINFO <chan> +<modes> <key> <limit> :<topic>" */
+	key = Channel_Key(Chan);
+	return IRC_WriteStrClient(Client, "CHANINFO %s +%s %s %lu :%s",
+				  Channel_Name(Chan), modes,
+				  has_k ? (key && *key ? key : "*") : "*",
+				  has_l ? Channel_MaxUsers(Chan) : 0, topic);
+} /* Send_CHANINFO */
+
+#endif /* IRCPLUS */
+
+/**
+ * Start the burst for a new server.
+ *
+ * All servers are announced right away, as there are only few of them,
+ * users and channels are announced later on by Burst_Continue().
+ *
+ * @param Client New server.
+ * @return CONNECTED or DISCONNECTED.
+ */
+GLOBAL bool
+Burst_Start(CLIENT *Client)
+{
+	int max_hops, i;
+	CLIENT *c;
+	BURST *b;
+
+	assert(Client != NULL);
+	assert(Client_Conn(Client) > NONE);
+
+	/* Get highest hop count */
+	max_hops = 0;
+	c = Client_First();
+	while (c) {
+		if (Client_Hops(c) > max_hops)
+			max_hops = Client_Hops(c);
+		c = Client_Next(c);
+	}
+
+	/* Inform the new server about all other servers, and announce the
+	 * new server to all the already registered ones. Important: we have
+	 * to do this "in order" and can't introduce servers of which the
+	 * "toplevel server" isn't known already. */
+	for (i = 0; i < (max_hops + 1); i++) {
+		for (c = Client_First(); c != NULL; c = Client_Next(c)) {
+			if (Client_Type(c) != CLIENT_SERVER)
+				continue;	/* not a server */
+			if (Client_Hops(c) != i)
+				continue;	/* not actual "nesting level" */
+			if (c == Client || c == Client_ThisServer())
+				continue;	/* that's us or the peer! */
+
+			if (!Announce_Server(Client, c))
+				return DISCONNECTED;
+		}
+	}
+
+	b = (BURST *)calloc(1, sizeof(BURST));
+	if (!b) {
+		Log(LOG_EMERG, "Can't allocate memory! [Burst_Start]");
+		Conn_Close(Client_Conn(Client), "Out of memory", NULL, false);
+		return DISCONNECTED;
+	}
+	b->client = Client;
+	b->phase = BURST_USERS;
+	b->next_client = Client_First();
+	b->serial = Client_LastSerial();
+	b->next = My_Bursts;
+	My_Bursts = b;
+
+	LogDebug("Starting burst for server \"%s\" (connection %d) ...",
+		 Client_ID(Client), Client_Conn(Client));
+	Conn_StartBurst(Client_Conn(Client));
+	return CONNECTED;
+} /* Burst_Start */
+
+/**
+ * Continue the burst on a server link until its write buffer is filled up
+ * to WRITEBUFFER_BURST_LEN bytes.
+ *
+ * @param Idx Connection index of the server link.
+ * @return true if the burst is still in progress, false if it is complete
+ *	   or the connection has been closed.
+ */
+GLOBAL bool
+Burst_Continue(CONN_ID Idx)
+{
+	BURST *b;
+
+	b = Find_Burst(Idx);
+	if (!b)
+		return false;
+
+	while (Conn_SendQ(Idx) < WRITEBUFFER_BURST_LEN) {
+		if (!Burst_Step(b))
+			return false;	/* connection closed, burst freed! */
+		if (b->phase != BURST_DONE)
+			continue;
+
+		LogDebug("Burst for server \"%s\" (connection %d) done.",
+			 Client_ID(b->client), Idx);
+		Free_Burst(b);
+		return false;
+	}
+	return true;
+} /* Burst_Continue */
+
+/**
+ * Cancel the burst on a server link, if any.
+ */
+GLOBAL void
+Burst_Cancel(CONN_ID Idx)
+{
+	BURST *b;
+
+	b = Find_Burst(Idx);
+	if (b)
+		Free_Burst(b);
+} /* Burst_Cancel */
+
+/**
+ * Check if a message can be forwarded to a server link while the burst is
+ * in progress: messages changing the state of channels which have not been
+ * announced to the peer yet must be dropped.
+ *
+ * @param Idx Connection index of the server link.
+ * @param Line The message, including CR+LF (not NULL-terminated).
+ * @param Len Length of the message.
+ * @return true if the message can be forwarded, false if it must be dropped.
+ */
+GLOBAL bool
+Burst_Forward(CONN_ID Idx, const char *Line, size_t Len)
+{
+	static const char *commands[] = { "CHANINFO", "JOIN", "KICK", "MODE",
+					  "NJOIN", "PART", "TOPIC", NULL };
+	const char *ptr, *end, *cmd;
+	size_t cmd_len;
+	BURST *b;
+	int i;
+
+	assert(Line != NULL);
+
+	b = Find_Burst(Idx);
+	if (!b || b->phase > BURST_CHANNELS)
+		return true;
+
+	/* Skip prefix, if any */
+	ptr = Line;
+	end = Line + Len;
+	if (ptr < end && *ptr == ':') {
+		while (ptr < end && *ptr != ' ')
+			ptr++;
+		while (ptr < end && *ptr == ' ')
+			ptr++;
+	}
+
+	/* Get command and check if it refers to a channel */
+	cmd = ptr;
+	while (ptr < end && *ptr != ' ')
+		ptr++;
+	cmd_len = (size_t)(ptr - cmd);
+	for (i = 0; commands[i]; i++) {
+		if (strlen(commands[i]) == cmd_len
+		    && strncasecmp(commands[i], cmd, cmd_len) == 0)
+			break;
+	}
+	if (!commands[i])
+		return true;
+
+	/* Get the channel name: the first parameter, without the list of
+	 * modes of a JOIN command (separated by ASCII 7) */
+	while (ptr < end && *ptr == ' ')
+		ptr++;
+	cmd = ptr;
+	while (ptr < end && !strchr(" ,\a\r\n", *ptr))
+		ptr++;
+	return Channel_Announced(b, cmd, (size_t)(ptr - cmd));
+} /* Burst_Forward */
+
+/**
+ * Advance the cursors of all bursts pointing to a client that is removed.
+ *
+ * This function must be called before the client is unlinked.
+ */
+GLOBAL void
+Burst_ClientRemoved(CLIENT *Client)
+{
+	BURST *b, *next;
+
+	for (b = My_Bursts; b; b = next) {
+		next = b->next;
+		if (b->client == Client)
+			Free_Burst(b);
+		else if (b->next_client == Client)
+			b->next_client = Client_Next(Client);
+	}
+} /* Burst_ClientRemoved */
+
+/**
+ * Advance the cursors of all bursts pointing to a channel that is removed.
+ *
+ * This function must be called before the channel is unlinked.
+ */
+GLOBAL void
+Burst_ChannelRemoved(CHANNEL *Chan)
+{
+	BURST *b;
+
+	for (b = My_Bursts; b; b = b->next) {
+		if (b->next_channel == Chan)
+			b->next_channel = Channel_Next(Chan);
+	}
+} /* Burst_ChannelRemoved */
+
+/**
+ * Find the burst in progress on a server link.
+ */
+static BURST *
+Find_Burst(CONN_ID Idx)
+{
+	BURST *b;
+
+	for (b = My_Bursts; b; b = b->next) {
+		if (Client_Conn(b->client) == Idx)
+			return b;
+	}
+	return NULL;
+} /* Find_Burst */
+
+/**
+ * Check if a channel has been announced by a burst already.
+ *
+ * Channels created after the burst has started announcing channels are
+ * not reached by the cursor, but are "announced" by the regular messages.
+ * Unknown names (user modes, for example) are considered as announced.
+ *
+ * @param b The burst.
+ * @param Name Name of the channel (not NULL-terminated).
+ * @param Len Length of the name.
+ */
+static bool
+Channel_Announced(BURST *b, const char *Name, size_t Len)
+{
+	char name[CHANNEL_NAME_LEN];
+	CHANNEL *chan;
+
+	if (Len == 0 || Len >= sizeof(name))
+		return true;
+	memcpy(name, Name, Len);
+	name[Len] = '\0';
+
+	chan = Channel_Search(name);
+	if (!chan)
+		return true;
+
+	if (b->phase == BURST_USERS)
+		return false;
+	return !b->next_channel
+	       || Channel_Serial(chan) > Channel_Serial(b->next_channel);
+} /* Channel_Announced */
+
+/**
+ * Unlink and free a burst structure.
+ */
+static void
+Free_Burst(BURST *b)
+{
+	BURST **p;
+
+	for (p = &My_Bursts; *p; p = &(*p)->next) {
+		if (*p == b) {
+			*p = b->next;
+			break;
+		}
+	}
+	free(b);
+} /* Free_Burst */
+
+/**
+ * Announce the next client or channel, or switch to the next phase.
+ *
+ * @return CONNECTED or DISCONNECTED.
+ */
+static bool
+Burst_Step(BURST *b)
+{
+	CLIENT *c;
+	CHANNEL *chan;
+
+	switch (b->phase) {
+	case BURST_USERS:
+		/* Announce all the users to the new server */
+		c = b->next_client;
+		if (!c) {
+			b->phase = BURST_CHANNELS;
+			b->next_channel = Channel_First();
+			return CONNECTED;
+		}
+		b->next_client = Client_Next(c);
+		if (Client_NextHop(c) == b->client)
+			return CONNECTED;
+		if (Client_Serial(c) > b->serial)
+			return CONNECTED;	/* announced on registration */
+		if (Client_Type(c) == CLIENT_USER ||
+		    Client_Type(c) == CLIENT_SERVICE)
+			return Client_Announce(b->client, Client_ThisServer(), c);
+		return CONNECTED;
+
+	case BURST_CHANNELS:
+		/* Announce all channels to the new server */
+		chan = b->next_channel;
+		if (!chan) {
+			b->phase = BURST_DONE;
+#ifdef IRCPLUS
+			if (Client_HasFlag(b->client, 'L')) {
+				LogDebug("Synchronizing INVITE- and BAN-lists ...");
+				b->phase = BURST_LISTS;
+				b->next_channel = Channel_First();
+				if (!Send_GLines(b->client))
+					return DISCONNECTED;
+			}
+#endif
+			if (b->phase == BURST_DONE)
+				return IRC_WriteStrClient(b->client, "PING :%s",
+					Client_ID(Client_ThisServer()));
+			return CONNECTED;
+		}
+		b->next_channel = Channel_Next(chan);
+		if (Channel_IsLocal(chan))
+			return CONNECTED;
+#ifdef IRCPLUS
+		/* Send CHANINFO if the peer supports it */
+		if (Client_HasFlag(b->client, 'C')) {
+			if (!Send_CHANINFO(b->client, chan))
+				return DISCONNECTED;
+		}
+#endif
+		return Announce_Channel(b->client, chan);
+
+#ifdef IRCPLUS
+	case BURST_LISTS:
+		chan = b->next_channel;
+		if (!chan) {
+			b->phase = BURST_DONE;
+			return IRC_WriteStrClient(b->client, "PING :%s",
+				Client_ID(Client_ThisServer()));
+		}
+		b->next_channel = Channel_Next(chan);
+		return Synchronize_Lists(b->client, chan);
+#endif
+	}
+	return CONNECTED;
+} /* Burst_Step */
+
+/* -eof- */
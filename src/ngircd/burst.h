@@ -0,0 +1,32 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#ifndef __burst_h__
+#define __burst_h__
+
+/**
+ * @file
+ * Server burst (header)
+ */
+
+#include "channel.h"
+
+GLOBAL bool Burst_Start PARAMS((CLIENT *Client));
+GLOBAL bool Burst_Continue PARAMS((CONN_ID Idx));
+GLOBAL void Burst_Cancel PARAMS((CONN_ID Idx));
+GLOBAL bool Burst_Forward PARAMS((CONN_ID Idx, const char *Line, size_t Len));
+
+GLOBAL void Burst_ClientRemoved PARAMS((CLIENT *Client));
+GLOBAL void Burst_ChannelRemoved PARAMS((CHANNEL *Chan));
+
+#endif
+
+/* -eof- */
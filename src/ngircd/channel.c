@@ -31,6 +31,7 @@
 #include "channel.h"
 
 #include "irc-write.h"
+#include "burst.h"
 #include "conf.h"
 #include "hash.h"
 #include "log.h"
@@ -38,19 +39,22 @@
 #include "match.h"
 #include "parse.h"
 #include "irc-mode.h"
+#include "slab.h"
 
 #define REMOVE_PART 0
 #define REMOVE_QUIT 1
 #define REMOVE_KICK 2
 
 static CHANNEL *My_Channels;
-static CL2CHAN *My_Cl2Chan;
+static unsigned long My_ChannelSerial;
+static HASH_TABLE My_ChannelsHash;
+static HASH_TABLE My_Cl2ChanHash;
+static SLAB_CACHE My_ChannelsSlab;
+static SLAB_CACHE My_Cl2ChanSlab;
 
 static CL2CHAN *Get_Cl2Chan PARAMS(( CHANNEL *Chan, CLIENT *Client ));
 static CL2CHAN *Add_Client PARAMS(( CHANNEL *Chan, CLIENT *Client ));
 static bool Remove_Client PARAMS(( int Type, CHANNEL *Chan, CLIENT *Client, CLIENT *Origin, const char *Reason, bool InformServer ));
-static CL2CHAN *Get_First_Cl2Chan PARAMS(( CLIENT *Client, CHANNEL *Chan ));
-static CL2CHAN *Get_Next_Cl2Chan PARAMS(( CL2CHAN *Start, CLIENT *Client, CHANNEL *Chan ));
 static void Delete_Channel PARAMS(( CHANNEL *Chan ));
 static void Free_Channel PARAMS(( CHANNEL *Chan ));
 static void Set_KeyFile PARAMS((CHANNEL *Chan, const char *KeyFile));
@@ -60,7 +64,15 @@ GLOBAL void
 Channel_Init( void )
 {
 	My_Channels = NULL;
-	My_Cl2Chan = NULL;
+
+	if (!Hash_TableInit(&My_ChannelsHash, CHANNEL_HASH_SIZE)
+	    || !Hash_TableInit(&My_Cl2ChanHash, CL2CHAN_HASH_SIZE)) {
+		Log(LOG_EMERG, "Can't allocate channel hash table! Going down.");
+		Log(LOG_ALERT, "%s exiting due to fatal errors!", PACKAGE_NAME);
+		exit(1);
+	}
+	Slab_Init(&My_ChannelsSlab, "CHANNEL", sizeof(CHANNEL));
+	Slab_Init(&My_Cl2ChanSlab, "CL2CHAN", sizeof(CL2CHAN));
 } /* Channel_Init */
 
 
@@ -205,13 +217,23 @@ Channel_InitPredefined( void )
 static void
 Free_Channel(CHANNEL *chan)
 {
+	CL2CHAN *cl2chan, *cl2chan_next;
+
+	/* Free all remaining memberships */
+	cl2chan = chan->members;
+	while (cl2chan) {
+		cl2chan_next = cl2chan->next_member;
+		Slab_Free(&My_Cl2ChanSlab, cl2chan);
+		cl2chan = cl2chan_next;
+	}
+
 	array_free(&chan->topic);
 	array_free(&chan->keyfile);
 	Lists_Free(&chan->list_bans);
 	Lists_Free(&chan->list_excepts);
 	Lists_Free(&chan->list_invites);
 
-	free(chan);
+	Slab_Free(&My_ChannelsSlab, chan);
 }
 
 
@@ -219,9 +241,8 @@ GLOBAL void
 Channel_Exit( void )
 {
 	CHANNEL *c, *c_next;
-	CL2CHAN *cl2chan, *cl2chan_next;
 
-	/* free struct Channel */
+	/* free struct Channel (and its memberships) */
 	c = My_Channels;
 	while (c) {
 		c_next = c->next;
@@ -229,13 +250,10 @@ Channel_Exit( void )
 		c = c_next;
 	}
 
-	/* Free Channel allocation table */
-	cl2chan = My_Cl2Chan;
-	while (cl2chan) {
-		cl2chan_next = cl2chan->next;
-		free(cl2chan);
-		cl2chan = cl2chan_next;
-	}
+	Hash_TableFree(&My_ChannelsHash);
+	Hash_TableFree(&My_Cl2ChanHash);
+	Slab_Exit(&My_ChannelsSlab);
+	Slab_Exit(&My_Cl2ChanSlab);
 } /* Channel_Exit */
 
 
@@ -423,7 +441,7 @@ Channel_Kick(CLIENT *Peer, CLIENT *Target, CLIENT *Origin, const char *Name,
 GLOBAL void
 Channel_Quit( CLIENT *Client, const char *Reason )
 {
-	CHANNEL *c, *next_c;
+	CL2CHAN *cl2chan, *next_cl2chan;
 
 	assert( Client != NULL );
 	assert( Reason != NULL );
@@ -433,12 +451,12 @@ Channel_Quit( CLIENT *Client, const char *Reason )
 
 	IRC_WriteStrRelatedPrefix( Client, Client, false, "QUIT :%s", Reason );
 
-	c = My_Channels;
-	while( c )
-	{
-		next_c = c->next;
-		Remove_Client( REMOVE_QUIT, c, Client, Client, Reason, false );
-		c = next_c;
+	cl2chan = (CL2CHAN *)Client_Channels(Client);
+	while (cl2chan) {
+		next_cl2chan = cl2chan->next_channel;
+		Remove_Client(REMOVE_QUIT, cl2chan->channel, Client, Client,
+			      Reason, false);
+		cl2chan = next_cl2chan;
 	}
 } /* Channel_Quit */
 
@@ -473,18 +491,8 @@ Channel_CountVisible (CLIENT *Client)
 GLOBAL unsigned long
 Channel_MemberCount( CHANNEL *Chan )
 {
-	CL2CHAN *cl2chan;
-	unsigned long count = 0;
-
 	assert( Chan != NULL );
-
-	cl2chan = My_Cl2Chan;
-	while( cl2chan )
-	{
-		if( cl2chan->channel == Chan ) count++;
-		cl2chan = cl2chan->next;
-	}
-	return count;
+	return Chan->member_count;
 } /* Channel_MemberCount */
 
 
@@ -498,11 +506,10 @@ Channel_CountForUser( CLIENT *Client )
 
 	assert( Client != NULL );
 
-	cl2chan = My_Cl2Chan;
-	while( cl2chan )
-	{
-		if( cl2chan->client == Client ) count++;
-		cl2chan = cl2chan->next;
+	cl2chan = (CL2CHAN *)Client_Channels(Client);
+	while (cl2chan) {
+		count++;
+		cl2chan = cl2chan->next_channel;
 	}
 
 	return count;
@@ -517,6 +524,19 @@ Channel_Name( const CHANNEL *Chan )
 } /* Channel_Name */
 
 
+/**
+ * Get the creation serial number of a channel: channels created later on
+ * have higher numbers, and the channel list is ordered by it (newest
+ * channel first).
+ */
+GLOBAL unsigned long
+Channel_Serial( const CHANNEL *Chan )
+{
+	assert( Chan != NULL );
+	return Chan->serial;
+} /* Channel_Serial */
+
+
 GLOBAL char *
 Channel_Modes( CHANNEL *Chan )
 {
@@ -569,21 +589,17 @@ Channel_Search( const char *Name )
 {
 	/* Search channel structure */
 
+	HASH_ITEM *item;
 	CHANNEL *c;
-	UINT32 search_hash;
 
 	assert( Name != NULL );
 
-	search_hash = Hash( Name );
-	c = My_Channels;
-	while( c )
-	{
-		if( search_hash == c->hash )
-		{
-			/* hash hit */
-			if( strcasecmp( Name, c->name ) == 0 ) return c;
-		}
-		c = c->next;
+	item = Hash_TableFirst(&My_ChannelsHash, Hash(Name));
+	while (item) {
+		c = (CHANNEL *)item->data;
+		if (strcasecmp(Name, c->name) == 0)
+			return c;
+		item = Hash_TableNext(item);
 	}
 	return NULL;
 } /* Channel_Search */
@@ -593,16 +609,17 @@ GLOBAL CL2CHAN *
 Channel_FirstMember( CHANNEL *Chan )
 {
 	assert( Chan != NULL );
-	return Get_First_Cl2Chan( NULL, Chan );
+	return Chan->members;
 } /* Channel_FirstMember */
 
 
 GLOBAL CL2CHAN *
-Channel_NextMember( CHANNEL *Chan, CL2CHAN *Cl2Chan )
+Channel_NextMember( CHANNEL UNUSED *Chan, CL2CHAN *Cl2Chan )
 {
 	assert( Chan != NULL );
 	assert( Cl2Chan != NULL );
-	return Get_Next_Cl2Chan( Cl2Chan->next, NULL, Chan );
+	assert( Cl2Chan->channel == Chan );
+	return Cl2Chan->next_member;
 } /* Channel_NextMember */
 
 
@@ -610,16 +627,17 @@ GLOBAL CL2CHAN *
 Channel_FirstChannelOf( CLIENT *Client )
 {
 	assert( Client != NULL );
-	return Get_First_Cl2Chan( Client, NULL );
+	return (CL2CHAN *)Client_Channels(Client);
 } /* Channel_FirstChannelOf */
 
 
 GLOBAL CL2CHAN *
-Channel_NextChannelOf( CLIENT *Client, CL2CHAN *Cl2Chan )
+Channel_NextChannelOf( CLIENT UNUSED *Client, CL2CHAN *Cl2Chan )
 {
 	assert( Client != NULL );
 	assert( Cl2Chan != NULL );
-	return Get_Next_Cl2Chan( Cl2Chan->next, Client, NULL );
+	assert( Cl2Chan->client == Client );
+	return Cl2Chan->next_channel;
 } /* Channel_NextChannelOf */
 
 
@@ -639,6 +657,17 @@ Channel_GetChannel( CL2CHAN *Cl2Chan )
 } /* Channel_GetChannel */
 
 
+/**
+ * Get the channel user modes of a channel membership.
+ */
+GLOBAL const char *
+Channel_GetModes( CL2CHAN *Cl2Chan )
+{
+	assert( Cl2Chan != NULL );
+	return Cl2Chan->modes;
+} /* Channel_GetModes */
+
+
 GLOBAL bool
 Channel_IsValidName( const char *Name )
 {
@@ -1002,7 +1031,7 @@ Channel_Create( const char *Name )
 
 	assert( Name != NULL );
 
-	c = (CHANNEL *)malloc( sizeof( CHANNEL ));
+	c = (CHANNEL *)Slab_Alloc(&My_ChannelsSlab);
 	if( ! c )
 	{
 		Log( LOG_EMERG, "Can't allocate memory! [New_Chan]" );
@@ -1010,11 +1039,14 @@ Channel_Create( const char *Name )
 	}
 	memset( c, 0, sizeof( CHANNEL ));
 	strlcpy( c->name, Name, sizeof( c->name ));
-	c->hash = Hash( c->name );
+	Hash_TableAdd(&My_ChannelsHash, &c->hash_item, Hash(c->name), c);
 	c->next = My_Channels;
+	if (My_Channels)
+		My_Channels->prev = c;
 #ifndef STRICT_RFC
 	c->creation_time = time(NULL);
 #endif
+	c->serial = ++My_ChannelSerial;
 	My_Channels = c;
 	LogDebug("Created new channel structure for \"%s\".", Name);
 	return c;
@@ -1024,16 +1056,18 @@ Channel_Create( const char *Name )
 static CL2CHAN *
 Get_Cl2Chan( CHANNEL *Chan, CLIENT *Client )
 {
+	HASH_ITEM *item;
 	CL2CHAN *cl2chan;
 
 	assert( Chan != NULL );
 	assert( Client != NULL );
 
-	cl2chan = My_Cl2Chan;
-	while( cl2chan )
-	{
-		if(( cl2chan->channel == Chan ) && ( cl2chan->client == Client )) return cl2chan;
-		cl2chan = cl2chan->next;
+	item = Hash_TableFirst(&My_Cl2ChanHash, Hash_Pointers(Chan, Client));
+	while (item) {
+		cl2chan = (CL2CHAN *)item->data;
+		if (cl2chan->channel == Chan && cl2chan->client == Client)
+			return cl2chan;
+		item = Hash_TableNext(item);
 	}
 	return NULL;
 } /* Get_Cl2Chan */
@@ -1048,19 +1082,31 @@ Add_Client( CHANNEL *Chan, CLIENT *Client )
 	assert( Client != NULL );
 
 	/* Create new CL2CHAN structure */
-	cl2chan = (CL2CHAN *)malloc( sizeof( CL2CHAN ));
+	cl2chan = (CL2CHAN *)Slab_Alloc(&My_Cl2ChanSlab);
 	if( ! cl2chan )
 	{
 		Log( LOG_EMERG, "Can't allocate memory! [Add_Client]" );
 		return NULL;
 	}
+	memset(cl2chan, 0, sizeof(CL2CHAN));
 	cl2chan->channel = Chan;
 	cl2chan->client = Client;
-	strcpy( cl2chan->modes, "" );
 
-	/* concatenate */
-	cl2chan->next = My_Cl2Chan;
-	My_Cl2Chan = cl2chan;
+	/* concatenate: member list of the channel ... */
+	cl2chan->next_member = Chan->members;
+	if (Chan->members)
+		Chan->members->prev_member = cl2chan;
+	Chan->members = cl2chan;
+	Chan->member_count++;
+
+	/* ... and channel list of the client */
+	cl2chan->next_channel = (CL2CHAN *)Client_Channels(Client);
+	if (cl2chan->next_channel)
+		cl2chan->next_channel->prev_channel = cl2chan;
+	Client_SetChannels(Client, cl2chan);
+
+	Hash_TableAdd(&My_Cl2ChanHash, &cl2chan->hash_item,
+		      Hash_Pointers(Chan, Client), cl2chan);
 
 	LogDebug("User \"%s\" joined channel \"%s\".", Client_Mask(Client), Chan->name);
 
@@ -1071,7 +1117,7 @@ Add_Client( CHANNEL *Chan, CLIENT *Client )
 static bool
 Remove_Client( int Type, CHANNEL *Chan, CLIENT *Client, CLIENT *Origin, const char *Reason, bool InformServer )
 {
-	CL2CHAN *cl2chan, *last_cl2chan;
+	CL2CHAN *cl2chan;
 	CHANNEL *c;
 
 	assert( Chan != NULL );
@@ -1084,23 +1130,31 @@ Remove_Client( int Type, CHANNEL *Chan, CLIENT *Client, CLIENT *Origin, const ch
 	if(InformServer)
 		InformServer = !Channel_IsLocal(Chan);
 
-	last_cl2chan = NULL;
-	cl2chan = My_Cl2Chan;
-	while( cl2chan )
-	{
-		if(( cl2chan->channel == Chan ) && ( cl2chan->client == Client )) break;
-		last_cl2chan = cl2chan;
-		cl2chan = cl2chan->next;
-	}
+	cl2chan = Get_Cl2Chan(Chan, Client);
 	if( ! cl2chan ) return false;
 
 	c = cl2chan->channel;
 	assert( c != NULL );
 
-	/* maintain cl2chan list */
-	if( last_cl2chan ) last_cl2chan->next = cl2chan->next;
-	else My_Cl2Chan = cl2chan->next;
-	free( cl2chan );
+	/* maintain member list of the channel ... */
+	if (cl2chan->prev_member)
+		cl2chan->prev_member->next_member = cl2chan->next_member;
+	else
+		c->members = cl2chan->next_member;
+	if (cl2chan->next_member)
+		cl2chan->next_member->prev_member = cl2chan->prev_member;
+	c->member_count--;
+
+	/* ... and channel list of the client */
+	if (cl2chan->prev_channel)
+		cl2chan->prev_channel->next_channel = cl2chan->next_channel;
+	else
+		Client_SetChannels(Client, cl2chan->next_channel);
+	if (cl2chan->next_channel)
+		cl2chan->next_channel->prev_channel = cl2chan->prev_channel;
+
+	Hash_TableRemove(&My_Cl2ChanHash, &cl2chan->hash_item);
+	Slab_Free(&My_Cl2ChanSlab, cl2chan);
 
 	switch( Type )
 	{
@@ -1151,7 +1205,7 @@ Remove_Client( int Type, CHANNEL *Chan, CLIENT *Client, CLIENT *Origin, const ch
 	/* When channel is empty and is not pre-defined, delete */
 	if( ! Channel_HasMode( Chan, 'P' ))
 	{
-		if( ! Get_First_Cl2Chan( NULL, Chan )) Delete_Channel( Chan );
+		if( ! Chan->members ) Delete_Channel( Chan );
 	}
 
 	return true;
@@ -1319,57 +1373,25 @@ Channel_CheckKey(CHANNEL *Chan, CLIENT *Client, const char *Key)
 } /* Channel_CheckKey */
 
 
-static CL2CHAN *
-Get_First_Cl2Chan( CLIENT *Client, CHANNEL *Chan )
-{
-	return Get_Next_Cl2Chan( My_Cl2Chan, Client, Chan );
-} /* Get_First_Cl2Chan */
-
-
-static CL2CHAN *
-Get_Next_Cl2Chan( CL2CHAN *Start, CLIENT *Client, CHANNEL *Channel )
-{
-	CL2CHAN *cl2chan;
-
-	assert( Client != NULL || Channel != NULL );
-
-	cl2chan = Start;
-	while( cl2chan )
-	{
-		if(( Client ) && ( cl2chan->client == Client )) return cl2chan;
-		if(( Channel ) && ( cl2chan->channel == Channel )) return cl2chan;
-		cl2chan = cl2chan->next;
-	}
-	return NULL;
-} /* Get_Next_Cl2Chan */
-
-
 /**
  * Remove a channel and free all of its data structures.
  */
 static void
 Delete_Channel(CHANNEL *Chan)
 {
-	CHANNEL *chan, *last_chan;
-
-	last_chan = NULL;
-	chan = My_Channels;
-	while (chan) {
-		if (chan == Chan)
-			break;
-		last_chan = chan;
-		chan = chan->next;
-	}
+	assert(Chan != NULL);
 
-	assert(chan != NULL);
-	if (!chan)
-		return;
+	Burst_ChannelRemoved(Chan);
 
 	/* maintain channel list */
-	if (last_chan)
-		last_chan->next = chan->next;
+	if (Chan->prev)
+		Chan->prev->next = Chan->next;
 	else
-		My_Channels = chan->next;
+		My_Channels = Chan->next;
+	if (Chan->next)
+		Chan->next->prev = Chan->prev;
+
+	Hash_TableRemove(&My_ChannelsHash, &Chan->hash_item);
 
 	LogDebug("Freed channel structure for \"%s\".", Chan->name);
 	Free_Channel(Chan);
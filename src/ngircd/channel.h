@@ -22,12 +22,15 @@
 #include "lists.h"
 #include "defines.h"
 #include "array.h"
+#include "hash.h"
 
 typedef struct _CHANNEL
 {
 	struct _CHANNEL *next;
+	struct _CHANNEL *prev;		/* previous channel in list or NULL */
 	char name[CHANNEL_NAME_LEN];	/* Name of the channel */
-	UINT32 hash;			/* Hash of the (lowecase!) name */
+	HASH_ITEM hash_item;		/* item in name hash table, keyed by
+					   the hash of the (lowercase!) name */
 	char modes[CHANNEL_MODE_LEN];	/* Channel modes */
 	array topic;			/* Topic of the channel */
 #ifndef STRICT_RFC
@@ -41,11 +44,18 @@ typedef struct _CHANNEL
 	struct list_head list_excepts;	/* list head of (ban) exception list */
 	struct list_head list_invites;	/* list head of invited users */
 	array keyfile;			/* Name of the channel key file */
+	struct _CLIENT2CHAN *members;	/* first member of the channel */
+	unsigned long member_count;	/* number of members */
+	unsigned long serial;		/* creation order of the channel */
 } CHANNEL;
 
 typedef struct _CLIENT2CHAN
 {
-	struct _CLIENT2CHAN *next;
+	struct _CLIENT2CHAN *next_member;	/* next member of channel */
+	struct _CLIENT2CHAN *prev_member;	/* previous member of channel */
+	struct _CLIENT2CHAN *next_channel;	/* next channel of client */
+	struct _CLIENT2CHAN *prev_channel;	/* previous channel of client */
+	HASH_ITEM hash_item;		/* item in membership hash table */
 	CLIENT *client;
 	CHANNEL *channel;
 	char modes[CHANNEL_MODE_LEN];	/* User-Modes in Channel */
@@ -79,6 +89,7 @@ GLOBAL unsigned long Channel_MemberCount PARAMS(( CHANNEL *Chan ));
 GLOBAL int Channel_CountForUser PARAMS(( CLIENT *Client ));
 
 GLOBAL const char *Channel_Name PARAMS(( const CHANNEL *Chan ));
+GLOBAL unsigned long Channel_Serial PARAMS(( const CHANNEL *Chan ));
 GLOBAL char *Channel_Topic PARAMS(( CHANNEL *Chan ));
 GLOBAL char *Channel_Key PARAMS(( CHANNEL *Chan ));
 GLOBAL unsigned long Channel_MaxUsers PARAMS(( CHANNEL *Chan ));
@@ -100,6 +111,7 @@ GLOBAL CL2CHAN *Channel_NextChannelOf PARAMS(( CLIENT *Client, CL2CHAN *Cl2Chan
 
 GLOBAL CLIENT *Channel_GetClient PARAMS(( CL2CHAN *Cl2Chan ));
 GLOBAL CHANNEL *Channel_GetChannel PARAMS(( CL2CHAN *Cl2Chan ));
+GLOBAL const char *Channel_GetModes PARAMS(( CL2CHAN *Cl2Chan ));
 
 GLOBAL bool Channel_IsValidName PARAMS(( const char *Name ));
 
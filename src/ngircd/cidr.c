@@ -0,0 +1,459 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#include "portab.h"
+
+/**
+ * @file
+ * Radix tree of IP address ranges
+ *
+ * Address ranges in CIDR notation ("192.0.2.0/24", "2001:db8::/32") are
+ * stored in a path-compressed binary radix tree ("PATRICIA tree"): each
+ * node covers the address prefix common to all nodes below it, and the
+ * next bit of an address selects the subtree to descend to. So looking up
+ * an address takes at most one step per bit of the address, independent
+ * of the number of ranges in the tree.
+ *
+ * IPv4 addresses are stored as "IPv4-mapped" IPv6 addresses (::ffff:0:0/96),
+ * so that both address families can be handled by a single tree.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+#include "cidr.h"
+
+#define KEY_BITS 128			/** Length of keys in bits */
+#define KEY_BITS_IPV4 32		/** Length of IPv4 addresses in bits */
+#define KEY_OFFSET_IPV4 (KEY_BITS - KEY_BITS_IPV4)
+
+/** Get bit "n" of a key. */
+#define KEY_BIT(key, n) (((key)[(n) >> 3] >> (7 - ((n) & 7))) & 1)
+
+static bool Is_Dotted_Quad PARAMS((const char *String));
+static bool Make_Key PARAMS((const ng_ipaddr_t *Addr, unsigned int Bits,
+			     UINT8 *Key, unsigned int *KeyBits));
+static unsigned int Common_Bits PARAMS((const UINT8 *A, const UINT8 *B,
+					unsigned int Max));
+static CIDR_NODE *New_Node PARAMS((const UINT8 *Key, unsigned int Bits,
+				   void *Data));
+static void Free_Node PARAMS((CIDR_NODE *Node));
+
+/**
+ * Parse an IP address range in CIDR notation.
+ *
+ * The prefix length is optional and defaults to the length of the whole
+ * address. All bits of the address after the prefix are cleared.
+ *
+ * @param String Input string, like "192.0.2.0/24" or "2001:db8::1".
+ * @param Addr Receives the address.
+ * @param Bits Receives the length of the prefix in bits.
+ * @return true if the string is a valid address range.
+ */
+GLOBAL bool
+Cidr_Parse(const char *String, ng_ipaddr_t *Addr, unsigned int *Bits)
+{
+	char buf[NG_INET_ADDRSTRLEN + 4], *slash, *end, *ptr, *colon;
+	unsigned int max, i;
+	unsigned long bits;
+	UINT8 *bytes;
+
+	assert(String != NULL);
+	assert(Addr != NULL);
+	assert(Bits != NULL);
+
+	if (strlcpy(buf, String, sizeof(buf)) >= sizeof(buf))
+		return false;
+
+	slash = strchr(buf, '/');
+	if (slash)
+		*slash++ = '\0';
+
+	/* ng_ipaddr_init() accepts other numeric forms as well, like
+	 * "127.1", "0x7f.0.0.1" or octal "010.0.0.1" (inet_aton(3)), which
+	 * could be meant as host names (patterns) or are easily misread:
+	 * accept strict dotted quads and IPv6 addresses only. */
+	colon = strrchr(buf, ':');
+	if (colon) {
+		/* IPv6 address, optionally ending with a dotted quad */
+		ptr = buf + strspn(buf, "0123456789abcdefABCDEF:");
+		if (*ptr && (ptr <= colon || !Is_Dotted_Quad(colon + 1)))
+			return false;
+	} else if (!Is_Dotted_Quad(buf))
+		return false;
+
+	if (!ng_ipaddr_init(Addr, buf, 0))
+		return false;
+
+	switch (ng_ipaddr_af(Addr)) {
+#ifdef WANT_IPV6
+	case AF_INET6:
+		max = KEY_BITS;
+		bytes = Addr->sin6.sin6_addr.s6_addr;
+		break;
+#endif
+	case AF_INET:
+		max = KEY_BITS_IPV4;
+		bytes = (UINT8 *)&Addr->sin4.sin_addr.s_addr;
+		break;
+	default:
+		return false;
+	}
+
+	if (slash) {
+		if (*slash < '0' || *slash > '9')
+			return false;
+		bits = strtoul(slash, &end, 10);
+		if (*end || bits > max)
+			return false;
+	} else
+		bits = max;
+
+	/* Clear all bits after the prefix */
+	for (i = (unsigned int)bits; i < max; i++)
+		bytes[i >> 3] &= (UINT8)~(0x80 >> (i & 7));
+
+	*Bits = (unsigned int)bits;
+	return true;
+} /* Cidr_Parse */
+
+/**
+ * Add an address range to a tree.
+ *
+ * When the range is already stored in the tree, its data is replaced.
+ *
+ * @param Tree The tree.
+ * @param Addr Address prefix.
+ * @param Bits Length of the prefix in bits.
+ * @param Data Data to store for this range, must not be NULL.
+ * @return true on success, false if out of memory or invalid range.
+ */
+GLOBAL bool
+Cidr_Add(CIDR_TREE *Tree, const ng_ipaddr_t *Addr, unsigned int Bits,
+	 void *Data)
+{
+	CIDR_NODE **link, *node, *new, *glue;
+	UINT8 key[16];
+	unsigned int bits, common;
+
+	assert(Tree != NULL);
+	assert(Addr != NULL);
+	assert(Data != NULL);
+
+	if (!Make_Key(Addr, Bits, key, &bits))
+		return false;
+
+	link = &Tree->root;
+	while ((node = *link)) {
+		common = Common_Bits(node->addr, key,
+				     node->bits < bits ? node->bits : bits);
+		if (common < node->bits) {
+			/* The new range doesn't cover all of this subtree:
+			 * insert it above, or split the prefix of the node */
+			new = New_Node(key, bits, Data);
+			if (!new)
+				return false;
+			if (common == bits) {
+				new->child[KEY_BIT(node->addr, bits)] = node;
+				*link = new;
+			} else {
+				glue = New_Node(key, common, NULL);
+				if (!glue) {
+					free(new);
+					return false;
+				}
+				glue->child[KEY_BIT(node->addr, common)] = node;
+				glue->child[KEY_BIT(key, common)] = new;
+				*link = glue;
+			}
+			Tree->count++;
+			return true;
+		}
+		if (node->bits == bits) {
+			/* Range (or "glue" node) already exists */
+			if (!node->data)
+				Tree->count++;
+			node->data = Data;
+			return true;
+		}
+		link = &node->child[KEY_BIT(key, node->bits)];
+	}
+
+	*link = New_Node(key, bits, Data);
+	if (!*link)
+		return false;
+	Tree->count++;
+	return true;
+} /* Cidr_Add */
+
+/**
+ * Delete an address range from a tree.
+ *
+ * @param Tree The tree.
+ * @param Addr Address prefix.
+ * @param Bits Length of the prefix in bits.
+ * @return true if the range has been deleted, false if it wasn't found.
+ */
+GLOBAL bool
+Cidr_Del(CIDR_TREE *Tree, const ng_ipaddr_t *Addr, unsigned int Bits)
+{
+	CIDR_NODE **link, **parent_link = NULL, *node, *parent;
+	UINT8 key[16];
+	unsigned int bits;
+
+	assert(Tree != NULL);
+	assert(Addr != NULL);
+
+	if (!Make_Key(Addr, Bits, key, &bits))
+		return false;
+
+	link = &Tree->root;
+	while ((node = *link)) {
+		if (node->bits > bits
+		    || Common_Bits(node->addr, key, node->bits) < node->bits)
+			return false;
+		if (node->bits == bits)
+			break;
+		parent_link = link;
+		link = &node->child[KEY_BIT(key, node->bits)];
+	}
+	if (!node || !node->data)
+		return false;
+
+	node->data = NULL;
+	Tree->count--;
+
+	/* Nodes with two subtrees are still required as "glue", all others
+	 * can be removed; and so can a "glue" parent of a removed leaf. */
+	if (node->child[0] && node->child[1])
+		return true;
+	*link = node->child[0] ? node->child[0] : node->child[1];
+	free(node);
+
+	if (*link || !parent_link)
+		return true;
+	parent = *parent_link;
+	if (!parent->data) {
+		*parent_link = parent->child[0] ? parent->child[0]
+						: parent->child[1];
+		free(parent);
+	}
+	return true;
+} /* Cidr_Del */
+
+/**
+ * Look up an address in a tree.
+ *
+ * @param Tree The tree.
+ * @param Addr The address to look up.
+ * @return Data of the most specific range containing the address or NULL.
+ */
+GLOBAL void *
+Cidr_Lookup(const CIDR_TREE *Tree, const ng_ipaddr_t *Addr)
+{
+	CIDR_NODE *node;
+	UINT8 key[16];
+	unsigned int bits;
+	void *data = NULL;
+
+	assert(Tree != NULL);
+	assert(Addr != NULL);
+
+	if (!Tree->root)
+		return NULL;
+
+	switch (ng_ipaddr_af(Addr)) {
+#ifdef WANT_IPV6
+	case AF_INET6:
+		bits = KEY_BITS;
+		break;
+#endif
+	case AF_INET:
+		bits = KEY_BITS_IPV4;
+		break;
+	default:
+		return NULL;
+	}
+	if (!Make_Key(Addr, bits, key, &bits))
+		return NULL;
+
+	node = Tree->root;
+	while (node) {
+		if (Common_Bits(node->addr, key, node->bits) < node->bits)
+			break;
+		if (node->data)
+			data = node->data;
+		if (node->bits == KEY_BITS)
+			break;
+		node = node->child[KEY_BIT(key, node->bits)];
+	}
+	return data;
+} /* Cidr_Lookup */
+
+/**
+ * Free all nodes of a tree.
+ *
+ * The data stored in the tree isn't touched and remains owned by the caller.
+ *
+ * @param Tree The tree.
+ */
+GLOBAL void
+Cidr_Free(CIDR_TREE *Tree)
+{
+	assert(Tree != NULL);
+
+	Free_Node(Tree->root);
+	Tree->root = NULL;
+	Tree->count = 0;
+} /* Cidr_Free */
+
+/**
+ * Check if a string is an IPv4 address in dotted-quad notation.
+ *
+ * @param String The string.
+ * @return true if it consists of four decimal numbers from 0 to 255,
+ *	   without leading zeros, separated by dots.
+ */
+static bool
+Is_Dotted_Quad(const char *String)
+{
+	unsigned int parts = 0, digits, value;
+
+	while (true) {
+		digits = value = 0;
+		while (*String >= '0' && *String <= '9') {
+			if (digits > 0 && value == 0)
+				return false;
+			value = value * 10 + (unsigned int)(*String++ - '0');
+			if (value > 255)
+				return false;
+			digits++;
+		}
+		if (digits == 0)
+			return false;
+		if (++parts == 4)
+			return *String == '\0';
+		if (*String++ != '.')
+			return false;
+	}
+} /* Is_Dotted_Quad */
+
+/**
+ * Build the key of an address range.
+ *
+ * @param Addr Address prefix.
+ * @param Bits Length of the prefix in bits, relative to its family.
+ * @param Key Receives the key (IPv6 or IPv4-mapped address), 16 bytes.
+ * @param KeyBits Receives the length of the key prefix in bits.
+ * @return true on success, false if the address or length is invalid.
+ */
+static bool
+Make_Key(const ng_ipaddr_t *Addr, unsigned int Bits, UINT8 *Key,
+	 unsigned int *KeyBits)
+{
+	switch (ng_ipaddr_af(Addr)) {
+#ifdef WANT_IPV6
+	case AF_INET6:
+		if (Bits > KEY_BITS)
+			return false;
+		memcpy(Key, Addr->sin6.sin6_addr.s6_addr, 16);
+		*KeyBits = Bits;
+		return true;
+#endif
+	case AF_INET:
+		if (Bits > KEY_BITS_IPV4)
+			return false;
+		memset(Key, 0, 10);
+		Key[10] = Key[11] = 0xff;
+		memcpy(Key + 12, &Addr->sin4.sin_addr.s_addr, 4);
+		*KeyBits = Bits + KEY_OFFSET_IPV4;
+		return true;
+	}
+	return false;
+} /* Make_Key */
+
+/**
+ * Count the leading bits two keys have in common.
+ *
+ * @param A First key.
+ * @param B Second key.
+ * @param Max Maximum number of bits to compare.
+ * @return Number of leading bits that are the same, at most Max.
+ */
+static unsigned int
+Common_Bits(const UINT8 *A, const UINT8 *B, unsigned int Max)
+{
+	unsigned int i = 0;
+	UINT8 diff;
+
+	while (i < Max) {
+		diff = A[i >> 3] ^ B[i >> 3];
+		if (!diff) {
+			i += 8;
+			continue;
+		}
+		while (!(diff & 0x80)) {
+			diff <<= 1;
+			i++;
+		}
+		break;
+	}
+	return i < Max ? i : Max;
+} /* Common_Bits */
+
+/**
+ * Allocate a new tree node.
+ *
+ * @param Key Key of the range, only the prefix is used.
+ * @param Bits Length of the prefix in bits.
+ * @param Data Data of the node or NULL for a "glue" node.
+ * @return New node or NULL if out of memory.
+ */
+static CIDR_NODE *
+New_Node(const UINT8 *Key, unsigned int Bits, void *Data)
+{
+	CIDR_NODE *node;
+	unsigned int i;
+
+	node = (CIDR_NODE *)calloc(1, sizeof(CIDR_NODE));
+	if (!node) {
+		Log(LOG_EMERG, "Can't allocate memory! [New_Node]");
+		return NULL;
+	}
+	for (i = 0; i < Bits; i += 8) {
+		node->addr[i >> 3] = Key[i >> 3];
+		if (Bits - i < 8)
+			node->addr[i >> 3] &= (UINT8)(0xff << (8 - (Bits - i)));
+	}
+	node->bits = Bits;
+	node->data = Data;
+	return node;
+} /* New_Node */
+
+/**
+ * Free a node and all its subtrees.
+ *
+ * @param Node The node or NULL.
+ */
+static void
+Free_Node(CIDR_NODE *Node)
+{
+	if (!Node)
+		return;
+	Free_Node(Node->child[0]);
+	Free_Node(Node->child[1]);
+	free(Node);
+} /* Free_Node */
+
+/* -eof- */
@@ -0,0 +1,53 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#ifndef __cidr_h__
+#define __cidr_h__
+
+/**
+ * @file
+ * Radix tree of IP address ranges (header)
+ */
+
+#include "portab.h"
+#include "ng_ipaddr.h"
+
+/** Node of a CIDR tree, see cidr.c. */
+typedef struct _CIDR_NODE
+{
+	struct _CIDR_NODE *child[2];	/**< Subtrees, next bit 0 and 1 */
+	UINT8 addr[16];			/**< Address prefix (IPv6 or IPv4-
+					     mapped), all other bits 0 */
+	unsigned int bits;		/**< Length of the prefix */
+	void *data;			/**< Data of this range or NULL */
+} CIDR_NODE;
+
+/** Tree of IPv4 and IPv6 address ranges. */
+typedef struct _CIDR_TREE
+{
+	CIDR_NODE *root;		/**< Root node or NULL */
+	size_t count;			/**< Number of ranges */
+} CIDR_TREE;
+
+GLOBAL bool Cidr_Parse PARAMS((const char *String, ng_ipaddr_t *Addr,
+			       unsigned int *Bits));
+
+GLOBAL bool Cidr_Add PARAMS((CIDR_TREE *Tree, const ng_ipaddr_t *Addr,
+			     unsigned int Bits, void *Data));
+GLOBAL bool Cidr_Del PARAMS((CIDR_TREE *Tree, const ng_ipaddr_t *Addr,
+			     unsigned int Bits));
+GLOBAL void *Cidr_Lookup PARAMS((const CIDR_TREE *Tree,
+				 const ng_ipaddr_t *Addr));
+GLOBAL void Cidr_Free PARAMS((CIDR_TREE *Tree));
+
+#endif
+
+/* -eof- */
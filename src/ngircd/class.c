@@ -18,19 +18,41 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include "conn.h"
+#include "cidr.h"
+#include "conn-func.h"
 #include "lists.h"
+#include "log.h"
+#include "timer.h"
 
 #include "class.h"
 
 struct list_head My_Classes[CLASS_COUNT];
 
+/** IP address ranges of all masks like "*!*@192.0.2.0/24" of each class. */
+static CIDR_TREE My_Addresses[CLASS_COUNT];
+
+/** Timer for expiring list entries, see Class_Expire(). */
+static TIMER *Expire_Timer;
+
+static void cb_Expire_Timer PARAMS((int Unused));
+static bool Mask_Addr PARAMS((char *Mask, size_t Len, ng_ipaddr_t *Addr,
+			      unsigned int *Bits));
+static void Rebuild_Addresses PARAMS((const int Class));
+
 GLOBAL void
 Class_Init(void)
 {
 	memset(My_Classes, 0, sizeof(My_Classes));
+	memset(My_Addresses, 0, sizeof(My_Addresses));
+
+	Expire_Timer = Timer_New(cb_Expire_Timer, 0);
+	if (!Expire_Timer) {
+		Log(LOG_EMERG, "Failed to initialize class expiration timer!");
+		exit(1);
+	}
 }
 
 GLOBAL void
@@ -38,20 +60,51 @@ Class_Exit(void)
 {
 	int i;
 
-	for (i = 0; i < CLASS_COUNT; Lists_Free(&My_Classes[i++]));
+	for (i = 0; i < CLASS_COUNT; i++) {
+		Cidr_Free(&My_Addresses[i]);
+		Lists_Free(&My_Classes[i]);
+	}
+
+	Timer_Free(Expire_Timer);
+	Expire_Timer = NULL;
 }
 
+/**
+ * Check if a client is member of a class.
+ *
+ * The IP address of the client is looked up in the address ranges of the
+ * class first, all other masks are matched against the client mask.
+ *
+ * @param Class The class.
+ * @param Client The client to check.
+ * @param reason Buffer receiving the reason of the matching entry.
+ * @param len Size of the buffer.
+ * @return true if the client is member of the class.
+ */
 GLOBAL bool
 Class_GetMemberReason(const int Class, CLIENT *Client, char *reason, size_t len)
 {
 	char str[COMMAND_LEN];
+	struct list_elem *e = NULL;
+	ng_ipaddr_t addr;
 
 	assert(Class < CLASS_COUNT);
 	assert(Client != NULL);
 
 	strlcpy(str, "listed", sizeof(str));
 
-	if (!Lists_CheckReason(&My_Classes[Class], Client, str, sizeof(str)))
+	if (My_Addresses[Class].root) {
+		if (Client_Conn(Client) > NONE)
+			e = Cidr_Lookup(&My_Addresses[Class],
+					Conn_GetAddr(Client_Conn(Client)));
+		else if (ng_ipaddr_init(&addr, Client_Hostname(Client), 0))
+			e = Cidr_Lookup(&My_Addresses[Class], &addr);
+	}
+	if (e) {
+		if (Lists_GetReason(e)[0])
+			strlcpy(str, Lists_GetReason(e), sizeof(str));
+	} else if (!Lists_CheckReason(&My_Classes[Class], Client, str,
+				      sizeof(str)))
 		return false;
 
 	switch(Class) {
@@ -98,25 +151,47 @@ Class_AddMask(const int Class, const char *Pattern, time_t ValidUntil,
 	      const char *Reason)
 {
 	char mask[MASK_LEN];
+	ng_ipaddr_t addr;
+	unsigned int bits;
+	bool is_addr, is_new;
 
 	assert(Class < CLASS_COUNT);
 	assert(Pattern != NULL);
 	assert(Reason != NULL);
 
 	Lists_MakeMask(Pattern, mask, sizeof(mask));
-	return Lists_Add(&My_Classes[Class], mask,
-			 ValidUntil, Reason, false);
+	is_addr = Mask_Addr(mask, sizeof(mask), &addr, &bits);
+	is_new = !Lists_CheckDupeMask(&My_Classes[Class], mask);
+	if (!Lists_Add(&My_Classes[Class], mask, ValidUntil, Reason, false))
+		return false;
+	if (is_addr && !Cidr_Add(&My_Addresses[Class], &addr, bits,
+				 Lists_CheckDupeMask(&My_Classes[Class], mask))) {
+		/* Address ranges only match using the tree, so don't list
+		 * an entry which wouldn't be enforced! */
+		if (is_new)
+			Lists_Del(&My_Classes[Class], mask);
+		return false;
+	}
+
+	/* Entries expire when their validity time has passed */
+	if (ValidUntil > 0)
+		Timer_SetEarlier(Expire_Timer, ValidUntil + 1);
+	return true;
 }
 
 GLOBAL void
 Class_DeleteMask(const int Class, const char *Pattern)
 {
 	char mask[MASK_LEN];
+	ng_ipaddr_t addr;
+	unsigned int bits;
 
 	assert(Class < CLASS_COUNT);
 	assert(Pattern != NULL);
 
 	Lists_MakeMask(Pattern, mask, sizeof(mask));
+	if (Mask_Addr(mask, sizeof(mask), &addr, &bits))
+		Cidr_Del(&My_Addresses[Class], &addr, bits);
 	Lists_Del(&My_Classes[Class], mask);
 }
 
@@ -128,11 +203,109 @@ Class_GetList(const int Class)
 	return &My_Classes[Class];
 }
 
+/**
+ * Delete all expired entries of all classes.
+ *
+ * The expiration timer is set to the time the next entry expires afterwards.
+ */
 GLOBAL void
 Class_Expire(void)
 {
+	struct list_elem *e;
+	time_t valid, next = 0;
+	unsigned long count;
+	int i;
+
+	count = Lists_Count(&My_Classes[CLASS_GLINE]);
 	Lists_Expire(&My_Classes[CLASS_GLINE], "G-Line");
+	if (Lists_Count(&My_Classes[CLASS_GLINE]) != count)
+		Rebuild_Addresses(CLASS_GLINE);
+
+	count = Lists_Count(&My_Classes[CLASS_KLINE]);
 	Lists_Expire(&My_Classes[CLASS_KLINE], "K-Line");
+	if (Lists_Count(&My_Classes[CLASS_KLINE]) != count)
+		Rebuild_Addresses(CLASS_KLINE);
+
+	for (i = 0; i < CLASS_COUNT; i++) {
+		for (e = Lists_GetFirst(&My_Classes[i]); e;
+		     e = Lists_GetNext(e)) {
+			valid = Lists_GetValidity(e);
+			if (valid > 0 && (!next || valid < next))
+				next = valid;
+		}
+	}
+	if (next)
+		Timer_Set(Expire_Timer, next + 1);
+}
+
+/**
+ * Callback of the expiration timer.
+ *
+ * @param Unused Unused.
+ */
+static void
+cb_Expire_Timer(UNUSED int Unused)
+{
+	Class_Expire();
+}
+
+/**
+ * Check if a mask is an IP address range and make it canonical.
+ *
+ * Masks like "*!*@192.0.2.0/24" and "*!*@2001:db8::/32" match all clients
+ * connecting from an address in the given range. Such masks are rewritten
+ * to a canonical form (host bits cleared, no prefix length if the mask
+ * consists of a single address), so that different spellings of the same
+ * range result in the same list entry.
+ *
+ * @param Mask The mask, may be rewritten.
+ * @param Len Size of the mask buffer.
+ * @param Addr Receives the address.
+ * @param Bits Receives the length of the prefix in bits.
+ * @return true if the mask is an IP address range.
+ */
+static bool
+Mask_Addr(char *Mask, size_t Len, ng_ipaddr_t *Addr, unsigned int *Bits)
+{
+	char str[NG_INET_ADDRSTRLEN];
+
+	if (strncmp(Mask, "*!*@", 4) != 0)
+		return false;
+	if (!Cidr_Parse(Mask + 4, Addr, Bits))
+		return false;
+	if (!ng_ipaddr_tostr_r(Addr, str))
+		return false;
+
+	if (*Bits == (ng_ipaddr_af(Addr) == AF_INET ? 32 : 128))
+		snprintf(Mask, Len, "*!*@%s", str);
+	else
+		snprintf(Mask, Len, "*!*@%s/%u", str, *Bits);
+	return true;
+}
+
+/**
+ * Rebuild the tree of IP address ranges of a class from its list.
+ *
+ * @param Class The class.
+ */
+static void
+Rebuild_Addresses(const int Class)
+{
+	struct list_elem *e;
+	char mask[MASK_LEN];
+	ng_ipaddr_t addr;
+	unsigned int bits;
+
+	Cidr_Free(&My_Addresses[Class]);
+	for (e = Lists_GetFirst(&My_Classes[Class]); e; e = Lists_GetNext(e)) {
+		strlcpy(mask, Lists_GetMask(e), sizeof(mask));
+		if (Mask_Addr(mask, sizeof(mask), &addr, &bits)
+		    && !Cidr_Add(&My_Addresses[Class], &addr, bits, e))
+			Log(LOG_ALERT,
+			    "Can't add address range \"%s\" of %s list, entry is NOT enforced!",
+			    Lists_GetMask(e),
+			    Class == CLASS_GLINE ? "G-Line" : "K-Line");
+	}
 }
 
 /* -eof- */
@@ -29,6 +29,7 @@
 
 #include "conn.h"
 #include "ngircd.h"
+#include "burst.h"
 #include "channel.h"
 #include "conf.h"
 #include "conn-func.h"
@@ -37,10 +38,14 @@
 #include "log.h"
 #include "match.h"
 #include "messages.h"
+#include "slab.h"
 
 #define GETID_LEN (CLIENT_NICK_LEN-1) + 1 + (CLIENT_USER_LEN-1) + 1 + (CLIENT_HOST_LEN-1) + 1
 
 static CLIENT *This_Server, *My_Clients;
+static HASH_TABLE My_ClientsHash;
+static SLAB_CACHE My_ClientsSlab;
+static unsigned long My_ClientSerial;
 
 static WHOWAS My_Whowas[MAX_WHOWAS];
 static int Last_Whowas = -1;
@@ -50,6 +55,7 @@ static long Max_Users, My_Max_Users;
 static unsigned long Count PARAMS(( CLIENT_TYPE Type ));
 static unsigned long MyCount PARAMS(( CLIENT_TYPE Type ));
 
+static CLIENT *Search_ID PARAMS((const char *ID));
 static CLIENT *New_Client_Struct PARAMS(( void ));
 static void Generate_MyToken PARAMS(( CLIENT *Client ));
 static void Adjust_Counters PARAMS(( CLIENT *Client ));
@@ -73,6 +79,13 @@ Client_Init( void )
 {
 	struct hostent *h;
 
+	if (!Hash_TableInit(&My_ClientsHash, CLIENT_HASH_SIZE)) {
+		Log(LOG_EMERG, "Can't allocate client hash table! Going down.");
+		Log(LOG_ALERT, "%s exiting due to fatal errors!", PACKAGE_NAME);
+		exit(1);
+	}
+	Slab_Init(&My_ClientsSlab, "CLIENT", sizeof(CLIENT));
+
 	This_Server = New_Client_Struct( );
 	if( ! This_Server )
 	{
@@ -123,6 +136,9 @@ Client_Exit( void )
 	if (cnt)
 		Log(LOG_INFO, "Freed %d client structure%s.",
 		    cnt, cnt == 1 ? "" : "s");
+
+	Hash_TableFree(&My_ClientsHash);
+	Slab_Exit(&My_ClientsSlab);
 } /* Client_Exit */
 
 
@@ -211,6 +227,8 @@ Init_New_Client(CONN_ID Idx, CLIENT *Introducer, CLIENT *TopServer,
 		Client_SetModes(client, Modes);
 	if (Type == CLIENT_SERVER)
 		Generate_MyToken(client);
+	if (Type == CLIENT_USER || Type == CLIENT_SERVICE)
+		client->serial = ++My_ClientSerial;
 
 	if (Client_HasMode(client, 'a'))
 		client->away = strdup(DEFAULT_AWAY_MSG);
@@ -270,6 +288,7 @@ Client_Destroy( CLIENT *Client, const char *LogMsg, const char *FwdMsg, bool Sen
 		if( c == Client )
 		{
 			/* found  the client: remove it */
+			Burst_ClientRemoved(c);
 			if( last ) last->next = c->next;
 			else My_Clients = (CLIENT *)c->next;
 
@@ -386,6 +405,8 @@ Client_SetID( CLIENT *Client, const char *ID )
 	assert( Client != NULL );
 	assert( ID != NULL );
 
+	Hash_TableRemove(&My_ClientsHash, &Client->hash_item);
+
 	strlcpy( Client->id, ID, sizeof( Client->id ));
 
 	if (Conf_CloakUserToNick) {
@@ -393,8 +414,9 @@ Client_SetID( CLIENT *Client, const char *ID )
 		strlcpy( Client->info, ID, sizeof( Client->info ));
 	}
 
-	/* Hash */
-	Client->hash = Hash( Client->id );
+	/* (Re-)index the client using the hash of its new ID */
+	Hash_TableAdd(&My_ClientsHash, &Client->hash_item, Hash(Client->id),
+		      Client);
 } /* Client_SetID */
 
 
@@ -488,6 +510,23 @@ Client_SetAccountName(CLIENT *Client, const char *AccountName)
 }
 
 
+/**
+ * Set the first channel membership of a client.
+ *
+ * The channel memberships of a client are a list maintained by the channel
+ * module, this is only the anchor of it.
+ *
+ * @param Client The client.
+ * @param Cl2Chan First channel membership (CL2CHAN) or NULL.
+ */
+GLOBAL void
+Client_SetChannels(CLIENT *Client, POINTER *Cl2Chan)
+{
+	assert(Client != NULL);
+	Client->channels = Cl2Chan;
+}
+
+
 GLOBAL void
 Client_SetAway( CLIENT *Client, const char *Txt )
 {
@@ -510,6 +549,9 @@ GLOBAL void
 Client_SetType( CLIENT *Client, int Type )
 {
 	assert( Client != NULL );
+	if ((Type == CLIENT_USER || Type == CLIENT_SERVICE)
+	    && Client->type != CLIENT_USER && Client->type != CLIENT_SERVICE)
+		Client->serial = ++My_ClientSerial;
 	Client->type = Type;
 	if( Type == CLIENT_SERVER ) Generate_MyToken( Client );
 	Adjust_Counters( Client );
@@ -598,8 +640,6 @@ GLOBAL CLIENT *
 Client_Search( const char *Nick )
 {
 	char search_id[CLIENT_ID_LEN], *ptr;
-	CLIENT *c = NULL;
-	UINT32 search_hash;
 
 	assert( Nick != NULL );
 
@@ -608,15 +648,7 @@ Client_Search( const char *Nick )
 	ptr = strchr( search_id, '!' );
 	if( ptr ) *ptr = '\0';
 
-	search_hash = Hash(search_id);
-
-	c = My_Clients;
-	while (c) {
-		if (c->hash == search_hash && strcasecmp(c->id, search_id) == 0)
-			return c;
-		c = (CLIENT *)c->next;
-	}
-	return NULL;
+	return Search_ID(search_id);
 }
 
 
@@ -1074,18 +1106,15 @@ Client_CheckID( CLIENT *Client, char *ID )
 	}
 
 	/* ID already in use? */
-	c = My_Clients;
-	while (c) {
-		if (strcasecmp(c->id, ID) == 0) {
-			snprintf(str, sizeof(str), "ID \"%s\" already registered", ID);
-			if (c->conn_id != NONE)
-				Log(LOG_ERR, "%s (on connection %d)!", str, c->conn_id);
-			else
-				Log(LOG_ERR, "%s (via network)!", str);
-			Conn_Close(Client->conn_id, str, str, true);
-			return false;
-		}
-		c = (CLIENT *)c->next;
+	c = Search_ID(ID);
+	if (c) {
+		snprintf(str, sizeof(str), "ID \"%s\" already registered", ID);
+		if (c->conn_id != NONE)
+			Log(LOG_ERR, "%s (on connection %d)!", str, c->conn_id);
+		else
+			Log(LOG_ERR, "%s (via network)!", str);
+		Conn_Close(Client->conn_id, str, str, true);
+		return false;
 	}
 
 	return true;
@@ -1270,6 +1299,43 @@ Client_StartTime(CLIENT *Client)
 } /* Client_Uptime */
 
 
+/**
+ * Get the registration serial number of a client: users and services
+ * registered later on have higher numbers, unregistered clients and servers
+ * have number 0.
+ */
+GLOBAL unsigned long
+Client_Serial(CLIENT *Client)
+{
+	assert(Client != NULL);
+	return Client->serial;
+} /* Client_Serial */
+
+
+/**
+ * Get the registration serial number of the client registered last.
+ */
+GLOBAL unsigned long
+Client_LastSerial(void)
+{
+	return My_ClientSerial;
+} /* Client_LastSerial */
+
+
+/**
+ * Get the first channel membership of a client.
+ *
+ * @param Client The client.
+ * @return First channel membership (CL2CHAN) or NULL.
+ */
+GLOBAL POINTER *
+Client_Channels(CLIENT *Client)
+{
+	assert(Client != NULL);
+	return Client->channels;
+}
+
+
 /**
  * Reject a client when logging in.
  *
@@ -1377,6 +1443,31 @@ MyCount( CLIENT_TYPE Type )
 } /* MyCount */
 
 
+/**
+ * Look up a client by its ID (nickname or server name) using the hash table.
+ *
+ * @param ID The ID to search for, compared case-insensitive.
+ * @return Pointer to CLIENT structure or NULL if not found.
+ */
+static CLIENT *
+Search_ID(const char *ID)
+{
+	HASH_ITEM *item;
+	CLIENT *c;
+
+	assert(ID != NULL);
+
+	item = Hash_TableFirst(&My_ClientsHash, Hash(ID));
+	while (item) {
+		c = (CLIENT *)item->data;
+		if (strcasecmp(c->id, ID) == 0)
+			return c;
+		item = Hash_TableNext(item);
+	}
+	return NULL;
+} /* Search_ID */
+
+
 /**
  * Allocate and initialize new CLIENT structure.
  *
@@ -1387,7 +1478,7 @@ New_Client_Struct( void )
 {
 	CLIENT *c;
 
-	c = (CLIENT *)malloc( sizeof( CLIENT ));
+	c = (CLIENT *)Slab_Alloc(&My_ClientsSlab);
 	if( ! c )
 	{
 		Log( LOG_EMERG, "Can't allocate memory! [New_Client_Struct]" );
@@ -1414,6 +1505,8 @@ Free_Client(CLIENT **Client)
 	assert(Client != NULL);
 	assert(*Client != NULL);
 
+	Hash_TableRemove(&My_ClientsHash, &(*Client)->hash_item);
+
 	if ((*Client)->account_name)
 		free((*Client)->account_name);
 	if ((*Client)->away)
@@ -1423,7 +1516,7 @@ Free_Client(CLIENT **Client)
 	if ((*Client)->ipa_text)
 		free((*Client)->ipa_text);
 
-	free(*Client);
+	Slab_Free(&My_ClientsSlab, *Client);
 	*Client = NULL;
 }
 
@@ -38,11 +38,14 @@
 
 #if defined(__client_c__) | defined(__client_cap_c__)
 
+#include "hash.h"
+
 typedef struct _CLIENT
 {
 	time_t starttime;		/* Start time of link */
 	char id[CLIENT_ID_LEN];		/* nick (user) / ID (server) */
-	UINT32 hash;			/* hash of lower-case ID */
+	HASH_ITEM hash_item;		/* item in ID hash table, keyed by the
+					   hash of the lower-case ID */
 	POINTER *next;			/* pointer to next client structure */
 	CLIENT_TYPE type;		/* type of client, see CLIENT_xxx */
 	CONN_ID conn_id;		/* ID of the connection (if local) or NONE (remote) */
@@ -63,6 +66,8 @@ typedef struct _CLIENT
 	char flags[CLIENT_FLAGS_LEN];	/* flags of the client */
 	char *account_name;		/* login account (for services) */
 	int capabilities;		/* enabled IRC capabilities */
+	POINTER *channels;		/* first channel membership (CL2CHAN) */
+	unsigned long serial;		/* registration order of the client */
 } CLIENT;
 
 #else
@@ -128,6 +133,9 @@ GLOBAL CLIENT *Client_NextHop PARAMS(( CLIENT *Client ));
 GLOBAL char *Client_Away PARAMS(( CLIENT *Client ));
 GLOBAL char *Client_AccountName PARAMS((CLIENT *Client));
 GLOBAL time_t Client_StartTime PARAMS(( CLIENT *Client ));
+GLOBAL unsigned long Client_Serial PARAMS(( CLIENT *Client ));
+GLOBAL unsigned long Client_LastSerial PARAMS(( void ));
+GLOBAL POINTER *Client_Channels PARAMS((CLIENT *Client));
 
 GLOBAL bool Client_HasMode PARAMS(( CLIENT *Client, char Mode ));
 GLOBAL bool Client_HasFlag PARAMS(( CLIENT *Client, char Flag ));
@@ -146,6 +154,7 @@ GLOBAL void Client_SetFlags PARAMS(( CLIENT *Client, const char *Flags ));
 GLOBAL void Client_SetIntroducer PARAMS(( CLIENT *Client, CLIENT *Introducer ));
 GLOBAL void Client_SetAway PARAMS(( CLIENT *Client, const char *Txt ));
 GLOBAL void Client_SetAccountName PARAMS((CLIENT *Client, const char *AccountName));
+GLOBAL void Client_SetChannels PARAMS((CLIENT *Client, POINTER *Cl2Chan));
 
 GLOBAL bool Client_ModeAdd PARAMS(( CLIENT *Client, char Mode ));
 GLOBAL bool Client_ModeDel PARAMS(( CLIENT *Client, char Mode ));
@@ -394,9 +394,15 @@ Conf_Test( void )
 
 	puts("[LIMITS]");
 	printf("  ConnectRetry = %d\n", Conf_ConnectRetry);
+	printf("  FloodBurst = %d\n", Conf_FloodBurst);
+	printf("  FloodRateOper = %d\n", Conf_FloodRateOper);
+	printf("  FloodRateServer = %d\n", Conf_FloodRateServer);
+	printf("  FloodRateService = %d\n", Conf_FloodRateService);
+	printf("  FloodRateUser = %d\n", Conf_FloodRateUser);
 	printf("  IdleTimeout = %d\n", Conf_IdleTimeout);
 	printf("  MaxConnections = %d\n", Conf_MaxConnections);
 	printf("  MaxConnectionsIP = %d\n", Conf_MaxConnectionsIP);
+	printf("  MaxConnectionsIPv6Net = %d\n", Conf_MaxConnectionsIPv6Net);
 	printf("  MaxJoins = %d\n", Conf_MaxJoins > 0 ? Conf_MaxJoins : -1);
 	printf("  MaxNickLength = %u\n", Conf_MaxNickLength - 1);
 	printf("  MaxPenaltyTime = %ld\n", (long)Conf_MaxPenaltyTime);
@@ -420,6 +426,7 @@ Conf_Test( void )
 	printf("  DefaultChannelModes = %s\n", Conf_DefaultChannelModes);
 	printf("  DefaultUserModes = %s\n", Conf_DefaultUserModes);
 	printf("  DNS = %s\n", yesno_to_str(Conf_DNS));
+	printf("  HostsFile = %s\n", Conf_HostsFile);
 #ifdef IDENTAUTH
 	printf("  Ident = %s\n", yesno_to_str(Conf_Ident));
 #endif
@@ -437,6 +444,7 @@ Conf_Test( void )
 #ifndef STRICT_RFC
 	printf("  RequireAuthPing = %s\n", yesno_to_str(Conf_AuthPing));
 #endif
+	printf("  ResolvConfFile = %s\n", Conf_ResolvConfFile);
 	printf("  ScrubCTCP = %s\n", yesno_to_str(Conf_ScrubCTCP));
 #ifdef SYSLOG
 	printf("  SyslogFacility = %s\n",
@@ -527,6 +535,7 @@ Conf_UnsetServer( CONN_ID Idx )
 {
 	int i;
 	time_t t;
+	bool found = false;
 
 	/* Check all our configured servers */
 	for( i = 0; i < MAX_SERVERS; i++ ) {
@@ -534,6 +543,7 @@ Conf_UnsetServer( CONN_ID Idx )
 
 		/* Gotcha! Mark server configuration as "unused": */
 		Conf_Server[i].conn_id = NONE;
+		found = true;
 
 		if( Conf_Server[i].flags & CONF_SFLAG_ONCE ) {
 			/* Delete configuration here */
@@ -558,6 +568,10 @@ Conf_UnsetServer( CONN_ID Idx )
 			}
 		}
 	}
+
+	/* Check when the next connection attempt is due */
+	if (found)
+		Conn_ScheduleServerCheck();
 }
 
 /**
@@ -615,6 +629,7 @@ Conf_EnableServer( const char *Name, UINT16 Port )
 			/* Gotcha! Set port and enable server: */
 			Conf_Server[i].port = Port;
 			Conf_Server[i].flags &= ~CONF_SFLAG_DISABLED;
+			Conn_ScheduleServerCheck();
 			return (Conf_Server[i].port && Conf_Server[i].host[0]);
 		}
 	}
@@ -642,6 +657,7 @@ Conf_EnablePassiveServer(const char *Name)
 			/* BINGO! Enable server */
 			Conf_Server[i].flags &= ~CONF_SFLAG_DISABLED;
 			Conf_Server[i].lasttry = 0;
+			Conn_ScheduleServerCheck();
 			return true;
 		}
 	}
@@ -710,6 +726,7 @@ Conf_AddServer(const char *Name, UINT16 Port, const char *Host,
 	Conf_Server[i].port = Port;
 	Conf_Server[i].flags = CONF_SFLAG_ONCE;
 
+	Conn_ScheduleServerCheck();
 	return true;
 }
 
@@ -782,9 +799,15 @@ Set_Defaults(bool InitServers)
 
 	/* Limits */
 	Conf_ConnectRetry = 60;
+	Conf_FloodBurst = 5;
+	Conf_FloodRateOper = 5;
+	Conf_FloodRateServer = 0;
+	Conf_FloodRateService = 0;
+	Conf_FloodRateUser = 3;
 	Conf_IdleTimeout = 0;
 	Conf_MaxConnections = 0;
 	Conf_MaxConnectionsIP = 5;
+	Conf_MaxConnectionsIPv6Net = 0;
 	Conf_MaxJoins = 10;
 	Conf_MaxNickLength = CLIENT_NICK_LEN_DEFAULT;
 	Conf_MaxPenaltyTime = -1;
@@ -814,6 +837,7 @@ Set_Defaults(bool InitServers)
 	strcpy(Conf_DefaultChannelModes, "");
 	strcpy(Conf_DefaultUserModes, "");
 	Conf_DNS = true;
+	strlcpy(Conf_HostsFile, HOSTS_FILE, sizeof(Conf_HostsFile));
 #ifdef IDENTAUTH
 	Conf_Ident = true;
 #else
@@ -832,6 +856,8 @@ Set_Defaults(bool InitServers)
 #endif
 	Conf_PAMIsOptional = false;
 	strcpy(Conf_PAMServiceName, "ngircd");
+	strlcpy(Conf_ResolvConfFile, RESOLV_CONF_FILE,
+		sizeof(Conf_ResolvConfFile));
 	Conf_ScrubCTCP = false;
 #ifdef SYSLOG
 #ifdef LOG_LOCAL5
@@ -1285,6 +1311,33 @@ Handle_MaxNickLength(const char *File, int Line, const char *Arg)
 	return new;
 }
 
+/**
+ * Handle setting of one of the "FloodRate..." variables.
+ *
+ * @param Line	Line number in configuration file.
+ * @param Var	Variable name.
+ * @param Arg	Input string.
+ * @returns	New configured number of commands per second (0: unlimited).
+ */
+static int
+Handle_FloodRate(const char *File, int Line, const char *Var, const char *Arg)
+{
+	int rate;
+
+	rate = atoi(Arg);
+	if (rate < 0 || (!rate && strcmp(Arg, "0"))) {
+		Config_Error_NaN(File, Line, Var);
+		return 0;
+	}
+	if (rate > 1000) {
+		Config_Error(LOG_WARNING,
+			     "%s, line %d: Value of \"%s\" exceeds 1000, ignoring limit!",
+			     File, Line, Var);
+		return 0;
+	}
+	return rate;
+}
+
 /**
  * Output a warning messages if IDENT is configured but not compiled in.
  */
@@ -1509,6 +1562,32 @@ Handle_LIMITS(const char *File, int Line, char *Var, char *Arg)
 		}
 		return;
 	}
+	if (strcasecmp(Var, "FloodBurst") == 0) {
+		Conf_FloodBurst = atoi(Arg);
+		if (Conf_FloodBurst < 1) {
+			Config_Error(LOG_WARNING,
+				     "%s, line %d: Value of \"FloodBurst\" too low!",
+				     File, Line);
+			Conf_FloodBurst = 1;
+		}
+		return;
+	}
+	if (strcasecmp(Var, "FloodRateOper") == 0) {
+		Conf_FloodRateOper = Handle_FloodRate(File, Line, Var, Arg);
+		return;
+	}
+	if (strcasecmp(Var, "FloodRateServer") == 0) {
+		Conf_FloodRateServer = Handle_FloodRate(File, Line, Var, Arg);
+		return;
+	}
+	if (strcasecmp(Var, "FloodRateService") == 0) {
+		Conf_FloodRateService = Handle_FloodRate(File, Line, Var, Arg);
+		return;
+	}
+	if (strcasecmp(Var, "FloodRateUser") == 0) {
+		Conf_FloodRateUser = Handle_FloodRate(File, Line, Var, Arg);
+		return;
+	}
 	if (strcasecmp(Var, "IdleTimeout") == 0) {
 		Conf_IdleTimeout = atoi(Arg);
 		if (!Conf_IdleTimeout && strcmp(Arg, "0"))
@@ -1527,6 +1606,12 @@ Handle_LIMITS(const char *File, int Line, char *Var, char *Arg)
 			Config_Error_NaN(File, Line, Var);
 		return;
 	}
+	if (strcasecmp(Var, "MaxConnectionsIPv6Net") == 0) {
+		Conf_MaxConnectionsIPv6Net = atoi(Arg);
+		if (!Conf_MaxConnectionsIPv6Net && strcmp(Arg, "0"))
+			Config_Error_NaN(File, Line, Var);
+		return;
+	}
 	if (strcasecmp(Var, "MaxJoins") == 0) {
 		Conf_MaxJoins = atoi(Arg);
 		if (!Conf_MaxJoins && strcmp(Arg, "0"))
@@ -1708,6 +1793,12 @@ Handle_OPTIONS(const char *File, int Line, char *Var, char *Arg)
 		Conf_DNS = Check_ArgIsTrue(Arg);
 		return;
 	}
+	if (strcasecmp(Var, "HostsFile") == 0) {
+		len = strlcpy(Conf_HostsFile, Arg, sizeof(Conf_HostsFile));
+		if (len >= sizeof(Conf_HostsFile))
+			Config_Error_TooLong(File, Line, Var);
+		return;
+	}
 	if (strcasecmp(Var, "Ident") == 0) {
 		Conf_Ident = Check_ArgIsTrue(Arg);
 		WarnIdent(File, Line);
@@ -1766,6 +1857,13 @@ Handle_OPTIONS(const char *File, int Line, char *Var, char *Arg)
 		return;
 	}
 #endif
+	if (strcasecmp(Var, "ResolvConfFile") == 0) {
+		len = strlcpy(Conf_ResolvConfFile, Arg,
+			      sizeof(Conf_ResolvConfFile));
+		if (len >= sizeof(Conf_ResolvConfFile))
+			Config_Error_TooLong(File, Line, Var);
+		return;
+	}
 	if (strcasecmp(Var, "ScrubCTCP") == 0) {
 		Conf_ScrubCTCP = Check_ArgIsTrue(Arg);
 		return;
@@ -2406,6 +2504,8 @@ Init_Server_Struct( CONF_SERVER *Server )
 {
 	assert( Server != NULL );
 
+	/* A pending lookup refers to this structure */
+	Resolve_Cancel(&Server->res_stat);
 	memset( Server, 0, sizeof (CONF_SERVER) );
 
 	Server->group = NONE;
@@ -2413,7 +2513,7 @@ Init_Server_Struct( CONF_SERVER *Server )
 
 	if( NGIRCd_Passive ) Server->flags = CONF_SFLAG_DISABLED;
 
-	Proc_InitStruct(&Server->res_stat);
+	Resolve_InitStruct(&Server->res_stat);
 	Server->conn_id = NONE;
 	memset(&Server->bind_addr, 0, sizeof(Server->bind_addr));
 
@@ -25,6 +25,7 @@
 #include "tool.h"
 #include "ng_ipaddr.h"
 #include "proc.h"
+#include "resolve.h"
 #include "conf-ssl.h"
 
 /**
@@ -53,7 +54,7 @@ typedef struct _Conf_Server
 	UINT16 port;			/**< Server port to connect to */
 	int group;			/**< Group ID of this server */
 	time_t lasttry;			/**< Time of last connection attempt */
-	PROC_STAT res_stat;		/**< Status of the resolver */
+	RES_STAT res_stat;		/**< Status of the resolver */
 	int flags;			/**< Server flags */
 	CONN_ID conn_id;		/**< ID of server connection or NONE */
 	ng_ipaddr_t bind_addr;		/**< Source address to use for outgoing
@@ -193,6 +194,12 @@ GLOBAL bool Conf_CloakUserToNick;
 /** Enable all DNS functions? */
 GLOBAL bool Conf_DNS;
 
+/** File with static host names for the DNS client */
+GLOBAL char Conf_HostsFile[FNAME_LEN];
+
+/** Resolver configuration file of the DNS client */
+GLOBAL char Conf_ResolvConfFile[FNAME_LEN];
+
 /** Enable IDENT lookups, even when compiled with support for it */
 GLOBAL bool Conf_Ident;
 
@@ -229,6 +236,22 @@ GLOBAL bool Conf_ConnectIPv6;
 /** Try to connect to remote systems using the IPv4 protocol (true) */
 GLOBAL bool Conf_ConnectIPv4;
 
+/** Flood control: max. commands per second of users (0: unlimited) */
+GLOBAL int Conf_FloodRateUser;
+
+/** Flood control: max. commands per second of IRC Operators */
+GLOBAL int Conf_FloodRateOper;
+
+/** Flood control: max. commands per second of services and users with
+ * user mode 'F' */
+GLOBAL int Conf_FloodRateService;
+
+/** Flood control: max. commands per second of servers */
+GLOBAL int Conf_FloodRateServer;
+
+/** Flood control: number of commands allowed in a row */
+GLOBAL int Conf_FloodBurst;
+
 /** Idle timeout (seconds), after which the daemon should exit */
 GLOBAL int Conf_IdleTimeout;
 
@@ -241,6 +264,9 @@ GLOBAL int Conf_MaxJoins;
 /** Maximum number of connections per IP address */
 GLOBAL int Conf_MaxConnectionsIP;
 
+/** Maximum number of connections per IPv6 /64 network */
+GLOBAL int Conf_MaxConnectionsIPv6Net;
+
 /** Maximum length of a nickname */
 GLOBAL unsigned int Conf_MaxNickLength;
 
@@ -26,6 +26,11 @@
 #include "conf.h"
 #include "conn-func.h"
 
+static array My_FlaggedConns;
+static unsigned long Flag_Generation = 1;
+
+static bool Is_ServerLink PARAMS((CONN_ID Idx));
+
 /**
  * Update "idle timestamp", the time of the last visible user action
  * (e. g. like sending messages, joining or leaving channels).
@@ -80,21 +85,122 @@ Conn_LastPing( CONN_ID Idx )
 	return My_Connections[Idx].lastping;
 } /* Conn_LastPing */
 
+/**
+ * Get the flood control "costs" of a command received on a connection.
+ *
+ * Flood control uses a token bucket per connection, which is refilled with
+ * the configured number of commands per second of the class of the client
+ * (user, IRC Operator, service or server) and holds up to "FloodBurst"
+ * commands. It is implemented as a "theoretical arrival time" of the next
+ * command ("flood_tat"), which is moved forward by the costs of each
+ * command and by penalties, in milliseconds: commands are only handled as
+ * long as it isn't further ahead of the current time than the burst size.
+ *
+ * Server links, including peers which are still logging in, are charged
+ * the server rate, see Is_ServerLink().
+ *
+ * @param Idx Connection index.
+ * @returns Milliseconds per command, or 0 if the rate isn't limited.
+ */
+GLOBAL long
+Conn_FloodCost(CONN_ID Idx)
+{
+	CLIENT *c;
+	int rate;
+
+	assert(Idx > NONE);
+
+	c = My_Connections[Idx].client;
+	if (!c)
+		rate = Conf_FloodRateUser;
+	else if (Is_ServerLink(Idx))
+		rate = Conf_FloodRateServer;
+	else switch (Client_Type(c)) {
+	    case CLIENT_SERVICE:
+		rate = Conf_FloodRateService;
+		break;
+	    default:
+		/* Users with mode 'F' get relaxed flood protection */
+		if (Client_HasMode(c, 'F'))
+			rate = Conf_FloodRateService;
+		else if (Client_HasMode(c, 'o'))
+			rate = Conf_FloodRateOper;
+		else
+			rate = Conf_FloodRateUser;
+	}
+	return rate > 0 ? 1000 / rate : 0;
+} /* Conn_FloodCost */
+
+/**
+ * Get the time until the next command of a connection can be handled.
+ *
+ * @param Idx Connection index.
+ * @param Now Current time, see Timer_Now().
+ * @returns Milliseconds to wait, 0 if a command can be handled right now.
+ * @see Conn_FloodCost
+ */
+GLOBAL long
+Conn_FloodWait(CONN_ID Idx, const struct timeval *Now)
+{
+	long ahead, burst, cost;
+
+	assert(Idx > NONE);
+	assert(Now != NULL);
+
+	cost = Conn_FloodCost(Idx);
+	if (cost == 0 && Is_ServerLink(Idx)) {
+		/* Unlimited server link: there are no penalties for servers
+		 * (see IRC_SetPenalty()), and the costs of commands charged
+		 * while the peer was logging in don't count any more. */
+		return 0;
+	}
+
+	ahead = Timer_DiffMs(&My_Connections[Idx].flood_tat, Now);
+	burst = cost * (Conf_FloodBurst - 1);
+	return ahead > burst ? ahead - burst : 0;
+} /* Conn_FloodWait */
+
+/**
+ * Take tokens out of the flood control bucket of a connection.
+ *
+ * @param Idx Connection index.
+ * @param Now Current time, see Timer_Now().
+ * @param Ms Costs in milliseconds.
+ * @see Conn_FloodCost
+ */
+GLOBAL void
+Conn_FloodCharge(CONN_ID Idx, const struct timeval *Now, long Ms)
+{
+	CONNECTION *c = &My_Connections[Idx];
+
+	assert(Idx > NONE);
+	assert(Now != NULL);
+	assert(Ms >= 0);
+
+	/* An empty bucket doesn't save up tokens for later */
+	if (Timer_DiffMs(&c->flood_tat, Now) < 0)
+		c->flood_tat = *Now;
+	Timer_AddMs(&c->flood_tat, Ms);
+} /* Conn_FloodCharge */
+
 /**
  * Add "penalty time" for a connection.
  *
- * During the "penalty time" the socket is ignored completely, no new data
- * is read. This function only increases the penalty, it is not possible to
- * decrease the penalty time.
+ * During the "penalty time" no more commands of the connection are handled
+ * and no new data is read. This function only increases the penalty, it is
+ * not possible to decrease the penalty time.
+ *
+ * The penalty is added to the flood control of the connection, so a
+ * penalty can be covered by the allowed burst of commands.
  *
  * @param Idx Connection index.
  * @param Seconds Seconds to add.
- * @see Conn_ResetPenalty
+ * @see Conn_FloodCost
  */
 GLOBAL void
 Conn_SetPenalty(CONN_ID Idx, time_t Seconds)
 {
-	time_t t;
+	struct timeval now;
 
 	assert(Idx > NONE);
 	assert(Seconds >= 0);
@@ -107,40 +213,97 @@ Conn_SetPenalty(CONN_ID Idx, time_t Seconds)
 	    && Seconds < 10)
 		Seconds = Conf_MaxPenaltyTime;
 
-	t = time(NULL);
-	if (My_Connections[Idx].delaytime < t)
-		My_Connections[Idx].delaytime = t;
+	Timer_Now(&now);
+	Conn_FloodCharge(Idx, &now, (long)Seconds * 1000);
 
-	My_Connections[Idx].delaytime += Seconds;
+	/* Update_Interest() in conn.c makes sure that the connection is
+	 * handled again when the penalty time is over */
+	Conn_Activate(Idx);
 
-	LogDebug("Add penalty time on connection %d: %ld second%s, total %ld second%s.",
+	LogDebug("Add penalty time on connection %d: %ld second%s, total %ld ms.",
 	    Idx, (long)Seconds, Seconds != 1 ? "s" : "",
-	    My_Connections[Idx].delaytime - t,
-	    My_Connections[Idx].delaytime - t != 1 ? "s" : "");
+	    Timer_DiffMs(&My_Connections[Idx].flood_tat, &now));
 } /* Conn_SetPenalty */
 
+/**
+ * Start a new set of flagged connections.
+ *
+ * Instead of resetting the flag of every connection in the pool, the flags
+ * are invalidated by advancing the "flag generation": a flag is only valid
+ * while the generation stamped into the connection structure matches.
+ */
 GLOBAL void
 Conn_ClearFlags( void )
 {
 	CONN_ID i;
 
-	for( i = 0; i < Pool_Size; i++ ) My_Connections[i].flag = 0;
+	array_trunc(&My_FlaggedConns);
+
+	if (++Flag_Generation == 0) {
+		/* Counter wrapped around, make sure that no stale stamp
+		 * can match the new generation by accident. */
+		for (i = 0; i < Pool_Size; i++)
+			My_Connections[i].flag_generation = 0;
+		Flag_Generation = 1;
+	}
 } /* Conn_ClearFlags */
 
 GLOBAL int
 Conn_Flag( CONN_ID Idx )
 {
 	assert( Idx > NONE );
+	if (My_Connections[Idx].flag_generation != Flag_Generation)
+		return 0;
 	return My_Connections[Idx].flag;
 } /* Conn_Flag */
 
+/**
+ * Set the flag of a connection and remember it in the list of flagged
+ * connections of the current generation, see Conn_ClearFlags().
+ */
 GLOBAL void
 Conn_SetFlag( CONN_ID Idx, int Flag )
 {
 	assert( Idx > NONE );
+
+	if (My_Connections[Idx].flag_generation != Flag_Generation) {
+		if (!array_catb(&My_FlaggedConns, (char *)&Idx, sizeof(Idx))) {
+			Log(LOG_ALERT,
+			    "Can't add connection %d to list of flagged connections!",
+			    Idx);
+			return;
+		}
+		My_Connections[Idx].flag_generation = Flag_Generation;
+	}
 	My_Connections[Idx].flag = Flag;
 } /* Conn_SetFlag */
 
+/**
+ * Get the number of connections flagged since the last call to
+ * Conn_ClearFlags().
+ */
+GLOBAL size_t
+Conn_FlaggedCount( void )
+{
+	return array_length(&My_FlaggedConns, sizeof(CONN_ID));
+} /* Conn_FlaggedCount */
+
+/**
+ * Get a flagged connection by its position in the list of flagged
+ * connections, in the order in which they have been flagged.
+ *
+ * @param Pos Position in the list, 0 to Conn_FlaggedCount() - 1.
+ * @returns Connection index or NONE.
+ */
+GLOBAL CONN_ID
+Conn_Flagged( size_t Pos )
+{
+	CONN_ID *idx;
+
+	idx = array_get(&My_FlaggedConns, sizeof(CONN_ID), Pos);
+	return idx ? *idx : NONE;
+} /* Conn_Flagged */
+
 GLOBAL CONN_ID
 Conn_First( void )
 {
@@ -205,7 +368,8 @@ Conn_StartTime( CONN_ID Idx )
 } /* Conn_StartTime */
 
 /**
- * return number of bytes queued for writing
+ * return number of bytes queued for writing (including data not
+ * compressed yet on compressed links)
  */
 GLOBAL size_t
 Conn_SendQ( CONN_ID Idx )
@@ -213,10 +377,11 @@ Conn_SendQ( CONN_ID Idx )
 	assert( Idx > NONE );
 #ifdef ZLIB
 	if( My_Connections[Idx].options & CONN_ZIP )
-		return array_bytes(&My_Connections[Idx].zip.wbuf);
+		return array_bytes(&My_Connections[Idx].zip.wbuf)
+		       + sendq_bytes(&My_Connections[Idx].wbuf);
 	else
 #endif
-	return array_bytes(&My_Connections[Idx].wbuf);
+	return sendq_bytes(&My_Connections[Idx].wbuf);
 } /* Conn_SendQ */
 
 /**
@@ -287,6 +452,13 @@ Conn_IPA(CONN_ID Idx)
 	return ng_ipaddr_tostr(&My_Connections[Idx].addr);
 }
 
+GLOBAL const ng_ipaddr_t *
+Conn_GetAddr(CONN_ID Idx)
+{
+	assert (Idx > NONE);
+	return &My_Connections[Idx].addr;
+}
+
 GLOBAL void
 Conn_ResetWCounter( void )
 {
@@ -299,4 +471,28 @@ Conn_WCounter( void )
 	return WCounter;
 } /* Conn_WCounter */
 
+/**
+ * Check if a connection is a server link, or a peer logging in: the latter
+ * did send a PASS command with a server protocol version and can't
+ * register as a user any more.
+ *
+ * @param Idx Connection index.
+ * @returns true if the connection is a server link.
+ */
+static bool
+Is_ServerLink(CONN_ID Idx)
+{
+	CLIENT *c = My_Connections[Idx].client;
+
+	if (!c)
+		return false;
+	switch (Client_Type(c)) {
+	    case CLIENT_SERVER:
+	    case CLIENT_UNKNOWNSERVER:
+	    case CLIENT_GOTPASS_2813:
+		return true;
+	}
+	return false;
+} /* Is_ServerLink */
+
 /* -eof- */
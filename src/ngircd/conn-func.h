@@ -28,6 +28,8 @@
 #define Conn_OPTION_ISSET( x, opt ) ( ((x)->options & (opt)) != 0)
 #endif
 
+#include "ng_ipaddr.h"
+
 
 GLOBAL void Conn_UpdateIdle PARAMS((CONN_ID Idx));
 GLOBAL void Conn_UpdatePing PARAMS((CONN_ID Idx, time_t TimeStamp));
@@ -43,12 +45,19 @@ GLOBAL long Conn_RecvMsg PARAMS(( CONN_ID Idx ));
 GLOBAL long Conn_SendBytes PARAMS(( CONN_ID Idx ));
 GLOBAL long Conn_RecvBytes PARAMS(( CONN_ID Idx ));
 GLOBAL const char *Conn_IPA PARAMS(( CONN_ID Idx ));
+GLOBAL const ng_ipaddr_t *Conn_GetAddr PARAMS(( CONN_ID Idx ));
 
+GLOBAL long Conn_FloodCost PARAMS(( CONN_ID Idx ));
+GLOBAL long Conn_FloodWait PARAMS(( CONN_ID Idx, const struct timeval *Now ));
+GLOBAL void Conn_FloodCharge PARAMS(( CONN_ID Idx, const struct timeval *Now,
+				      long Ms ));
 GLOBAL void Conn_SetPenalty PARAMS(( CONN_ID Idx, time_t Seconds ));
 
 GLOBAL void Conn_ClearFlags PARAMS(( void ));
 GLOBAL int Conn_Flag PARAMS(( CONN_ID Idx ));
 GLOBAL void Conn_SetFlag PARAMS(( CONN_ID Idx, int Flag ));
+GLOBAL size_t Conn_FlaggedCount PARAMS(( void ));
+GLOBAL CONN_ID Conn_Flagged PARAMS(( size_t Pos ));
 
 GLOBAL CONN_ID Conn_First PARAMS(( void ));
 GLOBAL CONN_ID Conn_Next PARAMS(( CONN_ID Idx ));
@@ -167,8 +167,8 @@ Zip_Flush( CONN_ID Idx )
 #if DEBUG_ZIP
 	LogDebug("zipbuf_used: %d", zipbuf_used);
 #endif
-	if (!array_catb(&My_Connections[Idx].wbuf,
-			(char *)zipbuf, (size_t) zipbuf_used)) {
+	if (!sendq_append(&My_Connections[Idx].wbuf,
+			  (char *)zipbuf, (size_t) zipbuf_used)) {
 		Log (LOG_ALERT, "Compression error: can't copy data!?");
 		Conn_Close(Idx, "Compression error!", NULL, false);
 		return false;
@@ -12,6 +12,8 @@
 #define CONN_MODULE
 #define CONN_MODULE_GLOBAL_INIT
 
+#define _GNU_SOURCE			/* for accept4(2) */
+
 #include "portab.h"
 
 /**
@@ -36,7 +38,9 @@
 #include <strings.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <netinet/in.h>
 
@@ -47,6 +51,10 @@
 # include <netinet/ip.h>
 #endif
 
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+# include <linux/sock_diag.h>		/* for SK_MEMINFO_DROPS */
+#endif
+
 #ifdef TCPWRAP
 # include <tcpd.h>			/* for TCP Wrappers */
 #endif
@@ -61,44 +69,80 @@
 #include "conn-ssl.h"
 #include "conn-zip.h"
 #include "conn-func.h"
+#include "burst.h"
+#include "hash.h"
 #include "io.h"
 #include "log.h"
 #include "ng_ipaddr.h"
 #include "parse.h"
 #include "resolve.h"
 #include "sighandlers.h"
+#include "timer.h"
 
 #define SERVER_WAIT (NONE - 1)		/** "Wait for outgoing connection" flag */
+#define BACKLOG_EMPTY (NONE - 1)	/** "No pending connection" result */
 
 #define MAX_COMMANDS 3			/** Max. commands per loop for users */
 #define MAX_COMMANDS_SERVER_MIN 10	/** Min. commands per loop for servers */
 #define MAX_COMMANDS_SERVICE 10		/** Max. commands per loop for services */
+#define MAX_IDLE_WAIT 60		/** Max. seconds to wait without timers */
+#define MAX_ACCEPTS 64			/** Max. connections accepted per loop */
 
 #define SD_LISTEN_FDS_START 3		/** systemd(8) socket activation offset */
 
-#define THROTTLE_CMDS 1			/** Throttling: max commands reached */
-#define THROTTLE_BPS 2			/** Throttling: max bps reached */
+#define ADDR_KEY_LEN 17			/** Tag byte and IPv6 address */
+#define ADDR_KEY_IPV4 4			/** Key tag: IPv4 address */
+#define ADDR_KEY_IPV6 6			/** Key tag: IPv6 address */
+#define ADDR_KEY_NET64 64		/** Key tag: IPv6 /64 network */
+#define ADDR_COUNTS_SIZE 64		/** Initial size of address hash */
+
+/** Number of connections from one IP address or IPv6 /64 network. */
+typedef struct _Addr_Count
+{
+	HASH_ITEM item;			/* item in Addr_Counts hash table */
+	UINT8 key[ADDR_KEY_LEN];	/* tag and address (prefix) */
+	long count;			/* number of connections */
+} ADDR_COUNT;
 
 static bool Handle_Write PARAMS(( CONN_ID Idx ));
-static bool Conn_Write PARAMS(( CONN_ID Idx, char *Data, size_t Len ));
+static bool Conn_Write PARAMS((CONN_ID Idx, const char *Data, size_t Len,
+			       SENDQ_BLOCK *Shared));
+static int Accept_Socket PARAMS((int Sock, ng_ipaddr_t *Addr,
+				 bool *NonBlocking));
 static int New_Connection PARAMS(( int Sock, bool IsSSL ));
 static CONN_ID Socket2Index PARAMS(( int Sock ));
 static void Read_Request PARAMS(( CONN_ID Idx ));
 static unsigned int Handle_Buffer PARAMS(( CONN_ID Idx ));
-static void Check_Connections PARAMS(( void ));
-static void Check_Servers PARAMS(( void ));
+static char *Find_Line_End PARAMS((char *Buf, size_t Len, size_t *Delta));
+static void Check_Connection PARAMS((int Idx));
+static bool Start_Connection_Timer PARAMS((CONN_ID Idx));
+static void Check_Servers PARAMS((int Unused));
 static void Init_Conn_Struct PARAMS(( CONN_ID Idx ));
-static bool Init_Socket PARAMS(( int Sock ));
+static bool Init_Socket PARAMS(( int Sock, bool IsNonBlocking ));
 static void New_Server PARAMS(( int Server, ng_ipaddr_t *dest ));
 static void Simple_Message PARAMS(( int Sock, const char *Msg ));
 static int NewListener PARAMS(( const char *listen_addr, UINT16 Port ));
 static void Account_Connection PARAMS((void));
-static void Throttle_Connection PARAMS((const CONN_ID Idx, CLIENT *Client,
-					const int Reason, unsigned int Value));
+static void Account_Accepts PARAMS((size_t Attempts, size_t Count));
+static long Listen_Drops PARAMS((void));
+static bool Update_Interest PARAMS((CONN_ID Idx, time_t t,
+				    const struct timeval *Now, long *Wait));
+static int Addr_Keys PARAMS((const ng_ipaddr_t *Addr,
+			     UINT8 Keys[2][ADDR_KEY_LEN]));
+static ADDR_COUNT *Addr_Find PARAMS((const UINT8 *Key, UINT32 HashValue));
+static void Addr_Account PARAMS((const ng_ipaddr_t *Addr, long Diff));
+static void Continue_Burst PARAMS((CONN_ID Idx));
+static void Continue_Login PARAMS((CONN_ID Idx));
+static const char *Lookup_Cached PARAMS((CONN_ID Idx));
 
 static array My_Listeners;
 static array My_ConnArray;
+static array My_ActiveConns;
+static TIMER *My_ServersTimer;
+static HASH_TABLE Addr_Counts;
 static size_t NumConnections, NumConnectionsMax, NumConnectionsAccepted;
+static size_t NumConnectionsRefused;
+static size_t NumAcceptLoops, NumAcceptLoopsFull, NumAcceptsMax;
 
 #ifdef TCPWRAP
 int allow_severity = LOG_INFO;
@@ -115,8 +159,10 @@ static void cb_listen_ssl PARAMS((int sock, short irrelevant));
 static void cb_connserver_login_ssl PARAMS((int sock, short what));
 static void cb_clientserver_ssl PARAMS((int sock, short what));
 #endif
-static void cb_Read_Resolver_Result PARAMS((int sock, UNUSED short what));
-static void cb_Connect_to_Server PARAMS((int sock, UNUSED short what));
+static void cb_Read_Resolver_Result PARAMS((int Token, const char *Hostname,
+					    const char *Ident));
+static void cb_Connect_to_Server PARAMS((int Token, const ng_ipaddr_t *Addrs,
+					 size_t Count));
 static void cb_clientserver PARAMS((int sock, short what));
 
 time_t idle_t = 0;
@@ -156,18 +202,87 @@ my_sd_listen_fds(void)
 	return count;
 }
 
+/**
+ * Update statistics of accept loops.
+ *
+ * @param Attempts	Number of connections handled in this loop.
+ * @param Count		Number of connections accepted in this loop, not
+ *			counting aborted and refused ones.
+ */
+static void
+Account_Accepts(size_t Attempts, size_t Count)
+{
+	if (Attempts == 0)
+		return;
+	NumAcceptLoops++;
+	if (Attempts >= MAX_ACCEPTS)
+		NumAcceptLoopsFull++;
+	if (Count > NumAcceptsMax)
+		NumAcceptsMax = Count;
+}
+
+/**
+ * Get the number of connection attempts the kernel dropped because the
+ * queue of pending connections ("backlog") of a listening socket was full.
+ *
+ * This is only available on Linux (getsockopt() option SO_MEMINFO), and
+ * counts since the current listening sockets have been opened; retries of
+ * clients are counted again when they are dropped, too.
+ *
+ * @returns	Number of dropped connection attempts or -1 if unknown.
+ */
+static long
+Listen_Drops(void)
+{
+#if defined(HAVE_LINUX_SOCK_DIAG_H) && defined(SO_MEMINFO)
+	UINT32 meminfo[SK_MEMINFO_VARS];
+	socklen_t len;
+	size_t i, count;
+	long drops = 0;
+	int *fd;
+
+	count = array_length(&My_Listeners, sizeof(int));
+	fd = array_start(&My_Listeners);
+	for (i = 0; i < count; i++) {
+		len = (socklen_t)sizeof(meminfo);
+		if (getsockopt(fd[i], SOL_SOCKET, SO_MEMINFO, meminfo, &len) != 0
+		    || len <= SK_MEMINFO_DROPS * sizeof(UINT32))
+			return -1;
+		drops += (long)meminfo[SK_MEMINFO_DROPS];
+	}
+	return drops;
+#else
+	return -1;
+#endif
+} /* Listen_Drops */
+
 /**
  * IO callback for listening sockets: handle new connections. This callback
  * gets called when a new non-SSL connection should be accepted.
  *
+ * All pending connections are accepted (up to MAX_ACCEPTS per loop, so
+ * that established connections aren't starved), as a server restart can
+ * result in thousands of clients reconnecting at the same time.
+ *
  * @param sock		Socket descriptor.
  * @param irrelevant	(ignored IO specification)
  */
 static void
 cb_listen(int sock, short irrelevant)
 {
+	size_t attempts = 0, count = 0;
+	int fd;
+
 	(void) irrelevant;
-	(void) New_Connection(sock, false);
+	while (attempts < MAX_ACCEPTS) {
+		fd = New_Connection(sock, false);
+		if (fd == BACKLOG_EMPTY)
+			break;
+		attempts++;
+		if (fd >= 0)
+			count++;
+	}
+	Account_Accepts(attempts, count);
 }
 
 /**
@@ -286,6 +401,8 @@ cb_clientserver(int sock, short what)
 		return;
 	}
 
+	Conn_Activate(idx);
+
 #ifdef SSL_SUPPORT
 	if (what & IO_WANTREAD
 	    || (Conn_OPTION_ISSET(&My_Connections[idx], CONN_SSL_WANT_WRITE))) {
@@ -318,9 +435,21 @@ Conn_Init( void )
 		Log(LOG_EMERG, "Failed to initialize connection pool!");
 		exit(1);
 	}
+	if (!Hash_TableInit(&Addr_Counts, ADDR_COUNTS_SIZE)) {
+		Log(LOG_EMERG, "Failed to initialize connection address hash!");
+		exit(1);
+	}
 
 	/* Initialize "listener" array. */
 	array_free( &My_Listeners );
+
+	/* Check the configured servers as soon as the main loop runs. */
+	My_ServersTimer = Timer_New(Check_Servers, 0);
+	if (!My_ServersTimer) {
+		Log(LOG_EMERG, "Failed to initialize server link timer!");
+		exit(1);
+	}
+	Conn_ScheduleServerCheck();
 } /* Conn_Init */
 
 /**
@@ -342,26 +471,41 @@ Conn_Exit( void )
 	}
 
 	array_free(&My_ConnArray);
+	array_free(&My_ActiveConns);
+	Hash_TableFree(&Addr_Counts);
+	Timer_Free(My_ServersTimer);
+	My_ServersTimer = NULL;
 	My_Connections = NULL;
 	Pool_Size = 0;
 	io_library_shutdown();
 } /* Conn_Exit */
 
 /**
- * Close all sockets (file descriptors) of open connections.
+ * Close all sockets (file descriptors) of open connections and listening
+ * sockets.
  * This is useful in forked child processes, for example, to make sure that
- * they don't hold connections open that the main process wants to close.
+ * they don't hold connections open that the main process wants to close,
+ * or ports that it wants to listen on again.
  */
 GLOBAL void
 Conn_CloseAllSockets(int ExceptOf)
 {
 	CONN_ID idx;
+	size_t i, len;
+	int *fd;
 
 	for(idx = 0; idx < Pool_Size; idx++) {
 		if(My_Connections[idx].sock > NONE &&
 		   My_Connections[idx].sock != ExceptOf)
 			close(My_Connections[idx].sock);
 	}
+
+	len = array_length(&My_Listeners, sizeof(int));
+	fd = array_start(&My_Listeners);
+	for (i = 0; i < len; i++) {
+		if (fd[i] != ExceptOf)
+			close(fd[i]);
+	}
 }
 
 /**
@@ -463,7 +607,7 @@ Conn_InitListeners( void )
 				continue;
 			}
 
-			Init_Socket(fd);
+			Init_Socket(fd, false);
 			if (!io_event_create(fd, IO_WANTREAD, cb_listen)) {
 				Log(LOG_ERR,
 				    "io_event_create(): Can't add fd %d: %s!",
@@ -625,7 +769,7 @@ NewListener(const char *listen_addr, UINT16 Port)
 
 	set_v6_only(af, sock);
 
-	if (!Init_Socket(sock))
+	if (!Init_Socket(sock, false))
 		return -1;
 
 	if (bind(sock, (struct sockaddr *)&addr, ng_ipaddr_salen(&addr)) != 0) {
@@ -635,7 +779,7 @@ NewListener(const char *listen_addr, UINT16 Port)
 		return -1;
 	}
 
-	if (listen(sock, 10) != 0) {
+	if (listen(sock, SOMAXCONN) != 0) {
 		Log(LOG_CRIT, "Can't listen on socket: %s!", strerror(errno));
 		close(sock);
 		return -1;
@@ -667,10 +811,10 @@ GLOBAL void
 Conn_Handler(void)
 {
 	int i;
-	size_t wdatalen;
-	struct timeval tv;
-	time_t t, notify_t = 0;
-	bool command_available;
+	size_t n, kept;
+	struct timeval tv, now;
+	time_t t, next, notify_t = 0;
+	long wait, ms;
 	char status[200];
 
 	Log(LOG_NOTICE, "Server \"%s\" (on \"%s\") ready.",
@@ -679,100 +823,89 @@ Conn_Handler(void)
 
 	while (!NGIRCd_SignalQuit && !NGIRCd_SignalRestart) {
 		t = time(NULL);
-		command_available = false;
+		wait = -1;
 
-		/* Check configured servers and established links */
-		Check_Servers();
-		Check_Connections();
+		/* Handle expired timers: PING-PONG and login timeouts, end of
+		 * "penalty times", server link (re-)connects, and expiration
+		 * of class/list items */
+		Timer_Run(t);
 
-		/* Expire outdated class/list items */
-		Class_Expire();
+		/* Deliver results of lookups which didn't have to wait for
+		 * name servers (hosts file, IP addresses, cached names) */
+		Resolve_Run();
 
 		/* Look for non-empty read buffers ... */
-		for (i = 0; i < Pool_Size; i++) {
+		for (n = 0;
+		     n < array_length(&My_ActiveConns, sizeof(CONN_ID)); n++) {
+			i = *(CONN_ID *)array_get(&My_ActiveConns,
+						  sizeof(CONN_ID), n);
+			/* Continue logins started by Conn_StartLogin() */
+			if (My_Connections[i].sock > NONE
+			    && Conn_OPTION_ISSET(&My_Connections[i], CONN_LOGIN))
+				Continue_Login(i);
 			if ((My_Connections[i].sock > NONE)
 			    && (array_bytes(&My_Connections[i].rbuf) > 0)) {
 				/* ... and try to handle the received data */
 				Handle_Buffer(i);
 			}
+			/* Continue server bursts when the write buffer
+			 * has been drained (mostly) */
+			if (My_Connections[i].sock > NONE
+			    && Conn_OPTION_ISSET(&My_Connections[i], CONN_BURST)
+			    && Conn_SendQ(i) < WRITEBUFFER_BURST_LEN)
+				Continue_Burst(i);
 		}
 
-		/* Look for non-empty write buffers ... */
-		for (i = 0; i < Pool_Size; i++) {
-			if (My_Connections[i].sock <= NONE)
-				continue;
-
-			wdatalen = array_bytes(&My_Connections[i].wbuf);
-#ifdef ZLIB
-			if (wdatalen > 0 ||
-			    array_bytes(&My_Connections[i].zip.wbuf) > 0)
-#else
-			if (wdatalen > 0)
-#endif
-			{
-#ifdef SSL_SUPPORT
-				if (SSL_WantRead(&My_Connections[i]))
-					continue;
-#endif
-				io_event_add(My_Connections[i].sock,
-					     IO_WANTWRITE);
-			}
-		}
-
-		/* Check from which sockets we possibly could read ... */
-		for (i = 0; i < Pool_Size; i++) {
-			if (My_Connections[i].sock <= NONE)
-				continue;
-#ifdef SSL_SUPPORT
-			if (SSL_WantWrite(&My_Connections[i]))
-				/* TLS/SSL layer needs to write data; deal
-				 * with this first! */
-				continue;
-#endif
-			if (Proc_InProgress(&My_Connections[i].proc_stat)) {
-				/* Wait for completion of forked subprocess
-				 * and ignore the socket in the meantime ... */
-				io_event_del(My_Connections[i].sock,
-					     IO_WANTREAD);
-				continue;
-			}
-
-			if (Conn_OPTION_ISSET(&My_Connections[i], CONN_ISCONNECTING))
-				/* Wait for completion of connect() ... */
-				continue;
-
-			if (My_Connections[i].delaytime > t) {
-				/* There is a "penalty time" set: ignore socket! */
-				io_event_del(My_Connections[i].sock,
-					     IO_WANTREAD);
-				continue;
-			}
-
-			if (array_bytes(&My_Connections[i].rbuf) >= COMMAND_LEN) {
-				/* There is still more data in the read buffer
-				 * than a single valid command can get long:
-				 * so either there is a complete command, or
-				 * invalid data. Therefore don't try to read in
-				 * even more data from the network but wait for
-				 * this command(s) to be handled first! */
-				io_event_del(My_Connections[i].sock,
-					     IO_WANTREAD);
-				command_available = true;
-				continue;
-			}
-
-			io_event_add(My_Connections[i].sock, IO_WANTREAD);
+		/* Update IO events of all active connections and remove the
+		 * ones from the list that don't need any more attention.
+		 * Note: handling commands above can append more connections
+		 * to the list, this is why it is only truncated afterwards! */
+		Timer_Now(&now);
+		for (n = 0, kept = 0;
+		     n < array_length(&My_ActiveConns, sizeof(CONN_ID)); n++) {
+			i = *(CONN_ID *)array_get(&My_ActiveConns,
+						  sizeof(CONN_ID), n);
+			if (Update_Interest(i, t, &now, &wait)) {
+				*(CONN_ID *)array_get(&My_ActiveConns,
+						      sizeof(CONN_ID), kept++) = i;
+			} else
+				My_Connections[i].active = false;
 		}
+		array_truncate(&My_ActiveConns, sizeof(CONN_ID), kept);
 
 		/* Don't wait for data when there is still at least one command
-		 * available in a read buffer which can be handled immediately;
-		 * set the timeout for reading from the network to 1 second
-		 * otherwise, which is the granularity with witch we handle
-		 * "penalty times" for example.
+		 * available in a read buffer which can be handled immediately,
+		 * or a lookup result to deliver (see Resolve_Run());
+		 * wait until the next timer expires otherwise (or the idle
+		 * timeout or service manager notification are due), or until
+		 * flood control allows handling the next command, whichever
+		 * comes first.
 		 * Note: tv_sec/usec are undefined(!) after io_dispatch()
 		 * returns, so we have to set it before each call to it! */
-		tv.tv_usec = 0;
-		tv.tv_sec = command_available ? 0 : 1;
+		if (Resolve_Deferred())
+			wait = 0;
+		next = Timer_NextExpiration();
+		if (Conf_IdleTimeout > 0 && NumConnectionsAccepted > 0
+		    && idle_t > 0
+		    && (!next || idle_t + Conf_IdleTimeout < next))
+			next = idle_t + Conf_IdleTimeout;
+		if (Signal_NotifySvcMgr_Possible()
+		    && (!next || notify_t + 4 < next))
+			next = notify_t + 4;
+		if (wait == 0 || (next && next <= t))
+			ms = 0;
+		else if (next && next - t <= MAX_IDLE_WAIT) {
+			/* Wake up right when the second "next" starts, not up
+			 * to one second later */
+			gettimeofday(&tv, NULL);
+			ms = next > tv.tv_sec ? (long)(next - tv.tv_sec) * 1000
+						- (long)tv.tv_usec / 1000 : 0;
+		} else
+			ms = MAX_IDLE_WAIT * 1000L;
+		if (wait > 0 && wait < ms)
+			ms = wait;
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000;
 
 		/* Wait for activity ... */
 		i = io_dispatch(&tv);
@@ -814,6 +947,142 @@ Conn_Handler(void)
 	}
 } /* Conn_Handler */
 
+/**
+ * Add a connection to the list of "active" connections, which are checked
+ * for pending data and updated IO events on each iteration of the main
+ * loop, see Conn_Handler(). Connections are removed from the list again
+ * as soon as they don't need any more attention.
+ *
+ * @param Idx	Index of the connection.
+ */
+GLOBAL void
+Conn_Activate(CONN_ID Idx)
+{
+	assert(Idx > NONE);
+
+	if (My_Connections[Idx].active)
+		return;
+
+	if (!array_catb(&My_ActiveConns, (char *)&Idx, sizeof(Idx))) {
+		Log(LOG_ALERT,
+		    "Can't add connection %d to list of active connections!",
+		    Idx);
+		return;
+	}
+	My_Connections[Idx].active = true;
+} /* Conn_Activate */
+
+/**
+ * Update the IO events of an active connection depending on its buffers,
+ * flood control ("penalty time") and subprocess state.
+ *
+ * @param Idx	Index of the connection.
+ * @param t	Current time.
+ * @param Now	Current time, see Timer_Now().
+ * @param Wait	Set to the number of milliseconds until a command waiting
+ *		in the read buffer can be handled, if less than before
+ *		(or negative, which means "no command waiting").
+ * @returns	true when the connection must be checked again on the
+ *		next iteration of the main loop.
+ */
+static bool
+Update_Interest(CONN_ID Idx, time_t t, const struct timeval *Now, long *Wait)
+{
+	CONNECTION *c = &My_Connections[Idx];
+	size_t wdatalen, delta;
+	long delay;
+
+	if (c->sock <= NONE)
+		return false;
+
+	/* Non-empty write buffer? */
+	wdatalen = sendq_bytes(&c->wbuf);
+#ifdef ZLIB
+	wdatalen += array_bytes(&c->zip.wbuf);
+#endif
+	if (wdatalen > 0) {
+#ifdef SSL_SUPPORT
+		if (!SSL_WantRead(c))
+#endif
+			io_event_add(c->sock, IO_WANTWRITE);
+	}
+
+	/* Check if we possibly could read from the socket ... */
+#ifdef SSL_SUPPORT
+	if (SSL_WantWrite(c))
+		/* TLS/SSL layer needs to write data; deal with this first! */
+		return true;
+#endif
+	if (Conn_OPTION_ISSET(c, CONN_LOGIN)) {
+		/* Login continues in the next pass of the main loop */
+		io_event_del(c->sock, IO_WANTREAD);
+		*Wait = 0;
+		return true;
+	}
+	if (Resolve_InProgress(&c->res_stat)
+#ifdef PAM
+	    || PAM_InProgress(&c->auth_stat)
+#endif
+	   ) {
+		/* Wait for completion of lookups or authentication
+		 * and ignore the socket in the meantime ... */
+		io_event_del(c->sock, IO_WANTREAD);
+		return true;
+	}
+
+	if (Conn_OPTION_ISSET(c, CONN_ISCONNECTING))
+		/* Wait for completion of connect() ... */
+		return false;
+
+	delay = Conn_FloodWait(Idx, Now);
+	if (delay > 0) {
+		/* Flood control delays the next command: ignore the socket
+		 * until then! Delays shorter than a second are handled by the
+		 * main loop, longer ones ("penalty times") by the timer of
+		 * the connection, which activates it again when it is over. */
+		io_event_del(c->sock, IO_WANTREAD);
+		if (delay < 1000) {
+			if (*Wait < 0 || delay < *Wait)
+				*Wait = delay;
+			return true;
+		}
+		if (c->timer)
+			Timer_SetEarlier(c->timer, t + (delay + 999) / 1000);
+		return wdatalen > 0;
+	}
+
+	if (array_bytes(&c->rbuf) >= COMMAND_LEN) {
+		/* There is still more data in the read buffer than a single
+		 * valid command can get long: so either there is a complete
+		 * command, or invalid data. Therefore don't try to read in
+		 * even more data from the network but wait for this
+		 * command(s) to be handled first! */
+		io_event_del(c->sock, IO_WANTREAD);
+		*Wait = 0;
+		return true;
+	}
+
+	/* Handle_Buffer() stopped early, because of its command limit per
+	 * call or flood control, and a complete command is left? */
+	if (array_bytes(&c->rbuf) > 0
+	    && Find_Line_End(array_start(&c->rbuf), array_bytes(&c->rbuf),
+			     &delta))
+		*Wait = 0;
+#ifdef ZLIB
+	else if (array_bytes(&c->zip.rbuf) > 0)
+		*Wait = 0;
+#endif
+
+	io_event_add(c->sock, IO_WANTREAD);
+
+	return wdatalen > 0 || array_bytes(&c->rbuf) > 0
+	    || Conn_OPTION_ISSET(c, CONN_BURST)
+#ifdef SSL_SUPPORT
+	    || Conn_OPTION_ISSET(c, CONN_SSL_WANT_READ)
+#endif
+	    ;
+} /* Update_Interest */
+
 /**
  * Write a text string into the socket of a connection.
  *
@@ -905,13 +1174,92 @@ va_dcl
 #endif
 
 	len = strlcat( buffer, "\r\n", sizeof( buffer ));
-	ok = Conn_Write(Idx, buffer, len);
+	ok = Conn_Write(Idx, buffer, len, NULL);
 	My_Connections[Idx].msg_out++;
 
 	va_end( ap );
 	return ok;
 } /* Conn_WriteStr */
 
+/**
+ * Build a complete IRC message line with prefix, ready to be sent to any
+ * number of connections using Conn_WriteLine().
+ *
+ * Oversized messages are shortened the same way as in Conn_WriteStr(), and
+ * CR+LF is appended. The line is stored in a block which the write buffers
+ * of all connections share; the caller must release its reference using
+ * sendq_block_release() when done.
+ *
+ * @param Prefix	Prefix of the message (without leading colon).
+ * @param Message	The message itself.
+ * @returns		The new line or NULL if out of memory.
+ */
+GLOBAL SENDQ_BLOCK *
+Conn_NewLine(const char *Prefix, const char *Message)
+{
+	SENDQ_BLOCK *line;
+	int r;
+
+	assert(Prefix != NULL);
+	assert(Message != NULL);
+
+	line = sendq_block_new();
+	if (!line) {
+		Log(LOG_EMERG, "Can't allocate memory! [Conn_NewLine]");
+		return NULL;
+	}
+
+	r = snprintf(line->data, COMMAND_LEN - 2, ":%s %s", Prefix, Message);
+	if (r >= COMMAND_LEN - 2 || r == -1)
+		strcpy(line->data + COMMAND_LEN - strlen(CUT_TXTSUFFIX) - 2 - 1,
+		       CUT_TXTSUFFIX);
+
+	line->len = strlcat(line->data, "\r\n", COMMAND_LEN);
+	return line;
+} /* Conn_NewLine */
+
+/**
+ * Write an IRC message line, built by Conn_NewLine(), into the socket
+ * of a connection.
+ *
+ * Unlike Conn_WriteStr(), the line isn't formatted again for each
+ * connection, and it is queued without copying it; only connections with
+ * a character set conversion in effect need their own copy of it.
+ *
+ * @param Idx	Index of the connection.
+ * @param Line	The message line.
+ * @returns	true on success, false otherwise.
+ */
+GLOBAL bool
+Conn_WriteLine(CONN_ID Idx, SENDQ_BLOCK *Line)
+{
+#ifdef ICONV
+	char buffer[COMMAND_LEN];
+#endif
+	bool ok;
+
+	assert(Idx > NONE);
+	assert(Line != NULL);
+	assert(Line->len > 2 && Line->len < COMMAND_LEN);
+
+#ifdef ICONV
+	if (My_Connections[Idx].iconv_to != (iconv_t)(-1)) {
+		strlcpy(buffer, Line->data, Line->len - 1);
+		return Conn_WriteStr(Idx, "%s", buffer);
+	}
+#endif
+
+#ifdef SNIFFER
+	if (NGIRCd_Sniffer)
+		LogDebug("-> connection %d: '%.*s'.", Idx, (int)(Line->len - 2),
+			 Line->data);
+#endif
+
+	ok = Conn_Write(Idx, Line->data, Line->len, Line);
+	My_Connections[Idx].msg_out++;
+	return ok;
+} /* Conn_WriteLine */
+
 GLOBAL char*
 Conn_Password( CONN_ID Idx )
 {
@@ -943,13 +1291,16 @@ Conn_SetPassword( CONN_ID Idx, const char *Pwd )
  * @param Idx	Index of the connection.
  * @param Data	pointer to the data.
  * @param Len	length of Data.
+ * @param Shared Shared block containing (exactly) Data, which can be
+ *		queued instead of a copy of Data, or NULL.
  * @returns	true on success, false otherwise.
  */
 static bool
-Conn_Write( CONN_ID Idx, char *Data, size_t Len )
+Conn_Write(CONN_ID Idx, const char *Data, size_t Len, SENDQ_BLOCK *Shared)
 {
 	CLIENT *c;
 	size_t writebuf_limit = WRITEBUFFER_MAX_LEN;
+	bool ok;
 	assert( Idx > NONE );
 	assert( Data != NULL );
 	assert( Len > 0 );
@@ -973,6 +1324,12 @@ Conn_Write( CONN_ID Idx, char *Data, size_t Len )
 	} else
 		LogDebug("Write on socket without client (connection %d)!?", Idx);
 
+	/* Server burst in progress? Then drop messages changing the state
+	 * of channels which will be announced by the burst later on. */
+	if (Conn_OPTION_ISSET(&My_Connections[Idx], CONN_BURST)
+	    && !Burst_Forward(Idx, Data, Len))
+		return true;
+
 #ifdef ZLIB
 	if ( Conn_OPTION_ISSET( &My_Connections[Idx], CONN_ZIP )) {
 		/* Compressed link:
@@ -987,7 +1344,7 @@ Conn_Write( CONN_ID Idx, char *Data, size_t Len )
 	{
 		/* Uncompressed link:
 		 * Check if outbound buffer has enough space for the data. */
-		if (array_bytes(&My_Connections[Idx].wbuf) + Len >=
+		if (sendq_bytes(&My_Connections[Idx].wbuf) + Len >=
 		    WRITEBUFFER_FLUSH_LEN) {
 			/* Buffer is full, flush it. Handle_Write deals with
 			 * low-level errors, if any. */
@@ -997,18 +1354,29 @@ Conn_Write( CONN_ID Idx, char *Data, size_t Len )
 
 		/* When the write buffer is still too big after flushing it,
 		 * the connection will be killed. */
-		if (array_bytes(&My_Connections[Idx].wbuf) + Len >=
+		if (sendq_bytes(&My_Connections[Idx].wbuf) + Len >=
 		    writebuf_limit) {
 			Log(LOG_NOTICE,
 			    "Write buffer space exhausted (connection %d, limit is %lu bytes, %lu bytes new, %lu bytes pending)",
 			    Idx, writebuf_limit, Len,
-			    (unsigned long)array_bytes(&My_Connections[Idx].wbuf));
+			    (unsigned long)sendq_bytes(&My_Connections[Idx].wbuf));
 			Conn_Close(Idx, "Write buffer space exhausted", NULL, false);
 			return false;
 		}
 
-		/* Copy data to write buffer */
-		if (!array_catb(&My_Connections[Idx].wbuf, Data, Len))
+#ifdef SSL_SUPPORT
+		/* SSL records are written one chunk at a time, so don't
+		 * send each shared message as a record of its own. */
+		if (Conn_OPTION_ISSET(&My_Connections[Idx], CONN_SSL))
+			Shared = NULL;
+#endif
+		/* Queue shared block or copy data to write buffer */
+		if (Shared)
+			ok = sendq_append_block(&My_Connections[Idx].wbuf,
+						Shared);
+		else
+			ok = sendq_append(&My_Connections[Idx].wbuf, Data, Len);
+		if (!ok)
 			return false;
 
 		My_Connections[Idx].bytes_out += Len;
@@ -1017,6 +1385,9 @@ Conn_Write( CONN_ID Idx, char *Data, size_t Len )
 	/* Adjust global write counter */
 	WCounter += Len;
 
+	/* Make sure the write buffer gets flushed by Conn_Handler() */
+	Conn_Activate(Idx);
+
 	return true;
 } /* Conn_Write */
 
@@ -1034,8 +1405,8 @@ Conn_Write( CONN_ID Idx, char *Data, size_t Len )
 GLOBAL void
 Conn_Close(CONN_ID Idx, const char *LogMsg, const char *FwdMsg, bool InformClient)
 {
-	/* Close connection. Open pipes of asynchronous resolver
-	 * sub-processes are closed down. */
+	/* Close connection. Pending lookups of the asynchronous
+	 * resolver are cancelled. */
 
 	CLIENT *c;
 	double in_k, out_k;
@@ -1103,6 +1474,12 @@ Conn_Close(CONN_ID Idx, const char *LogMsg, const char *FwdMsg, bool InformClien
 		ConnSSL_Free(&My_Connections[Idx]);
 	}
 #endif
+	Resolve_Cancel(&My_Connections[Idx].res_stat);
+	Burst_Cancel(Idx);
+#ifdef PAM
+	PAM_Cancel(&My_Connections[Idx].auth_stat);
+#endif
+
 	/* Shut down socket */
 	if (! io_close(My_Connections[Idx].sock)) {
 		/* Oops, we can't close the socket!? This is ... ugly! */
@@ -1114,6 +1491,7 @@ Conn_Close(CONN_ID Idx, const char *LogMsg, const char *FwdMsg, bool InformClien
 
 	/* Mark socket as invalid: */
 	My_Connections[Idx].sock = NONE;
+	Addr_Account(&My_Connections[Idx].addr, -1);
 
 	/* If there is still a client, unregister it now */
 	if (c)
@@ -1163,8 +1541,11 @@ Conn_Close(CONN_ID Idx, const char *LogMsg, const char *FwdMsg, bool InformClien
 	}
 #endif
 
+	Timer_Free(My_Connections[Idx].timer);
+	My_Connections[Idx].timer = NULL;
+
 	array_free(&My_Connections[Idx].rbuf);
-	array_free(&My_Connections[Idx].wbuf);
+	sendq_free(&My_Connections[Idx].wbuf);
 	if (My_Connections[Idx].pwd != NULL)
 		free(My_Connections[Idx].pwd);
 
@@ -1213,6 +1594,34 @@ Conn_CountAccepted(void)
 	return NumConnectionsAccepted;
 } /* Conn_CountAccepted */
 
+/**
+ * Get statistics of accepting new connections as text.
+ *
+ * @param Buf	Buffer for the text.
+ * @param Len	Size of the buffer.
+ * @returns	Pointer to the buffer.
+ */
+GLOBAL char *
+Conn_AcceptStats(char *Buf, size_t Len)
+{
+	char drops[24];
+	long dropped;
+
+	dropped = Listen_Drops();
+	if (dropped < 0)
+		strlcpy(drops, "unknown", sizeof(drops));
+	else
+		snprintf(drops, sizeof(drops), "%ld", dropped);
+
+	snprintf(Buf, Len,
+		 "%lu accepted, %lu refused, %s dropped by the kernel (backlog full); %lu accept loops, max %lu per loop, %lu loops hit the limit of %d",
+		 (unsigned long)NumConnectionsAccepted,
+		 (unsigned long)NumConnectionsRefused, drops,
+		 (unsigned long)NumAcceptLoops, (unsigned long)NumAcceptsMax,
+		 (unsigned long)NumAcceptLoopsFull, MAX_ACCEPTS);
+	return Buf;
+} /* Conn_AcceptStats */
+
 /**
  * Synchronize established connections and configured server structures
  * after a configuration update and store the correct connection IDs, if any.
@@ -1242,6 +1651,9 @@ Conn_SyncServerStruct(void)
 				Conf_Server[c].conn_id = i;
 		}
 	}
+
+	/* The server configuration has been (re-)read */
+	Conn_ScheduleServerCheck();
 } /* SyncServerStruct */
 
 /**
@@ -1266,8 +1678,10 @@ Conn_GetIPAInfo(CONN_ID Idx)
 static bool
 Handle_Write( CONN_ID Idx )
 {
+	struct iovec iov[SENDQ_IOV_MAX];
 	ssize_t len;
 	size_t wdatalen;
+	int cnt;
 
 	assert( Idx > NONE );
 	if ( My_Connections[Idx].sock < 0 ) {
@@ -1276,7 +1690,7 @@ Handle_Write( CONN_ID Idx )
 	}
 	assert( My_Connections[Idx].sock > NONE );
 
-	wdatalen = array_bytes(&My_Connections[Idx].wbuf );
+	wdatalen = sendq_bytes(&My_Connections[Idx].wbuf);
 
 #ifdef ZLIB
 	if (wdatalen == 0) {
@@ -1286,7 +1700,7 @@ Handle_Write( CONN_ID Idx )
 			return false;
 
 		/* Now the write buffer most probably has changed: */
-		wdatalen = array_bytes(&My_Connections[Idx].wbuf);
+		wdatalen = sendq_bytes(&My_Connections[Idx].wbuf);
 	}
 #endif
 
@@ -1304,18 +1718,24 @@ Handle_Write( CONN_ID Idx )
 
 #ifdef SSL_SUPPORT
 	if ( Conn_OPTION_ISSET( &My_Connections[Idx], CONN_SSL )) {
-		len = ConnSSL_Write(&My_Connections[Idx],
-				    array_start(&My_Connections[Idx].wbuf),
+		/* SSL records are written one chunk at a time */
+		sendq_iovec(&My_Connections[Idx].wbuf, iov, 1, &wdatalen);
+		len = ConnSSL_Write(&My_Connections[Idx], iov[0].iov_base,
 				    wdatalen);
 	} else
 #endif
 	{
-		len = write(My_Connections[Idx].sock,
-			    array_start(&My_Connections[Idx].wbuf), wdatalen );
+		cnt = sendq_iovec(&My_Connections[Idx].wbuf, iov,
+				  SENDQ_IOV_MAX, &wdatalen);
+		len = writev(My_Connections[Idx].sock, iov, cnt);
 	}
 	if( len < 0 ) {
-		if (errno == EAGAIN || errno == EINTR)
+		if (errno == EAGAIN || errno == EINTR) {
+			if (errno == EAGAIN)
+				io_event_exhausted(My_Connections[Idx].sock,
+						   IO_WANTWRITE);
 			return true;
+		}
 
 		if (!Conn_OPTION_ISSET(&My_Connections[Idx], CONN_ISCLOSING)) {
 			Log(LOG_ERR,
@@ -1329,38 +1749,190 @@ Handle_Write( CONN_ID Idx )
 		return false;
 	}
 
-	/* move any data not yet written to beginning */
-	array_moveleft(&My_Connections[Idx].wbuf, 1, (size_t)len);
+	/* Not all data could be written: the socket buffer is full. */
+	if ((size_t)len < wdatalen)
+		io_event_exhausted(My_Connections[Idx].sock, IO_WANTWRITE);
+
+	sendq_consume(&My_Connections[Idx].wbuf, (size_t)len);
+
+	/* Continue the server burst, if any, see Conn_Handler() */
+	if (Conn_OPTION_ISSET(&My_Connections[Idx], CONN_BURST))
+		Conn_Activate(Idx);
 
 	return true;
 } /* Handle_Write */
 
 /**
- * Count established connections to a specific IP address.
+ * Build the keys of an IP address in the connection address hash.
  *
- * @returns	Number of established connections.
+ * IPv6 addresses are counted per /64 network, too, as a single host
+ * usually can use all addresses of such a network.
+ *
+ * @param Addr	The IP address.
+ * @param Keys	Receives the keys.
+ * @returns	Number of keys: 1 or 2 (IPv6 address and network).
  */
 static int
-Count_Connections(ng_ipaddr_t *a)
+Addr_Keys(const ng_ipaddr_t *Addr, UINT8 Keys[2][ADDR_KEY_LEN])
 {
-	int i, cnt;
+	memset(Keys, 0, 2 * ADDR_KEY_LEN);
+#ifdef WANT_IPV6
+	if (ng_ipaddr_af(Addr) == AF_INET6) {
+		Keys[0][0] = ADDR_KEY_IPV6;
+		memcpy(&Keys[0][1], Addr->sin6.sin6_addr.s6_addr, 16);
+		/* Don't put all IPv4-mapped addresses into one network */
+		if (IN6_IS_ADDR_V4MAPPED(&Addr->sin6.sin6_addr))
+			return 1;
+		Keys[1][0] = ADDR_KEY_NET64;
+		memcpy(&Keys[1][1], Addr->sin6.sin6_addr.s6_addr, 8);
+		return 2;
+	}
+#endif
+	Keys[0][0] = ADDR_KEY_IPV4;
+	memcpy(&Keys[0][1], &Addr->sin4.sin_addr.s_addr, 4);
+	return 1;
+} /* Addr_Keys */
 
-	cnt = 0;
-	for (i = 0; i < Pool_Size; i++) {
-		if (My_Connections[i].sock <= NONE)
-			continue;
-		if (ng_ipaddr_ipequal(&My_Connections[i].addr, a))
-			cnt++;
+/**
+ * Look up a key in the connection address hash.
+ *
+ * @param Key		The key.
+ * @param HashValue	Hash value of the key.
+ * @returns		Counter of the key or NULL if there is none.
+ */
+static ADDR_COUNT *
+Addr_Find(const UINT8 *Key, UINT32 HashValue)
+{
+	HASH_ITEM *item;
+	ADDR_COUNT *ac;
+
+	for (item = Hash_TableFirst(&Addr_Counts, HashValue); item;
+	     item = Hash_TableNext(item)) {
+		ac = (ADDR_COUNT *)item->data;
+		if (memcmp(ac->key, Key, ADDR_KEY_LEN) == 0)
+			return ac;
+	}
+	return NULL;
+} /* Addr_Find */
+
+/**
+ * Update the number of connections from an IP address.
+ *
+ * @param Addr	The IP address.
+ * @param Diff	1 for a new connection, -1 for a closed one.
+ */
+static void
+Addr_Account(const ng_ipaddr_t *Addr, long Diff)
+{
+	UINT8 keys[2][ADDR_KEY_LEN];
+	ADDR_COUNT *ac;
+	UINT32 hash;
+	int i, n;
+
+	n = Addr_Keys(Addr, keys);
+	for (i = 0; i < n; i++) {
+		hash = Hash_Bytes(keys[i], ADDR_KEY_LEN);
+		ac = Addr_Find(keys[i], hash);
+		if (!ac) {
+			if (Diff < 0)
+				continue;
+			ac = (ADDR_COUNT *)calloc(1, sizeof(ADDR_COUNT));
+			if (!ac) {
+				Log(LOG_EMERG, "Can't allocate memory! [Addr_Account]");
+				continue;
+			}
+			memcpy(ac->key, keys[i], ADDR_KEY_LEN);
+			Hash_TableAdd(&Addr_Counts, &ac->item, hash, ac);
+		}
+		ac->count += Diff;
+		if (ac->count <= 0) {
+			Hash_TableRemove(&Addr_Counts, &ac->item);
+			free(ac);
+		}
+	}
+} /* Addr_Account */
+
+/**
+ * Count established connections to a specific IP address.
+ *
+ * @param a		The IP address.
+ * @param NetCount	Receives the number of established connections from
+ *			the IPv6 /64 network of the address, or 0.
+ * @returns		Number of established connections.
+ */
+static long
+Count_Connections(const ng_ipaddr_t *a, long *NetCount)
+{
+	UINT8 keys[2][ADDR_KEY_LEN];
+	ADDR_COUNT *ac;
+	long cnt = 0;
+	int n;
+
+	*NetCount = 0;
+	n = Addr_Keys(a, keys);
+	ac = Addr_Find(keys[0], Hash_Bytes(keys[0], ADDR_KEY_LEN));
+	if (ac)
+		cnt = ac->count;
+	if (n > 1) {
+		ac = Addr_Find(keys[1], Hash_Bytes(keys[1], ADDR_KEY_LEN));
+		if (ac)
+			*NetCount = ac->count;
 	}
 	return cnt;
 } /* Count_Connections */
 
+/**
+ * Accept a new connection on a listening socket.
+ *
+ * accept4() is used when available, so that the new socket is created in
+ * non-blocking and close-on-exec mode right away. Some kernels and C
+ * libraries declare it but don't support it (ENOSYS or EINVAL): then
+ * accept() is used from now on.
+ *
+ * @param Sock		Listening socket descriptor.
+ * @param Addr		Receives the address of the peer.
+ * @param NonBlocking	Set to true if the new socket is non-blocking.
+ * @returns		New socket descriptor or -1 on error (see errno).
+ */
+static int
+Accept_Socket(int Sock, ng_ipaddr_t *Addr, bool *NonBlocking)
+{
+	socklen_t len;
+	int fd;
+#ifdef HAVE_ACCEPT4
+	static bool no_accept4 = false;
+
+	if (!no_accept4) {
+		len = (socklen_t)sizeof(*Addr);
+		fd = accept4(Sock, (struct sockaddr *)Addr, &len,
+			     SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd >= 0 || (errno != ENOSYS && errno != EINVAL)) {
+			*NonBlocking = true;
+			return fd;
+		}
+		Log(LOG_WARNING,
+		    "accept4() on socket %d failed: %s - using accept() from now on.",
+		    Sock, strerror(errno));
+		no_accept4 = true;
+	}
+#endif
+	*NonBlocking = false;
+	len = (socklen_t)sizeof(*Addr);
+	fd = accept(Sock, (struct sockaddr *)Addr, &len);
+	if (fd >= 0 && !io_setcloexec(fd))
+		LogDebug("Can't set close-on-exec flag of socket %d: %s",
+			 fd, strerror(errno));
+	return fd;
+} /* Accept_Socket */
+
 /**
  * Initialize new client connection on a listening socket.
  *
  * @param Sock	Listening socket descriptor.
  * @param IsSSL	true if this socket expects SSL-encrypted data.
- * @returns	Accepted socket descriptor or -1 on error.
+ * @returns	Accepted socket descriptor, -1 on error or if the connection
+ *		has been refused, or BACKLOG_EMPTY if there is no pending
+ *		connection (left).
  */
 static int
 New_Connection(int Sock, UNUSED bool IsSSL)
@@ -1370,21 +1942,24 @@ New_Connection(int Sock, UNUSED bool IsSSL)
 #endif
 	ng_ipaddr_t new_addr;
 	char ip_str[NG_INET_ADDRSTRLEN];
-	int new_sock, new_sock_len;
+	int new_sock;
 	CLIENT *c;
-	long cnt;
+	long cnt, net_cnt;
+	bool ok, nonblock;
 
 	assert(Sock > NONE);
 
 	LogDebug("Accepting new connection on socket %d ...", Sock);
 
-	new_sock_len = (int)sizeof(new_addr);
-	new_sock = accept(Sock, (struct sockaddr *)&new_addr,
-			  (socklen_t *)&new_sock_len);
+	new_sock = Accept_Socket(Sock, &new_addr, &nonblock);
 	if (new_sock < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return BACKLOG_EMPTY;
+		if (errno == EINTR || errno == ECONNABORTED)
+			return -1;
 		Log(LOG_CRIT, "Can't accept connection on socket %d: %s!",
 		    Sock, strerror(errno));
-		return -1;
+		return BACKLOG_EMPTY;
 	}
 	NumConnectionsAccepted++;
 
@@ -1406,11 +1981,12 @@ New_Connection(int Sock, UNUSED bool IsSSL)
 		    ip_str, Sock);
 		Simple_Message(new_sock, "ERROR :Connection refused");
 		close(new_sock);
+		NumConnectionsRefused++;
 		return -1;
 	}
 #endif
 
-	if (!Init_Socket(new_sock))
+	if (!Init_Socket(new_sock, nonblock))
 		return -1;
 
 	/* Check global connection limit */
@@ -1420,11 +1996,12 @@ New_Connection(int Sock, UNUSED bool IsSSL)
 		    Sock, Conf_MaxConnections);
 		Simple_Message(new_sock, "ERROR :Connection limit reached");
 		close(new_sock);
+		NumConnectionsRefused++;
 		return -1;
 	}
 
-	/* Check IP-based connection limit */
-	cnt = Count_Connections(&new_addr);
+	/* Check IP-based connection limits */
+	cnt = Count_Connections(&new_addr, &net_cnt);
 	if ((Conf_MaxConnectionsIP > 0) && (cnt >= Conf_MaxConnectionsIP)) {
 		/* Access denied, too many connections from this IP address! */
 		Log(LOG_ERR,
@@ -1433,6 +2010,18 @@ New_Connection(int Sock, UNUSED bool IsSSL)
 		Simple_Message(new_sock,
 			       "ERROR :Connection refused, too many connections from your IP address");
 		close(new_sock);
+		NumConnectionsRefused++;
+		return -1;
+	}
+	if ((Conf_MaxConnectionsIPv6Net > 0) && (net_cnt >= Conf_MaxConnectionsIPv6Net)) {
+		/* Access denied, too many connections from this network! */
+		Log(LOG_ERR,
+		    "Refused connection from %s on socket %d: too may connections (%ld) from this IPv6 network!",
+		    ip_str, Sock, net_cnt);
+		Simple_Message(new_sock,
+			       "ERROR :Connection refused, too many connections from your network");
+		close(new_sock);
+		NumConnectionsRefused++;
 		return -1;
 	}
 
@@ -1442,8 +2031,16 @@ New_Connection(int Sock, UNUSED bool IsSSL)
 		return -1;
 	}
 
-	/* register callback */
-	if (!io_event_create(new_sock, IO_WANTREAD, cb_clientserver)) {
+	/* register callback; plain text connections can use edge-triggered
+	 * notifications, SSL/TLS ones can't, as the library buffers data */
+#ifdef SSL_SUPPORT
+	if (IsSSL)
+		ok = io_event_create(new_sock, IO_WANTREAD, cb_clientserver);
+	else
+#endif
+		ok = io_event_create_edge(new_sock, IO_WANTREAD,
+					  cb_clientserver);
+	if (!ok) {
 		Log(LOG_ALERT,
 		    "Can't accept connection: io_event_create failed!");
 		Simple_Message(new_sock, "ERROR :Internal error");
@@ -1463,6 +2060,7 @@ New_Connection(int Sock, UNUSED bool IsSSL)
 	Init_Conn_Struct(new_sock);
 	My_Connections[new_sock].sock = new_sock;
 	My_Connections[new_sock].addr = new_addr;
+	Addr_Account(&new_addr, 1);
 	My_Connections[new_sock].client = c;
 
 	/* Set initial hostname to IP address. This becomes overwritten when
@@ -1481,6 +2079,11 @@ New_Connection(int Sock, UNUSED bool IsSSL)
 	    ng_ipaddr_getport(&new_addr), Sock);
 	Account_Connection();
 
+	if (!Start_Connection_Timer(new_sock)) {
+		Conn_Close(new_sock, "Internal error", NULL, false);
+		return -1;
+	}
+
 #ifdef SSL_SUPPORT
 	/* Delay connection initialization until SSL handshake is finished */
 	if (!IsSSL)
@@ -1491,7 +2094,11 @@ New_Connection(int Sock, UNUSED bool IsSSL)
 } /* New_Connection */
 
 /**
- * Finish connection initialization, start resolver subprocess.
+ * Finish connection initialization, look up host name and IDENT user name.
+ *
+ * Without IDENT lookup, the login continues in the main loop, see
+ * Continue_Login(): the result can be available immediately, and handling
+ * it can close the connection, which the callers still use.
  *
  * @param Idx Connection index.
  */
@@ -1502,6 +2109,8 @@ Conn_StartLogin(CONN_ID Idx)
 
 	assert(Idx >= 0);
 
+	Conn_Activate(Idx);
+
 #ifdef IDENTAUTH
 	/* Should we make an IDENT request? */
 	if (Conf_Ident)
@@ -1533,11 +2142,91 @@ Conn_StartLogin(CONN_ID Idx)
 			return;
 	}
 
-	Resolve_Addr_Ident(&My_Connections[Idx].proc_stat,
-			   &My_Connections[Idx].addr,
-			   ident_sock, cb_Read_Resolver_Result);
+	if (ident_sock < 0) {
+		Conn_OPTION_ADD(&My_Connections[Idx], CONN_LOGIN);
+		return;
+	}
+
+	Resolve_Addr_Ident(&My_Connections[Idx].res_stat,
+			   &My_Connections[Idx].addr, ident_sock,
+			   Lookup_Cached(Idx), Idx, cb_Read_Resolver_Result);
 }
 
+/**
+ * Continue the login of a connection without IDENT lookup in the main loop,
+ * see Conn_StartLogin().
+ *
+ * @param Idx Connection index.
+ */
+static void
+Continue_Login(CONN_ID Idx)
+{
+	const char *host;
+
+	Conn_OPTION_DEL(&My_Connections[Idx], CONN_LOGIN);
+
+	/* Is the host name of this address still known? Then no DNS lookup
+	 * is required, and nothing is to be done. */
+	host = Conf_DNS ? Lookup_Cached(Idx) : "";
+	if (host)
+		cb_Read_Resolver_Result(Idx, host, "");
+	else
+		Resolve_Addr_Ident(&My_Connections[Idx].res_stat,
+				   &My_Connections[Idx].addr, -1, NULL, Idx,
+				   cb_Read_Resolver_Result);
+} /* Continue_Login */
+
+/**
+ * Look up the host name of the address of a connection in the resolver
+ * cache.
+ *
+ * @param Idx Connection index.
+ * @returns Host name (in a static buffer) or NULL if it isn't cached or
+ *	    DNS lookups are disabled.
+ */
+static const char *
+Lookup_Cached(CONN_ID Idx)
+{
+	static char host[CLIENT_HOST_LEN];
+
+	if (!Conf_DNS || !Resolve_Cached(&My_Connections[Idx].addr, host,
+					 sizeof(host)))
+		return NULL;
+	return host;
+} /* Lookup_Cached */
+
+/**
+ * Start the server burst on a server link.
+ *
+ * The burst is generated by Burst_Continue() in parts, whenever the write
+ * buffer of the connection runs low, see Conn_Handler().
+ *
+ * @param Idx Connection index.
+ */
+GLOBAL void
+Conn_StartBurst(CONN_ID Idx)
+{
+	assert(Idx > NONE);
+
+	Conn_OPTION_ADD(&My_Connections[Idx], CONN_BURST);
+	Conn_Activate(Idx);
+} /* Conn_StartBurst */
+
+/**
+ * Continue the server burst on a server link.
+ *
+ * @param Idx Connection index.
+ */
+static void
+Continue_Burst(CONN_ID Idx)
+{
+	if (Burst_Continue(Idx))
+		return;
+
+	/* Burst is complete (or the connection has been closed) */
+	Conn_OPTION_DEL(&My_Connections[Idx], CONN_BURST);
+} /* Continue_Burst */
+
 /**
  * Update global connection counters.
  */
@@ -1596,7 +2285,6 @@ static void
 Read_Request(CONN_ID Idx)
 {
 	ssize_t len;
-	static const unsigned int maxbps = COMMAND_LEN / 2;
 	char readbuf[READBUFFER_LEN];
 	time_t t;
 	CLIENT *c;
@@ -1639,8 +2327,11 @@ Read_Request(CONN_ID Idx)
 	}
 
 	if (len < 0) {
-		if (errno == EAGAIN)
+		if (errno == EAGAIN) {
+			io_event_exhausted(My_Connections[Idx].sock,
+					   IO_WANTREAD);
 			return;
+		}
 
 		Log(LOG_ERR, "Read error on connection %d (socket %d): %s!",
 		    Idx, My_Connections[Idx].sock, strerror(errno));
@@ -1649,6 +2340,10 @@ Read_Request(CONN_ID Idx)
 		return;
 	}
 
+	/* Less data than requested: the socket has been drained. */
+	if ((size_t)len < sizeof(readbuf))
+		io_event_exhausted(My_Connections[Idx].sock, IO_WANTREAD);
+
 	/* Now append the newly received data to the connection buffer.
 	 * NOTE: This can lead to connection read buffers being bigger(!) than
 	 * READBUFFER_LEN bytes, as we add up to READBUFFER_LEN new bytes to a
@@ -1680,7 +2375,7 @@ Read_Request(CONN_ID Idx)
 	My_Connections[Idx].bytes_in += len;
 
 	/* Handle read buffer */
-	My_Connections[Idx].bps += Handle_Buffer(Idx);
+	Handle_Buffer(Idx);
 
 	/* Make sure that there is still a valid client registered */
 	c = Conn_GetClient(Idx);
@@ -1696,38 +2391,76 @@ Read_Request(CONN_ID Idx)
 	    || Client_Type(c) == CLIENT_SERVER
 	    || Client_Type(c) == CLIENT_SERVICE) {
 		t = time(NULL);
-		if (My_Connections[Idx].lastdata != t)
-			My_Connections[Idx].bps = 0;
-
 		My_Connections[Idx].lastdata = t;
 		if (My_Connections[Idx].lastping > t)
 			My_Connections[Idx].lastping = t;
 	}
-
-	/* Look at the data in the (read-) buffer of this connection */
-	if (My_Connections[Idx].bps >= maxbps)
-		Throttle_Connection(Idx, c, THROTTLE_BPS, maxbps);
 } /* Read_Request */
 
+/**
+ * Find the end of the first line in a buffer.
+ *
+ * The buffer is scanned only once, up to the first line terminator.
+ *
+ * @param Buf	Buffer to search.
+ * @param Len	Length of the buffer in bytes.
+ * @param Delta	Receives the length of the line terminator found (1 or 2).
+ * @returns	Pointer to the line terminator or NULL if there is none.
+ */
+static char *
+Find_Line_End(char *Buf, size_t Len, size_t *Delta)
+{
+	char *end = Buf + Len, *ptr;
+
+#ifdef STRICT_RFC
+	/* RFC 2812, section "2.3 Messages", 5th paragraph:
+	 * "IRC messages are always lines of characters terminated
+	 * with a CR-LF (Carriage Return - Line Feed) pair [...]". */
+	while ((ptr = memchr(Buf, '\r', (size_t)(end - Buf)))) {
+		if (ptr + 1 < end && ptr[1] == '\n') {
+			*Delta = 2;
+			return ptr;
+		}
+		Buf = ptr + 1;
+	}
+#else
+	/* Accept non-RFC-compliant requests (only CR or LF), too.
+	 * Unfortunately, there are quite a few clients out there
+	 * that do this -- e. g. mIRC, BitchX, and Trillian :-( */
+	for (ptr = Buf; ptr < end; ptr++) {
+		if (*ptr != '\r' && *ptr != '\n')
+			continue;
+		if (*ptr == '\r' && ptr + 1 < end && ptr[1] == '\n')
+			*Delta = 2;
+		else
+			*Delta = 1;
+		return ptr;
+	}
+#endif
+	return NULL;
+} /* Find_Line_End */
+
 /**
  * Handle all data in the connection read-buffer.
  *
  * Data is processed until no complete command is left in the read buffer,
- * or MAX_COMMANDS[_SERVER|_SERVICE] commands were processed.
+ * MAX_COMMANDS[_SERVER|_SERVICE] commands were processed, or flood control
+ * delays the next command (see Conn_FloodCost()).
  * When a fatal error occurs, the connection is shut down.
  *
+ * Commands are parsed in place: a cursor is advanced over the buffer and
+ * the processed data is removed only once, before returning.
+ *
  * @param Idx	Index of the connection.
  * @returns	Number of bytes processed.
  */
 static unsigned int
 Handle_Buffer(CONN_ID Idx)
 {
-#ifndef STRICT_RFC
-	char *ptr1, *ptr2, *first_eol;
-#endif
-	char *ptr;
-	size_t len, delta;
-	time_t starttime;
+	char *ptr, *start;
+	size_t len, delta, pos = 0, avail;
+	struct timeval now;
+	long cost;
 #ifdef ZLIB
 	bool old_z;
 #endif
@@ -1735,7 +2468,7 @@ Handle_Buffer(CONN_ID Idx)
 	CLIENT *c;
 
 	c = Conn_GetClient(Idx);
-	starttime = time(NULL);
+	Timer_Now(&now);
 
 	assert(c != NULL);
 
@@ -1759,12 +2492,18 @@ Handle_Buffer(CONN_ID Idx)
 	}
 
 	for (i=0; i < maxcmd; i++) {
-		/* Check penalty */
-		if (My_Connections[Idx].delaytime > starttime)
-			return 0;
+		/* Check flood control and penalty */
+		if (Conn_FloodWait(Idx, &now) > 0)
+			break;
 #ifdef ZLIB
-		/* Unpack compressed data, if compression is in use */
-		if (Conn_OPTION_ISSET(&My_Connections[Idx], CONN_ZIP)) {
+		/* Unpack compressed data, if compression is in use. Only do
+		 * this when no complete command can be left in the buffer,
+		 * and drop the processed data first, so that the buffer
+		 * doesn't grow while commands are handled. */
+		if (Conn_OPTION_ISSET(&My_Connections[Idx], CONN_ZIP)
+		    && array_bytes(&My_Connections[Idx].rbuf) - pos < COMMAND_LEN) {
+			array_moveleft(&My_Connections[Idx].rbuf, 1, pos);
+			pos = 0;
 			/* When unzipping fails, Unzip_Buffer() shuts
 			 * down the connection itself */
 			if (!Unzip_Buffer(Idx))
@@ -1772,48 +2511,12 @@ Handle_Buffer(CONN_ID Idx)
 		}
 #endif
 
-		if (0 == array_bytes(&My_Connections[Idx].rbuf))
+		if (array_bytes(&My_Connections[Idx].rbuf) <= pos)
 			break;
 
-		/* Make sure that the buffer is NULL terminated */
-		if (!array_cat0_temporary(&My_Connections[Idx].rbuf)) {
-			Conn_Close(Idx, NULL,
-				   "Can't allocate memory [Handle_Buffer]",
-				   true);
-			return 0;
-		}
-
-		/* RFC 2812, section "2.3 Messages", 5th paragraph:
-		 * "IRC messages are always lines of characters terminated
-		 * with a CR-LF (Carriage Return - Line Feed) pair [...]". */
-		delta = 2;
-		ptr = strstr(array_start(&My_Connections[Idx].rbuf), "\r\n");
-
-#ifndef STRICT_RFC
-		/* Check for non-RFC-compliant request (only CR or LF)?
-		 * Unfortunately, there are quite a few clients out there
-		 * that do this -- e. g. mIRC, BitchX, and Trillian :-( */
-		ptr1 = strchr(array_start(&My_Connections[Idx].rbuf), '\r');
-		ptr2 = strchr(array_start(&My_Connections[Idx].rbuf), '\n');
-		if (ptr) {
-			/* Check if there is a single CR or LF _before_ the
-			 * correct CR+LF line terminator:  */
-			first_eol = ptr1 < ptr2 ? ptr1 : ptr2;
-			if (first_eol < ptr) {
-				/* Single CR or LF before CR+LF found */
-				ptr = first_eol;
-				delta = 1;
-			}
-		} else if (ptr1 || ptr2) {
-			/* No CR+LF terminated command found, but single
-			 * CR or LF found ... */
-			if (ptr1 && ptr2)
-				ptr = ptr1 < ptr2 ? ptr1 : ptr2;
-			else
-				ptr = ptr1 ? ptr1 : ptr2;
-			delta = 1;
-		}
-#endif
+		start = (char *)array_start(&My_Connections[Idx].rbuf) + pos;
+		avail = array_bytes(&My_Connections[Idx].rbuf) - pos;
+		ptr = Find_Line_End(start, avail, &delta);
 
 		if (!ptr) {
 			/* No complete command (terminated by CR and/or LF) is
@@ -1829,11 +2532,10 @@ Handle_Buffer(CONN_ID Idx)
 			 * more bytes. So disconnect the client in this case, the
 			 * same way an over-long terminated command is handled
 			 * below: */
-			if (array_bytes(&My_Connections[Idx].rbuf) >= COMMAND_LEN) {
+			if (avail >= COMMAND_LEN) {
 				Log(LOG_ERR,
 				    "Request too long (connection %d): %d bytes without a command terminator (max. %d expected)!",
-				    Idx, array_bytes(&My_Connections[Idx].rbuf),
-				    COMMAND_LEN - 1);
+				    Idx, avail, COMMAND_LEN - 1);
 				Conn_Close(Idx, NULL, "Request too long", true);
 				return 0;
 			}
@@ -1843,24 +2545,23 @@ Handle_Buffer(CONN_ID Idx)
 		/* Complete (=line terminated) request found, handle it! */
 		*ptr = '\0';
 
-		len = ptr - (char *)array_start(&My_Connections[Idx].rbuf) + delta;
+		len = ptr - start + delta;
 
 		if (len > (COMMAND_LEN - 1)) {
 			/* Request must not exceed 512 chars (incl. CR+LF!),
 			 * see RFC 2812. Disconnect Client if this happens. */
 			Log(LOG_ERR,
 			    "Request too long (connection %d): %d bytes (max. %d expected)!",
-			    Idx, array_bytes(&My_Connections[Idx].rbuf),
-			    COMMAND_LEN - 1);
+			    Idx, avail, COMMAND_LEN - 1);
 			Conn_Close(Idx, NULL, "Request too long", true);
 			return 0;
 		}
 
 		len_processed += (unsigned int)len;
+		pos += len;
 		if (len <= delta) {
 			/* Request is empty (only '\r\n', '\r' or '\n');
 			 * delta is 2 ('\r\n') or 1 ('\r' or '\n'), see above */
-			array_moveleft(&My_Connections[Idx].rbuf, 1, len);
 			continue;
 		}
 #ifdef ZLIB
@@ -1868,21 +2569,28 @@ Handle_Buffer(CONN_ID Idx)
 		old_z = My_Connections[Idx].options & CONN_ZIP;
 #endif
 
+		/* Take the costs of the command out of the flood control
+		 * bucket; long commands count twice. The client type can
+		 * change while handling a command, so check it first. */
+		cost = Conn_FloodCost(Idx);
+		if (len >= COMMAND_LEN / 2)
+			cost *= 2;
+		Conn_FloodCharge(Idx, &now, cost);
+
 		My_Connections[Idx].msg_in++;
-		if (!Parse_Request
-		    (Idx, (char *)array_start(&My_Connections[Idx].rbuf)))
+		if (!Parse_Request(Idx, start))
 			return 0; /* error -> connection has been closed */
 
-		array_moveleft(&My_Connections[Idx].rbuf, 1, len);
 #ifdef ZLIB
 		if ((!old_z) && (My_Connections[Idx].options & CONN_ZIP) &&
-		    (array_bytes(&My_Connections[Idx].rbuf) > 0)) {
+		    (array_bytes(&My_Connections[Idx].rbuf) > pos)) {
 			/* The last command activated socket compression.
 			 * Data that was read after that needs to be copied
 			 * to the unzip buffer for decompression: */
-			if (!array_copy
+			if (!array_copyb
 			    (&My_Connections[Idx].zip.rbuf,
-			     &My_Connections[Idx].rbuf)) {
+			     (char *)array_start(&My_Connections[Idx].rbuf) + pos,
+			     array_bytes(&My_Connections[Idx].rbuf) - pos)) {
 				Conn_Close(Idx, NULL,
 					   "Can't allocate memory [Handle_Buffer]",
 					   true);
@@ -1890,95 +2598,164 @@ Handle_Buffer(CONN_ID Idx)
 			}
 
 			array_trunc(&My_Connections[Idx].rbuf);
+			pos = 0;
 			LogDebug
 			    ("Moved already received data (%u bytes) to uncompression buffer.",
 			     array_bytes(&My_Connections[Idx].zip.rbuf));
 		}
 #endif
 	}
+
+	/* Remove all processed data from the read buffer at once */
+	array_moveleft(&My_Connections[Idx].rbuf, 1, pos);
+
 #if DEBUG_BUFFER
 	LogDebug("Connection %d: Processed %ld commands (max=%ld), %ld bytes. %ld bytes left in read buffer.",
 		 Idx, i, maxcmd, len_processed,
 		 array_bytes(&My_Connections[Idx].rbuf));
 #endif
 
-	/* If data has been processed but there is still data in the read
-	 * buffer, the command limit triggered. Enforce the penalty time: */
-	if (len_processed && array_bytes(&My_Connections[Idx].rbuf) > 2)
-		Throttle_Connection(Idx, c, THROTTLE_CMDS, maxcmd);
-
 	return len_processed;
 } /* Handle_Buffer */
 
 /**
- * Check whether established connections are still alive or not.
+ * Check whether an established connection is still alive or not.
  * If not, play PING-PONG first; and if that doesn't help either,
  * disconnect the respective peer.
+ *
+ * This is the callback of the timer of each connection, which is set to
+ * the time of the next check: as "lastdata" is updated without touching
+ * the timer, the timer can expire too early, and is just set again then.
+ * In addition, it activates the connection again when a longer "penalty
+ * time" is over, see Update_Interest().
+ *
+ * @param Idx	Index of the connection.
  */
 static void
-Check_Connections(void)
+Check_Connection(int Idx)
 {
 	CLIENT *c;
-	CONN_ID i;
 	char msg[64];
-	time_t time_now;
-
-	time_now = time(NULL);
+	time_t time_now, next;
+	struct timeval now;
+	long delay;
 
-	for (i = 0; i < Pool_Size; i++) {
-		if (My_Connections[i].sock < 0)
-			continue;
+	if (My_Connections[Idx].sock < 0)
+		return;
 
-		c = Conn_GetClient(i);
-		if (c && ((Client_Type(c) == CLIENT_USER)
-			  || (Client_Type(c) == CLIENT_SERVER)
-			  || (Client_Type(c) == CLIENT_SERVICE))) {
-			/* connected User, Server or Service */
-			if (My_Connections[i].lastping >
-			    My_Connections[i].lastdata) {
-				/* We already sent a ping */
-				if (My_Connections[i].lastping <
-				    time_now - Conf_PongTimeout) {
-					/* Timeout */
-					snprintf(msg, sizeof(msg),
-						 "Ping timeout: %d seconds",
-						 Conf_PongTimeout);
-					LogDebug("Connection %d: %s.", i, msg);
-					Conn_Close(i, NULL, msg, true);
-				}
-			} else if (My_Connections[i].lastdata <
-				   time_now - Conf_PingTimeout) {
-				/* We need to send a PING ... */
-				LogDebug("Connection %d: sending PING ...", i);
-				Conn_UpdatePing(i, time_now);
-				Conn_WriteStr(i, "PING :%s",
-					      Client_ID(Client_ThisServer()));
-			}
-		} else {
-			/* The connection is not fully established yet, so
-			 * we don't do the PING-PONG game here but instead
-			 * disconnect the client after "a short time" if it's
-			 * still not registered. */
+	time_now = time(NULL);
 
-			if (My_Connections[i].lastdata <
+	c = Conn_GetClient(Idx);
+	if (c && ((Client_Type(c) == CLIENT_USER)
+		  || (Client_Type(c) == CLIENT_SERVER)
+		  || (Client_Type(c) == CLIENT_SERVICE))) {
+		/* connected User, Server or Service */
+		if (My_Connections[Idx].lastping >
+		    My_Connections[Idx].lastdata) {
+			/* We already sent a ping */
+			if (My_Connections[Idx].lastping <
 			    time_now - Conf_PongTimeout) {
-				LogDebug
-				    ("Unregistered connection %d timed out ...",
-				     i);
-				Conn_Close(i, NULL, "Timeout", false);
+				/* Timeout */
+				snprintf(msg, sizeof(msg),
+					 "Ping timeout: %d seconds",
+					 Conf_PongTimeout);
+				LogDebug("Connection %d: %s.", Idx, msg);
+				Conn_Close(Idx, NULL, msg, true);
+				return;
 			}
+			next = My_Connections[Idx].lastping
+			       + Conf_PongTimeout + 1;
+		} else if (My_Connections[Idx].lastdata <
+			   time_now - Conf_PingTimeout) {
+			/* We need to send a PING ... */
+			LogDebug("Connection %d: sending PING ...", Idx);
+			Conn_UpdatePing(Idx, time_now);
+			Conn_WriteStr(Idx, "PING :%s",
+				      Client_ID(Client_ThisServer()));
+			next = time_now + Conf_PongTimeout + 1;
+		} else
+			next = My_Connections[Idx].lastdata
+			       + Conf_PingTimeout + 1;
+	} else {
+		/* The connection is not fully established yet, so
+		 * we don't do the PING-PONG game here but instead
+		 * disconnect the client after "a short time" if it's
+		 * still not registered. */
+
+		if (My_Connections[Idx].lastdata <
+		    time_now - Conf_PongTimeout) {
+			LogDebug
+			    ("Unregistered connection %d timed out ...",
+			     Idx);
+			Conn_Close(Idx, NULL, "Timeout", false);
+			return;
 		}
+		next = My_Connections[Idx].lastdata + Conf_PongTimeout + 1;
 	}
-} /* Check_Connections */
+
+	/* Sending the PING could have failed and closed the connection! */
+	if (My_Connections[Idx].sock < 0)
+		return;
+
+	Timer_Now(&now);
+	delay = Conn_FloodWait(Idx, &now);
+	if (delay > 0) {
+		if (time_now + (delay + 999) / 1000 < next)
+			next = time_now + (delay + 999) / 1000;
+	} else
+		Conn_Activate(Idx);
+
+	Timer_Set(My_Connections[Idx].timer, next);
+} /* Check_Connection */
+
+/**
+ * Create and set the timer of a new connection, see Check_Connection().
+ *
+ * @param Idx	Index of the connection.
+ * @returns	true on success, false if out of memory.
+ */
+static bool
+Start_Connection_Timer(CONN_ID Idx)
+{
+	assert(My_Connections[Idx].timer == NULL);
+
+	My_Connections[Idx].timer = Timer_New(Check_Connection, Idx);
+	if (!My_Connections[Idx].timer)
+		return false;
+
+	Timer_Set(My_Connections[Idx].timer,
+		  My_Connections[Idx].lastdata + Conf_PongTimeout + 1);
+	return true;
+} /* Start_Connection_Timer */
+
+/**
+ * Check the configured servers as soon as possible, for example because a
+ * server link has been closed or the configuration changed: the server link
+ * timer expires "now" and is run in the next iteration of the main loop,
+ * see Timer_Run().
+ */
+GLOBAL void
+Conn_ScheduleServerCheck(void)
+{
+	if (My_ServersTimer)
+		Timer_SetEarlier(My_ServersTimer, time(NULL));
+} /* Conn_ScheduleServerCheck */
 
 /**
  * Check if further server links should be established.
+ *
+ * This is the callback of the server link timer, which is set to the time
+ * of the next connection attempt afterwards. Changes of the server
+ * configuration and closed server links are handled by calling
+ * Conn_ScheduleServerCheck().
+ *
+ * @param Unused	Unused.
  */
 static void
-Check_Servers(void)
+Check_Servers(UNUSED int Unused)
 {
 	int i, n;
-	time_t time_now;
+	time_t time_now, next = 0;
 
 	time_now = time(NULL);
 
@@ -1990,8 +2767,14 @@ Check_Servers(void)
 			continue;	/* No host and/or port configured */
 		if (Conf_Server[i].flags & CONF_SFLAG_DISABLED)
 			continue;	/* Disabled configuration entry */
-		if (Conf_Server[i].lasttry > (time_now - Conf_ConnectRetry))
-			continue;	/* We have to wait a little bit ... */
+		if (Conf_Server[i].lasttry > (time_now - Conf_ConnectRetry)) {
+			/* We have to wait a little bit ... */
+			if (!next || Conf_Server[i].lasttry
+				     + Conf_ConnectRetry < next)
+				next = Conf_Server[i].lasttry
+				       + Conf_ConnectRetry;
+			continue;
+		}
 
 		/* Is there already a connection in this group? */
 		if (Conf_Server[i].group > NONE) {
@@ -2012,13 +2795,21 @@ Check_Servers(void)
 		    Conf_Server[i].name);
 		Conf_Server[i].lasttry = time_now;
 		Conf_Server[i].conn_id = SERVER_WAIT;
-		assert(Proc_GetPipeFd(&Conf_Server[i].res_stat) < 0);
+		assert(!Resolve_InProgress(&Conf_Server[i].res_stat));
 
-		/* Start resolver subprocess ... */
+		/* Start resolver ... */
 		if (!Resolve_Name(&Conf_Server[i].res_stat, Conf_Server[i].host,
-				  cb_Connect_to_Server))
+				  i, cb_Connect_to_Server))
 			Conf_Server[i].conn_id = NONE;
+
+		/* Check again when the next attempt would be due, in case
+		 * this one fails before a server link is established. */
+		if (!next || time_now + Conf_ConnectRetry < next)
+			next = time_now + Conf_ConnectRetry;
 	}
+
+	if (next)
+		Timer_Set(My_ServersTimer, next);
 } /* Check_Servers */
 
 /**
@@ -2066,7 +2857,7 @@ New_Server( int Server , ng_ipaddr_t *dest)
 		return;
 	}
 
-	if (!Init_Socket(new_sock)) {
+	if (!Init_Socket(new_sock, false)) {
 		Conf_Server[Server].conn_id = NONE;
 		return;
 	}
@@ -2129,10 +2920,17 @@ New_Server( int Server , ng_ipaddr_t *dest)
 		return;
 	My_Connections[new_sock].sock = new_sock;
 	My_Connections[new_sock].addr = *dest;
+	Addr_Account(dest, 1);
 	My_Connections[new_sock].client = c;
 	strlcpy( My_Connections[new_sock].host, Conf_Server[Server].host,
 				sizeof(My_Connections[new_sock].host ));
 
+	if (!Start_Connection_Timer(new_sock)) {
+		Conn_Close(new_sock, "Could not initialize timer for outgoing connection",
+			   NULL, false);
+		return;
+	}
+
 #ifdef SSL_SUPPORT
 	if (Conf_Server[Server].SSLConnect &&
 	    !ConnSSL_PrepareConnect(&My_Connections[new_sock], &Conf_Server[Server]))
@@ -2159,13 +2957,19 @@ static void
 Init_Conn_Struct(CONN_ID Idx)
 {
 	time_t now = time(NULL);
+	bool active;
+
+	/* A closed connection can still be listed as "active" until the
+	 * next iteration of Conn_Handler(), so keep this flag! */
+	active = My_Connections[Idx].active;
 
 	memset(&My_Connections[Idx], 0, sizeof(CONNECTION));
+	My_Connections[Idx].active = active;
 	My_Connections[Idx].sock = -1;
 	My_Connections[Idx].signon = now;
 	My_Connections[Idx].lastdata = now;
 	My_Connections[Idx].lastprivmsg = now;
-	Proc_InitStruct(&My_Connections[Idx].proc_stat);
+	Resolve_InitStruct(&My_Connections[Idx].res_stat);
 
 #ifdef ICONV
 	My_Connections[Idx].iconv_from = (iconv_t)(-1);
@@ -2179,15 +2983,16 @@ Init_Conn_Struct(CONN_ID Idx)
  * For example, we try to set socket options SO_REUSEADDR and IPTOS_LOWDELAY.
  * The socket is automatically closed if a fatal error is encountered.
  *
- * @param Sock	Socket handle.
+ * @param Sock		Socket handle.
+ * @param IsNonBlocking	true if the socket already is in non-blocking mode.
  * @returns false if socket was closed due to fatal error.
  */
 static bool
-Init_Socket( int Sock )
+Init_Socket(int Sock, bool IsNonBlocking)
 {
 	int value;
 
-	if (!io_setnonblock(Sock)) {
+	if (!IsNonBlocking && !io_setnonblock(Sock)) {
 		Log(LOG_CRIT, "Can't enable non-blocking mode for socket: %s!",
 		    strerror(errno));
 		close(Sock);
@@ -2220,115 +3025,72 @@ Init_Socket( int Sock )
 } /* Init_Socket */
 
 /**
- * Read results of a resolver sub-process and try to initiate a new server
- * connection.
+ * Handle results of the resolver and try to initiate a new server connection.
  *
- * @param fd		File descriptor of the pipe to the sub-process.
- * @param events	(ignored IO specification)
+ * @param Token		Configuration index of the server.
+ * @param Addrs		IP addresses of the server.
+ * @param Count		Number of IP addresses.
  */
 static void
-cb_Connect_to_Server(int fd, UNUSED short events)
+cb_Connect_to_Server(int Token, const ng_ipaddr_t *Addrs, size_t Count)
 {
-	int i;
-	size_t len;
-
-	/* we can handle at most 3 addresses; but we read up to 4 so we can
-	 * log the 'more than we can handle' condition. First result is tried
-	 * immediately, rest is saved for later if needed. */
-	ng_ipaddr_t dest_addrs[4];
-
-	LogDebug("Resolver: Got forward lookup callback on fd %d, events %d",
-		 fd, events);
+	int i = Token;
 
-	for (i=0; i < MAX_SERVERS; i++) {
-		  if (Proc_GetPipeFd(&Conf_Server[i].res_stat) == fd )
-			  break;
-	}
+	/* First result is tried immediately, rest is saved for later if
+	 * needed; but we can handle at most 3 addresses. */
+	LogDebug("Resolver: Got forward lookup result for server %d: %u address(es).",
+		 i, (unsigned int)Count);
 
-	if( i >= MAX_SERVERS) {
-		/* Ops, no matching server found?! */
-		io_close( fd );
+	assert(i >= 0 && i < MAX_SERVERS);
+	if (Conf_Server[i].conn_id != SERVER_WAIT) {
 		LogDebug("Resolver: Got Forward Lookup callback for unknown server!?");
 		return;
 	}
 
-	/* Read result from pipe */
-	len = Proc_Read(&Conf_Server[i].res_stat, dest_addrs, sizeof(dest_addrs));
-	Proc_Close(&Conf_Server[i].res_stat);
-	if (len == 0) {
+	if (Count == 0) {
 		/* Error resolving hostname: reset server structure */
 		Conf_Server[i].conn_id = NONE;
 		return;
 	}
 
-	assert((len % sizeof(ng_ipaddr_t)) == 0);
-
-	LogDebug("Got result from resolver: %u structs (%u bytes).",
-		 len/sizeof(ng_ipaddr_t), len);
-
 	memset(&Conf_Server[i].dst_addr, 0, sizeof(Conf_Server[i].dst_addr));
-	if (len > sizeof(ng_ipaddr_t)) {
+	if (Count > 1) {
 		/* more than one address for this hostname, remember them
 		 * in case first address is unreachable/not available */
-		len -= sizeof(ng_ipaddr_t);
-		if (len > sizeof(Conf_Server[i].dst_addr)) {
-			len = sizeof(Conf_Server[i].dst_addr);
+		Count--;
+		if (Count > sizeof(Conf_Server[i].dst_addr) / sizeof(ng_ipaddr_t)) {
+			Count = sizeof(Conf_Server[i].dst_addr) / sizeof(ng_ipaddr_t);
 			Log(LOG_NOTICE,
 				"Notice: Resolver returned more IP Addresses for host than we can handle, additional addresses dropped.");
 		}
-		memcpy(&Conf_Server[i].dst_addr, &dest_addrs[1], len);
+		memcpy(&Conf_Server[i].dst_addr, &Addrs[1],
+		       Count * sizeof(ng_ipaddr_t));
 	}
 	/* connect() */
-	New_Server(i, dest_addrs);
-} /* cb_Read_Forward_Lookup */
+	New_Server(i, (ng_ipaddr_t *)Addrs);
+} /* cb_Connect_to_Server */
 
 /**
- * Read results of a resolver sub-process from the pipe and update the
- * appropriate connection/client structure(s): hostname and/or IDENT user name.
+ * Handle results of the resolver and update the appropriate connection/client
+ * structure(s): hostname and/or IDENT user name.
  *
- * @param r_fd		File descriptor of the pipe to the sub-process.
- * @param events	(ignored IO specification)
+ * @param Token		Connection index.
+ * @param Hostname	Host name, or empty string.
+ * @param Ident		IDENT user name, or empty string.
  */
 static void
-cb_Read_Resolver_Result( int r_fd, UNUSED short events )
+cb_Read_Resolver_Result(int Token, const char *Hostname, const char *Ident)
 {
 	CLIENT *c;
-	CONN_ID i;
-	size_t len;
-	char *identptr;
+	CONN_ID i = Token;
 #ifdef IDENTAUTH
-	char readbuf[HOST_LEN + 2 + CLIENT_USER_LEN];
-	char *ptr;
+	const char *ptr;
 #else
-	char readbuf[HOST_LEN + 1];
+	(void)Ident;
 #endif
 
-	LogDebug("Resolver: Got callback on fd %d, events %d", r_fd, events );
-	i = Conn_GetFromProc(r_fd);
-	if (i == NONE) {
-		/* Ops, none found? Probably the connection has already
-		 * been closed!? We'll ignore that ... */
-		io_close( r_fd );
-		LogDebug("Resolver: Got callback for unknown connection!?");
-		return;
-	}
-
-	/* Read result from pipe */
-	len = Proc_Read(&My_Connections[i].proc_stat, readbuf, sizeof readbuf -1);
-	Proc_Close(&My_Connections[i].proc_stat);
-	if (len == 0)
-		return;
-
-	readbuf[len] = '\0';
-	identptr = strchr(readbuf, '\n');
-	assert(identptr != NULL);
-	if (!identptr) {
-		Log( LOG_CRIT, "Resolver: Got malformed result!");
-		return;
-	}
-
-	*identptr = '\0';
-	LogDebug("Got result from resolver: \"%s\" (%u bytes read).", readbuf, len);
+	LogDebug("Got result from resolver for connection %d: \"%s\", \"%s\".",
+		 i, Hostname, Ident);
 	/* Okay, we got a complete result: this is a host name for outgoing
 	 * connections and a host name and IDENT user name (if enabled) for
 	 * incoming connections.*/
@@ -2342,20 +3104,19 @@ cb_Read_Resolver_Result( int r_fd, UNUSED short events )
 	 * the resolver results, so we don't have to worry to override settings
 	 * from these commands here. */
 	if(Client_Type(c) == CLIENT_UNKNOWN) {
-		if (readbuf[0]) {
+		if (Hostname[0]) {
 			/* We got a hostname */
-			strlcpy(My_Connections[i].host, readbuf,
+			strlcpy(My_Connections[i].host, Hostname,
 				sizeof(My_Connections[i].host));
-			Client_SetHostname(c, readbuf);
+			Client_SetHostname(c, Hostname);
 			if (Conf_NoticeBeforeRegistration)
 				(void)Conn_WriteStr(i,
 					"NOTICE * :*** Found your hostname: %s",
 					My_Connections[i].host);
 		}
 #ifdef IDENTAUTH
-		++identptr;
-		if (*identptr) {
-			ptr = identptr;
+		if (*Ident) {
+			ptr = Ident;
 			while (*ptr) {
 				if ((*ptr < '0' || *ptr > '9') &&
 				    (*ptr < 'A' || *ptr > 'Z') &&
@@ -2371,15 +3132,15 @@ cb_Read_Resolver_Result( int r_fd, UNUSED short events )
 			} else {
 				Log(LOG_INFO,
 				    "IDENT lookup for connection %d: \"%s\".",
-				    i, identptr);
-				Client_SetUser(c, identptr, true);
+				    i, Ident);
+				Client_SetUser(c, Ident, true);
 			}
 			if (Conf_NoticeBeforeRegistration) {
 				(void)Conn_WriteStr(i,
 					"NOTICE * :*** Got %sident response%s%s",
 					*ptr ? "invalid " : "",
 					*ptr ? "" : ": ",
-					*ptr ? "" : identptr);
+					*ptr ? "" : Ident);
 			}
 		} else if(Conf_Ident) {
 			Log(LOG_INFO, "IDENT lookup for connection %d: no result.", i);
@@ -2455,72 +3216,26 @@ Conn_GetClient( CONN_ID Idx )
 	return c ? c->client : NULL;
 }
 
+#ifdef PAM
+
 /**
- * Get PROC_STAT sub-process structure of a connection.
+ * Get authentication status structure of a connection.
  *
  * @param Idx	Connection index number.
- * @returns	PROC_STAT structure.
+ * @returns	AUTH_STAT structure.
  */
-GLOBAL PROC_STAT *
-Conn_GetProcStat(CONN_ID Idx)
+GLOBAL AUTH_STAT *
+Conn_GetAuthStat(CONN_ID Idx)
 {
 	CONNECTION *c;
 
 	assert(Idx >= 0);
 	c = array_get(&My_ConnArray, sizeof (CONNECTION), (size_t)Idx);
 	assert(c != NULL);
-	return &c->proc_stat;
-} /* Conn_GetProcStat */
+	return &c->auth_stat;
+} /* Conn_GetAuthStat */
 
-/**
- * Get CONN_ID from file descriptor associated to a subprocess structure.
- *
- * @param fd	File descriptor.
- * @returns	CONN_ID or NONE (-1).
- */
-GLOBAL CONN_ID
-Conn_GetFromProc(int fd)
-{
-	int i;
-
-	assert(fd > 0);
-	for (i = 0; i < Pool_Size; i++) {
-		if ((My_Connections[i].sock != NONE)
-		    && (Proc_GetPipeFd(&My_Connections[i].proc_stat) == fd))
-			return i;
-	}
-	return NONE;
-} /* Conn_GetFromProc */
-
-/**
- * Throttle a connection because of excessive usage.
- *
- * @param Reason The reason, see THROTTLE_xxx constants.
- * @param Idx The connection index.
- * @param Client The client of this connection.
- * @param Value The time to delay this connection.
- */
-static void
-Throttle_Connection(const CONN_ID Idx, CLIENT *Client, const int Reason,
-		    unsigned int Value)
-{
-	assert(Idx > NONE);
-	assert(Client != NULL);
-
-	/* Never throttle servers or services, only interrupt processing */
-	if (Client_Type(Client) == CLIENT_SERVER
-	    || Client_Type(Client) == CLIENT_UNKNOWNSERVER
-	    || Client_Type(Client) == CLIENT_SERVICE)
-		return;
-
-	/* Don't throttle clients with user mode 'F' set */
-	if (Client_HasMode(Client, 'F'))
-		return;
-
-	LogDebug("Throttling connection %d: code %d, value %d!", Idx,
-		 Reason, Value);
-	Conn_SetPenalty(Idx, 1);
-}
+#endif
 
 #ifndef STRICT_RFC
 
@@ -2583,13 +3298,22 @@ cb_clientserver_ssl(int sock, UNUSED short what)
 static void
 cb_listen_ssl(int sock, short irrelevant)
 {
+	size_t attempts = 0, count = 0;
 	int fd;
 
 	(void) irrelevant;
-	fd = New_Connection(sock, true);
-	if (fd < 0)
-		return;
-	io_event_setcb(My_Connections[fd].sock, cb_clientserver_ssl);
+	while (attempts < MAX_ACCEPTS) {
+		fd = New_Connection(sock, true);
+		if (fd == BACKLOG_EMPTY)
+			break;
+		attempts++;
+		if (fd >= 0) {
+			count++;
+			io_event_setcb(My_Connections[fd].sock,
+				       cb_clientserver_ssl);
+		}
+	}
+	Account_Accepts(attempts, count);
 }
 
 /**
@@ -2777,17 +3501,19 @@ GLOBAL void
 Conn_DebugDump(void)
 {
 	int i;
+	struct timeval now;
 
+	Timer_Now(&now);
 	LogDebug("Connection status:");
 	for (i = 0; i < Pool_Size; i++) {
 		if (My_Connections[i].sock == NONE)
 			continue;
 		LogDebug(
-		    " - %d: host=%s, lastdata=%ld, lastping=%ld, delaytime=%ld, flag=%d, options=%d, bps=%d, client=%s",
+		    " - %d: host=%s, lastdata=%ld, lastping=%ld, floodwait=%ld, flag=%d, options=%d, client=%s",
 		    My_Connections[i].sock, My_Connections[i].host,
 		    My_Connections[i].lastdata, My_Connections[i].lastping,
-		    My_Connections[i].delaytime, My_Connections[i].flag,
-		    My_Connections[i].options, My_Connections[i].bps,
+		    Conn_FloodWait(i, &now), My_Connections[i].flag,
+		    My_Connections[i].options,
 		    My_Connections[i].client ? Client_ID(My_Connections[i].client) : "-");
 	}
 } /* Conn_DumpClients */
@@ -34,6 +34,8 @@
 #endif
 
 #include "conf-ssl.h"
+#include "sendq.h"
+#include "timer.h"
 
 #ifdef SSL_SUPPORT
 #define CONN_SSL_CONNECT	16	/* wait for ssl connect to finish */
@@ -43,10 +45,14 @@
 #define CONN_SSL_PEERCERT_OK	256	/* peer presented a valid certificate (used to check inbound server auth */
 #define CONN_SSL_FLAGS_ALL	(CONN_SSL_CONNECT|CONN_SSL|CONN_SSL_WANT_WRITE|CONN_SSL_WANT_READ|CONN_SSL_PEERCERT_OK)
 #endif
+#define CONN_BURST		512	/* server burst in progress, see burst.c */
+#define CONN_LOGIN		1024	/* login continues in main loop, see Conn_StartLogin() */
 typedef int CONN_ID;
 
 #include "client.h"
 #include "proc.h"
+#include "resolve.h"
+#include "pam.h"
 
 #ifdef CONN_MODULE
 
@@ -75,21 +81,26 @@ typedef struct _Connection
 {
 	int sock;			/* Socket handle */
 	ng_ipaddr_t addr;		/* Client address */
-	PROC_STAT proc_stat;		/* Status of resolver process */
+#ifdef PAM
+	AUTH_STAT auth_stat;		/* Status of PAM authentication */
+#endif
+	RES_STAT res_stat;		/* Status of resolver */
 	char host[HOST_LEN];		/* Hostname */
 	char *pwd;			/* password received of the client */
 	array rbuf;			/* Read buffer */
-	array wbuf;			/* Write buffer */
+	SENDQ wbuf;			/* Write buffer */
 	time_t signon;			/* Signon ("connect") time */
 	time_t lastdata;		/* Last activity */
 	time_t lastping;		/* Last PING */
 	time_t lastprivmsg;		/* Last PRIVMSG */
-	time_t delaytime;		/* Ignore link ("penalty") */
+	struct timeval flood_tat;	/* Flood control, see Conn_FloodWait() */
 	long bytes_in, bytes_out;	/* Received and sent bytes */
 	long msg_in, msg_out;		/* Received and sent IRC messages */
 	int flag;			/* Flag (see "irc-write" module) */
+	unsigned long flag_generation;	/* Generation "flag" is valid for */
 	UINT16 options;			/* Link options / connection state */
-	UINT16 bps;			/* bytes processed within last second */
+	bool active;			/* listed as "active", see Conn_Handler() */
+	TIMER *timer;			/* Next check, see Check_Connection() */
 	CLIENT *client;			/* pointer to client structure */
 #ifdef ZLIB
 	ZIPDATA zip;			/* Compression information */
@@ -132,10 +143,15 @@ GLOBAL unsigned int Conn_InitListeners PARAMS(( void ));
 GLOBAL void Conn_ExitListeners PARAMS(( void ));
 
 GLOBAL void Conn_StartLogin PARAMS((CONN_ID Idx));
+GLOBAL void Conn_StartBurst PARAMS((CONN_ID Idx));
 
 GLOBAL void Conn_Handler PARAMS(( void ));
+GLOBAL void Conn_Activate PARAMS((CONN_ID Idx));
 
 GLOBAL bool Conn_WriteStr PARAMS(( CONN_ID Idx, const char *Format, ... ));
+GLOBAL SENDQ_BLOCK *Conn_NewLine PARAMS((const char *Prefix,
+					 const char *Message));
+GLOBAL bool Conn_WriteLine PARAMS((CONN_ID Idx, SENDQ_BLOCK *Line));
 
 GLOBAL char* Conn_Password PARAMS(( CONN_ID Idx ));
 GLOBAL void Conn_SetPassword PARAMS(( CONN_ID Idx, const char *Pwd ));
@@ -143,10 +159,12 @@ GLOBAL void Conn_SetPassword PARAMS(( CONN_ID Idx, const char *Pwd ));
 GLOBAL void Conn_Close PARAMS(( CONN_ID Idx, const char *LogMsg, const char *FwdMsg, bool InformClient ));
 
 GLOBAL void Conn_SyncServerStruct PARAMS(( void ));
+GLOBAL void Conn_ScheduleServerCheck PARAMS((void));
 
-GLOBAL CONN_ID Conn_GetFromProc PARAMS((int fd));
 GLOBAL CLIENT* Conn_GetClient PARAMS((CONN_ID i));
-GLOBAL PROC_STAT* Conn_GetProcStat PARAMS((CONN_ID i));
+#ifdef PAM
+GLOBAL AUTH_STAT* Conn_GetAuthStat PARAMS((CONN_ID i));
+#endif
 
 GLOBAL char *Conn_GetCertFp PARAMS((CONN_ID Idx));
 GLOBAL bool Conn_SetCertFp PARAMS((CONN_ID Idx, const char *fingerprint));
@@ -161,6 +179,7 @@ GLOBAL const char *Conn_GetIPAInfo PARAMS((CONN_ID Idx));
 GLOBAL long Conn_Count PARAMS((void));
 GLOBAL long Conn_CountMax PARAMS((void));
 GLOBAL long Conn_CountAccepted PARAMS((void));
+GLOBAL char *Conn_AcceptStats PARAMS((char *Buf, size_t Len));
 
 #ifndef STRICT_RFC
 GLOBAL long Conn_GetAuthPing PARAMS((CONN_ID Idx));
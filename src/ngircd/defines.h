@@ -58,6 +58,21 @@
 /** Max. number of WHOWAS list items that can be stored. */
 #define MAX_WHOWAS 64
 
+/** Initial number of buckets of the client ID hash table. */
+#define CLIENT_HASH_SIZE 256
+
+/** Initial number of buckets of the channel name hash table. */
+#define CHANNEL_HASH_SIZE 256
+
+/** Initial number of buckets of the channel membership hash table. */
+#define CL2CHAN_HASH_SIZE 1024
+
+/** Size of the memory blocks ("slabs") of the object allocator, see slab.c. */
+#define SLAB_LEN 32768
+
+/** Minimum number of objects per slab (for very large objects). */
+#define SLAB_OBJECTS_MIN 4
+
 /** Size of default connection pool. */
 #define CONNECTION_POOL 100
 
@@ -94,6 +109,12 @@
 /** Default file for the process ID. */
 #define PID_FILE ""
 
+/** Default resolver configuration file of the DNS client. */
+#define RESOLV_CONF_FILE "/etc/resolv.conf"
+
+/** Default file with static host names for the DNS client. */
+#define HOSTS_FILE "/etc/hosts"
+
 
 /* Sizes of "IRC elements": nicks, users, ... */
 
@@ -171,6 +192,23 @@
 /** Maximum size of the write buffer of a server link connection in bytes. */
 #define WRITEBUFFER_SLINK_LEN 65536
 
+/** Size of the write buffer of a server link up to which the server burst
+ * is continued, see burst.c. */
+#define WRITEBUFFER_BURST_LEN 32768
+
+/** Size of the chunks a write buffer is made of, see "sendq" module. */
+#define SENDQ_CHUNK_LEN 4096
+
+/** Maximum number of write buffer chunks to send with one writev() call
+ * (shared messages are separate chunks of up to COMMAND_LEN bytes). */
+#define SENDQ_IOV_MAX 64
+
+/** Number of unused write buffer chunks kept for reuse. */
+#define SENDQ_FREE_CHUNKS 64
+
+/** Number of unused references to shared messages kept for reuse. */
+#define SENDQ_FREE_REFS 1024
+
 
 /* IRC/IRC+ protocol */
 
@@ -0,0 +1,1080 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#include "portab.h"
+
+/**
+ * @file
+ * Asynchronous DNS client
+ *
+ * A minimal "stub resolver": queries are sent using UDP to the name servers
+ * listed in /etc/resolv.conf, and the answers are handled by the main loop
+ * of the daemon, so no sub-process is required for DNS lookups. Names and
+ * addresses listed in /etc/hosts are answered without querying any server.
+ * Like the C library does, names are looked up in the domains of the
+ * "search" (or "domain") list of /etc/resolv.conf, too.
+ *
+ * Each query is sent using its own UDP socket, bound to a random local port
+ * and connected to the name server: spoofing an answer requires guessing
+ * both the port number and the random query ID.
+ *
+ * Both files are read once on startup (before changing the root directory),
+ * their names are passed to Dns_Init() (see the "ResolvConfFile" and
+ * "HostsFile" options).
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "array.h"
+#include "hash.h"
+#include "io.h"
+#include "log.h"
+#include "timer.h"
+
+#include "dns.h"
+
+
+#define DNS_PORT 53			/** Port number of name servers */
+#define DNS_MAX_SERVERS 3		/** Max. number of name servers */
+#define DNS_MAX_SEARCH 6		/** Max. number of search domains */
+#define DNS_NDOTS 1			/** Default "ndots" option */
+#define DNS_NDOTS_MAX 15		/** Max. "ndots" option */
+#define DNS_TIMEOUT 5			/** Default timeout in seconds */
+#define DNS_ATTEMPTS 2			/** Default attempts per server */
+#define DNS_MSG_LEN 512			/** Max. length of UDP messages */
+#define DNS_HEADER_LEN 12		/** Length of message header */
+#define DNS_PORT_MIN 1024		/** Min. random local port number */
+#define DNS_BIND_TRIES 8		/** Attempts to bind to a random port */
+#define DNS_QUERIES_SIZE 16		/** Initial size of query hash */
+
+#define DNS_TYPE_SOA 6			/** Type "start of authority" */
+#define DNS_CLASS_IN 1			/** Class "Internet" */
+#define DNS_TTL_MAX 0x7fffffff		/** Max. time to live (RFC 2181) */
+#define DNS_HOSTS_TTL 3600		/** Time to live of /etc/hosts entries */
+#define DNS_FLAG_QR 0x8000		/** Message is a response */
+#define DNS_FLAG_TC 0x0200		/** Message is truncated */
+#define DNS_FLAG_RD 0x0100		/** Recursion desired */
+#define DNS_RCODE(f) ((f) & 0x000f)	/** Response code of flags */
+#define DNS_RCODE_NXDOMAIN 3		/** Response code: no such name */
+
+/** Get 16 bit number in network byte order. */
+#define GET16(p) ((UINT16)(((p)[0] << 8) | (p)[1]))
+/** Get 32 bit number in network byte order. */
+#define GET32(p) (((UINT32)GET16(p) << 16) | GET16((p) + 2))
+
+/** Pending DNS query. */
+struct _Dns_Query
+{
+	HASH_ITEM item;			/* item in Queries table, key: id */
+	UINT16 id;			/* query ID */
+	UINT16 type;			/* query type (DNS_TYPE_xxx) */
+	char name[HOST_LEN];		/* queried name */
+	char base[HOST_LEN];		/* name to look up */
+	bool search;			/* use search list, see Next_Name() */
+	int next_name;			/* index of the next name to query */
+	int sock;			/* socket of the current query or -1 */
+	int server;			/* index of current name server */
+	int tries;			/* number of queries sent */
+	bool answered;			/* result is complete */
+	TIMER *timer;			/* timeout of the current query */
+	DNS_RESULT result;		/* result of the query */
+	DNS_CALLBACK callback;		/* function to call when finished */
+	void *data;			/* argument for the callback */
+};
+
+/** Entry of the /etc/hosts file. */
+typedef struct _Dns_Host
+{
+	ng_ipaddr_t addr;		/* IP address */
+	char name[HOST_LEN];		/* host name or alias */
+} DNS_HOST;
+
+static ng_ipaddr_t Servers[DNS_MAX_SERVERS];
+static int Server_Count;
+static char Search[DNS_MAX_SEARCH][HOST_LEN];
+static int Search_Count;
+static int Ndots = DNS_NDOTS;
+static int Timeout = DNS_TIMEOUT;
+static int Attempts = DNS_ATTEMPTS;
+static array Hosts;
+static HASH_TABLE Queries;
+static array Deferred;
+
+static void Read_Resolv_Conf PARAMS((const char *File));
+static void Read_Hosts PARAMS((const char *File));
+static DNS_QUERY *New_Query PARAMS((const char *Name, int Type,
+				    DNS_CALLBACK Callback, void *Data));
+static DNS_QUERY *Find_Query PARAMS((UINT16 Id));
+static bool Next_Name PARAMS((DNS_QUERY *Query));
+static void Send_Query PARAMS((DNS_QUERY *Query));
+static void Next_Try PARAMS((DNS_QUERY *Query));
+static void Defer_Result PARAMS((DNS_QUERY *Query));
+static void Finish_Query PARAMS((DNS_QUERY *Query));
+static void Free_Query PARAMS((DNS_QUERY *Query));
+static int New_Socket PARAMS((const ng_ipaddr_t *Server));
+static size_t Put_Name PARAMS((const char *Name, UINT8 *Buf, size_t Len));
+static bool Get_Name PARAMS((const UINT8 *Msg, size_t Len, size_t *Pos,
+			     char *Name, size_t NameLen));
+static void Handle_Answer PARAMS((const UINT8 *Msg, size_t Len,
+				  const ng_ipaddr_t *From, int Sock));
+static UINT32 Negative_TTL PARAMS((const UINT8 *Msg, size_t Len, size_t Pos,
+				   unsigned int Skipped));
+static void cb_Read_Answers PARAMS((int Sock, short What));
+static void cb_Query_Timer PARAMS((int Id));
+
+/**
+ * Initialize the DNS client: read name servers and static host names.
+ *
+ * When a file can't be read (for example after a restart in a chroot
+ * environment), the settings read before are kept.
+ *
+ * @param ResolvConfFile Name of the resolver configuration file.
+ * @param HostsFile Name of the hosts file.
+ */
+GLOBAL void
+Dns_Init(const char *ResolvConfFile, const char *HostsFile)
+{
+	Read_Resolv_Conf(ResolvConfFile);
+	if (Server_Count == 0) {
+		/* Use local name server, like the C library does */
+		ng_ipaddr_init(&Servers[0], "127.0.0.1", DNS_PORT);
+		Server_Count = 1;
+	}
+	Read_Hosts(HostsFile);
+
+	if (!Queries.buckets && !Hash_TableInit(&Queries, DNS_QUERIES_SIZE)) {
+		Log(LOG_EMERG, "Can't allocate memory for DNS queries!");
+		exit(1);
+	}
+	LogDebug("DNS: %d name server(s), %d search domain(s), %u static host name(s).",
+		 Server_Count, Search_Count,
+		 (unsigned int)array_length(&Hosts, sizeof(DNS_HOST)));
+} /* Dns_Init */
+
+/**
+ * Shut down the DNS client: cancel all queries (and close their sockets).
+ */
+GLOBAL void
+Dns_Exit(void)
+{
+	HASH_ITEM *item;
+	size_t i;
+
+	if (Queries.buckets) {
+		for (i = 0; i < Queries.size; i++) {
+			while ((item = Queries.buckets[i]))
+				Free_Query((DNS_QUERY *)item->data);
+		}
+		Hash_TableFree(&Queries);
+	}
+	array_free(&Deferred);
+} /* Dns_Exit */
+
+/**
+ * Look up the host name of an IP address ("reverse lookup").
+ *
+ * @param Addr The IP address.
+ * @param Callback Function to call with the result.
+ * @param Data Argument for the callback function.
+ * @return Pending query or NULL on error.
+ */
+GLOBAL DNS_QUERY *
+Dns_QueryAddr(const ng_ipaddr_t *Addr, DNS_CALLBACK Callback, void *Data)
+{
+	char name[HOST_LEN];
+	const UINT8 *bytes;
+	DNS_QUERY *query;
+	DNS_HOST *host;
+	size_t i, len;
+
+	assert(Addr != NULL);
+	assert(Callback != NULL);
+
+#ifdef WANT_IPV6
+	if (ng_ipaddr_af(Addr) == AF_INET6) {
+		char *ptr = name;
+
+		bytes = Addr->sin6.sin6_addr.s6_addr;
+		if (IN6_IS_ADDR_V4MAPPED(&Addr->sin6.sin6_addr))
+			snprintf(name, sizeof(name), "%u.%u.%u.%u.in-addr.arpa",
+				 bytes[15], bytes[14], bytes[13], bytes[12]);
+		else {
+			for (i = 16; i > 0; i--) {
+				ptr += sprintf(ptr, "%x.%x.", bytes[i - 1] & 0x0f,
+					       bytes[i - 1] >> 4);
+			}
+			strlcpy(ptr, "ip6.arpa", sizeof(name) - (ptr - name));
+		}
+	} else
+#endif
+	{
+		bytes = (const UINT8 *)&Addr->sin4.sin_addr.s_addr;
+		snprintf(name, sizeof(name), "%u.%u.%u.%u.in-addr.arpa",
+			 bytes[3], bytes[2], bytes[1], bytes[0]);
+	}
+
+	query = New_Query(name, DNS_TYPE_PTR, Callback, Data);
+	if (!query)
+		return NULL;
+
+	/* Listed in the hosts file? */
+	host = array_start(&Hosts);
+	len = array_length(&Hosts, sizeof(DNS_HOST));
+	for (i = 0; i < len; i++, host++) {
+		if (!ng_ipaddr_ipequal(&host->addr, Addr))
+			continue;
+		strlcpy(query->result.name, host->name,
+			sizeof(query->result.name));
+		query->result.found = true;
+		query->result.ttl = DNS_HOSTS_TTL;
+		Defer_Result(query);
+		return query;
+	}
+
+	Send_Query(query);
+	return query;
+} /* Dns_QueryAddr */
+
+/**
+ * Look up the IP addresses of a host name.
+ *
+ * @param Name The host name.
+ * @param Type Type of the addresses, DNS_TYPE_A or DNS_TYPE_AAAA.
+ * @param Callback Function to call with the result.
+ * @param Data Argument for the callback function.
+ * @return Pending query or NULL on error.
+ */
+GLOBAL DNS_QUERY *
+Dns_QueryName(const char *Name, int Type, DNS_CALLBACK Callback, void *Data)
+{
+	DNS_QUERY *query;
+	DNS_HOST *host;
+	size_t i, len;
+	int af;
+
+	assert(Name != NULL);
+	assert(Type == DNS_TYPE_A || Type == DNS_TYPE_AAAA);
+	assert(Callback != NULL);
+
+#ifdef WANT_IPV6
+	af = Type == DNS_TYPE_AAAA ? AF_INET6 : AF_INET;
+#else
+	if (Type == DNS_TYPE_AAAA)
+		return NULL;
+	af = AF_INET;
+#endif
+
+	query = New_Query(Name, Type, Callback, Data);
+	if (!query)
+		return NULL;
+
+	/* Fully qualified names (with a trailing dot) are looked up as they
+	 * are, all others in the domains of the search list, too. */
+	len = strlen(Name);
+	query->search = len > 0 && Name[len - 1] != '.';
+	(void)Next_Name(query);
+
+	/* Listed in the hosts file? */
+	host = array_start(&Hosts);
+	len = array_length(&Hosts, sizeof(DNS_HOST));
+	for (i = 0; i < len; i++, host++) {
+		if (ng_ipaddr_af(&host->addr) != af
+		    || strcasecmp(host->name, query->base) != 0)
+			continue;
+		if (query->result.count < DNS_MAX_ADDRS)
+			query->result.addr[query->result.count++] = host->addr;
+	}
+	if (query->result.count > 0) {
+		query->result.found = true;
+		query->result.ttl = DNS_HOSTS_TTL;
+		Defer_Result(query);
+		return query;
+	}
+
+	Send_Query(query);
+	return query;
+} /* Dns_QueryName */
+
+/**
+ * Cancel a pending query. The callback function isn't called.
+ *
+ * @param Query The query.
+ */
+GLOBAL void
+Dns_Cancel(DNS_QUERY *Query)
+{
+	assert(Query != NULL);
+
+	Free_Query(Query);
+} /* Dns_Cancel */
+
+/**
+ * Deliver the results of all queries which have been answered without
+ * asking a name server (see Defer_Result()), by calling their callback
+ * functions.
+ *
+ * Results deferred by these callback functions are delivered on the next
+ * call only.
+ */
+GLOBAL void
+Dns_Run(void)
+{
+	DNS_QUERY *query;
+	size_t i, len;
+
+	len = array_length(&Deferred, sizeof(UINT16));
+	for (i = 0; i < len; i++) {
+		query = Find_Query(*(UINT16 *)array_get(&Deferred,
+							sizeof(UINT16), i));
+		if (query && query->answered)
+			Finish_Query(query);
+	}
+	array_moveleft(&Deferred, sizeof(UINT16), len);
+} /* Dns_Run */
+
+/**
+ * Check if there are results to deliver, see Dns_Run().
+ */
+GLOBAL bool
+Dns_Deferred(void)
+{
+	return array_length(&Deferred, sizeof(UINT16)) > 0;
+} /* Dns_Deferred */
+
+/**
+ * Read name servers, search list and options from the resolver
+ * configuration file.
+ *
+ * Like in the C library, the last "search" or "domain" line wins. As an
+ * extension, a port number can follow the address of a name server (the C
+ * library ignores it); this is used by the test suite.
+ */
+static void
+Read_Resolv_Conf(const char *File)
+{
+	char line[1024], *ptr, *arg;
+	UINT16 port;
+	FILE *fd;
+
+	fd = fopen(File, "r");
+	if (!fd) {
+		Log(LOG_WARNING, "Can't read \"%s\": %s", File,
+		    strerror(errno));
+		return;
+	}
+	Server_Count = 0;
+	Search_Count = 0;
+	Ndots = DNS_NDOTS;
+	Timeout = DNS_TIMEOUT;
+	Attempts = DNS_ATTEMPTS;
+
+	while (fgets(line, (int)sizeof(line), fd)) {
+		ptr = strtok(line, " \t\r\n");
+		if (!ptr || *ptr == '#' || *ptr == ';')
+			continue;
+		if (strcmp(ptr, "nameserver") == 0) {
+			ptr = strtok(NULL, " \t\r\n");
+			if (!ptr || Server_Count >= DNS_MAX_SERVERS)
+				continue;
+			arg = strtok(NULL, " \t\r\n");
+			port = arg ? (UINT16)atoi(arg) : 0;
+			if (ng_ipaddr_init(&Servers[Server_Count], ptr,
+					   port ? port : DNS_PORT))
+				Server_Count++;
+			else
+				LogDebug("DNS: Ignoring name server \"%s\".",
+					 ptr);
+		} else if (strcmp(ptr, "search") == 0
+			   || strcmp(ptr, "domain") == 0) {
+			Search_Count = 0;
+			while ((ptr = strtok(NULL, " \t\r\n"))
+			       && Search_Count < DNS_MAX_SEARCH) {
+				/* Strip trailing dot, ignore the root domain */
+				if (ptr[0] && ptr[strlen(ptr) - 1] == '.')
+					ptr[strlen(ptr) - 1] = '\0';
+				if (!*ptr || strlcpy(Search[Search_Count], ptr,
+						     HOST_LEN) >= HOST_LEN)
+					continue;
+				Search_Count++;
+			}
+		} else if (strcmp(ptr, "options") == 0) {
+			while ((ptr = strtok(NULL, " \t\r\n"))) {
+				if (strncmp(ptr, "ndots:", 6) == 0)
+					Ndots = atoi(ptr + 6);
+				else if (strncmp(ptr, "timeout:", 8) == 0)
+					Timeout = atoi(ptr + 8);
+				else if (strncmp(ptr, "attempts:", 9) == 0)
+					Attempts = atoi(ptr + 9);
+			}
+		}
+	}
+	fclose(fd);
+
+	if (Ndots < 0)
+		Ndots = 0;
+	if (Ndots > DNS_NDOTS_MAX)
+		Ndots = DNS_NDOTS_MAX;
+	if (Timeout < 1)
+		Timeout = 1;
+	if (Attempts < 1)
+		Attempts = 1;
+} /* Read_Resolv_Conf */
+
+/**
+ * Read static host names from the hosts file.
+ */
+static void
+Read_Hosts(const char *File)
+{
+	char line[1024], *ptr;
+	DNS_HOST host;
+	FILE *fd;
+
+	fd = fopen(File, "r");
+	if (!fd) {
+		LogDebug("DNS: Can't read \"%s\": %s", File,
+			 strerror(errno));
+		return;
+	}
+	array_trunc(&Hosts);
+
+	while (fgets(line, (int)sizeof(line), fd)) {
+		ptr = strchr(line, '#');
+		if (ptr)
+			*ptr = '\0';
+		ptr = strtok(line, " \t\r\n");
+		if (!ptr || !ng_ipaddr_init(&host.addr, ptr, 0))
+			continue;
+		while ((ptr = strtok(NULL, " \t\r\n"))) {
+			if (strlcpy(host.name, ptr, sizeof(host.name))
+			    >= sizeof(host.name))
+				continue;
+			if (!array_catb(&Hosts, (char *)&host, sizeof(host))) {
+				Log(LOG_WARNING,
+				    "Can't allocate memory for host names!");
+				break;
+			}
+		}
+	}
+	fclose(fd);
+} /* Read_Hosts */
+
+/**
+ * Allocate a new query and its timer, and register it.
+ *
+ * @param Name Name to query.
+ * @param Type Type of the query.
+ * @param Callback Function to call with the result.
+ * @param Data Argument for the callback function.
+ * @return New query or NULL on error.
+ */
+static DNS_QUERY *
+New_Query(const char *Name, int Type, DNS_CALLBACK Callback, void *Data)
+{
+	DNS_QUERY *query;
+	UINT16 id;
+
+	query = (DNS_QUERY *)calloc(1, sizeof(DNS_QUERY));
+	if (!query) {
+		Log(LOG_EMERG, "Can't allocate memory! [New_Query]");
+		return NULL;
+	}
+	if (strlcpy(query->base, Name, sizeof(query->base))
+	    >= sizeof(query->base)) {
+		free(query);
+		return NULL;
+	}
+	/* Strip trailing dot of fully qualified names */
+	if (query->base[0] && query->base[strlen(query->base) - 1] == '.')
+		query->base[strlen(query->base) - 1] = '\0';
+	strlcpy(query->name, query->base, sizeof(query->name));
+	query->sock = -1;
+
+	/* Random query IDs make it harder to spoof answers */
+	do {
+		id = (UINT16)arc4random();
+	} while (Find_Query(id));
+
+	query->timer = Timer_New(cb_Query_Timer, (int)id);
+	if (!query->timer) {
+		free(query);
+		return NULL;
+	}
+	query->id = id;
+	query->type = (UINT16)Type;
+	query->callback = Callback;
+	query->data = Data;
+	Hash_TableAdd(&Queries, &query->item, (UINT32)id, query);
+	return query;
+} /* New_Query */
+
+/**
+ * Find a pending query.
+ *
+ * @param Id Query ID.
+ * @return Query or NULL if there is none.
+ */
+static DNS_QUERY *
+Find_Query(UINT16 Id)
+{
+	HASH_ITEM *item;
+
+	for (item = Hash_TableFirst(&Queries, (UINT32)Id); item;
+	     item = Hash_TableNext(item)) {
+		if (((DNS_QUERY *)item->data)->id == Id)
+			return (DNS_QUERY *)item->data;
+	}
+	return NULL;
+} /* Find_Query */
+
+/**
+ * Set the next name to query: the name itself and the name in each domain
+ * of the search list. Names with at least "ndots" dots are tried as they
+ * are first, all others last.
+ *
+ * @param Query The query.
+ * @return true if there was a name left to query, false otherwise.
+ */
+static bool
+Next_Name(DNS_QUERY *Query)
+{
+	const char *ptr;
+	int i, dots = 0;
+
+	for (ptr = Query->base; (ptr = strchr(ptr, '.')); ptr++)
+		dots++;
+
+	while (Query->next_name < (Query->search ? Search_Count + 1 : 1)) {
+		i = Query->next_name++;
+		if (!Query->search)
+			i = -1;
+		else if (dots >= Ndots)
+			i--;
+		else if (i == Search_Count)
+			i = -1;
+
+		if (i < 0)
+			strlcpy(Query->name, Query->base, sizeof(Query->name));
+		else if (snprintf(Query->name, sizeof(Query->name), "%s.%s",
+				  Query->base, Search[i])
+			 >= (int)sizeof(Query->name))
+			continue;
+		return true;
+	}
+	return false;
+} /* Next_Name */
+
+/**
+ * Send a query to its current name server.
+ *
+ * A new socket is used for every query sent. Errors are ignored: the next
+ * name server is tried on timeout.
+ *
+ * @param Query The query.
+ */
+static void
+Send_Query(DNS_QUERY *Query)
+{
+	UINT8 msg[DNS_MSG_LEN];
+	const ng_ipaddr_t *server;
+	size_t len;
+
+	server = &Servers[Query->server % Server_Count];
+	Query->tries++;
+	/* The timer expires at the start of a second: wait one more second,
+	 * so that the timeout isn't shorter than configured. */
+	Timer_Set(Query->timer, time(NULL) + Timeout + 1);
+
+	if (Query->sock >= 0)
+		io_close(Query->sock);
+	Query->sock = -1;
+
+	memset(msg, 0, DNS_HEADER_LEN);
+	msg[0] = (UINT8)(Query->id >> 8);
+	msg[1] = (UINT8)Query->id;
+	msg[2] = (UINT8)(DNS_FLAG_RD >> 8);
+	msg[5] = 1;			/* one question */
+	len = Put_Name(Query->name, msg + DNS_HEADER_LEN,
+		       sizeof(msg) - DNS_HEADER_LEN - 4);
+	if (len == 0) {
+		Log(LOG_WARNING, "Can't resolve \"%s\": invalid name!",
+		    Query->name);
+		Defer_Result(Query);
+		return;
+	}
+	len += DNS_HEADER_LEN;
+	msg[len++] = (UINT8)(Query->type >> 8);
+	msg[len++] = (UINT8)Query->type;
+	msg[len++] = 0;
+	msg[len++] = DNS_CLASS_IN;
+
+	Query->sock = New_Socket(server);
+	if (Query->sock < 0)
+		return;
+	if (send(Query->sock, msg, len, 0) < 0)
+		LogDebug("DNS: Can't send query to %s: %s",
+			 ng_ipaddr_tostr(server), strerror(errno));
+} /* Send_Query */
+
+/**
+ * Retry a query using the next name server, or give up.
+ *
+ * @param Query The query.
+ */
+static void
+Next_Try(DNS_QUERY *Query)
+{
+	if (Query->tries >= Attempts * Server_Count) {
+		LogDebug("DNS: No answer for \"%s\" (type %u).", Query->name,
+			 (unsigned int)Query->type);
+		Finish_Query(Query);
+		return;
+	}
+	Query->server++;
+	Send_Query(Query);
+} /* Next_Try */
+
+/**
+ * Mark a query as answered and deliver its result on the next call of
+ * Dns_Run(): results are always delivered asynchronously, even when no name
+ * server has to be asked.
+ *
+ * @param Query The query.
+ */
+static void
+Defer_Result(DNS_QUERY *Query)
+{
+	Query->answered = true;
+	Timer_Stop(Query->timer);
+	if (array_catb(&Deferred, (char *)&Query->id, sizeof(UINT16)))
+		return;
+
+	/* Out of memory: let the timer of the query deliver the result */
+	Timer_Set(Query->timer, time(NULL));
+} /* Defer_Result */
+
+/**
+ * Finish a query: free it and call its callback function.
+ *
+ * @param Query The query.
+ */
+static void
+Finish_Query(DNS_QUERY *Query)
+{
+	DNS_RESULT result;
+	DNS_CALLBACK callback;
+	void *data;
+
+	result = Query->result;
+	callback = Query->callback;
+	data = Query->data;
+	Free_Query(Query);
+
+	callback(data, &result);
+} /* Finish_Query */
+
+/**
+ * Unregister and free a query.
+ *
+ * @param Query The query.
+ */
+static void
+Free_Query(DNS_QUERY *Query)
+{
+	if (Query->sock >= 0)
+		io_close(Query->sock);
+	Hash_TableRemove(&Queries, &Query->item);
+	Timer_Free(Query->timer);
+	free(Query);
+} /* Free_Query */
+
+/**
+ * Create a socket for sending a query to a name server.
+ *
+ * The socket is bound to a random local port and connected to the name
+ * server, so that the system drops datagrams of all other senders. If no
+ * random port is available, connect() binds the socket to a port chosen by
+ * the system.
+ *
+ * @param Server Address of the name server.
+ * @return Socket or -1 on error.
+ */
+static int
+New_Socket(const ng_ipaddr_t *Server)
+{
+	ng_ipaddr_t local;
+	UINT16 port;
+	int sock, af, i;
+
+	af = ng_ipaddr_af(Server);
+	sock = socket(af, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		Log(LOG_CRIT, "Can't create DNS socket (af %d): %s!", af,
+		    strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < DNS_BIND_TRIES; i++) {
+		port = (UINT16)(DNS_PORT_MIN
+				+ arc4random() % (65536 - DNS_PORT_MIN));
+#ifdef WANT_IPV6
+		if (!ng_ipaddr_init(&local, af == AF_INET6 ? "::" : "0.0.0.0",
+				    port))
+#else
+		if (!ng_ipaddr_init(&local, "0.0.0.0", port))
+#endif
+			break;
+		if (bind(sock, (struct sockaddr *)&local,
+			 ng_ipaddr_salen(&local)) == 0)
+			break;
+	}
+
+	if (connect(sock, (const struct sockaddr *)Server,
+		    ng_ipaddr_salen(Server)) != 0
+	    || !io_setnonblock(sock) || !io_setcloexec(sock)
+	    || !io_event_create(sock, IO_WANTREAD, cb_Read_Answers)) {
+		Log(LOG_CRIT, "Can't initialize DNS socket: %s!",
+		    strerror(errno));
+		close(sock);
+		return -1;
+	}
+	return sock;
+} /* New_Socket */
+
+/**
+ * Encode a domain name.
+ *
+ * @param Name The name, labels separated by dots.
+ * @param Buf Buffer for the encoded name.
+ * @param Len Size of the buffer.
+ * @return Length of the encoded name or 0 if it is invalid.
+ */
+static size_t
+Put_Name(const char *Name, UINT8 *Buf, size_t Len)
+{
+	const char *dot;
+	size_t pos = 0, label;
+
+	while (*Name) {
+		dot = strchr(Name, '.');
+		label = dot ? (size_t)(dot - Name) : strlen(Name);
+		if (label == 0 || label > 63 || pos + label + 2 > Len)
+			return 0;
+		Buf[pos++] = (UINT8)label;
+		memcpy(Buf + pos, Name, label);
+		pos += label;
+		Name += label;
+		if (*Name)
+			Name++;
+	}
+	if (pos == 0)
+		return 0;
+	Buf[pos++] = 0;
+	return pos;
+} /* Put_Name */
+
+/**
+ * Decode a (possibly compressed) domain name of a message.
+ *
+ * Only names consisting of letters, digits, "-" and "_" are accepted.
+ *
+ * @param Msg The message.
+ * @param Len Length of the message.
+ * @param Pos Position of the name, set to the position after it.
+ * @param Name Buffer for the name, labels separated by dots.
+ * @param NameLen Size of the buffer.
+ * @return true on success, false if the name is invalid.
+ */
+static bool
+Get_Name(const UINT8 *Msg, size_t Len, size_t *Pos, char *Name,
+	 size_t NameLen)
+{
+	size_t pos = *Pos, out = 0, label, i;
+	int jumps = 0;
+	bool jumped = false;
+	UINT8 c;
+
+	while (pos < Len) {
+		label = Msg[pos];
+		if ((label & 0xc0) == 0xc0) {
+			/* Pointer to another name (compression) */
+			if (pos + 1 >= Len || ++jumps > 16)
+				return false;
+			if (!jumped)
+				*Pos = pos + 2;
+			jumped = true;
+			pos = ((label & 0x3f) << 8) | Msg[pos + 1];
+			continue;
+		}
+		if (label & 0xc0)
+			return false;
+		pos++;
+		if (label == 0) {
+			if (!jumped)
+				*Pos = pos;
+			if (out == 0) {
+				if (NameLen < 1)
+					return false;
+				Name[0] = '\0';
+			} else
+				Name[out - 1] = '\0';
+			return true;
+		}
+		if (pos + label > Len || out + label + 1 > NameLen)
+			return false;
+		for (i = 0; i < label; i++) {
+			c = Msg[pos + i];
+			if ((c < '0' || c > '9') && (c < 'a' || c > 'z')
+			    && (c < 'A' || c > 'Z') && c != '-' && c != '_')
+				return false;
+			Name[out++] = (char)c;
+		}
+		Name[out++] = '.';
+		pos += label;
+	}
+	return false;
+} /* Get_Name */
+
+/**
+ * Handle an answer received from a name server.
+ *
+ * @param Msg The message.
+ * @param Len Length of the message.
+ * @param From Address of the sender.
+ * @param Sock Socket the message has been received on.
+ */
+static void
+Handle_Answer(const UINT8 *Msg, size_t Len, const ng_ipaddr_t *From,
+	      int Sock)
+{
+	char name[HOST_LEN];
+	const ng_ipaddr_t *server;
+	DNS_QUERY *query;
+	ng_ipaddr_t *addr;
+	UINT16 flags, count, type, class, rdlen;
+	UINT32 ttl, min_ttl = DNS_TTL_MAX;
+	size_t pos, rdpos;
+
+	if (Len < DNS_HEADER_LEN)
+		return;
+	query = Find_Query(GET16(Msg));
+	if (!query || query->answered || query->sock != Sock)
+		return;
+
+	/* Answers must come from the name server that has been asked */
+	server = &Servers[query->server % Server_Count];
+	if (!ng_ipaddr_ipequal(From, server)
+	    || ng_ipaddr_getport(From) != ng_ipaddr_getport(server))
+		return;
+
+	flags = GET16(Msg + 2);
+	if (!(flags & DNS_FLAG_QR) || GET16(Msg + 4) != 1)
+		return;
+
+	/* Check that the question matches the query */
+	pos = DNS_HEADER_LEN;
+	if (!Get_Name(Msg, Len, &pos, name, sizeof(name)) || pos + 4 > Len)
+		return;
+	if (strcasecmp(name, query->name) != 0
+	    || GET16(Msg + pos) != query->type
+	    || GET16(Msg + pos + 2) != DNS_CLASS_IN)
+		return;
+	pos += 4;
+
+	if ((DNS_RCODE(flags) != 0
+	     && DNS_RCODE(flags) != DNS_RCODE_NXDOMAIN)
+	    || (flags & DNS_FLAG_TC)) {
+		/* Server failure, refused, or truncated answer */
+		LogDebug("DNS: Error %u from %s for \"%s\".",
+			 (unsigned int)DNS_RCODE(flags),
+			 ng_ipaddr_tostr(server), query->name);
+		Next_Try(query);
+		return;
+	}
+
+	for (count = GET16(Msg + 6); count > 0; count--) {
+		if (!Get_Name(Msg, Len, &pos, name, sizeof(name))
+		    || pos + 10 > Len)
+			break;
+		type = GET16(Msg + pos);
+		class = GET16(Msg + pos + 2);
+		ttl = GET32(Msg + pos + 4);
+		rdlen = GET16(Msg + pos + 8);
+		pos += 10;
+		if (pos + rdlen > Len)
+			break;
+		if (class != DNS_CLASS_IN) {
+			pos += rdlen;
+			continue;
+		}
+		/* Records of other types (CNAME) count for the TTL, too */
+		if (ttl > DNS_TTL_MAX)
+			ttl = 0;
+		if (ttl < min_ttl)
+			min_ttl = ttl;
+		if (type != query->type) {
+			pos += rdlen;
+			continue;
+		}
+
+		addr = &query->result.addr[query->result.count];
+		switch (type) {
+		case DNS_TYPE_PTR:
+			rdpos = pos;
+			if (!query->result.found
+			    && Get_Name(Msg, Len, &rdpos, query->result.name,
+					sizeof(query->result.name)))
+				query->result.found = true;
+			break;
+		case DNS_TYPE_A:
+			if (rdlen != 4 || query->result.count >= DNS_MAX_ADDRS)
+				break;
+			memset(addr, 0, sizeof(*addr));
+			addr->sin4.sin_family = AF_INET;
+			memcpy(&addr->sin4.sin_addr, Msg + pos, 4);
+			query->result.count++;
+			query->result.found = true;
+			break;
+#ifdef WANT_IPV6
+		case DNS_TYPE_AAAA:
+			if (rdlen != 16 || query->result.count >= DNS_MAX_ADDRS)
+				break;
+			memset(addr, 0, sizeof(*addr));
+			addr->sin6.sin6_family = AF_INET6;
+			memcpy(&addr->sin6.sin6_addr, Msg + pos, 16);
+			query->result.count++;
+			query->result.found = true;
+			break;
+#endif
+		}
+		pos += rdlen;
+	}
+
+	if (query->result.found)
+		query->result.ttl = min_ttl;
+	else {
+		LogDebug("DNS: \"%s\" (type %u) doesn't exist.", query->name,
+			 (unsigned int)query->type);
+		if (query->search && Next_Name(query)) {
+			/* Try the next domain of the search list */
+			query->tries = 0;
+			Send_Query(query);
+			return;
+		}
+		query->result.ttl = Negative_TTL(Msg, Len, pos,
+						 GET16(Msg + 6) - count);
+	}
+	Finish_Query(query);
+} /* Handle_Answer */
+
+/**
+ * Get the time for which a negative answer can be cached (RFC 2308).
+ *
+ * This is the minimum of the TTL and the "minimum" field of the SOA record
+ * in the authority section; without one, negative answers aren't cached.
+ *
+ * @param Msg The message.
+ * @param Len Length of the message.
+ * @param Pos Position after the answer section.
+ * @param Skipped Number of records of the answer section read so far.
+ * @return Time to live in seconds, or 0.
+ */
+static UINT32
+Negative_TTL(const UINT8 *Msg, size_t Len, size_t Pos, unsigned int Skipped)
+{
+	char name[HOST_LEN];
+	UINT16 count, rdlen;
+	UINT32 ttl, minimum;
+
+	/* Answer section must have been read completely */
+	if (Skipped != GET16(Msg + 6))
+		return 0;
+
+	for (count = GET16(Msg + 8); count > 0; count--) {
+		if (!Get_Name(Msg, Len, &Pos, name, sizeof(name))
+		    || Pos + 10 > Len)
+			return 0;
+		rdlen = GET16(Msg + Pos + 8);
+		if (Pos + 10 + rdlen > Len)
+			return 0;
+		if (GET16(Msg + Pos) == DNS_TYPE_SOA && rdlen >= 22) {
+			ttl = GET32(Msg + Pos + 4);
+			minimum = GET32(Msg + Pos + 10 + rdlen - 4);
+			if (minimum < ttl)
+				ttl = minimum;
+			return ttl > DNS_TTL_MAX ? 0 : ttl;
+		}
+		Pos += 10 + rdlen;
+	}
+	return 0;
+} /* Negative_TTL */
+
+/**
+ * IO callback of the DNS sockets: read an answer.
+ *
+ * Only one message is read, as handling it can finish the query and close
+ * the socket. Further messages are read when the callback is called again.
+ *
+ * @param Sock Socket descriptor.
+ * @param What (ignored IO specification)
+ */
+static void
+cb_Read_Answers(int Sock, UNUSED short What)
+{
+	UINT8 msg[DNS_MSG_LEN];
+	ng_ipaddr_t from;
+	socklen_t from_len;
+	ssize_t len;
+
+	from_len = (socklen_t)sizeof(from);
+	len = recvfrom(Sock, msg, sizeof(msg), 0, (struct sockaddr *)&from,
+		       &from_len);
+	if (len < 0) {
+		/* Errors like "connection refused" are reported as well */
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			LogDebug("DNS: Can't read answer: %s",
+				 strerror(errno));
+		return;
+	}
+	Handle_Answer(msg, (size_t)len, &from, Sock);
+} /* cb_Read_Answers */
+
+/**
+ * Timer callback of a query: retry on timeout, or deliver the result (if
+ * it couldn't be deferred, see Defer_Result()).
+ *
+ * @param Id ID of the query.
+ */
+static void
+cb_Query_Timer(int Id)
+{
+	DNS_QUERY *query;
+
+	query = Find_Query((UINT16)Id);
+	if (!query)
+		return;
+	if (query->answered)
+		Finish_Query(query);
+	else
+		Next_Try(query);
+} /* cb_Query_Timer */
+
+/* -eof- */
@@ -0,0 +1,66 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#ifndef __dns_h__
+#define __dns_h__
+
+/**
+ * @file
+ * Asynchronous DNS client (header)
+ */
+
+#include "portab.h"
+#include "defines.h"
+#include "ng_ipaddr.h"
+
+#define DNS_TYPE_A	1		/**< IPv4 address of a name */
+#define DNS_TYPE_PTR	12		/**< Name of an address */
+#define DNS_TYPE_AAAA	28		/**< IPv6 address of a name */
+
+#define DNS_MAX_ADDRS	8		/**< Max. addresses in a result */
+
+/** Result of a DNS query. */
+typedef struct _Dns_Result
+{
+	bool found;			/**< Name or address exists */
+	char name[HOST_LEN];		/**< Host name (PTR queries) */
+	ng_ipaddr_t addr[DNS_MAX_ADDRS];
+					/**< Addresses (A and AAAA queries) */
+	size_t count;			/**< Number of addresses */
+	UINT32 ttl;			/**< Time the result can be cached, in
+					     seconds (0: don't cache it) */
+} DNS_RESULT;
+
+/** Pending DNS query, see dns.c. */
+typedef struct _Dns_Query DNS_QUERY;
+
+/**
+ * Function called when a DNS query is finished. The result is only valid
+ * while the function runs, and the query must not be cancelled by it.
+ */
+typedef void (*DNS_CALLBACK) PARAMS((void *Data, const DNS_RESULT *Result));
+
+GLOBAL void Dns_Init PARAMS((const char *ResolvConfFile,
+			     const char *HostsFile));
+GLOBAL void Dns_Exit PARAMS((void));
+
+GLOBAL DNS_QUERY *Dns_QueryAddr PARAMS((const ng_ipaddr_t *Addr,
+					DNS_CALLBACK Callback, void *Data));
+GLOBAL DNS_QUERY *Dns_QueryName PARAMS((const char *Name, int Type,
+					DNS_CALLBACK Callback, void *Data));
+GLOBAL void Dns_Cancel PARAMS((DNS_QUERY *Query));
+
+GLOBAL void Dns_Run PARAMS((void));
+GLOBAL bool Dns_Deferred PARAMS((void));
+
+#endif
+
+/* -eof- */
@@ -13,10 +13,11 @@
 
 /**
  * @file
- * Hash calculation
+ * Hash calculation and hash tables
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "defines.h"
@@ -25,6 +26,7 @@
 #include "hash.h"
 
 static UINT32 jenkins_hash PARAMS((UINT8 *k, UINT32 length, UINT32 initval));
+static void Resize_Table PARAMS((HASH_TABLE *Table, size_t Size));
 
 /**
  * Calculate hash value for a given string.
@@ -42,6 +44,220 @@ Hash( const char *String )
 			    (UINT32)strlen(buffer), 42);
 } /* Hash */
 
+/**
+ * Calculate hash value for a pair of pointers.
+ *
+ * @param First First pointer.
+ * @param Second Second pointer.
+ * @return 32 bit hash value
+ */
+GLOBAL UINT32
+Hash_Pointers(const void *First, const void *Second)
+{
+	const void *key[2];
+
+	key[0] = First;
+	key[1] = Second;
+	return jenkins_hash((UINT8 *)key, (UINT32)sizeof(key), 42);
+} /* Hash_Pointers */
+
+/**
+ * Calculate hash value for binary data.
+ *
+ * @param Data Pointer to the data.
+ * @param Len Length of the data in bytes.
+ * @return 32 bit hash value
+ */
+GLOBAL UINT32
+Hash_Bytes(const void *Data, size_t Len)
+{
+	return jenkins_hash((UINT8 *)Data, (UINT32)Len, 42);
+} /* Hash_Bytes */
+
+/**
+ * Initialize a hash table.
+ *
+ * @param Table The hash table to initialize.
+ * @param Size Initial number of buckets, must be a power of 2.
+ * @return true on success, false if memory could not be allocated.
+ */
+GLOBAL bool
+Hash_TableInit(HASH_TABLE *Table, size_t Size)
+{
+	assert(Table != NULL);
+	assert(Size > 0 && (Size & (Size - 1)) == 0);
+
+	Table->count = 0;
+	Table->buckets = (HASH_ITEM **)calloc(Size, sizeof(HASH_ITEM *));
+	if (!Table->buckets) {
+		Table->size = 0;
+		return false;
+	}
+	Table->size = Size;
+	return true;
+} /* Hash_TableInit */
+
+/**
+ * Free all buckets of a hash table.
+ *
+ * The indexed items themselves are not touched and remain owned by the
+ * caller.
+ *
+ * @param Table The hash table.
+ */
+GLOBAL void
+Hash_TableFree(HASH_TABLE *Table)
+{
+	assert(Table != NULL);
+
+	free(Table->buckets);
+	Table->buckets = NULL;
+	Table->size = 0;
+	Table->count = 0;
+} /* Hash_TableFree */
+
+/**
+ * Link an item into a hash table.
+ *
+ * The table is enlarged when it holds more items than buckets; if this fails,
+ * the old bucket array is used further on (with longer chains).
+ *
+ * @param Table The hash table.
+ * @param Item The (unlinked) item, embedded in the indexed object.
+ * @param HashValue Hash value of the key of the object.
+ * @param Data Pointer to the indexed object.
+ */
+GLOBAL void
+Hash_TableAdd(HASH_TABLE *Table, HASH_ITEM *Item, UINT32 HashValue,
+	      void *Data)
+{
+	size_t idx;
+
+	assert(Table != NULL);
+	assert(Table->buckets != NULL);
+	assert(Item != NULL);
+	assert(Item->data == NULL);
+	assert(Data != NULL);
+
+	if (Table->count >= Table->size)
+		Resize_Table(Table, Table->size * 2);
+
+	idx = HashValue & (Table->size - 1);
+	Item->hash = HashValue;
+	Item->data = Data;
+	Item->next = Table->buckets[idx];
+	Table->buckets[idx] = Item;
+	Table->count++;
+} /* Hash_TableAdd */
+
+/**
+ * Unlink an item from a hash table.
+ *
+ * Items that are not linked into the table are silently ignored.
+ *
+ * @param Table The hash table.
+ * @param Item The item to remove.
+ */
+GLOBAL void
+Hash_TableRemove(HASH_TABLE *Table, HASH_ITEM *Item)
+{
+	HASH_ITEM **ptr;
+
+	assert(Table != NULL);
+	assert(Item != NULL);
+
+	if (!Item->data || !Table->buckets)
+		return;
+
+	ptr = &Table->buckets[Item->hash & (Table->size - 1)];
+	while (*ptr) {
+		if (*ptr == Item) {
+			*ptr = Item->next;
+			Table->count--;
+			break;
+		}
+		ptr = &(*ptr)->next;
+	}
+	Item->next = NULL;
+	Item->data = NULL;
+} /* Hash_TableRemove */
+
+/**
+ * Get the first item of a hash table with a given hash value.
+ *
+ * Different keys can result in the same hash value, so the caller has to
+ * compare the actual key and continue with Hash_TableNext() if it differs.
+ *
+ * @param Table The hash table.
+ * @param HashValue The hash value to look up.
+ * @return Pointer to the item or NULL if there is none.
+ */
+GLOBAL HASH_ITEM *
+Hash_TableFirst(HASH_TABLE *Table, UINT32 HashValue)
+{
+	HASH_ITEM *item;
+
+	assert(Table != NULL);
+
+	if (!Table->buckets)
+		return NULL;
+
+	item = Table->buckets[HashValue & (Table->size - 1)];
+	while (item && item->hash != HashValue)
+		item = item->next;
+	return item;
+} /* Hash_TableFirst */
+
+/**
+ * Get the next item of a hash table with the same hash value.
+ *
+ * @param Item The current item.
+ * @return Pointer to the next item or NULL if there is none.
+ */
+GLOBAL HASH_ITEM *
+Hash_TableNext(HASH_ITEM *Item)
+{
+	HASH_ITEM *item;
+
+	assert(Item != NULL);
+
+	item = Item->next;
+	while (item && item->hash != Item->hash)
+		item = item->next;
+	return item;
+} /* Hash_TableNext */
+
+/**
+ * Re-distribute all items of a hash table to a new bucket array.
+ *
+ * @param Table The hash table.
+ * @param Size New number of buckets, must be a power of 2.
+ */
+static void
+Resize_Table(HASH_TABLE *Table, size_t Size)
+{
+	HASH_ITEM **buckets, *item, *next;
+	size_t i, idx;
+
+	buckets = (HASH_ITEM **)calloc(Size, sizeof(HASH_ITEM *));
+	if (!buckets)
+		return;
+
+	for (i = 0; i < Table->size; i++) {
+		item = Table->buckets[i];
+		while (item) {
+			next = item->next;
+			idx = item->hash & (Size - 1);
+			item->next = buckets[idx];
+			buckets[idx] = item;
+			item = next;
+		}
+	}
+	free(Table->buckets);
+	Table->buckets = buckets;
+	Table->size = Size;
+} /* Resize_Table */
+
 /*
  * This hash function originates from lookup3.c of Bob Jenkins
  * (URL: <http://burtleburtle.net/bob/c/lookup3.c>):
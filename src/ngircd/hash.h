@@ -14,10 +14,41 @@
 
 /**
  * @file
- * Hash calculation (header)
+ * Hash calculation and hash tables (header)
  */
 
+/**
+ * Item of a hash table; embedded into the structure to be indexed.
+ */
+typedef struct _HASH_ITEM
+{
+	struct _HASH_ITEM *next;	/* next item in the same bucket */
+	UINT32 hash;			/* hash value of this item */
+	void *data;			/* indexed object, NULL if not linked */
+} HASH_ITEM;
+
+/**
+ * Chained hash table, the number of buckets grows with the item count.
+ */
+typedef struct _HASH_TABLE
+{
+	HASH_ITEM **buckets;		/* array of bucket chains */
+	size_t size;			/* number of buckets (power of 2) */
+	size_t count;			/* number of linked items */
+} HASH_TABLE;
+
 GLOBAL UINT32 Hash PARAMS((const char *String ));
+GLOBAL UINT32 Hash_Pointers PARAMS((const void *First, const void *Second));
+GLOBAL UINT32 Hash_Bytes PARAMS((const void *Data, size_t Len));
+
+GLOBAL bool Hash_TableInit PARAMS((HASH_TABLE *Table, size_t Size));
+GLOBAL void Hash_TableFree PARAMS((HASH_TABLE *Table));
+GLOBAL void Hash_TableAdd PARAMS((HASH_TABLE *Table, HASH_ITEM *Item,
+				  UINT32 HashValue, void *Data));
+GLOBAL void Hash_TableRemove PARAMS((HASH_TABLE *Table, HASH_ITEM *Item));
+GLOBAL HASH_ITEM *Hash_TableFirst PARAMS((HASH_TABLE *Table,
+					  UINT32 HashValue));
+GLOBAL HASH_ITEM *Hash_TableNext PARAMS((HASH_ITEM *Item));
 
 #endif
 
@@ -38,6 +38,14 @@ typedef struct {
  void (*callback)();
 #endif
  short what;
+ short ready;		/* pending readiness of edge-triggered fds */
+ bool edge;		/* fd uses edge-triggered notifications */
+ bool queued;		/* fd is listed in io_ready_fds */
+#ifdef HAVE_LINUX_IO_URING_H
+ short armed;		/* events of poll request submitted to the ring */
+ bool dirty;		/* fd is listed in io_uring_changes */
+ UINT32 seq;		/* sequence number of current poll request */
+#endif
 } io_event;
 
 #define INIT_IOEVENT		{ NULL, -1, 0, NULL }
@@ -69,14 +77,48 @@ typedef struct {
 #  endif /* HAVE_KQUEUE */
 #endif /* HAVE_EPOLL_CREATE */
 
+#ifdef HAVE_LINUX_IO_URING_H
+#  define IO_USE_IO_URING	1
+#endif
+
 static bool library_initialized = false;
 
+#ifdef IO_USE_IO_URING
+#include <endian.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define IO_URING_ENTRIES	256
+#define IO_URING_REMOVE_DATA	(~(__u64)0)	/* user_data of POLL_REMOVE */
+
+static int io_uring_fd = -1;
+static void *sq_ring, *cq_ring;
+static size_t sq_ring_size, cq_ring_size, sqes_size;
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array, sq_entries;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static UINT32 io_uring_seq;
+static array io_uring_changes;	/* fds with changed interest */
+
+static bool io_event_change_uring PARAMS((int fd));
+static int io_dispatch_uring PARAMS((struct timeval *tv));
+static void io_close_uring PARAMS((int fd));
+#else
+#define io_uring_fd -1
+#endif
+
 #ifdef IO_USE_EPOLL
 #include <sys/epoll.h>
 
 static int io_masterfd = -1;
+static array io_ready_fds;	/* edge-triggered fds with pending readiness */
 static bool io_event_change_epoll(int fd, short what, const int action);
 static int io_dispatch_epoll(struct timeval *tv);
+static void io_ready_enqueue(int fd, io_event *i);
 #endif
 
 #ifdef IO_USE_KQUEUE
@@ -177,7 +219,7 @@ io_dispatch_devpoll(struct timeval *tv)
 {
 	struct dvpoll dvp;
 	time_t sec = tv->tv_sec * 1000;
-	int i, ret, timeout = tv->tv_usec + sec;
+	int i, ret, timeout = tv->tv_usec / 1000 + sec;
 	short what;
 	struct pollfd p[MAX_EVENTS];
 
@@ -257,7 +299,7 @@ static int
 io_dispatch_poll(struct timeval *tv)
 {
 	time_t sec = tv->tv_sec * 1000;
-	int i, ret, timeout = tv->tv_usec + sec;
+	int i, ret, timeout = tv->tv_usec / 1000 + sec;
 	int fds_ready;
 	short what;
 	struct pollfd *p = array_start(&pollfds);
@@ -470,17 +512,84 @@ io_event_change_epoll(int fd, short what, const int action)
 	return epoll_ctl(io_masterfd, action, fd, &ev) == 0;
 }
 
+/*
+ * Edge-triggered fds are registered for both reading and writing exactly
+ * once, epoll only reports changes of their state. The readiness is
+ * remembered in the io_event structure until the caller reports that the
+ * socket has been drained using io_event_exhausted(), and callbacks are
+ * invoked from the list of ready fds as long as the application is
+ * interested in the respective events -- without any epoll_ctl() calls.
+ */
+static void
+io_ready_enqueue(int fd, io_event *i)
+{
+	if (i->queued)
+		return;
+	if (!array_catb(&io_ready_fds, (char *)&fd, sizeof(fd)))
+		return;
+	i->queued = true;
+}
+
+static bool
+io_ready_pending(void)
+{
+	size_t n, len;
+	int *fd;
+	io_event *i;
+
+	len = array_length(&io_ready_fds, sizeof(int));
+	fd = array_start(&io_ready_fds);
+	for (n = 0; n < len; n++) {
+		i = io_event_get(fd[n]);
+		if (i->edge && (i->ready & i->what))
+			return true;
+	}
+	return false;
+}
+
+static void
+io_dispatch_ready(void)
+{
+	size_t n, kept;
+	io_event *i;
+	short what;
+	int fd;
+
+	for (n = 0, kept = 0;
+	     n < array_length(&io_ready_fds, sizeof(int)); n++) {
+		fd = *(int *)array_get(&io_ready_fds, sizeof(int), n);
+		i = io_event_get(fd);
+		what = i->ready & i->what;
+		if (i->edge && what && i->callback)
+			i->callback(fd, what);
+
+		/* callback could have created new events, so the
+		 * io_events array might have been moved in memory */
+		i = io_event_get(fd);
+		if (i->edge && (i->ready & i->what))
+			*(int *)array_get(&io_ready_fds, sizeof(int), kept++) = fd;
+		else
+			i->queued = false;
+	}
+	array_truncate(&io_ready_fds, sizeof(int), kept);
+}
+
 static int
 io_dispatch_epoll(struct timeval *tv)
 {
 	time_t sec = tv->tv_sec * 1000;
-	int i, ret, timeout = tv->tv_usec + sec;
+	int i, ret, timeout = tv->tv_usec / 1000 + sec;
 	struct epoll_event epoll_ev[MAX_EVENTS];
+	io_event *ev;
 	short type;
 
 	if (timeout < 0)
 		timeout = 1000;
 
+	/* Don't wait when edge-triggered fds are already known to be ready */
+	if (io_ready_pending())
+		timeout = 0;
+
 	ret = epoll_wait(io_masterfd, epoll_ev, MAX_EVENTS, timeout);
 
 	for (i = 0; i < ret; i++) {
@@ -494,9 +603,21 @@ io_dispatch_epoll(struct timeval *tv)
 		if (epoll_ev[i].events & EPOLLOUT)
 			type |= IO_WANTWRITE;
 
+		ev = io_event_get(epoll_ev[i].data.fd);
+		if (ev->edge) {
+			/* Errors are reported by read() and write() */
+			if (type & IO_ERROR)
+				type = IO_WANTREAD | IO_WANTWRITE;
+			ev->ready |= type;
+			io_ready_enqueue(epoll_ev[i].data.fd, ev);
+			continue;
+		}
+
 		io_docallback(epoll_ev[i].data.fd, type);
 	}
 
+	io_dispatch_ready();
+
 	return ret;
 }
 
@@ -504,6 +625,9 @@ static void
 io_library_init_epoll(unsigned int eventsize)
 {
 	int ecreate_hint = (int)eventsize;
+
+	if (library_initialized)
+		return;
 	if (ecreate_hint <= 0)
 		ecreate_hint = 128;
 	io_masterfd = epoll_create(ecreate_hint);
@@ -525,6 +649,310 @@ io_library_init_epoll(unsigned int UNUSED ev)
 #endif /* IO_USE_EPOLL */
 
 
+#ifdef IO_USE_IO_URING
+/*
+ * The io_uring backend uses one-shot IORING_OP_POLL_ADD requests: all
+ * changes of the interest set are collected and submitted together with
+ * waiting for completions, using a single io_uring_enter() call for each
+ * iteration of the main loop. Poll requests that fired are re-armed the
+ * same way on the next iteration, if the fd is still of interest.
+ */
+
+static int
+io_uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+	       void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, io_uring_fd, to_submit,
+			    min_complete, flags, arg, argsz);
+}
+
+static unsigned
+io_uring_unsubmitted(void)
+{
+	return *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+}
+
+static struct io_uring_sqe *
+io_uring_get_sqe(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail = *sq_tail, idx;
+
+	if (io_uring_unsubmitted() >= sq_entries) {
+		/* Submission queue is full, flush it to the kernel */
+		if (io_uring_enter(io_uring_unsubmitted(), 0, 0, NULL, 0) < 0
+		    || io_uring_unsubmitted() >= sq_entries) {
+			Log(LOG_ERR, "io_uring: submission queue overflow!");
+			return NULL;
+		}
+	}
+
+	idx = tail & *sq_mask;
+	sqe = &sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sq_array[idx] = idx;
+	__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return sqe;
+}
+
+static void
+io_uring_remove_poll(int fd, io_event *i)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = ((__u64)i->seq << 32) | (UINT32)fd;
+	sqe->user_data = IO_URING_REMOVE_DATA;
+	i->armed = 0;
+}
+
+static void
+io_uring_mark_changed(int fd, io_event *i)
+{
+	if (i->dirty)
+		return;
+	if (!array_catb(&io_uring_changes, (char *)&fd, sizeof(fd))) {
+		/* can't defer the change, so submit it right now */
+		io_event_change_uring(fd);
+		return;
+	}
+	i->dirty = true;
+}
+
+static bool
+io_event_change_uring(int fd)
+{
+	struct io_uring_sqe *sqe;
+	io_event *i = io_event_get(fd);
+	UINT32 events = 0;
+
+	if (i->armed == i->what)
+		return true;
+
+	if (i->armed)
+		io_uring_remove_poll(fd, i);
+	if (!i->what)
+		return true;
+
+	sqe = io_uring_get_sqe();
+	if (!sqe)
+		return false;
+
+	if (i->what & IO_WANTREAD)
+		events = POLLIN | POLLPRI;
+	if (i->what & IO_WANTWRITE)
+		events |= POLLOUT;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	/* poll32_events is "word-reversed" on big endian systems */
+	events = (events << 16) | (events >> 16);
+#endif
+	i->seq = ++io_uring_seq;
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = events;
+	sqe->user_data = ((__u64)i->seq << 32) | (UINT32)fd;
+	i->armed = i->what;
+	return true;
+}
+
+static void
+io_uring_submit_changes(void)
+{
+	size_t n, len;
+	io_event *i;
+	int *fd;
+
+	len = array_length(&io_uring_changes, sizeof(int));
+	fd = array_start(&io_uring_changes);
+	for (n = 0; n < len; n++) {
+		i = io_event_get(fd[n]);
+		i->dirty = false;
+		io_event_change_uring(fd[n]);
+	}
+	array_trunc(&io_uring_changes);
+}
+
+static int
+io_dispatch_uring(struct timeval *tv)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	struct io_uring_cqe cqe;
+	unsigned head;
+	io_event *i;
+	int fd, ret, count = 0;
+	short what;
+
+	io_uring_submit_changes();
+
+	memset(&arg, 0, sizeof(arg));
+	ts.tv_sec = tv->tv_sec;
+	ts.tv_nsec = tv->tv_usec * 1000;
+	arg.ts = (__u64)(unsigned long)&ts;
+
+	ret = io_uring_enter(io_uring_unsubmitted(), 1,
+			     IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+			     &arg, sizeof(arg));
+	if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+		return -1;
+
+	head = *cq_head;
+	while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = cqes[head & *cq_mask];
+		__atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+
+		if (cqe.user_data == IO_URING_REMOVE_DATA)
+			continue;
+
+		fd = (int)(cqe.user_data & 0xffffffff);
+		i = io_event_get(fd);
+		if (!i || !i->armed || i->seq != (UINT32)(cqe.user_data >> 32))
+			continue;	/* outdated request */
+
+		/* One-shot request fired: re-arm it on the next iteration */
+		i->armed = 0;
+		io_uring_mark_changed(fd, i);
+
+		what = 0;
+		if (cqe.res < 0 || cqe.res & (POLLERR | POLLHUP | POLLNVAL))
+			what = IO_ERROR;
+		if (cqe.res > 0 && cqe.res & (POLLIN | POLLPRI))
+			what |= IO_WANTREAD;
+		if (cqe.res > 0 && cqe.res & POLLOUT)
+			what |= IO_WANTWRITE;
+
+		io_docallback(fd, what);
+		count++;
+	}
+
+	return count;
+}
+
+static void
+io_close_uring(int fd)
+{
+	io_event *i = io_event_get(fd);
+
+	if (!i || !i->armed)
+		return;
+
+	/* A pending poll request holds a reference to the file, so it has
+	 * to be removed right now for close() to take effect. */
+	io_uring_remove_poll(fd, i);
+	(void)io_uring_enter(io_uring_unsubmitted(), 0, 0, NULL, 0);
+}
+
+static void
+io_library_shutdown_uring(void)
+{
+	if (io_uring_fd < 0)
+		return;
+	if (sqes)
+		munmap(sqes, sqes_size);
+	if (cq_ring && cq_ring != sq_ring)
+		munmap(cq_ring, cq_ring_size);
+	if (sq_ring)
+		munmap(sq_ring, sq_ring_size);
+	sqes = NULL;
+	sq_ring = cq_ring = NULL;
+	close(io_uring_fd);
+	io_uring_fd = -1;
+	array_free(&io_uring_changes);
+}
+
+static void
+io_library_init_uring(unsigned int eventsize)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	io_uring_fd = (int)syscall(__NR_io_uring_setup, IO_URING_ENTRIES, &p);
+	if (io_uring_fd < 0) {
+		Log(LOG_INFO,
+		    "Can't initialize io_uring IO interface: %s", strerror(errno));
+		return;
+	}
+	if (!(p.features & IORING_FEAT_EXT_ARG)) {
+		Log(LOG_INFO,
+		    "Can't use io_uring IO interface: kernel is too old.");
+		close(io_uring_fd);
+		io_uring_fd = -1;
+		return;
+	}
+
+	sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_ring_size = p.cq_off.cqes
+		       + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_ring_size > sq_ring_size)
+			sq_ring_size = cq_ring_size;
+		cq_ring_size = sq_ring_size;
+	}
+	sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, io_uring_fd,
+		       IORING_OFF_SQ_RING);
+	if (sq_ring == MAP_FAILED) {
+		sq_ring = NULL;
+		goto failed;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cq_ring = sq_ring;
+	else {
+		cq_ring = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE,
+			       MAP_SHARED | MAP_POPULATE, io_uring_fd,
+			       IORING_OFF_CQ_RING);
+		if (cq_ring == MAP_FAILED) {
+			cq_ring = NULL;
+			goto failed;
+		}
+	}
+	sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, io_uring_fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		sqes = NULL;
+		goto failed;
+	}
+
+	sq = sq_ring;
+	sq_head = (unsigned *)(sq + p.sq_off.head);
+	sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	sq_array = (unsigned *)(sq + p.sq_off.array);
+	sq_entries = p.sq_entries;
+	cq = cq_ring;
+	cq_head = (unsigned *)(cq + p.cq_off.head);
+	cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	array_init(&io_uring_changes);
+	library_initialized = true;
+	Log(LOG_INFO,
+	    "IO subsystem: io_uring (%u entries, initial maxfd %u, ringfd %d).",
+	    sq_entries, eventsize, io_uring_fd);
+	return;
+
+    failed:
+	Log(LOG_INFO, "Can't map io_uring IO interface: %s", strerror(errno));
+	io_library_shutdown_uring();
+}
+#else
+static inline void
+io_library_init_uring(unsigned int UNUSED ev)
+{ /* NOTHING */ }
+static inline void
+io_library_shutdown_uring(void)
+{ /* NOTHING */ }
+#endif /* IO_USE_IO_URING */
+
+
 #ifdef IO_USE_KQUEUE
 static bool
 io_event_kqueue_commit_cache(void)
@@ -654,6 +1082,7 @@ io_library_init(unsigned int eventsize)
 	if ((eventsize > 0) && !array_alloc(&io_events, sizeof(io_event), (size_t)eventsize))
 		eventsize = 0;
 
+	io_library_init_uring(eventsize);
 	io_library_init_epoll(eventsize);
 	io_library_init_kqueue(eventsize);
 	io_library_init_devpoll(eventsize);
@@ -667,6 +1096,7 @@ io_library_init(unsigned int eventsize)
 void
 io_library_shutdown(void)
 {
+	io_library_shutdown_uring();
 #ifdef IO_USE_SELECT
 	FD_ZERO(&readers);
 	FD_ZERO(&writers);
@@ -678,6 +1108,9 @@ io_library_shutdown(void)
 #endif
 #ifdef IO_USE_KQUEUE
 	array_free(&io_evcache);
+#endif
+#ifdef IO_USE_EPOLL
+	array_free(&io_ready_fds);
 #endif
 	library_initialized = false;
 }
@@ -699,6 +1132,12 @@ static bool
 backend_create_ev(int fd, short what)
 {
 	bool ret;
+#ifdef IO_USE_IO_URING
+	if (io_uring_fd >= 0) {
+		io_uring_mark_changed(fd, io_event_get(fd));
+		return true;
+	}
+#endif
 #ifdef IO_USE_DEVPOLL
 	ret = io_event_change_devpoll(fd, what);
 #endif
@@ -727,7 +1166,7 @@ io_event_create(int fd, short what, void (*cbfunc) (int, short))
 
 	assert(fd >= 0);
 #if defined(IO_USE_SELECT) && defined(FD_SETSIZE)
-	if (io_masterfd < 0 && fd >= FD_SETSIZE) {
+	if (io_masterfd < 0 && io_uring_fd < 0 && fd >= FD_SETSIZE) {
 		Log(LOG_ERR,
 		    "fd %d exceeds FD_SETSIZE (%u) (select can't handle more file descriptors)",
 		    fd, FD_SETSIZE);
@@ -744,6 +1183,8 @@ io_event_create(int fd, short what, void (*cbfunc) (int, short))
 
 	i->callback = cbfunc;
 	i->what = 0;
+	i->ready = 0;
+	i->edge = false;
 	ret = backend_create_ev(fd, what);
 	if (ret)
 		i->what = what;
@@ -751,6 +1192,50 @@ io_event_create(int fd, short what, void (*cbfunc) (int, short))
 }
 
 
+bool
+io_event_create_edge(int fd, short what, void (*cbfunc) (int, short))
+{
+#ifdef IO_USE_EPOLL
+	struct epoll_event ev = { 0, {0} };
+	io_event *i;
+
+	if (io_masterfd >= 0) {
+		assert(fd >= 0);
+		i = (io_event *) array_alloc(&io_events, sizeof(io_event),
+					     (size_t) fd);
+		if (!i) {
+			Log(LOG_WARNING,
+			    "array_alloc failed: could not allocate space for %d io_event structures",
+			    fd);
+			return false;
+		}
+
+		ev.data.fd = fd;
+		ev.events = EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLET;
+		if (epoll_ctl(io_masterfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+			return false;
+
+		i->callback = cbfunc;
+		i->what = what;
+		i->ready = 0;
+		i->edge = true;
+		return true;
+	}
+#endif
+	return io_event_create(fd, what, cbfunc);
+}
+
+
+void
+io_event_exhausted(int fd, short what)
+{
+	io_event *i = io_event_get(fd);
+
+	if (i)
+		i->ready &= ~what;
+}
+
+
 bool
 io_event_add(int fd, short what)
 {
@@ -764,7 +1249,18 @@ io_event_add(int fd, short what)
 	io_debug("io_event_add: fd, what", fd, what);
 
 	i->what |= what;
+#ifdef IO_USE_IO_URING
+	if (io_uring_fd >= 0) {
+		io_uring_mark_changed(fd, i);
+		return true;
+	}
+#endif
 #ifdef IO_USE_EPOLL
+	if (i->edge) {
+		if (i->ready & what)
+			io_ready_enqueue(fd, i);
+		return true;
+	}
 	if (io_masterfd >= 0)
 		return io_event_change_epoll(fd, i->what, EPOLL_CTL_MOD);
 #endif
@@ -825,6 +1321,16 @@ io_close(int fd)
 	io_event *i;
 
 	i = io_event_get(fd);
+#ifdef IO_USE_IO_URING
+	if (io_uring_fd >= 0) {
+		io_close_uring(fd);
+		if (i) {
+			i->callback = NULL;
+			i->what = 0;
+		}
+		return close(fd) == 0;
+	}
+#endif
 #ifdef IO_USE_KQUEUE
 	if (array_length(&io_evcache, sizeof (struct kevent)))	/* pending data in cache? */
 		io_event_kqueue_commit_cache();
@@ -846,6 +1352,8 @@ io_close(int fd)
 	if (i) {
 		i->callback = NULL;
 		i->what = 0;
+		i->ready = 0;
+		i->edge = false;
 	}
 	return close(fd) == 0;
 }
@@ -863,6 +1371,12 @@ io_event_del(int fd, short what)
 		return true;
 
 	i->what &= ~what;
+#ifdef IO_USE_IO_URING
+	if (io_uring_fd >= 0) {
+		io_uring_mark_changed(fd, i);
+		return true;
+	}
+#endif
 #ifdef IO_USE_DEVPOLL
 	return io_event_change_devpoll(fd, i->what);
 #endif
@@ -870,6 +1384,8 @@ io_event_del(int fd, short what)
 	return io_event_change_poll(fd, i->what);
 #endif
 #ifdef IO_USE_EPOLL
+	if (i->edge)
+		return true;
 	if (io_masterfd >= 0)
 		return io_event_change_epoll(fd, i->what, EPOLL_CTL_MOD);
 #endif
@@ -891,6 +1407,10 @@ io_event_del(int fd, short what)
 int
 io_dispatch(struct timeval *tv)
 {
+#ifdef IO_USE_IO_URING
+	if (io_uring_fd >= 0)
+		return io_dispatch_uring(tv);
+#endif
 #ifdef IO_USE_EPOLL
 	if (io_masterfd >= 0)
 		return io_dispatch_epoll(tv);
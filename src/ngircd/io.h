@@ -31,6 +31,13 @@ void io_library_shutdown PARAMS((void));
 /* add fd to internal set, enable readability check, set callback */
 bool io_event_create PARAMS((int fd, short what, void (*cbfunc)(int, short)));
 
+/* like io_event_create, but use edge-triggered notifications if supported;
+   the caller must report drained sockets using io_event_exhausted() */
+bool io_event_create_edge PARAMS((int fd, short what, void (*cbfunc)(int, short)));
+
+/* reading from/writing to fd would block (EAGAIN, short read or write) */
+void io_event_exhausted PARAMS((int fd, short what));
+
 /* change callback function associated with fd */
 bool io_event_setcb PARAMS((int fd, void (*cbfunc)(int, short)));
 
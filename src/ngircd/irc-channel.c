@@ -581,6 +581,7 @@ GLOBAL bool
 IRC_LIST( CLIENT *Client, REQUEST *Req )
 {
 	char *pattern;
+	PATTERN *compiled;
 	CHANNEL *chan;
 	CLIENT *from, *target;
 	int count = 0;
@@ -618,12 +619,13 @@ IRC_LIST( CLIENT *Client, REQUEST *Req )
 
 	while (pattern) {
 		/* Loop through all the channels */
-		if (Req->argc > 0)
-			ngt_LowerStr(pattern);
+		compiled = Match_Compile(pattern, true);
+		if (!compiled)
+			break;
 		chan = Channel_First();
 		while (chan) {
 			/* Check search pattern */
-			if (MatchCaseInsensitive(pattern, Channel_Name(chan))) {
+			if (Match_Compiled(compiled, Channel_Name(chan))) {
 				/* Gotcha! */
 				if (!Channel_HasMode(chan, 's')
 				    || Channel_IsMemberOf(chan, from)
@@ -638,13 +640,16 @@ IRC_LIST( CLIENT *Client, REQUEST *Req )
 					     RPL_LIST_MSG, Client_ID(from),
 					     Channel_Name(chan),
 					     Channel_MemberCount(chan),
-					     Channel_Topic( chan )))
+					     Channel_Topic( chan ))) {
+						Match_Free(compiled);
 						return DISCONNECTED;
+					}
 					count++;
 				}
 			}
 			chan = Channel_Next(chan);
 		}
+		Match_Free(compiled);
 
 		/* Get next name ... */
 		if(Req->argc > 0)
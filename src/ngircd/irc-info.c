@@ -33,6 +33,8 @@
 #include "messages.h"
 #include "match.h"
 #include "parse.h"
+#include "resolve.h"
+#include "slab.h"
 #include "irc.h"
 #include "irc-macros.h"
 #include "irc-write.h"
@@ -207,14 +209,20 @@ IRC_WHO_Mask(CLIENT *Client, char *Mask, bool OnlyOps)
 	CLIENT *c;
 	CL2CHAN *cl2chan;
 	CHANNEL *chan;
+	PATTERN *pattern = NULL;
 	bool client_match, is_visible;
 	char flags[3];
 	int count = 0;
 
 	assert (Client != NULL);
 
-	if (Mask)
+	if (Mask) {
 		ngt_LowerStr(Mask);
+		pattern = Match_Compile(Mask, true);
+		if (!pattern)
+			return IRC_WriteStrClient(Client, RPL_ENDOFWHO_MSG,
+						  Client_ID(Client), Mask);
+	}
 
 	IRC_SetPenalty(Client, 3);
 	for (c = Client_First(); c != NULL; c = Client_Next(c)) {
@@ -224,19 +232,19 @@ IRC_WHO_Mask(CLIENT *Client, char *Mask, bool OnlyOps)
 		if (OnlyOps && !Client_HasMode(c, 'o'))
 			continue;
 
-		if (Mask) {
+		if (pattern) {
 			/* Match pattern against user host/server/name/nick */
-			client_match = MatchCaseInsensitive(Mask,
-							    Client_Hostname(c));
+			client_match = Match_Compiled(pattern,
+						      Client_Hostname(c));
 			if (!client_match)
-				client_match = MatchCaseInsensitive(Mask,
-								    Client_ID(Client_Introducer(c)));
+				client_match = Match_Compiled(pattern,
+							      Client_ID(Client_Introducer(c)));
 			if (!client_match)
-				client_match = MatchCaseInsensitive(Mask,
-								    Client_Info(c));
+				client_match = Match_Compiled(pattern,
+							      Client_Info(c));
 			if (!client_match)
-				client_match = MatchCaseInsensitive(Mask,
-								    Client_ID(c));
+				client_match = Match_Compiled(pattern,
+							      Client_ID(c));
 			if (!client_match)
 				continue;	/* no match: skip this client */
 		}
@@ -274,11 +282,14 @@ IRC_WHO_Mask(CLIENT *Client, char *Mask, bool OnlyOps)
 		if (Client_HasMode(c, 'o'))
 			flags[1] = '*';
 
-		if (!write_whoreply(Client, c, "*", flags))
+		if (!write_whoreply(Client, c, "*", flags)) {
+			Match_Free(pattern);
 			return DISCONNECTED;
+		}
 		count++;
 	}
 
+	Match_Free(pattern);
 	return IRC_WriteStrClient(Client, RPL_ENDOFWHO_MSG, Client_ID(Client),
 				  Mask ? Mask : "*");
 }
@@ -857,8 +868,9 @@ IRC_STATS( CLIENT *Client, REQUEST *Req )
 {
 	CLIENT *from, *target, *cl;
 	CONN_ID con;
-	char query;
+	char query, text[COMMAND_LEN];
 	COMMAND *cmd;
+	SLAB_CACHE *slab;
 	time_t time_now;
 	unsigned int days, hrs, mins;
 	struct list_head *list;
@@ -884,6 +896,17 @@ IRC_STATS( CLIENT *Client, REQUEST *Req )
 		query = '*';
 
 	switch (query) {
+	case 'a':	/* Statistics of accepting connections */
+	case 'A':
+		if (!Client_HasMode(from, 'o'))
+		    return IRC_WriteErrClient(from, ERR_NOPRIVILEGES_MSG,
+					      Client_ID(from));
+		if (!IRC_WriteStrClient(from, RPL_STATSACCEPT_MSG,
+					Client_ID(from),
+					Conn_AcceptStats(text,
+							 sizeof(text))))
+			return DISCONNECTED;
+		break;
 	case 'g':	/* Network-wide bans ("G-Lines") */
 	case 'G':
 	case 'k':	/* Server-local bans ("K-Lines") */
@@ -959,6 +982,33 @@ IRC_STATS( CLIENT *Client, REQUEST *Req )
 				return DISCONNECTED;
 		}
 		break;
+	case 'r':	/* Resolver cache statistics */
+	case 'R':
+		if (!Client_HasMode(from, 'o'))
+		    return IRC_WriteErrClient(from, ERR_NOPRIVILEGES_MSG,
+					      Client_ID(from));
+		if (!IRC_WriteStrClient(from, RPL_STATSRESOLVER_MSG,
+					Client_ID(from),
+					Resolve_CacheStats(text,
+							   sizeof(text))))
+			return DISCONNECTED;
+		break;
+	case 't':	/* IRC command timing (handler latencies) */
+	case 'T':
+		if (!Client_HasMode(from, 'o'))
+		    return IRC_WriteErrClient(from, ERR_NOPRIVILEGES_MSG,
+					      Client_ID(from));
+		cmd = Parse_GetCommandStruct();
+		for (; cmd->name; cmd++) {
+			if (cmd->lcount == 0 && cmd->rcount == 0)
+				continue;
+			if (!IRC_WriteStrClient
+			    (from, RPL_STATSCMDTIMING_MSG, Client_ID(from),
+			     cmd->name,
+			     Parse_CommandTiming(cmd, text, sizeof(text))))
+				return DISCONNECTED;
+		}
+		break;
 	case 'u':	/* Server uptime */
 	case 'U':
 		time_now = time(NULL) - NGIRCd_Start;
@@ -969,6 +1019,19 @@ IRC_STATS( CLIENT *Client, REQUEST *Req )
 				       days, hrs, mins, (unsigned int)time_now))
 			return DISCONNECTED;
 		break;
+	case 'z':	/* Object allocator statistics */
+	case 'Z':
+		if (!Client_HasMode(from, 'o'))
+		    return IRC_WriteErrClient(from, ERR_NOPRIVILEGES_MSG,
+					      Client_ID(from));
+		for (slab = Slab_First(); slab; slab = Slab_Next(slab)) {
+			if (!IRC_WriteStrClient(from, RPL_STATSSLAB_MSG,
+						Client_ID(from),
+						Slab_Stats(slab, text,
+							   sizeof(text))))
+				return DISCONNECTED;
+		}
+		break;
 	}
 
 	return IRC_WriteStrClient(from, RPL_ENDOFSTATS_MSG,
@@ -32,7 +32,6 @@
 #include "irc.h"
 #include "irc-macros.h"
 #include "irc-write.h"
-#include "lists.h"
 #include "log.h"
 #include "match.h"
 #include "messages.h"
@@ -385,8 +384,7 @@ GLOBAL bool
 IRC_xLINE(CLIENT *Client, REQUEST *Req)
 {
 	CLIENT *from, *c, *c_next;
-	char reason[COMMAND_LEN], class_c;
-	struct list_head *list;
+	char reason[COMMAND_LEN], class_c, listed[COMMAND_LEN];
 	time_t timeout;
 	int class;
 
@@ -463,12 +461,12 @@ IRC_xLINE(CLIENT *Client, REQUEST *Req)
 			/* Check currently connected clients */
 			snprintf(reason, sizeof(reason), "%c-Line by \"%s\": \"%s\"",
 				 class_c, Client_ID(from), Req->argv[2]);
-			list = Class_GetList(class);
 			c = Client_First();
 			while (c) {
 				c_next = Client_Next(c);
 				if ((class == CLASS_GLINE || Client_Conn(c) > NONE)
-				    && Lists_Check(list, c))
+				    && Class_GetMemberReason(class, c, listed,
+							     sizeof(listed)))
 					IRC_KillClient(Client, NULL,
 						       Client_ID(c), reason);
 				c = c_next;
@@ -583,21 +583,39 @@ cb_writeStrServersPrefixFlag(CLIENT *Client, CLIENT *Prefix, void *Buffer)
 static void
 Send_Marked_Connections(CLIENT *Prefix, const char *Buffer)
 {
+	SENDQ_BLOCK *server_line = NULL, *user_line = NULL;
+	size_t i;
 	CONN_ID conn;
 
 	assert(Prefix != NULL);
 	assert(Buffer != NULL);
 
-	conn = Conn_First();
-	while (conn != NONE) {
-		if (Conn_Flag(conn) == SEND_TO_SERVER)
-			Conn_WriteStr(conn, ":%s %s",
-				      Client_ID(Prefix), Buffer);
-		else if (Conn_Flag(conn) == SEND_TO_USER)
-			Conn_WriteStr(conn, ":%s %s",
-				      Client_MaskCloaked(Prefix), Buffer);
-		conn = Conn_Next(conn);
+	/* Only walk the connections flagged for this message, not the
+	 * whole connection pool. Both variants of the message (with the
+	 * prefix for servers and for users) are built at most once, and
+	 * the write buffers of all connections share them. */
+	for (i = 0; i < Conn_FlaggedCount(); i++) {
+		conn = Conn_Flagged(i);
+		if (Conn_Flag(conn) == SEND_TO_SERVER) {
+			if (!server_line)
+				server_line = Conn_NewLine(Client_ID(Prefix),
+							   Buffer);
+			if (server_line)
+				Conn_WriteLine(conn, server_line);
+		} else if (Conn_Flag(conn) == SEND_TO_USER) {
+			if (!user_line)
+				user_line = Conn_NewLine(
+						Client_MaskCloaked(Prefix),
+						Buffer);
+			if (user_line)
+				Conn_WriteLine(conn, user_line);
+		}
 	}
+
+	if (server_line)
+		sendq_block_release(server_line);
+	if (user_line)
+		sendq_block_release(user_line);
 }
 
 /* -eof- */
@@ -793,7 +793,8 @@ Send_Message_Mask(CLIENT * from, char * command, char * targetMask,
 		  char * message, bool SendErrors)
 {
 	CLIENT *cl;
-	bool client_match;
+	PATTERN *pattern;
+	bool client_match, result = CONNECTED;
 	char *mask = targetMask + 1;
 	const char *check_wildcards;
 
@@ -818,32 +819,33 @@ Send_Message_Mask(CLIENT * from, char * command, char * targetMask,
 					  targetMask);
 	}
 
-	if (targetMask[0] == '#') {
-		/* #: host mask, see RFC 2812, sec. 3.3.1 */
-		for (cl = Client_First(); cl != NULL; cl = Client_Next(cl)) {
-			if (Client_Type(cl) != CLIENT_USER)
-				continue;
-			client_match = MatchCaseInsensitive(mask, Client_Hostname(cl));
-			if (client_match)
-				if (!IRC_WriteStrClientPrefix(cl, from, "%s %s :%s",
-						command, Client_ID(cl), message))
-					return false;
-		}
-	} else {
-		/* $: server mask, see RFC 2812, sec. 3.3.1 */
-		assert(targetMask[0] == '$');
-		for (cl = Client_First(); cl != NULL; cl = Client_Next(cl)) {
-			if (Client_Type(cl) != CLIENT_USER)
-				continue;
-			client_match = MatchCaseInsensitive(mask,
+	pattern = Match_Compile(mask, true);
+	if (!pattern)
+		return CONNECTED;
+
+	for (cl = Client_First(); cl != NULL; cl = Client_Next(cl)) {
+		if (Client_Type(cl) != CLIENT_USER)
+			continue;
+		if (targetMask[0] == '#') {
+			/* #: host mask, see RFC 2812, sec. 3.3.1 */
+			client_match = Match_Compiled(pattern,
+						      Client_Hostname(cl));
+		} else {
+			/* $: server mask, see RFC 2812, sec. 3.3.1 */
+			assert(targetMask[0] == '$');
+			client_match = Match_Compiled(pattern,
 					Client_ID(Client_Introducer(cl)));
-			if (client_match)
-				if (!IRC_WriteStrClientPrefix(cl, from, "%s %s :%s",
-						command, Client_ID(cl), message))
-					return false;
 		}
+		if (client_match)
+			if (!IRC_WriteStrClientPrefix(cl, from, "%s %s :%s",
+					command, Client_ID(cl), message)) {
+				result = false;
+				break;
+			}
 	}
-	return CONNECTED;
+
+	Match_Free(pattern);
+	return result;
 } /* Send_Message_Mask */
 
 /* -eof- */
@@ -23,19 +23,48 @@
 #include <time.h>
 
 #include "conn.h"
+#include "hash.h"
 #include "log.h"
 #include "match.h"
 
 #include "lists.h"
 
+/*
+ * All elements of a list are indexed in a hash table, so that checking a
+ * client doesn't require matching its masks against all elements:
+ *
+ * - Masks without wildcards are indexed by the hash of the whole mask,
+ * - masks starting with at least LISTS_KEY_LEN literal characters (like
+ *   "nick!*@*") by the hash of this prefix,
+ * - masks ending with at least LISTS_KEY_LEN literal characters (like
+ *   "*!*@*.example.net") by the hash of this suffix,
+ * - and all other masks (like "*!ident@*") are "residue" indexed by
+ *   LISTS_RESIDUE_HASH, which is checked for every client.
+ *
+ * A client mask has to be looked up by all of these hash values, and the
+ * elements found have to be matched: different keys can result in the
+ * same hash value, of course. When more than one element matches, the
+ * first one in list order wins, which is the one added last: elements are
+ * numbered in the order they are added for this reason.
+ */
+
+#define LISTS_INDEX_SIZE 8	/** Initial number of buckets of the index */
+#define LISTS_KEY_LEN 3		/** Length of prefix and suffix keys */
+#define LISTS_RESIDUE_HASH 0	/** Hash value of "residue" elements */
+
 struct list_elem {
 	struct list_elem *next;	/** pointer to next list element */
 	char mask[MASK_LEN];	/** IRC mask */
+	PATTERN *pattern;	/** Compiled IRC mask */
+	HASH_ITEM index_item;	/** Item of the list index */
 	char *reason;		/** Optional "reason" text */
 	time_t valid_until;	/** 0: unlimited; t(>0): until t */
 	bool onlyonce;
+	unsigned long serial;	/** Number of the element in order of adding */
 };
 
+static unsigned long My_ListsSerial;
+
 /**
  * Get IRC mask stored in list element.
  *
@@ -114,6 +143,88 @@ Lists_GetNext(const struct list_elem *e)
 	return e->next;
 }
 
+/**
+ * Calculate the hash value of a prefix or suffix key.
+ *
+ * @param Key Start of the key.
+ * @param Type '<' for a prefix, '>' for a suffix.
+ * @return Hash value.
+ */
+static UINT32
+Key_Hash(const char *Key, char Type)
+{
+	char key[LISTS_KEY_LEN + 2];
+
+	key[0] = Type;
+	memcpy(key + 1, Key, LISTS_KEY_LEN);
+	key[LISTS_KEY_LEN + 1] = '\0';
+	return Hash(key);
+}
+
+/**
+ * Calculate the hash value a mask is indexed by.
+ *
+ * @param Mask IRC mask (compiled pattern text).
+ * @return Hash value.
+ */
+static UINT32
+Index_Hash(const char *Mask)
+{
+	size_t len, prefix, suffix;
+
+	len = strlen(Mask);
+	prefix = strcspn(Mask, "*?");
+	if (prefix == len)
+		return Hash(Mask);
+	if (prefix >= LISTS_KEY_LEN)
+		return Key_Hash(Mask, '<');
+
+	for (suffix = 0; suffix < LISTS_KEY_LEN; suffix++) {
+		if (Mask[len - 1 - suffix] == '*'
+		    || Mask[len - 1 - suffix] == '?')
+			return LISTS_RESIDUE_HASH;
+	}
+	return Key_Hash(Mask + len - LISTS_KEY_LEN, '>');
+}
+
+/**
+ * Find a list element matching a client mask using the index of the list.
+ *
+ * @param h List head.
+ * @param Mask Client mask.
+ * @param Found Matching element found so far, or NULL.
+ * @return Matching list element which comes first in the list, or NULL.
+ */
+static struct list_elem *
+Lists_Lookup(struct list_head *h, const char *Mask, struct list_elem *Found)
+{
+	UINT32 hash[4];
+	HASH_ITEM *item;
+	struct list_elem *e;
+	size_t len;
+	int i, count = 0;
+
+	len = strlen(Mask);
+	hash[count++] = Hash(Mask);
+	if (len >= LISTS_KEY_LEN) {
+		hash[count++] = Key_Hash(Mask, '<');
+		hash[count++] = Key_Hash(Mask + len - LISTS_KEY_LEN, '>');
+	}
+	hash[count++] = LISTS_RESIDUE_HASH;
+
+	for (i = 0; i < count; i++) {
+		for (item = Hash_TableFirst(&h->index, hash[i]); item;
+		     item = Hash_TableNext(item)) {
+			e = (struct list_elem *)item->data;
+			if (Found && e->serial <= Found->serial)
+				continue;
+			if (Match_Compiled(e->pattern, Mask))
+				Found = e;
+		}
+	}
+	return Found;
+}
+
 /**
  * Add a new mask to a list.
  *
@@ -152,7 +263,22 @@ Lists_Add(struct list_head *h, const char *Mask, time_t ValidUntil,
 		return false;
 	}
 
+	if (!h->index.buckets && !Hash_TableInit(&h->index, LISTS_INDEX_SIZE)) {
+		Log(LOG_EMERG, "Can't allocate memory for list index!");
+		free(newelem);
+		return false;
+	}
+
 	strlcpy(newelem->mask, Mask, sizeof(newelem->mask));
+	newelem->pattern = Match_Compile(newelem->mask, true);
+	if (!newelem->pattern) {
+		free(newelem);
+		return false;
+	}
+	newelem->index_item.next = NULL;
+	newelem->index_item.data = NULL;
+	Hash_TableAdd(&h->index, &newelem->index_item,
+		      Index_Hash(newelem->pattern->text), newelem);
 	if (Reason) {
 		newelem->reason = strdup(Reason);
 		if (!newelem->reason)
@@ -163,6 +289,7 @@ Lists_Add(struct list_head *h, const char *Mask, time_t ValidUntil,
 		newelem->reason = NULL;
 	newelem->valid_until = ValidUntil;
 	newelem->onlyonce = OnlyOnce;
+	newelem->serial = ++My_ListsSerial;
 	newelem->next = e;
 	h->first = newelem;
 
@@ -190,6 +317,8 @@ Lists_Unlink(struct list_head *h, struct list_elem *p, struct list_elem *victim)
 	if (victim->reason)
 		free(victim->reason);
 
+	Hash_TableRemove(&h->index, &victim->index_item);
+	Match_Free(victim->pattern);
 	free(victim);
 }
 
@@ -242,8 +371,10 @@ Lists_Free(struct list_head *head)
 		e = e->next;
 		if (victim->reason)
 			free(victim->reason);
+		Match_Free(victim->pattern);
 		free(victim);
 	}
+	Hash_TableFree(&head->index);
 }
 
 /**
@@ -332,31 +463,38 @@ Lists_Check(struct list_head *h, CLIENT *Client)
 bool
 Lists_CheckReason(struct list_head *h, CLIENT *Client, char *reason, size_t len)
 {
-	struct list_elem *e, *last, *next;
+	struct list_elem *e, *last;
+	char mask[CLIENT_NICK_LEN + CLIENT_USER_LEN + CLIENT_HOST_LEN];
 
 	assert(h != NULL);
 
-	e = h->first;
-	last = NULL;
+	if (!h->first)
+		return false;
 
-	while (e) {
-		next = e->next;
-		if (MatchCaseInsensitive(e->mask, Client_MaskCloaked(Client)) || MatchCaseInsensitive(e->mask, Client_Mask(Client))) {
-			if (len && e->reason)
-				strlcpy(reason, e->reason, len);
-			if (e->onlyonce) {
-				/* Entry is valid only once, delete it */
-				LogDebug("Deleted \"%s\" from list (used).",
-					 e->mask);
-				Lists_Unlink(h, last, e);
-			}
-			return true;
+	/* Client_Mask() and Client_MaskCloaked() share a static buffer,
+	 * and both masks are the same when the client doesn't use
+	 * cloaking, so check the cloaked mask only if necessary. */
+	strlcpy(mask, Client_Mask(Client), sizeof(mask));
+	e = Lists_Lookup(h, mask, NULL);
+	if (Client_HasMode(Client, 'x'))
+		e = Lists_Lookup(h, Client_MaskCloaked(Client), e);
+	if (!e)
+		return false;
+
+	if (len && e->reason)
+		strlcpy(reason, e->reason, len);
+	if (e->onlyonce) {
+		/* Entry is valid only once, delete it */
+		LogDebug("Deleted \"%s\" from list (used).", e->mask);
+		last = NULL;
+		if (e != h->first) {
+			for (last = h->first; last->next != e;
+			     last = last->next)
+				;
 		}
-		last = e;
-		e = next;
+		Lists_Unlink(h, last, e);
 	}
-
-	return false;
+	return true;
 }
 
 /**
@@ -406,17 +544,9 @@ Lists_Expire(struct list_head *h, const char *ListName)
 GLOBAL unsigned long
 Lists_Count(struct list_head *h)
 {
-	struct list_elem *e;
-	unsigned long count = 0;
-
 	assert(h != NULL);
 
-	e = h->first;
-	while (e) {
-		count++;
-		e = e->next;
-	}
-	return count;
+	return (unsigned long)h->index.count;
 }
 
 /* -eof- */
@@ -19,11 +19,13 @@
 
 #include "portab.h"
 #include "client.h"
+#include "hash.h"
 
 struct list_elem;
 
 struct list_head {
 	struct list_elem *first;
+	HASH_TABLE index;	/* index of all elements, see lists.c */
 };
 
 GLOBAL struct list_elem *Lists_GetFirst PARAMS((const struct list_head *));
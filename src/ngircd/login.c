@@ -40,10 +40,9 @@
 
 #ifdef PAM
 
-#include "io.h"
 #include "pam.h"
 
-static void cb_Read_Auth_Result PARAMS((int r_fd, UNUSED short events));
+static void cb_Auth_Result PARAMS((CONN_ID conn, int result));
 
 #endif
 
@@ -52,8 +51,8 @@ static void cb_Read_Auth_Result PARAMS((int r_fd, UNUSED short events));
  *
  * This function is called after the daemon received the required NICK and
  * USER commands of a new client. If the daemon is compiled with support for
- * PAM, the authentication sub-processs is forked; otherwise the global server
- * password is checked.
+ * PAM, the client is passed to the authentication processes; otherwise the
+ * global server password is checked.
  *
  * @param Client The client logging in.
  * @returns CONNECTED or DISCONNECTED.
@@ -61,10 +60,6 @@ static void cb_Read_Auth_Result PARAMS((int r_fd, UNUSED short events));
 GLOBAL bool
 Login_User(CLIENT * Client)
 {
-#ifdef PAM
-	int pipefd[2], result;
-	pid_t pid;
-#endif
 	CONN_ID conn;
 
 	assert(Client != NULL);
@@ -111,25 +106,15 @@ Login_User(CLIENT * Client)
 	}
 
 	if (Conf_PAM) {
-		/* Fork child process for PAM authentication; and make sure that the
-		 * process timeout is set higher than the login timeout! */
-		pid = Proc_Fork(Conn_GetProcStat(conn), pipefd,
-				cb_Read_Auth_Result, Conf_PongTimeout + 1);
-		if (pid > 0) {
-			LogDebug("Authenticator for connection %d created (PID %d).",
-				 conn, pid);
-			return CONNECTED;
-		} else {
-			/* Sub process */
-			Log_Init_Subprocess("Auth");
-			Conn_CloseAllSockets(NONE);
-			result = PAM_Authenticate(Client);
-			if (write(pipefd[1], &result, sizeof(result)) != sizeof(result))
-				Log_Subprocess(LOG_ERR,
-					       "Failed to pipe result to parent!");
-			Log_Exit_Subprocess("Auth");
-			exit(0);
+		/* Queue PAM authentication request, the connection is
+		 * ignored until the result is available. */
+		if (!PAM_Authenticate(Conn_GetAuthStat(conn), Client,
+				      cb_Auth_Result)) {
+			Client_Reject(Client, "Internal error", false);
+			return DISCONNECTED;
 		}
+		LogDebug("Authentication of connection %d requested.", conn);
+		return CONNECTED;
 	} else return CONNECTED;
 #else
 	/* Check global server password ... */
@@ -242,46 +227,32 @@ Login_Autojoin(CLIENT *Client)
 #ifdef PAM
 
 /**
- * Read result of the authenticator sub-process from pipe
+ * Handle the result of the PAM authentication of a client.
  *
- * @param r_fd		File descriptor of the pipe.
- * @param events	(ignored IO specification)
+ * @param conn		Connection index.
+ * @param result	PAM_AUTH_OK, PAM_AUTH_FAILED or PAM_AUTH_ERROR.
  */
 static void
-cb_Read_Auth_Result(int r_fd, UNUSED short events)
+cb_Auth_Result(CONN_ID conn, int result)
 {
 	char user[CLIENT_USER_LEN], *ptr;
-	CONN_ID conn;
 	CLIENT *client;
-	int result;
-	size_t len;
-	PROC_STAT *proc;
 
-	LogDebug("Auth: Got callback on fd %d, events %d", r_fd, events);
-	conn = Conn_GetFromProc(r_fd);
-	if (conn == NONE) {
+	LogDebug("Auth: Got result %d for connection %d", result, conn);
+	client = Conn_GetClient(conn);
+	if (!client) {
 		/* Ops, none found? Probably the connection has already
 		 * been closed!? We'll ignore that ... */
-		io_close(r_fd);
-		LogDebug("Auth: Got callback for unknown connection!?");
+		LogDebug("Auth: Got result for unknown connection!?");
 		return;
 	}
-	proc = Conn_GetProcStat(conn);
-	client = Conn_GetClient(conn);
-
-	/* Read result from pipe */
-	len = Proc_Read(proc, &result, sizeof(result));
-	Proc_Close(proc);
-	if (len == 0)
-		return;
 
-	if (len != sizeof(result)) {
-		Log(LOG_CRIT, "Auth: Got malformed result!");
+	if (result == PAM_AUTH_ERROR) {
 		Client_Reject(client, "Internal error", false);
 		return;
 	}
 
-	if (result == true) {
+	if (result == PAM_AUTH_OK) {
 		/* Authentication succeeded, now set the correct user name
 		 * supplied by the client (without prepended '~' for example),
 		 * but cut it at the first '@' character: */
@@ -17,28 +17,33 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "defines.h"
+#include "log.h"
 #include "tool.h"
 
 #include "match.h"
 
 /*
- * The pattern matching functions [Matche(), Matche_After_Star()] are based
- * on code of J. Kercheval. Version 1.1 has been released on 1991-03-12 as
- * "public domain": <http://c.snippets.org/snip_lister.php?fname=match.c>
+ * Patterns consist of literal characters and the wildcards '?' (any single
+ * character) and '*' (any sequence of characters, including none). So the
+ * stars split a pattern into "segments" of fixed length, and the first
+ * segment must match at the start of the string and the last segment at
+ * its end (unless the pattern starts or ends with a star, respectively).
+ * All other segments can simply be searched for from left to right, because
+ * taking the leftmost position of a segment never prevents the following
+ * segments from matching. Therefore no backtracking is required at all, and
+ * the run time is bounded by the product of the lengths of the string and
+ * the pattern, instead of growing exponentially with the number of stars.
  */
 
-static int Matche PARAMS(( const char *p, const char *t ));
-static int Matche_After_Star PARAMS(( const char *p, const char *t ));
-
-#define MATCH_PATTERN	6	/**< bad pattern */
-#define MATCH_LITERAL	5	/**< match failure on literal match */
-#define MATCH_RANGE	4	/**< match failure on [..] construct */
-#define MATCH_ABORT	3	/**< premature end of text string */
-#define MATCH_END	2	/**< premature end of pattern string */
-#define MATCH_VALID	1	/**< valid match */
+static bool Match_Segment PARAMS((const char *Segment, const char *String,
+				  size_t Len, bool Fold));
+static bool Match_Segments PARAMS((const char *Pattern, const char *String,
+				   size_t Len, bool Fold));
 
 /**
  * Match string with pattern.
@@ -50,28 +55,31 @@ static int Matche_After_Star PARAMS(( const char *p, const char *t ));
 GLOBAL bool
 Match( const char *Pattern, const char *String )
 {
-	if (Matche(Pattern, String) == MATCH_VALID)
-		return true;
-	else
-		return false;
+	assert(Pattern != NULL);
+	assert(String != NULL);
+
+	return Match_Segments(Pattern, String, strlen(String), false);
 } /* Match */
 
 /**
  * Match string with pattern case-insensitive.
  *
- * @param Pattern Pattern to match with
- * @param String Input string, at most COMMAND_LEN-1 characters long
+ * @param Pattern Pattern to match with, at most COMMAND_LEN-1 characters long
+ * @param String Input string
  * @return true if pattern matches
  */
 GLOBAL bool
 MatchCaseInsensitive(const char *Pattern, const char *String)
 {
-	char needle[COMMAND_LEN], haystack[COMMAND_LEN];
+	char needle[COMMAND_LEN];
+
+	assert(Pattern != NULL);
+	assert(String != NULL);
 
 	strlcpy(needle, Pattern, sizeof(needle));
-	strlcpy(haystack, String, sizeof(haystack));
 
-	return Match(ngt_LowerStr(needle), ngt_LowerStr(haystack));
+	return Match_Segments(ngt_LowerStr(needle), String, strlen(String),
+			      true);
 } /* MatchCaseInsensitive */
 
 /**
@@ -100,83 +108,155 @@ MatchCaseInsensitiveList(const char *Pattern, const char *String,
 	return false;
 } /* MatchCaseInsensitive */
 
-static int
-Matche( const char *p, const char *t )
+/**
+ * Compile a pattern for matching it against many strings.
+ *
+ * The compiled pattern is folded to lower case already (when matching
+ * case-insensitive), and redundant stars are removed from it.
+ *
+ * @param Pattern Pattern to compile.
+ * @param CaseInsensitive true to match case-insensitive.
+ * @return Compiled pattern (to free using Match_Free()) or NULL on error.
+ */
+GLOBAL PATTERN *
+Match_Compile(const char *Pattern, bool CaseInsensitive)
 {
-	for( ; *p; p++, t++ )
-	{
-		/* if this is the end of the text then this is the end of the match */
-		if( ! *t )
-		{
-			return ( *p == '*' && *++p == '\0' ) ? MATCH_VALID : MATCH_ABORT;
-		}
+	PATTERN *pattern;
+	char *ptr;
 
-		/* determine and react to pattern type */
-		switch( *p )
-		{
-			case '?':	/* single any character match */
-				break;
+	assert(Pattern != NULL);
 
-			case '*':	/* multiple any character match */
-				return Matche_After_Star( p, t );
+	pattern = malloc(sizeof(PATTERN) + strlen(Pattern) + 1);
+	if (!pattern) {
+		Log(LOG_EMERG, "Can't allocate memory! [Match_Compile]");
+		return NULL;
+	}
+	pattern->text = (char *)(pattern + 1);
+	pattern->min_len = 0;
+	pattern->fold = CaseInsensitive;
 
-			default:	/* must match this character exactly */
-				if( *p != *t ) return MATCH_LITERAL;
-		}
+	for (ptr = pattern->text; *Pattern; Pattern++) {
+		if (*Pattern == '*') {
+			if (ptr > pattern->text && ptr[-1] == '*')
+				continue;
+		} else
+			pattern->min_len++;
+		*ptr++ = CaseInsensitive ? (char)tolower((unsigned char)*Pattern)
+					 : *Pattern;
 	}
-	/* if end of text not reached then the pattern fails */
+	*ptr = '\0';
 
-	if( *t ) return MATCH_END;
-	else return MATCH_VALID;
-} /* Matche */
+	return pattern;
+} /* Match_Compile */
 
-static int
-Matche_After_Star( const char *p, const char *t )
+/**
+ * Match string with a compiled pattern.
+ *
+ * @param Pattern Compiled pattern, see Match_Compile().
+ * @param String Input string.
+ * @return true if pattern matches
+ */
+GLOBAL bool
+Match_Compiled(const PATTERN *Pattern, const char *String)
 {
-	register int nextp, match = 0;
-
-	/* pass over existing ? and * in pattern */
-	while( *p == '?' || *p == '*' )
-	{
-		/* take one char for each ? and + */
-		if (*p == '?')
-		{
-			/* if end of text then no match */
-			if( ! *t++ ) return MATCH_ABORT;
-		}
+	size_t len;
 
-		/* move to next char in pattern */
-		p++;
-	}
+	assert(Pattern != NULL);
+	assert(String != NULL);
+
+	len = strlen(String);
+	if (len < Pattern->min_len)
+		return false;
 
-	/* if end of pattern we have matched regardless of text left */
-	if( ! *p ) return MATCH_VALID;
+	return Match_Segments(Pattern->text, String, len, Pattern->fold);
+} /* Match_Compiled */
 
-	/* get the next character to match which must be a literal or '[' */
-	nextp = *p;
-	if( nextp == '\\' )
-	{
-		nextp = p[1];
+/**
+ * Free a compiled pattern.
+ *
+ * @param Pattern Compiled pattern, see Match_Compile(), or NULL.
+ */
+GLOBAL void
+Match_Free(PATTERN *Pattern)
+{
+	free(Pattern);
+} /* Match_Free */
 
-		/* if end of text then we have a bad pattern */
-		if( ! nextp ) return MATCH_PATTERN;
+/**
+ * Compare one segment of a pattern with a part of a string.
+ *
+ * @param Segment Segment of the pattern (folded when Fold is set).
+ * @param String Part of the input string.
+ * @param Len Length of the segment.
+ * @param Fold true to fold the string to lower case.
+ * @return true if the segment matches.
+ */
+static bool
+Match_Segment(const char *Segment, const char *String, size_t Len, bool Fold)
+{
+	size_t i;
+	char c;
+
+	for (i = 0; i < Len; i++) {
+		if (Segment[i] == '?')
+			continue;
+		c = Fold ? (char)tolower((unsigned char)String[i]) : String[i];
+		if (Segment[i] != c)
+			return false;
 	}
+	return true;
+} /* Match_Segment */
+
+/**
+ * Match string with pattern, segment by segment.
+ *
+ * @param Pattern Pattern to match with (folded when Fold is set).
+ * @param String Input string.
+ * @param Len Length of the input string.
+ * @param Fold true to fold the string to lower case.
+ * @return true if pattern matches
+ */
+static bool
+Match_Segments(const char *Pattern, const char *String, size_t Len, bool Fold)
+{
+	const char *end = String + Len;
+	size_t seg;
+	bool star;
 
-	/* Continue until we run out of text or definite result seen */
-	do
-	{
-		/* a precondition for matching is that the next character
-		 * in the pattern match the next character in the text or that
-		 * the next pattern char is the beginning of a range.  Increment
-		 * text pointer as we go here */
-		if( nextp == *t || nextp == '[' ) match = Matche( p, t );
-
-		/* if the end of text is reached then no match */
-		if( ! *t++ ) match = MATCH_ABORT;
-	} while( match != MATCH_VALID && match != MATCH_ABORT && match != MATCH_PATTERN );
-
-	/* return result */
-	return match;
-} /* Matche_After_Star */
+	while (true) {
+		star = false;
+		while (*Pattern == '*') {
+			star = true;
+			Pattern++;
+		}
+		seg = strcspn(Pattern, "*");
+
+		if (!Pattern[seg]) {
+			/* Last segment: must match at the end of the string */
+			if (star ? (size_t)(end - String) < seg
+				 : (size_t)(end - String) != seg)
+				return false;
+			return Match_Segment(Pattern, end - seg, seg, Fold);
+		}
+
+		if (!star) {
+			/* First segment: must match at the start */
+			if ((size_t)(end - String) < seg
+			    || !Match_Segment(Pattern, String, seg, Fold))
+				return false;
+		} else {
+			/* Search leftmost position of this segment */
+			while (true) {
+				if ((size_t)(end - String) < seg)
+					return false;
+				if (Match_Segment(Pattern, String, seg, Fold))
+					break;
+				String++;
+			}
+		}
+		String += seg;
+		Pattern += seg;
+	}
+} /* Match_Segments */
 
 /* -eof- */
@@ -17,6 +17,15 @@
  * Wildcard pattern matching (header)
  */
 
+/** Compiled pattern, see Match_Compile(). */
+typedef struct _Pattern
+{
+	char *text;		/**< Pattern text, folded to lower case when
+				     matching case-insensitive */
+	size_t min_len;		/**< Minimum length of matching strings */
+	bool fold;		/**< Match case-insensitive */
+} PATTERN;
+
 GLOBAL bool Match PARAMS((const char *Pattern, const char *String));
 
 GLOBAL bool MatchCaseInsensitive PARAMS((const char *Pattern,
@@ -26,6 +35,12 @@ GLOBAL bool MatchCaseInsensitiveList PARAMS((const char *Pattern,
 					     const char *String,
 					     const char *Separator));
 
+GLOBAL PATTERN *Match_Compile PARAMS((const char *Pattern,
+				      bool CaseInsensitive));
+GLOBAL bool Match_Compiled PARAMS((const PATTERN *Pattern,
+				   const char *String));
+GLOBAL void Match_Free PARAMS((PATTERN *Pattern));
+
 #endif
 
 /* -eof- */
@@ -36,6 +36,10 @@
 #define RPL_SERVLIST_MSG		"234 %s %s %s %s %d %d :%s"
 #define RPL_SERVLISTEND_MSG		"235 %s %s %s :End of service listing"
 #define RPL_STATSUPTIME			"242 %s :Server Up %u days %u:%02u:%02u"
+#define RPL_STATSCMDTIMING_MSG		"249 %s :%s %s"
+#define RPL_STATSACCEPT_MSG		"249 %s :Connections: %s"
+#define RPL_STATSRESOLVER_MSG		"249 %s :Resolver cache: %s"
+#define RPL_STATSSLAB_MSG		"249 %s :Objects: %s"
 #define RPL_LUSERCLIENT_MSG		"251 %s :There are %ld users and %ld services on %ld servers"
 #define RPL_LUSEROP_MSG			"252 %s %lu :operator(s) online"
 #define RPL_LUSERUNKNOWN_MSG		"253 %s %lu :unknown connection(s)"
@@ -40,6 +40,8 @@
 #include "channel.h"
 #include "conf.h"
 #include "log.h"
+#include "pam.h"
+#include "resolve.h"
 #include "sighandlers.h"
 #include "io.h"
 
@@ -258,6 +260,10 @@ main(int argc, const char *argv[])
 		Conf_Init();
 		Log_ReInit();
 
+		/* The resolver reads its configuration files, so initialize
+		 * it before a chroot environment is entered. */
+		Resolve_Init();
+
 		/* Initialize the "main program":
 		 * chroot environment, user and group ID, ... */
 		if (!NGIRCd_Init(NGIRCd_NoDaemon)) {
@@ -283,6 +289,11 @@ main(int argc, const char *argv[])
 		Conn_Init();
 		Class_Init();
 		Client_Init();
+#ifdef PAM
+		/* Start the authentication processes before the daemon
+		 * is listening on any socket. */
+		PAM_Init();
+#endif
 
 		/* Create protocol and server identification. The syntax
 		 * used by ngIRCd in PASS commands and the known "extended
@@ -320,6 +331,10 @@ main(int argc, const char *argv[])
 		/* Main Run Loop */
 		Conn_Handler();
 
+		Resolve_Exit();
+#ifdef PAM
+		PAM_Exit();
+#endif
 		Conn_Exit();
 		Client_Exit();
 		Channel_Exit();
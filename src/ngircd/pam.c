@@ -1,6 +1,6 @@
 /*
  * ngIRCd -- The Next Generation IRC Daemon
- * Copyright (c)2001-2014 Alexander Barton (alex@barton.de) and Contributors.
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -16,11 +16,29 @@
 /**
  * @file
  * PAM User Authentication
+ *
+ * The PAM library functions block, so authentication is done by a fixed
+ * pool of PAM_WORKERS sub-processes, which are started in advance and
+ * handle the requests of all connections. Requests and replies are sent
+ * over a socket pair per process and carry an ID, so a process can get
+ * further requests while it is still busy and no process is forked when
+ * a client logs in.
+ *
+ * Each request has a time limit, which includes the time it waits in the
+ * queue of a process. A process which doesn't answer its current request
+ * in time is killed. When a process terminates, its current request fails,
+ * all other requests queued for it are passed to the other processes, and
+ * a new process is started.
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
 #ifdef HAVE_SECURITY_PAM_APPL_H
 # include <security/pam_appl.h>
 #endif
@@ -29,15 +47,96 @@
 #endif
 
 #include "defines.h"
+#include "array.h"
 #include "log.h"
 #include "conn.h"
 #include "client.h"
 #include "conf.h"
+#include "hash.h"
+#include "io.h"
+#include "timer.h"
 
 #include "pam.h"
 
+#define PAM_WORKERS 4			/** Number of authentication processes */
+#define PAM_JOBS_SIZE 64		/** Initial size of the hash table */
+#define PAM_RESTART_DELAY 5		/** Delay to restart failing processes */
+
+/** Time limit of requests, must be higher than the login timeout! */
+#define PAM_TIMEOUT (Conf_PongTimeout + 1)
+
+/** Time limit of a process for answering its current request: a process
+ * which hangs is killed early enough for the requests queued behind to be
+ * handled by another process in time. */
+#define PAM_PROCESS_TIMEOUT (PAM_TIMEOUT / 2 + 1)
+
+/** Request sent to an authentication process. */
+typedef struct _Pam_Request
+{
+	UINT32 id;			/* request ID */
+	char service[MAX_PAM_SERVICE_NAME_LEN];
+					/* PAM service name */
+	char user[CLIENT_USER_LEN];	/* user name supplied by the client */
+	char ruser[CLIENT_USER_LEN];	/* current user name of the client */
+	char host[CLIENT_HOST_LEN];	/* host name of the client */
+	char mask[MASK_LEN];		/* client mask, for log messages */
+	char password[COMMAND_LEN];	/* password supplied by the client */
+} PAM_REQUEST;
+
+/** Reply of an authentication process. */
+typedef struct _Pam_Reply
+{
+	UINT32 id;			/* request ID */
+	int result;			/* PAM_AUTH_OK or PAM_AUTH_FAILED */
+} PAM_REPLY;
+
+/** Authentication process. */
+typedef struct _Pam_Worker
+{
+	PROC_STAT proc;			/* process ID and socket */
+	TIMER *timer;			/* time limit of the current request, or
+					   delayed restart of the process */
+	time_t started;			/* time the process has been started */
+	array queue;			/* IDs of requests not answered yet,
+					   the current request first */
+	array wbuf;			/* requests not written yet */
+	char rbuf[sizeof(PAM_REPLY)];	/* partial reply */
+	size_t rlen;			/* length of partial reply */
+} PAM_WORKER;
+
+/** Pending authentication of a connection. */
+typedef struct _Pam_Job
+{
+	HASH_ITEM item;			/* item in Jobs table, key: id */
+	UINT32 id;			/* request ID */
+	CONN_ID conn;			/* connection to authenticate */
+	PAM_WORKER *worker;		/* process handling the request */
+	TIMER *timer;			/* time limit of the request */
+	void (*cbfunc)(CONN_ID, int);	/* function receiving the result */
+	PAM_REQUEST req;		/* the request, to queue it again */
+} PAM_JOB;
+
+static PAM_WORKER Workers[PAM_WORKERS];
+static HASH_TABLE Jobs;
+static UINT32 Last_Id;
 static char *password;
 
+static bool Start_Worker PARAMS((PAM_WORKER *w));
+static void Stop_Worker PARAMS((PAM_WORKER *w));
+static void Worker_Failed PARAMS((PAM_WORKER *w));
+static PAM_WORKER *Select_Worker PARAMS((void));
+static unsigned int Pending PARAMS((PAM_WORKER *w));
+static bool Queue_Job PARAMS((PAM_JOB *job));
+static bool Flush_Requests PARAMS((PAM_WORKER *w));
+static PAM_JOB *Find_Job PARAMS((UINT32 Id));
+static void Finish_Job PARAMS((PAM_JOB *job, int Result));
+static void Free_Job PARAMS((PAM_JOB *job));
+static void cb_Worker PARAMS((int Sock, short What));
+static void cb_Worker_Timer PARAMS((int Idx));
+static void cb_Job_Timer PARAMS((int Id));
+static void Worker_Main PARAMS((int Sock));
+static bool Authenticate PARAMS((PAM_REQUEST *Req));
+
 /**
  * PAM "conversation function".
  * This is a callback function used by the PAM library to get the password.
@@ -82,34 +181,569 @@ static struct pam_conv conv = {
 	NULL
 };
 
+/**
+ * Initialize the pool of authentication processes.
+ *
+ * The processes are started when PAM is enabled, so this function must be
+ * called after the root directory and the user ID have been changed, and
+ * before the server starts listening for connections.
+ */
+GLOBAL void
+PAM_Init(void)
+{
+	int i;
+
+	if (!Hash_TableInit(&Jobs, PAM_JOBS_SIZE)) {
+		Log(LOG_EMERG, "Can't allocate memory for PAM requests!");
+		exit(1);
+	}
+
+	for (i = 0; i < PAM_WORKERS; i++) {
+		Proc_InitStruct(&Workers[i].proc);
+		array_init(&Workers[i].queue);
+		array_init(&Workers[i].wbuf);
+		Workers[i].rlen = 0;
+		Workers[i].timer = Timer_New(cb_Worker_Timer, i);
+		if (!Workers[i].timer) {
+			Log(LOG_EMERG, "Failed to initialize PAM timer!");
+			exit(1);
+		}
+		if (Conf_PAM)
+			Start_Worker(&Workers[i]);
+	}
+} /* PAM_Init */
+
+/**
+ * Discard all pending requests and stop the authentication processes.
+ */
+GLOBAL void
+PAM_Exit(void)
+{
+	HASH_ITEM *item;
+	size_t i;
+
+	if (Jobs.buckets) {
+		for (i = 0; i < Jobs.size; i++) {
+			while ((item = Jobs.buckets[i]))
+				Free_Job((PAM_JOB *)item->data);
+		}
+		Hash_TableFree(&Jobs);
+	}
+
+	for (i = 0; i < PAM_WORKERS; i++) {
+		Stop_Worker(&Workers[i]);
+		Timer_Free(Workers[i].timer);
+		Workers[i].timer = NULL;
+	}
+} /* PAM_Exit */
+
+/**
+ * Check if the authentication of a connection is still pending.
+ */
+GLOBAL bool
+PAM_InProgress(const AUTH_STAT *s)
+{
+	assert(s != NULL);
+
+	return s->id != 0 && Find_Job(s->id) != NULL;
+} /* PAM_InProgress */
+
 /**
  * Authenticate a connecting client using PAM.
+ *
+ * The request is queued for the least busy authentication process, and the
+ * callback function gets the result (PAM_AUTH_OK, PAM_AUTH_FAILED or
+ * PAM_AUTH_ERROR) later on, but after PAM_TIMEOUT seconds at the latest.
+ *
+ * @param s Authentication status of the connection.
  * @param Client The client to authenticate.
- * @return true when authentication succeeded, false otherwise.
+ * @param cbfunc Function receiving the result.
+ * @return true if the request has been queued, false otherwise.
  */
 GLOBAL bool
-PAM_Authenticate(CLIENT *Client) {
+PAM_Authenticate(AUTH_STAT *s, CLIENT *Client, void (*cbfunc)(CONN_ID, int))
+{
+	PAM_JOB *job;
+
+	assert(s != NULL);
+	assert(Client != NULL);
+	assert(cbfunc != NULL);
+	assert(!PAM_InProgress(s));
+
+	job = (PAM_JOB *)calloc(1, sizeof(PAM_JOB));
+	if (!job) {
+		Log(LOG_EMERG, "Can't allocate memory! [PAM_Authenticate]");
+		return false;
+	}
+
+	do {
+		if (++Last_Id == 0)
+			Last_Id = 1;
+	} while (Find_Job(Last_Id));
+
+	job->id = Last_Id;
+	job->conn = Client_Conn(Client);
+	job->cbfunc = cbfunc;
+	job->req.id = job->id;
+	strlcpy(job->req.service, Conf_PAMServiceName,
+		sizeof(job->req.service));
+	strlcpy(job->req.user, Client_OrigUser(Client), sizeof(job->req.user));
+	strlcpy(job->req.ruser, Client_User(Client), sizeof(job->req.ruser));
+	strlcpy(job->req.host, Client_Hostname(Client), sizeof(job->req.host));
+	strlcpy(job->req.mask, Client_Mask(Client), sizeof(job->req.mask));
+	strlcpy(job->req.password, Conn_Password(Client_Conn(Client)),
+		sizeof(job->req.password));
+
+	job->timer = Timer_New(cb_Job_Timer, (int)job->id);
+	if (!job->timer || !Queue_Job(job)) {
+		if (job->timer)
+			Timer_Free(job->timer);
+		memset(&job->req, 0, sizeof(job->req));
+		free(job);
+		return false;
+	}
+	Hash_TableAdd(&Jobs, &job->item, job->id, job);
+	Timer_Set(job->timer, time(NULL) + PAM_TIMEOUT);
+
+	s->id = job->id;
+	return true;
+} /* PAM_Authenticate */
+
+/**
+ * Cancel the authentication of a connection.
+ *
+ * The authentication process still handles the request, but its result
+ * is ignored.
+ */
+GLOBAL void
+PAM_Cancel(AUTH_STAT *s)
+{
+	PAM_JOB *job;
+
+	assert(s != NULL);
+
+	if (s->id != 0) {
+		job = Find_Job(s->id);
+		if (job)
+			Free_Job(job);
+	}
+	s->id = 0;
+} /* PAM_Cancel */
+
+/**
+ * Start an authentication process.
+ */
+static bool
+Start_Worker(PAM_WORKER *w)
+{
+	int fds[2], i;
+	pid_t pid;
+
+	assert(!Proc_InProgress(&w->proc));
+
+	pid = Proc_Fork(&w->proc, fds, cb_Worker, 0);
+	if (pid > 0) {
+		LogDebug("PAM authentication process %d started (PID %ld).",
+			 (int)(w - Workers), (long)pid);
+		Timer_Stop(w->timer);
+		w->started = time(NULL);
+		w->rlen = 0;
+		return true;
+	} else if (pid < 0)
+		return false;
+
+	/* Sub process */
+	Log_Init_Subprocess("Auth");
+	Conn_CloseAllSockets(NONE);
+	for (i = 0; i < PAM_WORKERS; i++) {
+		if (Proc_GetPipeFd(&Workers[i].proc) >= 0)
+			close(Proc_GetPipeFd(&Workers[i].proc));
+	}
+	Worker_Main(fds[1]);
+	return false;
+} /* Start_Worker */
+
+/**
+ * Stop an authentication process by closing its socket.
+ */
+static void
+Stop_Worker(PAM_WORKER *w)
+{
+	Proc_Close(&w->proc);
+	array_free(&w->queue);
+	array_free_wipe(&w->wbuf);
+	w->rlen = 0;
+} /* Stop_Worker */
+
+/**
+ * Handle the termination of an authentication process: fail its current
+ * request, queue all other requests again and start a new process.
+ *
+ * Processes failing right after they have been started are restarted with
+ * a delay, to avoid forking in a tight loop.
+ */
+static void
+Worker_Failed(PAM_WORKER *w)
+{
+	time_t now = time(NULL);
+	array queue;
+	PAM_JOB *job;
+	UINT32 *id;
+	size_t i, len;
+
+	Log(LOG_ERR, "PAM authentication process %d terminated!",
+	    (int)(w - Workers));
+
+	/* Keep the list of requests, Stop_Worker() would free it */
+	queue = w->queue;
+	array_init(&w->queue);
+	Stop_Worker(w);
+
+	if (Conf_PAM) {
+		if (now > w->started)
+			Start_Worker(w);
+		if (!Proc_InProgress(&w->proc))
+			Timer_Set(w->timer, now + PAM_RESTART_DELAY);
+	}
+
+	/* The callback functions can cancel other requests, so look up each
+	 * request again. */
+	len = array_length(&queue, sizeof(UINT32));
+	for (i = 0; i < len; i++) {
+		id = (UINT32 *)array_get(&queue, sizeof(UINT32), i);
+		job = Find_Job(*id);
+		if (!job || job->worker != w)
+			continue;
+		if (i > 0 && Conf_PAM && Queue_Job(job))
+			continue;
+		Finish_Job(job, PAM_AUTH_ERROR);
+	}
+	array_free(&queue);
+} /* Worker_Failed */
+
+/**
+ * Select the authentication process with the fewest pending requests.
+ *
+ * A new process is only started here when no process is running at all,
+ * for example when PAM has been enabled at runtime.
+ */
+static PAM_WORKER *
+Select_Worker(void)
+{
+	PAM_WORKER *w = NULL;
+	int i;
+
+	for (i = 0; i < PAM_WORKERS; i++) {
+		if (!Proc_InProgress(&Workers[i].proc))
+			continue;
+		if (!w || Pending(&Workers[i]) < Pending(w))
+			w = &Workers[i];
+	}
+	if (w)
+		return w;
+
+	for (i = 0; i < PAM_WORKERS; i++) {
+		if (Start_Worker(&Workers[i]))
+			return &Workers[i];
+	}
+	return NULL;
+} /* Select_Worker */
+
+/**
+ * Get the number of requests of an authentication process not answered yet.
+ */
+static unsigned int
+Pending(PAM_WORKER *w)
+{
+	return (unsigned int)array_length(&w->queue, sizeof(UINT32));
+} /* Pending */
+
+/**
+ * Queue a request for the least busy authentication process.
+ *
+ * The request is written when the socket becomes writable, together with
+ * all other requests queued in the meantime. The time limit of the process
+ * starts when it has nothing else to do.
+ *
+ * @return true if the request has been queued, false otherwise.
+ */
+static bool
+Queue_Job(PAM_JOB *job)
+{
+	PAM_WORKER *w;
+	size_t len;
+
+	w = Select_Worker();
+	if (!w) {
+		Log(LOG_CRIT, "No PAM authentication process available!");
+		return false;
+	}
+
+	len = array_bytes(&w->wbuf);
+	if (!array_catb(&w->queue, (char *)&job->id, sizeof(job->id))) {
+		Log(LOG_CRIT, "Can't queue PAM request: %s!", strerror(errno));
+		return false;
+	}
+	if (!array_catb(&w->wbuf, (char *)&job->req, sizeof(job->req))
+	    || !io_event_add(Proc_GetPipeFd(&w->proc), IO_WANTWRITE)) {
+		Log(LOG_CRIT, "Can't queue PAM request: %s!", strerror(errno));
+		array_truncate(&w->queue, sizeof(UINT32), Pending(w) - 1);
+		array_truncate(&w->wbuf, 1, len);
+		return false;
+	}
+
+	if (Pending(w) == 1)
+		Timer_Set(w->timer, time(NULL) + PAM_PROCESS_TIMEOUT);
+	job->worker = w;
+	return true;
+} /* Queue_Job */
+
+/**
+ * Write queued requests to an authentication process.
+ *
+ * @return false if the socket is broken.
+ */
+static bool
+Flush_Requests(PAM_WORKER *w)
+{
+	int fd = Proc_GetPipeFd(&w->proc);
+	ssize_t len;
+
+	while (array_bytes(&w->wbuf) > 0) {
+		len = write(fd, array_start(&w->wbuf), array_bytes(&w->wbuf));
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return true;
+			Log(LOG_ERR, "Can't write to PAM process: %s!",
+			    strerror(errno));
+			return false;
+		}
+		array_moveleft(&w->wbuf, 1, (size_t)len);
+	}
+
+	/* Don't keep passwords in memory */
+	array_free_wipe(&w->wbuf);
+	io_event_del(fd, IO_WANTWRITE);
+	return true;
+} /* Flush_Requests */
+
+/**
+ * Find a pending request by its ID.
+ */
+static PAM_JOB *
+Find_Job(UINT32 Id)
+{
+	HASH_ITEM *item;
+
+	for (item = Hash_TableFirst(&Jobs, Id); item;
+	     item = Hash_TableNext(item)) {
+		if (((PAM_JOB *)item->data)->id == Id)
+			return (PAM_JOB *)item->data;
+	}
+	return NULL;
+} /* Find_Job */
+
+/**
+ * Remove a request and pass its result to the callback function.
+ */
+static void
+Finish_Job(PAM_JOB *job, int Result)
+{
+	void (*cbfunc)(CONN_ID, int) = job->cbfunc;
+	CONN_ID conn = job->conn;
+
+	Free_Job(job);
+	cbfunc(conn, Result);
+} /* Finish_Job */
+
+/**
+ * Remove a request and free it (without passing a result).
+ */
+static void
+Free_Job(PAM_JOB *job)
+{
+	Hash_TableRemove(&Jobs, &job->item);
+	Timer_Free(job->timer);
+	memset(&job->req, 0, sizeof(job->req));
+	free(job);
+} /* Free_Job */
+
+/**
+ * IO callback of the socket of an authentication process.
+ */
+static void
+cb_Worker(int Sock, short What)
+{
+	PAM_WORKER *w = NULL;
+	PAM_REPLY reply;
+	PAM_JOB *job;
+	ssize_t len;
+	int i;
+
+	for (i = 0; i < PAM_WORKERS && !w; i++) {
+		if (Proc_GetPipeFd(&Workers[i].proc) == Sock)
+			w = &Workers[i];
+	}
+	if (!w) {
+		io_close(Sock);
+		return;
+	}
+
+	if ((What & IO_WANTWRITE) && !Flush_Requests(w)) {
+		Worker_Failed(w);
+		return;
+	}
+	if (!(What & IO_WANTREAD))
+		return;
+
+	for (;;) {
+		len = read(Sock, w->rbuf + w->rlen, sizeof(w->rbuf) - w->rlen);
+		if (len < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		if (len <= 0) {
+			if (len < 0)
+				Log(LOG_ERR, "Can't read from PAM process: %s!",
+				    strerror(errno));
+			Worker_Failed(w);
+			return;
+		}
+		w->rlen += (size_t)len;
+		if (w->rlen < sizeof(w->rbuf))
+			continue;
+
+		memcpy(&reply, w->rbuf, sizeof(reply));
+		w->rlen = 0;
+
+		/* Requests are answered in order: the time limit of the
+		 * process restarts with its next request, if any */
+		if (Pending(w) > 0)
+			array_moveleft(&w->queue, sizeof(UINT32), 1);
+		if (Pending(w) > 0)
+			Timer_Set(w->timer, time(NULL) + PAM_PROCESS_TIMEOUT);
+		else
+			Timer_Stop(w->timer);
+
+		/* The request has been cancelled when it is unknown */
+		job = Find_Job(reply.id);
+		if (job)
+			Finish_Job(job, reply.result);
+	}
+} /* cb_Worker */
+
+/**
+ * Timer callback of an authentication process: kill the process when it
+ * didn't answer its current request in time, or restart a failed process.
+ */
+static void
+cb_Worker_Timer(int Idx)
+{
+	PAM_WORKER *w = &Workers[Idx];
+
+	if (Proc_InProgress(&w->proc)) {
+		if (Pending(w) == 0)
+			return;
+		Log(LOG_ERR,
+		    "PAM authentication process %d (PID %ld) timed out, killing it!",
+		    Idx, (long)w->proc.pid);
+		kill(w->proc.pid, SIGKILL);
+		Worker_Failed(w);
+		return;
+	}
+	if (!Conf_PAM)
+		return;
+	if (!Start_Worker(w))
+		Timer_Set(w->timer, time(NULL) + PAM_RESTART_DELAY);
+} /* cb_Worker_Timer */
+
+/**
+ * Timer callback of a request: fail it when it hasn't been answered in time.
+ *
+ * The authentication process still handles the request (unless it is
+ * killed because of it), but its result is ignored.
+ */
+static void
+cb_Job_Timer(int Id)
+{
+	PAM_JOB *job;
+
+	job = Find_Job((UINT32)Id);
+	if (!job)
+		return;
+	Log(LOG_ERR, "PAM: Authentication of \"%s\" (%s) timed out!",
+	    job->req.user, job->req.mask);
+	Finish_Job(job, PAM_AUTH_ERROR);
+} /* cb_Job_Timer */
+
+/**
+ * Main loop of an authentication process: handle requests until the
+ * socket is closed by the daemon.
+ */
+static void
+Worker_Main(int Sock)
+{
+	PAM_REQUEST req;
+	PAM_REPLY reply;
+	size_t done;
+	ssize_t len;
+
+	for (;;) {
+		for (done = 0; done < sizeof(req); done += (size_t)len) {
+			len = read(Sock, (char *)&req + done, sizeof(req) - done);
+			if (len < 0 && errno == EINTR)
+				len = 0;
+			else if (len <= 0) {
+				Log_Exit_Subprocess("Auth");
+				exit(0);
+			}
+		}
+
+		reply.id = req.id;
+		reply.result = Authenticate(&req) ? PAM_AUTH_OK
+						  : PAM_AUTH_FAILED;
+		memset(&req, 0, sizeof(req));
+
+		for (done = 0; done < sizeof(reply); done += (size_t)len) {
+			len = write(Sock, (char *)&reply + done,
+				    sizeof(reply) - done);
+			if (len < 0 && errno == EINTR)
+				len = 0;
+			else if (len < 0) {
+				Log_Subprocess(LOG_ERR,
+					       "Failed to send result to parent!");
+				Log_Exit_Subprocess("Auth");
+				exit(1);
+			}
+		}
+	}
+} /* Worker_Main */
+
+/**
+ * Authenticate a user using PAM; called by an authentication process.
+ * @param Req The request containing the client data.
+ * @return true when authentication succeeded, false otherwise.
+ */
+static bool
+Authenticate(PAM_REQUEST *Req) {
 	pam_handle_t *pam;
 	int retval = PAM_SUCCESS;
 
-	LogDebug("PAM: Authenticate \"%s\" (%s) ...",
-		 Client_OrigUser(Client), Client_Mask(Client));
+	LogDebug("PAM: Authenticate \"%s\" (%s) ...", Req->user, Req->mask);
 
 	/* Set supplied client password */
 	if (password)
 		free(password);
-	password = strdup(Conn_Password(Client_Conn(Client)));
-	conv.appdata_ptr = Conn_Password(Client_Conn(Client));
+	password = strdup(Req->password);
+	conv.appdata_ptr = Req->password;
 
 	/* Initialize PAM */
-	retval = pam_start(Conf_PAMServiceName, Client_OrigUser(Client), &conv, &pam);
+	retval = pam_start(Req->service, Req->user, &conv, &pam);
 	if (retval != PAM_SUCCESS) {
 		Log(LOG_ERR, "PAM: Failed to create authenticator! (%d)", retval);
 		return false;
 	}
 
-	pam_set_item(pam, PAM_RUSER, Client_User(Client));
-	pam_set_item(pam, PAM_RHOST, Client_Hostname(Client));
+	pam_set_item(pam, PAM_RUSER, Req->ruser);
+	pam_set_item(pam, PAM_RHOST, Req->host);
 #if defined(HAVE_PAM_FAIL_DELAY) && !defined(NO_PAM_FAIL_DELAY)
 	pam_fail_delay(pam, 0);
 #endif
@@ -120,16 +754,20 @@ PAM_Authenticate(CLIENT *Client) {
 	/* Success? */
 	if (retval == PAM_SUCCESS)
 		Log(LOG_INFO, "PAM: Authenticated \"%s\" (%s).",
-		    Client_OrigUser(Client), Client_Mask(Client));
+		    Req->user, Req->mask);
 	else
 		Log(LOG_ERR, "PAM: Error on \"%s\" (%s): %s",
-		    Client_OrigUser(Client), Client_Mask(Client),
-		    pam_strerror(pam, retval));
+		    Req->user, Req->mask, pam_strerror(pam, retval));
 
 	/* Free PAM structures */
 	if (pam_end(pam, retval) != PAM_SUCCESS)
 		Log(LOG_ERR, "PAM: Failed to release authenticator!");
 
+	if (password) {
+		memset(password, 0, strlen(password));
+		free(password);
+		password = NULL;
+	}
 	return (retval == PAM_SUCCESS);
 }
 
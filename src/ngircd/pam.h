@@ -1,6 +1,6 @@
 /*
  * ngIRCd -- The Next Generation IRC Daemon
- * Copyright (c)2001-2010 Alexander Barton (alex@barton.de).
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -19,7 +19,29 @@
  * PAM User Authentication (header)
  */
 
-GLOBAL bool PAM_Authenticate PARAMS((CLIENT *Client));
+/** Result of an authentication: the password has been accepted */
+#define PAM_AUTH_OK		1
+/** Result of an authentication: the password has been rejected */
+#define PAM_AUTH_FAILED		0
+/** Result of an authentication: it could not be performed */
+#define PAM_AUTH_ERROR		-1
+
+/**
+ * Status of the authentication of a connection.
+ * Only the ID of the request is stored, so the structure can be moved freely.
+ */
+typedef struct _Auth_Stat {
+	UINT32 id;			/**< ID of the request or 0 */
+} AUTH_STAT;
+
+GLOBAL void PAM_Init PARAMS((void));
+GLOBAL void PAM_Exit PARAMS((void));
+
+GLOBAL bool PAM_InProgress PARAMS((const AUTH_STAT *s));
+GLOBAL bool PAM_Authenticate PARAMS((AUTH_STAT *s, CLIENT *Client,
+				     void (*cbfunc)(CONN_ID Conn,
+						    int Result)));
+GLOBAL void PAM_Cancel PARAMS((AUTH_STAT *s));
 
 #endif	/* __pam_h__ */
 
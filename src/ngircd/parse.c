@@ -17,9 +17,13 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/time.h>
+#include <time.h>
 
 #include "ngircd.h"
 #include "conn-func.h"
@@ -27,6 +31,7 @@
 #include "channel.h"
 #include "log.h"
 #include "messages.h"
+#include "timer.h"
 
 #include "parse.h"
 
@@ -55,7 +60,8 @@ struct _NUMERIC {
 static COMMAND My_Commands[] =
 {
 #define _CMD(name, func, type, min, max, penalty) \
-    { (name), (func), (type), (min), (max), (penalty), 0, 0, 0 }
+    { (name), (func), (type), (min), (max), (penalty), 0, 0, 0, 0, 0, 0, \
+      { 0 } }
 	_CMD("ADMIN", IRC_ADMIN, CLIENT_USER|CLIENT_SERVER, 0, 1, 1),
 	_CMD("AWAY", IRC_AWAY, CLIENT_USER, 0, 1, 0),
 	_CMD("CAP", IRC_CAP, CLIENT_ANY, 1, 2, 0),
@@ -131,7 +137,24 @@ static COMMAND My_Commands[] =
 #undef _CMD
 };
 
+/**
+ * Lookup table for the commands in My_Commands, see Find_Command().
+ *
+ * The command names are hashed on their length and their first, second
+ * and last characters; the factors in Command_Slot() have been chosen so
+ * that all commands get a distinct slot (perfect hash), and a lookup
+ * therefore needs only one string comparison. Colliding names are
+ * stored in the following free slot, so commands that are added later
+ * are found in any case, but the factors should be adjusted then.
+ */
+#define COMMAND_SLOTS 256		/* must be a power of two */
+static COMMAND *My_Command_Slots[COMMAND_SLOTS];
+static bool My_Command_Slots_Init = false;
+
 static void Init_Request PARAMS(( REQUEST *Req ));
+static unsigned int Command_Slot PARAMS((const char *Name, size_t Len));
+static COMMAND *Find_Command PARAMS((const char *Name));
+static void Account_Timing PARAMS((COMMAND *Cmd, struct timeval *Start));
 
 static bool Validate_Prefix PARAMS(( CONN_ID Idx, REQUEST *Req, bool *Closed ));
 static bool Validate_Command PARAMS(( CONN_ID Idx, REQUEST *Req, bool *Closed ));
@@ -154,6 +177,59 @@ Parse_GetCommandStruct( void )
 } /* Parse_GetCommandStruct */
 
 
+/**
+ * Format the timing statistics of an IRC command.
+ *
+ * The result is a space separated list of the total number of calls, the
+ * total time spent in the command handler (in seconds), the maximum
+ * latency (in microseconds), and the comma separated latency histogram
+ * (calls below 10 us, below 100 us, ..., and all slower ones).
+ *
+ * @param Cmd Command structure.
+ * @param Buffer Buffer for the result.
+ * @param Len Size of the buffer.
+ * @return Pointer to the buffer.
+ */
+GLOBAL char *
+Parse_CommandTiming(COMMAND *Cmd, char *Buffer, size_t Len)
+{
+	char bucket[24];
+	int i;
+
+	assert(Cmd != NULL);
+	assert(Buffer != NULL);
+
+	snprintf(Buffer, Len, "%ld %lu.%06ld %ld ", Cmd->lcount + Cmd->rcount,
+		 Cmd->time_sec, Cmd->time_usec, Cmd->time_max);
+	for (i = 0; i < COMMAND_TIMING_BUCKETS; i++) {
+		snprintf(bucket, sizeof(bucket), i ? ",%ld" : "%ld",
+			 Cmd->time_hist[i]);
+		strlcat(Buffer, bucket, Len);
+	}
+	return Buffer;
+} /* Parse_CommandTiming */
+
+
+/**
+ * Dump the usage and timing statistics of all IRC commands.
+ */
+GLOBAL void
+Parse_DebugDump(void)
+{
+	COMMAND *cmd;
+	char timing[COMMAND_LEN];
+
+	LogDebug("Command statistics (name lcount rcount bytes calls total max histogram):");
+	for (cmd = My_Commands; cmd->name; cmd++) {
+		if (cmd->lcount == 0 && cmd->rcount == 0)
+			continue;
+		LogDebug(" - %s %ld %ld %ld %s", cmd->name, cmd->lcount,
+			 cmd->rcount, cmd->bytes,
+			 Parse_CommandTiming(cmd, timing, sizeof(timing)));
+	}
+} /* Parse_DebugDump */
+
+
 /**
  * Parse a command ("request") received from a client.
  *
@@ -496,6 +572,7 @@ Handle_Request( CONN_ID Idx, REQUEST *Req )
 	bool result = CONNECTED;
 	int client_type;
 	COMMAND *cmd;
+	struct timeval start;
 
 	assert( Idx >= 0 );
 	assert( Req != NULL );
@@ -511,13 +588,8 @@ Handle_Request( CONN_ID Idx, REQUEST *Req )
 	    && strlen(Req->command) == 3 && atoi(Req->command) > 1)
 		return Handle_Numeric(client, Req);
 
-	cmd = My_Commands;
-	while (cmd->name) {
-		if (strcasecmp(Req->command, cmd->name) != 0) {
-			cmd++;
-			continue;
-		}
-
+	cmd = Find_Command(Req->command);
+	if (cmd) {
 		if (!(client_type & cmd->type)) {
 			if (client_type == CLIENT_USER
 			    && cmd->type & CLIENT_SERVER)
@@ -541,7 +613,9 @@ Handle_Request( CONN_ID Idx, REQUEST *Req )
 		/* Command is allowed for this client: call it and count
 		 * generated bytes in output */
 		Conn_ResetWCounter();
+		Timer_Now(&start);
 		result = (cmd->function)(client, Req);
+		Account_Timing(cmd, &start);
 		cmd->bytes += Conn_WCounter();
 
 		/* Adjust counters */
@@ -573,6 +647,106 @@ Handle_Request( CONN_ID Idx, REQUEST *Req )
 } /* Handle_Request */
 
 
+/**
+ * Calculate the slot of a command name in the command lookup table.
+ *
+ * @param Name Command name.
+ * @param Len Length of the command name, must be greater than 0.
+ * @returns Slot number.
+ */
+static unsigned int
+Command_Slot(const char *Name, size_t Len)
+{
+	unsigned int hash;
+
+	assert(Len > 0);
+
+	hash = (unsigned int)Len * 145
+	     + tolower((unsigned char)Name[0]) * 143
+	     + tolower((unsigned char)Name[1]) * 114
+	     + tolower((unsigned char)Name[Len - 1]) * 228;
+	return hash & (COMMAND_SLOTS - 1);
+} /* Command_Slot */
+
+
+/**
+ * Look up a command in the command lookup table (case-insensitive).
+ *
+ * The table is set up from My_Commands on first use.
+ *
+ * @param Name Command name.
+ * @returns Pointer to the command structure or NULL if not found.
+ */
+static COMMAND *
+Find_Command(const char *Name)
+{
+	COMMAND *cmd;
+	unsigned int slot;
+	size_t len;
+
+	assert(Name != NULL);
+
+	if (!My_Command_Slots_Init) {
+		for (cmd = My_Commands; cmd->name; cmd++) {
+			slot = Command_Slot(cmd->name, strlen(cmd->name));
+			while (My_Command_Slots[slot])
+				slot = (slot + 1) & (COMMAND_SLOTS - 1);
+			My_Command_Slots[slot] = cmd;
+		}
+		My_Command_Slots_Init = true;
+	}
+
+	len = strlen(Name);
+	if (len == 0)
+		return NULL;
+
+	slot = Command_Slot(Name, len);
+	while ((cmd = My_Command_Slots[slot])) {
+		if (strcasecmp(Name, cmd->name) == 0)
+			return cmd;
+		slot = (slot + 1) & (COMMAND_SLOTS - 1);
+	}
+	return NULL;
+} /* Find_Command */
+
+
+/**
+ * Account the time a command handler took.
+ *
+ * Handlers are called one after the other in the main loop and must not
+ * block, so this is the CPU time spent on behalf of the command, too.
+ *
+ * @param Cmd Command structure.
+ * @param Start Timestamp taken before the handler has been called.
+ */
+static void
+Account_Timing(COMMAND *Cmd, struct timeval *Start)
+{
+	struct timeval now;
+	long usec, limit;
+	int i;
+
+	Timer_Now(&now);
+	usec = (long)(now.tv_sec - Start->tv_sec) * 1000000
+	       + (long)(now.tv_usec - Start->tv_usec);
+	if (usec < 0)
+		usec = 0;
+
+	Cmd->time_usec += usec;
+	if (Cmd->time_usec >= 1000000) {
+		Cmd->time_sec += Cmd->time_usec / 1000000;
+		Cmd->time_usec %= 1000000;
+	}
+	if (usec > Cmd->time_max)
+		Cmd->time_max = usec;
+
+	for (i = 0, limit = 10; i < COMMAND_TIMING_BUCKETS - 1 && usec >= limit;
+	     i++, limit *= 10)
+		;
+	Cmd->time_hist[i]++;
+} /* Account_Timing */
+
+
 /**
  * Check if incoming messages contains CTCP commands and should be dropped.
  *
@@ -28,6 +28,10 @@ typedef struct _REQUEST
 	int argc;			/**< Number of given parameters */
 } REQUEST;
 
+/** Number of buckets of the command latency histograms: the handler
+ * call latencies are counted in decades, starting below 10 microseconds. */
+#define COMMAND_TIMING_BUCKETS 6
+
 /** IRC command handling structure */
 typedef struct _COMMAND
 {
@@ -40,12 +44,22 @@ typedef struct _COMMAND
 	int penalty;			/**< Penalty for this command */
 	long lcount, rcount;		/**< Number of local and remote calls */
 	long bytes;			/**< Number of bytes created */
+	unsigned long time_sec;		/**< Total handler time (seconds) */
+	long time_usec;			/**< ... and microseconds */
+	long time_max;			/**< Max. handler latency (usec) */
+	long time_hist[COMMAND_TIMING_BUCKETS];
+					/**< Handler latency histogram */
 } COMMAND;
 
 GLOBAL bool Parse_Request PARAMS((CONN_ID Idx, char *Request ));
 
 GLOBAL COMMAND *Parse_GetCommandStruct PARAMS(( void ));
 
+GLOBAL char *Parse_CommandTiming PARAMS((COMMAND *Cmd, char *Buffer,
+					 size_t Len));
+
+GLOBAL void Parse_DebugDump PARAMS((void));
+
 #endif
 
 /* -eof- */
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <time.h>
 
@@ -44,6 +45,11 @@ Proc_InitStruct (PROC_STAT *proc)
 
 /**
  * Fork a child process.
+ *
+ * The child process is connected to its parent by a pair of sockets, so
+ * that it can be used in both directions: the parent uses pipefds[0], which
+ * is registered with the callback function, and the child uses pipefds[1].
+ * Use a timeout of 0 for child processes that don't time out on their own.
  */
 GLOBAL pid_t
 Proc_Fork(PROC_STAT *proc, int *pipefds, void (*cbfunc)(int, short), int timeout)
@@ -57,8 +63,8 @@ Proc_Fork(PROC_STAT *proc, int *pipefds, void (*cbfunc)(int, short), int timeout
 	assert(pipefds != NULL);
 	assert(cbfunc != NULL);
 
-	if (pipe(pipefds) != 0) {
-		Log(LOG_ALERT, "Can't create output pipe for child process: %s!",
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pipefds) != 0) {
+		Log(LOG_ALERT, "Can't create sockets for child process: %s!",
 		    strerror(errno));
 		return -1;
 	}
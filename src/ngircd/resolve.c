@@ -1,6 +1,6 @@
 /*
  * ngIRCd -- The Next Generation IRC Daemon
- * Copyright (c)2001-2024 Alexander Barton (alex@barton.de) and Contributors.
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -16,34 +16,124 @@
 /**
  * @file
  * Asynchronous resolver
+ *
+ * Host names and IDENT user names are looked up by the main process: DNS
+ * queries are handled by the DNS client (see dns.c), and IDENT requests
+ * (RFC 1413) use non-blocking sockets. All sockets are handled by the main
+ * loop, so no sub-process is required.
+ *
+ * Results of address lookups are cached for the time to live of the DNS
+ * records involved (but at most RESOLVE_CACHE_TTL seconds), so that clients
+ * reconnecting again and again from the same address don't cause new DNS
+ * queries. Failures (unknown addresses and forgeries) are cached as well,
+ * but only for RESOLVE_CACHE_NEG_TTL seconds at most.
  */
 
 #include <assert.h>
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <netdb.h>
-
-#ifdef IDENTAUTH
-#ifdef HAVE_IDENT_H
-#include <ident.h>
-#endif
-#endif
 
+#include "array.h"
 #include "conn.h"
 #include "conf.h"
+#include "dns.h"
+#include "hash.h"
+#include "io.h"
 #include "log.h"
-#include "ng_ipaddr.h"
+#include "timer.h"
 
 #include "resolve.h"
 
-static void Do_ResolveAddr_Ident PARAMS(( const ng_ipaddr_t *Addr, int Sock, int w_fd ));
-static void Do_ResolveName PARAMS(( const char *Host, int w_fd ));
+#define IDENT_PORT 113			/** Port of IDENT servers */
+#define IDENT_TIMEOUT 10		/** Timeout of IDENT lookups */
+#define IDENT_REPLY_LEN 512		/** Max. length of IDENT replies */
+#define RESOLVERS_SIZE 64		/** Initial size of hash tables */
+#define RESOLVE_CACHE_MAX 4096		/** Max. number of cached results */
+#define RESOLVE_CACHE_TTL 3600		/** Max. time to cache host names */
+#define RESOLVE_CACHE_NEG_TTL 300	/** Max. time to cache failures */
+
+/** Pending lookup of a connection or server. */
+typedef struct _Resolver
+{
+	HASH_ITEM item;			/* item in Resolvers table, key: id */
+	int id;				/* resolver ID, argument of timer */
+	int token;			/* argument for callback functions */
+	TIMER *timer;			/* timeout of the lookup */
+	time_t expires;			/* time the whole lookup times out */
+	int pending;			/* number of pending DNS queries */
+	DNS_QUERY *query[2];		/* pending DNS queries */
+	ng_ipaddr_t addr;		/* address to look up */
+	UINT32 ttl;			/* time to live of DNS records */
+	char host[HOST_LEN];		/* host name (to look up) */
+	ng_ipaddr_t addrs[2][DNS_MAX_ADDRS];
+					/* addresses found (AAAA, A) */
+	size_t count[2];		/* number of addresses found */
+	void (*addr_cb)(int, const char *, const char *);
+	void (*name_cb)(int, const ng_ipaddr_t *, size_t);
+#ifdef IDENTAUTH
+	HASH_ITEM ident_item;		/* item in Idents table, key: fd */
+	int ident_sock;			/* socket to IDENT server or -1 */
+	bool ident_sent;		/* IDENT request has been sent */
+	UINT16 ident_ports[2];		/* remote and local port */
+	char ident_reply[IDENT_REPLY_LEN];
+	size_t ident_len;		/* length of reply read so far */
+	char ident[CLIENT_USER_LEN];	/* IDENT user name */
+#endif
+} RESOLVER;
+
+/** Cached result of an address lookup. */
+typedef struct _Resolve_Cache
+{
+	HASH_ITEM item;			/* item in Cache table, key: address */
+	struct _Resolve_Cache *prev;	/* previous entry (older) */
+	struct _Resolve_Cache *next;	/* next entry (newer) */
+	ng_ipaddr_t addr;		/* IP address */
+	char host[CLIENT_HOST_LEN];	/* host name, or address on failure */
+	bool failed;			/* lookup failed or forgery */
+	time_t expires;			/* time the entry expires */
+} RESOLVE_CACHE;
+
+static HASH_TABLE Resolvers;
+static int Last_Id;
+static array Deferred;
+static HASH_TABLE Cache;
+static RESOLVE_CACHE *Cache_Oldest, *Cache_Newest;
+static unsigned long Cache_Failed, Cache_Hits, Cache_Misses;
+#ifdef IDENTAUTH
+static HASH_TABLE Idents;
+#endif
+
+static RESOLVER *New_Resolver PARAMS((RES_STAT *s, int Token));
+static RESOLVER *Find_Resolver PARAMS((int Id));
+static void Free_Resolver PARAMS((RESOLVER *r));
+static void Defer_Result PARAMS((RESOLVER *r));
+static void Check_Finished PARAMS((RESOLVER *r));
+static void Finish_Addr PARAMS((RESOLVER *r));
+static void Finish_Name PARAMS((RESOLVER *r));
+static void Lookup_Failed PARAMS((RESOLVER *r));
+static UINT32 Cache_Hash PARAMS((const ng_ipaddr_t *Addr));
+static RESOLVE_CACHE *Cache_Find PARAMS((const ng_ipaddr_t *Addr));
+static void Cache_Add PARAMS((const ng_ipaddr_t *Addr, const char *Host,
+			      UINT32 Ttl, bool Failed));
+static void Cache_Remove PARAMS((RESOLVE_CACHE *e));
+static void cb_Reverse PARAMS((void *Data, const DNS_RESULT *Result));
+static void cb_Forward PARAMS((void *Data, const DNS_RESULT *Result));
+static void cb_Name_AAAA PARAMS((void *Data, const DNS_RESULT *Result));
+static void cb_Name_A PARAMS((void *Data, const DNS_RESULT *Result));
+static void cb_Resolver_Timer PARAMS((int Id));
+#ifdef IDENTAUTH
+static bool Start_Ident PARAMS((RESOLVER *r, int Sock));
+static void Close_Ident PARAMS((RESOLVER *r));
+static void Parse_Ident PARAMS((RESOLVER *r));
+static void cb_Ident PARAMS((int Sock, short What));
+#endif
 
 #ifdef WANT_IPV6
 extern bool Conf_ConnectIPv4;
@@ -51,403 +141,905 @@ extern bool Conf_ConnectIPv6;
 #endif
 
 
+/**
+ * Initialize the resolver and the DNS client.
+ *
+ * This function must be called before changing the root directory, because
+ * the DNS client reads its configuration files.
+ */
+GLOBAL void
+Resolve_Init(void)
+{
+	Dns_Init(Conf_ResolvConfFile, Conf_HostsFile);
+
+	if (!Hash_TableInit(&Resolvers, RESOLVERS_SIZE)
+	    || !Hash_TableInit(&Cache, RESOLVERS_SIZE)
+#ifdef IDENTAUTH
+	    || !Hash_TableInit(&Idents, RESOLVERS_SIZE)
+#endif
+	   ) {
+		Log(LOG_EMERG, "Can't allocate memory for resolvers!");
+		exit(1);
+	}
+} /* Resolve_Init */
+
+
+/**
+ * Cancel all pending lookups and shut down the DNS client.
+ */
+GLOBAL void
+Resolve_Exit(void)
+{
+	HASH_ITEM *item;
+	size_t i;
+
+	if (Resolvers.buckets) {
+		for (i = 0; i < Resolvers.size; i++) {
+			while ((item = Resolvers.buckets[i]))
+				Free_Resolver((RESOLVER *)item->data);
+		}
+		Hash_TableFree(&Resolvers);
+	}
+	while (Cache_Oldest)
+		Cache_Remove(Cache_Oldest);
+	Hash_TableFree(&Cache);
+#ifdef IDENTAUTH
+	Hash_TableFree(&Idents);
+#endif
+	array_free(&Deferred);
+	Dns_Exit();
+} /* Resolve_Exit */
+
+
+/**
+ * Initialize resolver status structure.
+ */
+GLOBAL void
+Resolve_InitStruct(RES_STAT *s)
+{
+	assert(s != NULL);
+
+	s->id = 0;
+} /* Resolve_InitStruct */
+
+
+/**
+ * Check if a lookup is in progress.
+ */
+GLOBAL bool
+Resolve_InProgress(const RES_STAT *s)
+{
+	assert(s != NULL);
+
+	return s->id != 0 && Find_Resolver(s->id) != NULL;
+} /* Resolve_InProgress */
+
+
+/**
+ * Deliver all results which are available already: results of the DNS
+ * client which didn't need to ask a name server, and results of lookups
+ * which didn't need the DNS client at all (see Defer_Result()).
+ *
+ * This function is called by the main loop, which must not wait for I/O
+ * events while Resolve_Deferred() is true.
+ */
+GLOBAL void
+Resolve_Run(void)
+{
+	RESOLVER *r;
+	size_t i, len;
+
+	Dns_Run();
+
+	len = array_length(&Deferred, sizeof(int));
+	for (i = 0; i < len; i++) {
+		r = Find_Resolver(*(int *)array_get(&Deferred, sizeof(int), i));
+		if (r && r->pending == 0)
+			Check_Finished(r);
+	}
+	array_moveleft(&Deferred, sizeof(int), len);
+} /* Resolve_Run */
+
+
+/**
+ * Check if there are results to deliver, see Resolve_Run().
+ */
+GLOBAL bool
+Resolve_Deferred(void)
+{
+	return Dns_Deferred() || array_length(&Deferred, sizeof(int)) > 0;
+} /* Resolve_Deferred */
+
+
 /**
  * Resolve IP address and do IDENT lookup asynchronously.
+ *
+ * The callback function gets the host name (the IP address if it can't be
+ * resolved, or an empty string if DNS lookups are disabled) and the IDENT
+ * user name (an empty string if there is none).
+ *
+ * When the host name is already known (see Resolve_Cached()), it can be
+ * passed in Hostname and only the IDENT lookup is done.
  */
 GLOBAL bool
-Resolve_Addr_Ident(PROC_STAT * s, const ng_ipaddr_t *Addr, int identsock,
-		   void (*cbfunc) (int, short))
+Resolve_Addr_Ident(RES_STAT *s, const ng_ipaddr_t *Addr, int identsock,
+		   const char *Hostname, int Token,
+		   void (*cbfunc)(int, const char *, const char *))
 {
-	int pipefd[2];
-	pid_t pid;
+	RESOLVER *r;
 
 	assert(s != NULL);
+	assert(Addr != NULL);
 
-	pid = Proc_Fork(s, pipefd, cbfunc, RESOLVER_TIMEOUT);
-	if (pid > 0) {
-		LogDebug("Resolver for %s created (PID %d).", ng_ipaddr_tostr(Addr), pid);
+	r = New_Resolver(s, Token);
+	if (!r)
+		return false;
+	r->addr = *Addr;
+	r->addr_cb = cbfunc;
+
+	if (Hostname)
+		strlcpy(r->host, Hostname, sizeof(r->host));
+	else if (Conf_DNS) {
+		LogDebug("Now resolving %s ...", ng_ipaddr_tostr(Addr));
+		r->query[0] = Dns_QueryAddr(Addr, cb_Reverse, r);
+		if (r->query[0])
+			r->pending++;
+		else
+			Lookup_Failed(r);
+	}
+#ifdef IDENTAUTH
+	if (identsock >= 0 && Start_Ident(r, identsock)) {
+		if (IDENT_TIMEOUT < RESOLVER_TIMEOUT)
+			Timer_Set(r->timer, time(NULL) + IDENT_TIMEOUT);
 		return true;
-	} else if( pid == 0 ) {
-		/* Sub process */
-		Log_Init_Subprocess("Resolver");
-		Conn_CloseAllSockets(identsock);
-		Do_ResolveAddr_Ident(Addr, identsock, pipefd[1]);
-		Log_Exit_Subprocess("Resolver");
-		exit(0);
 	}
-	return false;
-} /* Resolve_Addr */
+#else
+	(void)identsock;
+#endif
+
+	/* Results are always delivered asynchronously */
+	if (r->pending == 0)
+		Defer_Result(r);
+	return true;
+} /* Resolve_Addr_Ident */
 
 
 /**
  * Resolve hostname (asynchronous!).
+ *
+ * The callback function gets all IP addresses found (IPv6 addresses first),
+ * or none if the name can't be resolved.
  */
 GLOBAL bool
-Resolve_Name( PROC_STAT *s, const char *Host, void (*cbfunc)(int, short))
+Resolve_Name(RES_STAT *s, const char *Host, int Token,
+	     void (*cbfunc)(int, const ng_ipaddr_t *, size_t))
 {
-	int pipefd[2];
-	pid_t pid;
+	RESOLVER *r;
+	bool ipv4 = true;
 
 	assert(s != NULL);
+	assert(Host != NULL);
 
-	pid = Proc_Fork(s, pipefd, cbfunc, RESOLVER_TIMEOUT);
-	if (pid > 0) {
-		/* Main process */
-		Log( LOG_DEBUG, "Resolver for \"%s\" created (PID %d).", Host, pid );
+	r = New_Resolver(s, Token);
+	if (!r)
+		return false;
+	strlcpy(r->host, Host, sizeof(r->host));
+	r->name_cb = cbfunc;
+
+	/* IP addresses don't need to be looked up */
+	if (ng_ipaddr_init(&r->addrs[1][0], Host, 0)) {
+		r->count[1] = 1;
+		Defer_Result(r);
 		return true;
-	} else if( pid == 0 ) {
-		/* Sub process */
-		Log_Init_Subprocess("Resolver");
-		Conn_CloseAllSockets(NONE);
-		Do_ResolveName(Host, pipefd[1]);
-		Log_Exit_Subprocess("Resolver");
-		exit(0);
 	}
-	return false;
-} /* Resolve_Name */
 
-#if !defined(HAVE_WORKING_GETADDRINFO) || !defined(HAVE_GETNAMEINFO)
-#ifdef h_errno
-static char *
-Get_Error( int H_Error )
-{
-	/* Get error message for H_Error */
-	switch( H_Error ) {
-	case HOST_NOT_FOUND:
-		return "host not found";
-	case NO_DATA:
-		return "name valid but no IP address defined";
-	case NO_RECOVERY:
-		return "name server error";
-	case TRY_AGAIN:
-		return "name server temporary not available";
+	LogDebug("Now resolving \"%s\" ...", Host);
+#ifdef WANT_IPV6
+	assert(Conf_ConnectIPv6 || Conf_ConnectIPv4);
+	ipv4 = Conf_ConnectIPv4;
+	if (Conf_ConnectIPv6) {
+		r->query[0] = Dns_QueryName(Host, DNS_TYPE_AAAA, cb_Name_AAAA,
+					    r);
+		if (r->query[0])
+			r->pending++;
 	}
-	return "unknown error";
-}
-#endif
 #endif
+	if (ipv4) {
+		r->query[1] = Dns_QueryName(Host, DNS_TYPE_A, cb_Name_A, r);
+		if (r->query[1])
+			r->pending++;
+	}
+	if (r->pending == 0)
+		Defer_Result(r);
+	return true;
+} /* Resolve_Name */
 
 
-/* Do "IDENT" (aka "AUTH") lookup and append result to resolved_addr array */
-static void
-Do_IdentQuery(int identsock, array *resolved_addr)
+/**
+ * Cancel a pending lookup, if any. The callback function isn't called.
+ */
+GLOBAL void
+Resolve_Cancel(RES_STAT *s)
 {
-#ifdef IDENTAUTH
-	char *res;
+	RESOLVER *r;
 
-	if (identsock < 0)
-		return;
+	assert(s != NULL);
 
-	Log_Subprocess(LOG_DEBUG, "Doing IDENT lookup on socket %d ...",
-		       identsock);
-	res = ident_id( identsock, 10 );
-	Log_Subprocess(LOG_DEBUG, "Ok, IDENT lookup on socket %d done: \"%s\"",
-		       identsock, res ? res : "(NULL)");
-	if (!res) /* no result */
-		return;
-	if (!array_cats(resolved_addr, res))
-		Log_Subprocess(LOG_WARNING,
-			       "Resolver: Cannot copy IDENT result: %s!",
-			       strerror(errno));
+	if (s->id != 0) {
+		r = Find_Resolver(s->id);
+		if (r)
+			Free_Resolver(r);
+	}
+	s->id = 0;
+} /* Resolve_Cancel */
 
-	free(res);
-#else
-	(void) identsock;
-	(void) resolved_addr;
-#endif
-}
+
+/**
+ * Look up the host name of an IP address in the cache.
+ *
+ * @param Addr The IP address.
+ * @param Host Buffer receiving the host name (or the IP address, if the
+ *		lookup failed).
+ * @param Len Size of the buffer.
+ * @return true if the address has been found.
+ */
+GLOBAL bool
+Resolve_Cached(const ng_ipaddr_t *Addr, char *Host, size_t Len)
+{
+	RESOLVE_CACHE *e;
+
+	assert(Addr != NULL);
+	assert(Host != NULL);
+
+	e = Cache_Find(Addr);
+	if (e && e->expires <= time(NULL)) {
+		Cache_Remove(e);
+		e = NULL;
+	}
+	if (!e) {
+		Cache_Misses++;
+		return false;
+	}
+	Cache_Hits++;
+	strlcpy(Host, e->host, Len);
+	LogDebug("Found %s in resolver cache: \"%s\".", ng_ipaddr_tostr(Addr),
+		 Host);
+	return true;
+} /* Resolve_Cached */
 
 
 /**
- * perform reverse DNS lookup and put result string into resbuf.
- * If no hostname could be obtained, this function stores the string representation of
- * the IP address in resbuf and returns false.
- * @param IpAddr ip address to resolve
- * @param resbuf result buffer to store DNS name/string representation of ip address
- * @param reslen size of result buffer (must be >= NGT_INET_ADDRSTRLEN)
- * @return true if reverse lookup successful, false otherwise
+ * Get statistics of the resolver cache.
+ *
+ * @param Buf Buffer for the text.
+ * @param Len Size of the buffer.
+ * @return Pointer to the buffer.
  */
-static bool
-ReverseLookup(const ng_ipaddr_t *IpAddr, char *resbuf, size_t reslen)
+GLOBAL char *
+Resolve_CacheStats(char *Buf, size_t Len)
 {
-	char tmp_ip_str[NG_INET_ADDRSTRLEN];
-	const char *errmsg;
-#ifdef HAVE_GETNAMEINFO
-	static const char funcname[]="getnameinfo";
-	int res;
+	snprintf(Buf, Len,
+		 "%lu entries (%lu failures), %lu hits, %lu misses, max %d entries",
+		 (unsigned long)Cache.count, Cache_Failed, Cache_Hits,
+		 Cache_Misses, RESOLVE_CACHE_MAX);
+	return Buf;
+} /* Resolve_CacheStats */
 
-	*resbuf = 0;
 
-	res = getnameinfo((struct sockaddr *) IpAddr, ng_ipaddr_salen(IpAddr),
-			  resbuf, (socklen_t)reslen, NULL, 0, NI_NAMEREQD);
-	if (res == 0)
-		return true;
+/**
+ * Allocate and register a new resolver structure.
+ */
+static RESOLVER *
+New_Resolver(RES_STAT *s, int Token)
+{
+	RESOLVER *r;
 
-	if (res == EAI_SYSTEM)
-		errmsg = strerror(errno);
-	else
-		errmsg = gai_strerror(res);
-#else
-	const struct sockaddr_in *Addr = (const struct sockaddr_in *) IpAddr;
-	struct hostent *h;
-	static const char funcname[]="gethostbyaddr";
-
-	h = gethostbyaddr((char *)&Addr->sin_addr, sizeof(Addr->sin_addr), AF_INET);
-	if (h) {
-		if (strlcpy(resbuf, h->h_name, reslen) < reslen)
-			return true;
-		errmsg = "hostname too long";
-	} else {
-# ifdef h_errno
-		errmsg = Get_Error(h_errno);
-# else
-		errmsg = "unknown error";
-# endif /* h_errno */
+	assert(!Resolve_InProgress(s));
+
+	r = (RESOLVER *)calloc(1, sizeof(RESOLVER));
+	if (!r) {
+		Log(LOG_EMERG, "Can't allocate memory! [New_Resolver]");
+		return NULL;
 	}
-#endif	/* HAVE_GETNAMEINFO */
 
-	assert(errmsg);
-	assert(reslen >= NG_INET_ADDRSTRLEN);
-	ng_ipaddr_tostr_r(IpAddr, tmp_ip_str);
+	do {
+		if (++Last_Id <= 0)
+			Last_Id = 1;
+	} while (Find_Resolver(Last_Id));
 
-	Log_Subprocess(LOG_WARNING, "Can't resolve address \"%s\": %s [%s].",
-		       tmp_ip_str, errmsg, funcname);
-	strlcpy(resbuf, tmp_ip_str, reslen);
-	return false;
-}
+	r->timer = Timer_New(cb_Resolver_Timer, Last_Id);
+	if (!r->timer) {
+		free(r);
+		return NULL;
+	}
+	r->id = Last_Id;
+	r->token = Token;
+	r->expires = time(NULL) + RESOLVER_TIMEOUT;
+	Timer_Set(r->timer, r->expires);
+#ifdef IDENTAUTH
+	r->ident_sock = -1;
+#endif
+	Hash_TableAdd(&Resolvers, &r->item, (UINT32)r->id, r);
+	s->id = r->id;
+	return r;
+} /* New_Resolver */
 
 
 /**
- * perform DNS lookup of given host name and fill IpAddr with a list of
- * ip addresses associated with that name.
- * ip addresses found are stored in the "array *IpAddr" argument (type ng_ipaddr_t)
- * @param hostname The domain name to look up.
- * @param IpAddr pointer to empty and initialized array to store results
- * @return true if lookup successful, false if domain name not found
+ * Find a resolver structure by its ID.
  */
-static bool
-#ifdef HAVE_WORKING_GETADDRINFO
-ForwardLookup(const char *hostname, array *IpAddr, int af)
-#else
-ForwardLookup(const char *hostname, array *IpAddr, UNUSED int af)
-#endif
+static RESOLVER *
+Find_Resolver(int Id)
 {
-	ng_ipaddr_t addr;
+	HASH_ITEM *item;
 
-#ifdef HAVE_WORKING_GETADDRINFO
-	int res;
-	struct addrinfo *a, *ai_results;
-	static struct addrinfo hints;
+	for (item = Hash_TableFirst(&Resolvers, (UINT32)Id); item;
+	     item = Hash_TableNext(item)) {
+		if (((RESOLVER *)item->data)->id == Id)
+			return (RESOLVER *)item->data;
+	}
+	return NULL;
+} /* Find_Resolver */
 
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
-	hints.ai_family = af;
 
-	memset(&addr, 0, sizeof(addr));
+/**
+ * Cancel all pending lookups of a resolver structure and free it.
+ */
+static void
+Free_Resolver(RESOLVER *r)
+{
+	int i;
 
-	res = getaddrinfo(hostname, NULL, &hints, &ai_results);
-	switch (res) {
-	case 0:	break;
-	case EAI_SYSTEM:
-		Log_Subprocess(LOG_WARNING, "Can't resolve \"%s\": %s", hostname, strerror(errno));
-		return false;
-	default:
-		Log_Subprocess(LOG_WARNING, "Can't resolve \"%s\": %s", hostname, gai_strerror(res));
-		return false;
+	for (i = 0; i < 2; i++) {
+		if (r->query[i])
+			Dns_Cancel(r->query[i]);
 	}
+#ifdef IDENTAUTH
+	Close_Ident(r);
+#endif
+	Hash_TableRemove(&Resolvers, &r->item);
+	Timer_Free(r->timer);
+	free(r);
+} /* Free_Resolver */
 
-	for (a = ai_results; a != NULL; a = a->ai_next) {
-		assert((size_t)a->ai_addrlen <= sizeof(addr));
 
-		if ((size_t)a->ai_addrlen > sizeof(addr))
-			continue;
+/**
+ * Deliver the result of a lookup on the next call of Resolve_Run(), because
+ * the callback function must not be called before the lookup function
+ * returned.
+ */
+static void
+Defer_Result(RESOLVER *r)
+{
+	if (array_catb(&Deferred, (char *)&r->id, sizeof(int)))
+		return;
 
-		memcpy(&addr, a->ai_addr, a->ai_addrlen);
+	/* Out of memory: let the timer deliver the result */
+	Timer_Set(r->timer, time(NULL));
+} /* Defer_Result */
 
-		if (!array_catb(IpAddr, (char *)&addr, sizeof(addr)))
-			break;
-	}
 
-	freeaddrinfo(ai_results);
-	return a == NULL;
-#else
-	struct hostent *h = gethostbyname(hostname);
+/**
+ * Deliver the result if no lookup is pending any more.
+ */
+static void
+Check_Finished(RESOLVER *r)
+{
+	if (r->pending > 0)
+		return;
+#ifdef IDENTAUTH
+	if (r->ident_sock >= 0)
+		return;
+#endif
+	if (r->addr_cb)
+		Finish_Addr(r);
+	else
+		Finish_Name(r);
+} /* Check_Finished */
+
+
+/**
+ * Deliver the result of an address lookup and free the resolver.
+ */
+static void
+Finish_Addr(RESOLVER *r)
+{
+	char hostname[CLIENT_HOST_LEN], ident[CLIENT_USER_LEN];
+	void (*cbfunc)(int, const char *, const char *);
+	int token;
 
-	if (!h) {
-#ifdef h_errno
-		Log_Subprocess(LOG_WARNING, "Can't resolve \"%s\": %s",
-			       hostname, Get_Error(h_errno));
+	strlcpy(hostname, r->host, sizeof(hostname));
+#ifdef IDENTAUTH
+	strlcpy(ident, r->ident, sizeof(ident));
 #else
-		Log_Subprocess(LOG_WARNING, "Can't resolve \"%s\"", hostname);
+	ident[0] = '\0';
 #endif
-		return false;
-	}
-	memset(&addr, 0, sizeof(addr));
+	cbfunc = r->addr_cb;
+	token = r->token;
+	Free_Resolver(r);
+
+	cbfunc(token, hostname, ident);
+} /* Finish_Addr */
+
+
+/**
+ * Deliver the result of a name lookup and free the resolver.
+ */
+static void
+Finish_Name(RESOLVER *r)
+{
+	ng_ipaddr_t addrs[2 * DNS_MAX_ADDRS];
+	void (*cbfunc)(int, const ng_ipaddr_t *, size_t);
+	size_t count, i;
+	int token;
 
-	addr.sin4.sin_family = AF_INET;
-	memcpy(&addr.sin4.sin_addr, h->h_addr, sizeof(struct in_addr));
+	memcpy(addrs, r->addrs[0], r->count[0] * sizeof(ng_ipaddr_t));
+	memcpy(addrs + r->count[0], r->addrs[1],
+	       r->count[1] * sizeof(ng_ipaddr_t));
+	count = r->count[0] + r->count[1];
+	if (count == 0)
+		Log(LOG_WARNING, "Can't resolve \"%s\"!", r->host);
+	for (i = 0; i < count; i++)
+		LogDebug("translated \"%s\" to %s.", r->host,
+			 ng_ipaddr_tostr(&addrs[i]));
 
-	return array_copyb(IpAddr, (char *)&addr, sizeof(addr));
-#endif /* HAVE_GETADDRINFO */
-}
+	cbfunc = r->name_cb;
+	token = r->token;
+	Free_Resolver(r);
 
+	cbfunc(token, addrs, count);
+} /* Finish_Name */
 
-static bool
-Addr_in_list(const array *resolved_addr, const ng_ipaddr_t *Addr)
+
+/**
+ * Calculate the hash value of an IP address.
+ */
+static UINT32
+Cache_Hash(const ng_ipaddr_t *Addr)
 {
-	char tmp_ip_str[NG_INET_ADDRSTRLEN];
-	const ng_ipaddr_t *tmpAddrs = array_start(resolved_addr);
-	size_t len = array_length(resolved_addr, sizeof(*tmpAddrs));
+#ifdef WANT_IPV6
+	if (ng_ipaddr_af(Addr) == AF_INET6)
+		return Hash_Bytes(&Addr->sin6.sin6_addr,
+				  sizeof(Addr->sin6.sin6_addr));
+#endif
+	return Hash_Bytes(&Addr->sin4.sin_addr, sizeof(Addr->sin4.sin_addr));
+} /* Cache_Hash */
+
 
-	assert(len > 0);
-	assert(tmpAddrs);
+/**
+ * Find the cache entry of an IP address, expired or not.
+ */
+static RESOLVE_CACHE *
+Cache_Find(const ng_ipaddr_t *Addr)
+{
+	HASH_ITEM *item;
 
-	while (len > 0) {
-		if (ng_ipaddr_ipequal(Addr, tmpAddrs))
-			return true;
-		tmpAddrs++;
-		len--;
+	for (item = Hash_TableFirst(&Cache, Cache_Hash(Addr)); item;
+	     item = Hash_TableNext(item)) {
+		if (ng_ipaddr_ipequal(&((RESOLVE_CACHE *)item->data)->addr,
+				      Addr))
+			return (RESOLVE_CACHE *)item->data;
 	}
-	/* failed; print list of addresses */
-	ng_ipaddr_tostr_r(Addr, tmp_ip_str);
-	len = array_length(resolved_addr, sizeof(*tmpAddrs));
-	tmpAddrs = array_start(resolved_addr);
-
-	while (len > 0) {
-		Log_Subprocess(LOG_WARNING, "Address mismatch: %s != %s",
-			tmp_ip_str, ng_ipaddr_tostr(tmpAddrs));
-		tmpAddrs++;
-		len--;
+	return NULL;
+} /* Cache_Find */
+
+
+/**
+ * Add the result of an address lookup to the cache.
+ *
+ * When the cache is full, the oldest entry is replaced.
+ *
+ * @param Addr The IP address.
+ * @param Host The host name, or the IP address if the lookup failed.
+ * @param Ttl Time to live of the result (0: don't cache it).
+ * @param Failed true if the lookup failed or detected a forgery.
+ */
+static void
+Cache_Add(const ng_ipaddr_t *Addr, const char *Host, UINT32 Ttl, bool Failed)
+{
+	RESOLVE_CACHE *e;
+	UINT32 max = Failed ? RESOLVE_CACHE_NEG_TTL : RESOLVE_CACHE_TTL;
+
+	if (Ttl == 0 || !Cache.buckets)
+		return;
+
+	e = Cache_Find(Addr);
+	if (e)
+		Cache_Remove(e);
+	if (Cache.count >= RESOLVE_CACHE_MAX)
+		Cache_Remove(Cache_Oldest);
+
+	e = (RESOLVE_CACHE *)calloc(1, sizeof(RESOLVE_CACHE));
+	if (!e) {
+		Log(LOG_EMERG, "Can't allocate memory! [Cache_Add]");
+		return;
 	}
+	e->addr = *Addr;
+	strlcpy(e->host, Host, sizeof(e->host));
+	e->failed = Failed;
+	e->expires = time(NULL) + (Ttl < max ? Ttl : max);
+
+	e->prev = Cache_Newest;
+	e->next = NULL;
+	if (Cache_Newest)
+		Cache_Newest->next = e;
+	else
+		Cache_Oldest = e;
+	Cache_Newest = e;
+	Hash_TableAdd(&Cache, &e->item, Cache_Hash(Addr), e);
+	if (Failed)
+		Cache_Failed++;
+} /* Cache_Add */
 
-	return false;
-}
 
+/**
+ * Remove an entry from the cache and free it.
+ */
+static void
+Cache_Remove(RESOLVE_CACHE *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		Cache_Oldest = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		Cache_Newest = e->prev;
+	Hash_TableRemove(&Cache, &e->item);
+	if (e->failed)
+		Cache_Failed--;
+	free(e);
+} /* Cache_Remove */
 
+
+/**
+ * Use the IP address as host name, because it can't be resolved.
+ */
 static void
-Log_Forgery_NoIP(const char *ip, const char *host)
+Lookup_Failed(RESOLVER *r)
 {
-	Log_Subprocess(LOG_WARNING,
-		"Possible forgery: %s resolved to \"%s\", which has no IP address!",
-		ip, host);
-}
+	ng_ipaddr_tostr_r(&r->addr, r->host);
+} /* Lookup_Failed */
+
 
+/**
+ * Callback of the reverse DNS lookup: confirm the host name found.
+ */
 static void
-Log_Forgery_WrongIP(const char *ip, const char *host)
+cb_Reverse(void *Data, const DNS_RESULT *Result)
 {
-	Log_Subprocess(LOG_WARNING,
-		"Possible forgery: %s resolved to \"%s\", which points to a different address!",
-		ip, host);
-}
+	RESOLVER *r = (RESOLVER *)Data;
+
+	r->query[0] = NULL;
+	r->pending--;
+
+	if (!Result->found || !Result->name[0]
+	    || strlen(Result->name) >= CLIENT_HOST_LEN) {
+		Log(LOG_WARNING, "Can't resolve address \"%s\": %s.",
+		    ng_ipaddr_tostr(&r->addr), Result->found
+		    ? "invalid or too long host name" : "host not found");
+		Lookup_Failed(r);
+		Cache_Add(&r->addr, r->host, Result->ttl, true);
+		Check_Finished(r);
+		return;
+	}
+	strlcpy(r->host, Result->name, sizeof(r->host));
+	r->ttl = Result->ttl;
 
+	/* Forward lookup, the host name must point to the address */
+	r->query[0] = Dns_QueryName(r->host,
+#ifdef WANT_IPV6
+				    ng_ipaddr_af(&r->addr) == AF_INET6
+				    ? DNS_TYPE_AAAA :
+#endif
+				    DNS_TYPE_A, cb_Forward, r);
+	if (r->query[0])
+		r->pending++;
+	else
+		Lookup_Failed(r);
+	Check_Finished(r);
+} /* cb_Reverse */
 
+
+/**
+ * Callback of the forward DNS lookup of a host name found.
+ */
 static void
-ArrayWrite(int fd, const array *a)
+cb_Forward(void *Data, const DNS_RESULT *Result)
 {
-	size_t len = array_bytes(a);
-	const char *data = array_start(a);
+	RESOLVER *r = (RESOLVER *)Data;
+	char ip[NG_INET_ADDRSTRLEN];
+	bool failed = true;
+	size_t i;
+
+	r->query[0] = NULL;
+	r->pending--;
+	if (Result->ttl < r->ttl)
+		r->ttl = Result->ttl;
+
+	ng_ipaddr_tostr_r(&r->addr, ip);
+	if (Result->count == 0) {
+		Log(LOG_WARNING,
+		    "Possible forgery: %s resolved to \"%s\", which has no IP address!",
+		    ip, r->host);
+		Lookup_Failed(r);
+	} else {
+		for (i = 0; i < Result->count; i++) {
+			if (ng_ipaddr_ipequal(&r->addr, &Result->addr[i]))
+				break;
+		}
+		if (i >= Result->count) {
+			for (i = 0; i < Result->count; i++)
+				Log(LOG_WARNING, "Address mismatch: %s != %s",
+				    ip, ng_ipaddr_tostr(&Result->addr[i]));
+			Log(LOG_WARNING,
+			    "Possible forgery: %s resolved to \"%s\", which points to a different address!",
+			    ip, r->host);
+			Lookup_Failed(r);
+		} else
+			failed = false;
+	}
+	Cache_Add(&r->addr, r->host, r->ttl, failed);
+	LogDebug("Ok, translated %s to \"%s\".", ip, r->host);
+	Check_Finished(r);
+} /* cb_Forward */
 
-	assert(data);
 
-	if( (size_t)write(fd, data, len) != len )
-		Log_Subprocess( LOG_CRIT, "Resolver: Can't write to parent: %s!",
-							strerror(errno));
-}
+/**
+ * Callback of the IPv6 address lookup of a host name.
+ */
+static void
+cb_Name_AAAA(void *Data, const DNS_RESULT *Result)
+{
+	RESOLVER *r = (RESOLVER *)Data;
+
+	r->query[0] = NULL;
+	r->pending--;
+	memcpy(r->addrs[0], Result->addr, Result->count * sizeof(ng_ipaddr_t));
+	r->count[0] = Result->count;
+	Check_Finished(r);
+} /* cb_Name_AAAA */
+
+
+/**
+ * Callback of the IPv4 address lookup of a host name.
+ */
+static void
+cb_Name_A(void *Data, const DNS_RESULT *Result)
+{
+	RESOLVER *r = (RESOLVER *)Data;
 
+	r->query[1] = NULL;
+	r->pending--;
+	memcpy(r->addrs[1], Result->addr, Result->count * sizeof(ng_ipaddr_t));
+	r->count[1] = Result->count;
+	Check_Finished(r);
+} /* cb_Name_A */
 
+
+/**
+ * Timer callback: deliver deferred results, or handle timeouts.
+ */
 static void
-Do_ResolveAddr_Ident(const ng_ipaddr_t *Addr, int identsock, int w_fd)
-{
-	/* Resolver sub-process: resolve IP address and write result into
-	 * pipe to parent. */
-	char hostname[CLIENT_HOST_LEN];
-	char tmp_ip_str[NG_INET_ADDRSTRLEN];
-	size_t len;
-	array resolved_addr;
-
-	hostname[0] = '\0';
-	array_init(&resolved_addr);
-	ng_ipaddr_tostr_r(Addr, tmp_ip_str);
-
-	/* Skip DNS lookup when DNS is disabled; just return an empty ("") host
-	 * name but still issue an IDENT query, if supported and enabled. */
-	if (!Conf_DNS)
-		goto dns_done;
-
-	Log_Subprocess(LOG_DEBUG, "Now resolving %s ...", tmp_ip_str);
-	if (!ReverseLookup(Addr, hostname, sizeof(hostname)))
-		goto dns_done;
-
-	if (ForwardLookup(hostname, &resolved_addr, ng_ipaddr_af(Addr))) {
-		if (!Addr_in_list(&resolved_addr, Addr)) {
-			Log_Forgery_WrongIP(tmp_ip_str, hostname);
-			strlcpy(hostname, tmp_ip_str, sizeof(hostname));
+cb_Resolver_Timer(int Id)
+{
+	RESOLVER *r;
+	int i;
+
+	r = Find_Resolver(Id);
+	if (!r)
+		return;
+
+#ifdef IDENTAUTH
+	if (r->ident_sock >= 0) {
+		LogDebug("IDENT lookup on socket %d timed out.",
+			 r->ident_sock);
+		Close_Ident(r);
+	}
+#endif
+	if (r->pending > 0) {
+		if (time(NULL) < r->expires) {
+			Timer_Set(r->timer, r->expires);
+			return;
 		}
-	} else {
-		Log_Forgery_NoIP(tmp_ip_str, hostname);
-		strlcpy(hostname, tmp_ip_str, sizeof(hostname));
+		Log(LOG_WARNING, "Resolver for \"%s\" timed out.",
+		    r->addr_cb ? ng_ipaddr_tostr(&r->addr) : r->host);
+		for (i = 0; i < 2; i++) {
+			if (r->query[i])
+				Dns_Cancel(r->query[i]);
+			r->query[i] = NULL;
+		}
+		r->pending = 0;
+		if (r->addr_cb)
+			Lookup_Failed(r);
 	}
-	Log_Subprocess(LOG_DEBUG, "Ok, translated %s to \"%s\".", tmp_ip_str, hostname);
- dns_done:
-	len = strlen(hostname);
-	hostname[len] = '\n';
-	if (!array_copyb(&resolved_addr, hostname, ++len)) {
-		Log_Subprocess(LOG_CRIT,
-			       "Resolver: Can't copy resolved name: %s!",
-			       strerror(errno));
-		array_free(&resolved_addr);
-		return;
+	Check_Finished(r);
+} /* cb_Resolver_Timer */
+
+
+#ifdef IDENTAUTH
+
+/**
+ * Start an IDENT lookup for a client connection (RFC 1413).
+ *
+ * @param r The resolver structure.
+ * @param Sock Socket of the client connection.
+ * @return true if the lookup is in progress.
+ */
+static bool
+Start_Ident(RESOLVER *r, int Sock)
+{
+	ng_ipaddr_t local, remote;
+	socklen_t len;
+	int fd;
+
+	len = (socklen_t)sizeof(local);
+	if (getsockname(Sock, (struct sockaddr *)&local, &len) != 0)
+		return false;
+	len = (socklen_t)sizeof(remote);
+	if (getpeername(Sock, (struct sockaddr *)&remote, &len) != 0)
+		return false;
+	r->ident_ports[0] = ng_ipaddr_getport(&remote);
+	r->ident_ports[1] = ng_ipaddr_getport(&local);
+
+	LogDebug("Doing IDENT lookup on socket %d ...", Sock);
+	fd = socket(ng_ipaddr_af(&remote), SOCK_STREAM, 0);
+	if (fd < 0) {
+		Log(LOG_WARNING, "Can't create IDENT socket: %s!",
+		    strerror(errno));
+		return false;
+	}
+	if (!io_setnonblock(fd) || !io_setcloexec(fd)) {
+		Log(LOG_WARNING, "Can't initialize IDENT socket: %s!",
+		    strerror(errno));
+		close(fd);
+		return false;
 	}
 
-	Do_IdentQuery(identsock, &resolved_addr);
+	/* Connect from the address the client is connected to */
+	ng_ipaddr_setport(&local, 0);
+	ng_ipaddr_setport(&remote, IDENT_PORT);
+	if (bind(fd, (struct sockaddr *)&local, ng_ipaddr_salen(&local)) != 0
+	    || (connect(fd, (struct sockaddr *)&remote,
+			ng_ipaddr_salen(&remote)) != 0
+		&& errno != EINPROGRESS)) {
+		LogDebug("Can't connect to IDENT server: %s", strerror(errno));
+		close(fd);
+		return false;
+	}
+	if (!io_event_create(fd, IO_WANTWRITE, cb_Ident)) {
+		Log(LOG_WARNING, "Can't register IDENT socket: %s!",
+		    strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	r->ident_sock = fd;
+	Hash_TableAdd(&Idents, &r->ident_item, (UINT32)fd, r);
+	return true;
+} /* Start_Ident */
 
-	ArrayWrite(w_fd, &resolved_addr);
 
-	array_free(&resolved_addr);
-} /* Do_ResolveAddr_Ident */
+/**
+ * Close the IDENT socket of a resolver structure, if any.
+ */
+static void
+Close_Ident(RESOLVER *r)
+{
+	if (r->ident_sock < 0)
+		return;
+	Hash_TableRemove(&Idents, &r->ident_item);
+	io_close(r->ident_sock);
+	r->ident_sock = -1;
+} /* Close_Ident */
 
 
+/**
+ * Parse the IDENT reply, like "1234 , 6667 : USERID : UNIX : user".
+ */
 static void
-Do_ResolveName( const char *Host, int w_fd )
+Parse_Ident(RESOLVER *r)
 {
-	/* Resolver sub-process: resolve name and write result into pipe
-	 * to parent. */
-	array IpAddrs;
-	int af;
-	ng_ipaddr_t *addr;
-	size_t len;
-	Log_Subprocess(LOG_DEBUG, "Now resolving \"%s\" ...", Host);
+	char *field[4], *ptr, *end;
+	int i;
+
+	r->ident_reply[r->ident_len] = '\0';
+	ptr = r->ident_reply;
+	for (i = 0; i < 4; i++) {
+		field[i] = ptr;
+		if (i < 3) {
+			ptr = strchr(ptr, ':');
+			if (!ptr)
+				return;
+			*ptr++ = '\0';
+		}
+	}
 
-	array_init(&IpAddrs);
+	/* Strip leading and trailing white space */
+	for (i = 0; i < 4; i++) {
+		while (*field[i] == ' ' || *field[i] == '\t')
+			field[i]++;
+		end = field[i] + strlen(field[i]);
+		while (end > field[i] && (end[-1] == ' ' || end[-1] == '\t'
+					  || end[-1] == '\r' || end[-1] == '\n'))
+			*--end = '\0';
+	}
+	if (strcmp(field[1], "USERID") != 0)
+		return;
+	strlcpy(r->ident, field[3], sizeof(r->ident));
+} /* Parse_Ident */
 
-#ifdef WANT_IPV6
-	af = AF_UNSPEC;
-	assert(Conf_ConnectIPv6 || Conf_ConnectIPv4);
 
-	if (!Conf_ConnectIPv6)
-		af = AF_INET;
-	if (!Conf_ConnectIPv4)
-		af = AF_INET6;
-#else
-	af = AF_INET;
-#endif
-	if (!ForwardLookup(Host, &IpAddrs, af)) {
-		close(w_fd);
+/**
+ * IO callback of IDENT sockets: send the request, and read the reply.
+ */
+static void
+cb_Ident(int Sock, short What)
+{
+	char request[32];
+	HASH_ITEM *item;
+	RESOLVER *r = NULL;
+	socklen_t len;
+	ssize_t n;
+	int err;
+
+	for (item = Hash_TableFirst(&Idents, (UINT32)Sock); item;
+	     item = Hash_TableNext(item)) {
+		if (((RESOLVER *)item->data)->ident_sock == Sock) {
+			r = (RESOLVER *)item->data;
+			break;
+		}
+	}
+	if (!r) {
+		io_close(Sock);
 		return;
 	}
-	len = array_length(&IpAddrs, sizeof(*addr));
-	assert(len > 0);
-	addr = array_start(&IpAddrs);
-	assert(addr);
-	for (; len > 0; --len,addr++) {
-		Log_Subprocess(LOG_DEBUG, "translated \"%s\" to %s.",
-					Host, ng_ipaddr_tostr(addr));
+
+	if (!r->ident_sent) {
+		if (!(What & IO_WANTWRITE))
+			return;
+		err = 0;
+		len = (socklen_t)sizeof(err);
+		if (getsockopt(Sock, SOL_SOCKET, SO_ERROR, &err, &len) != 0
+		    || err != 0) {
+			LogDebug("Can't connect to IDENT server: %s",
+				 strerror(err ? err : errno));
+			goto done;
+		}
+		snprintf(request, sizeof(request), "%u , %u\r\n",
+			 (unsigned int)r->ident_ports[0],
+			 (unsigned int)r->ident_ports[1]);
+		n = write(Sock, request, strlen(request));
+		if (n != (ssize_t)strlen(request))
+			goto done;
+		r->ident_sent = true;
+		io_event_del(Sock, IO_WANTWRITE);
+		io_event_add(Sock, IO_WANTREAD);
+		return;
 	}
-	/* Write result into pipe to parent */
-	ArrayWrite(w_fd, &IpAddrs);
 
-	array_free(&IpAddrs);
-} /* Do_ResolveName */
+	if (!(What & IO_WANTREAD))
+		return;
+	n = read(Sock, r->ident_reply + r->ident_len,
+		 sizeof(r->ident_reply) - 1 - r->ident_len);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n > 0) {
+		r->ident_len += (size_t)n;
+		if (!memchr(r->ident_reply, '\n', r->ident_len)
+		    && r->ident_len < sizeof(r->ident_reply) - 1)
+			return;
+	}
+	Parse_Ident(r);
+	LogDebug("Ok, IDENT lookup on socket %d done: \"%s\"", Sock,
+		 r->ident);
+ done:
+	Close_Ident(r);
+	Check_Finished(r);
+} /* cb_Ident */
+
+#endif /* IDENTAUTH */
 
 
 /* -eof- */
@@ -1,6 +1,6 @@
 /*
  * ngIRCd -- The Next Generation IRC Daemon
- * Copyright (c)2001-2024 Alexander Barton (alex@barton.de) and Contributors.
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -17,10 +17,40 @@
  * Asynchronous resolver (header)
  */
 
-GLOBAL bool Resolve_Addr_Ident PARAMS((PROC_STAT * s, const ng_ipaddr_t * Addr,
-				 int identsock, void (*cbfunc) (int, short)));
-GLOBAL bool Resolve_Name PARAMS((PROC_STAT * s, const char *Host,
-				 void (*cbfunc) (int, short)));
+#include "ng_ipaddr.h"
+
+/**
+ * Status of the resolver of a connection or server.
+ * Only the ID of the lookup is stored, so the structure can be moved freely.
+ */
+typedef struct _Res_Stat {
+	int id;				/**< ID of the lookup or 0 */
+} RES_STAT;
+
+GLOBAL void Resolve_Init PARAMS((void));
+GLOBAL void Resolve_Exit PARAMS((void));
+
+GLOBAL void Resolve_InitStruct PARAMS((RES_STAT *s));
+GLOBAL bool Resolve_InProgress PARAMS((const RES_STAT *s));
+
+GLOBAL bool Resolve_Addr_Ident PARAMS((RES_STAT *s, const ng_ipaddr_t *Addr,
+				       int identsock, const char *Hostname,
+				       int Token,
+				       void (*cbfunc)(int Token,
+						      const char *Hostname,
+						      const char *Ident)));
+GLOBAL bool Resolve_Name PARAMS((RES_STAT *s, const char *Host, int Token,
+				 void (*cbfunc)(int Token,
+						const ng_ipaddr_t *Addrs,
+						size_t Count)));
+GLOBAL void Resolve_Cancel PARAMS((RES_STAT *s));
+
+GLOBAL void Resolve_Run PARAMS((void));
+GLOBAL bool Resolve_Deferred PARAMS((void));
+
+GLOBAL bool Resolve_Cached PARAMS((const ng_ipaddr_t *Addr, char *Host,
+				   size_t Len));
+GLOBAL char *Resolve_CacheStats PARAMS((char *Buf, size_t Len));
 
 #endif
 
@@ -0,0 +1,352 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#include "portab.h"
+
+/**
+ * @file
+ * Chained write queues of connections
+ *
+ * Data is queued in a list of fixed-size chunks: appending never moves
+ * data already queued, and data that has been sent is consumed by
+ * advancing the offset into the first chunk (instead of moving all the
+ * remaining data to the front of one large buffer). The queued chunks
+ * can be handed to writev(2) as they are.
+ *
+ * A message sent to many connections (like to all members of a channel)
+ * can be queued as a reference-counted, immutable block instead: all
+ * queues then link to the same data, which is freed when the last one
+ * has sent it.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sendq.h"
+
+/** Chunks kept for reuse, see Chunk_New() and Chunk_Release(). */
+static SENDQ_CHUNK *Free_Chunks = NULL;
+static unsigned int Free_Chunks_Count = 0;
+
+/** Chunks referencing shared blocks kept for reuse, see Ref_New(). */
+static SENDQ_CHUNK *Free_Refs = NULL;
+static unsigned int Free_Refs_Count = 0;
+
+/**
+ * Get an empty chunk, reusing a released one when available.
+ *
+ * @returns Pointer to the new chunk or NULL if out of memory.
+ */
+static SENDQ_CHUNK *
+Chunk_New(void)
+{
+	SENDQ_CHUNK *chunk;
+
+	if (Free_Chunks) {
+		chunk = Free_Chunks;
+		Free_Chunks = chunk->next;
+		Free_Chunks_Count--;
+	} else {
+		/* The buffer of the chunk directly follows its header */
+		chunk = (SENDQ_CHUNK *)malloc(sizeof(SENDQ_CHUNK)
+					      + SENDQ_CHUNK_LEN);
+		if (!chunk)
+			return NULL;
+		chunk->data = (char *)(chunk + 1);
+		chunk->block = NULL;
+	}
+	chunk->next = NULL;
+	chunk->start = chunk->used = 0;
+	return chunk;
+}
+
+/**
+ * Get a chunk referencing a shared block (without a buffer of its own),
+ * reusing a released one when available.
+ *
+ * @param Block The shared block, its reference count is incremented.
+ * @returns Pointer to the new chunk or NULL if out of memory.
+ */
+static SENDQ_CHUNK *
+Ref_New(SENDQ_BLOCK *Block)
+{
+	SENDQ_CHUNK *chunk;
+
+	if (Free_Refs) {
+		chunk = Free_Refs;
+		Free_Refs = chunk->next;
+		Free_Refs_Count--;
+	} else {
+		chunk = (SENDQ_CHUNK *)malloc(sizeof(SENDQ_CHUNK));
+		if (!chunk)
+			return NULL;
+	}
+	chunk->next = NULL;
+	chunk->data = Block->data;
+	chunk->start = 0;
+	chunk->used = Block->len;
+	chunk->block = Block;
+	Block->refcnt++;
+	return chunk;
+}
+
+/**
+ * Release a chunk which is no longer used by any queue.
+ *
+ * @param Chunk Chunk to release.
+ */
+static void
+Chunk_Release(SENDQ_CHUNK *Chunk)
+{
+	if (Chunk->block) {
+		sendq_block_release(Chunk->block);
+		if (Free_Refs_Count >= SENDQ_FREE_REFS) {
+			free(Chunk);
+			return;
+		}
+		Chunk->next = Free_Refs;
+		Free_Refs = Chunk;
+		Free_Refs_Count++;
+		return;
+	}
+	if (Free_Chunks_Count >= SENDQ_FREE_CHUNKS) {
+		free(Chunk);
+		return;
+	}
+	Chunk->next = Free_Chunks;
+	Free_Chunks = Chunk;
+	Free_Chunks_Count++;
+}
+
+/**
+ * Append data to a write queue.
+ *
+ * @param Queue Write queue.
+ * @param Data Data to append.
+ * @param Len Length of the data in bytes.
+ * @returns true on success, false if out of memory (the queue is
+ *	    left unchanged then).
+ */
+GLOBAL bool
+sendq_append(SENDQ *Queue, const char *Data, size_t Len)
+{
+	SENDQ_CHUNK *chunk, *last, *first_new = NULL, *last_new = NULL;
+	size_t space, len;
+
+	assert(Queue != NULL);
+	assert(Data != NULL || Len == 0);
+
+	/* Allocate all chunks needed up front, so that nothing has to be
+	 * undone when running out of memory halfway through. Shared blocks
+	 * are never appended to. */
+	last = Queue->last && !Queue->last->block ? Queue->last : NULL;
+	space = last ? SENDQ_CHUNK_LEN - last->used : 0;
+	while (space < Len) {
+		chunk = Chunk_New();
+		if (!chunk) {
+			while (first_new) {
+				chunk = first_new->next;
+				Chunk_Release(first_new);
+				first_new = chunk;
+			}
+			return false;
+		}
+		if (last_new)
+			last_new->next = chunk;
+		else
+			first_new = chunk;
+		last_new = chunk;
+		space += SENDQ_CHUNK_LEN;
+	}
+
+	if (first_new) {
+		if (Queue->last)
+			Queue->last->next = first_new;
+		else
+			Queue->first = first_new;
+	}
+
+	chunk = last ? last : first_new;
+	Queue->bytes += Len;
+	while (Len > 0) {
+		len = SENDQ_CHUNK_LEN - chunk->used;
+		if (len == 0) {
+			chunk = chunk->next;
+			continue;
+		}
+		if (len > Len)
+			len = Len;
+		memcpy(chunk->data + chunk->used, Data, len);
+		chunk->used += len;
+		Data += len;
+		Len -= len;
+	}
+
+	if (last_new)
+		Queue->last = last_new;
+	return true;
+} /* sendq_append */
+
+/**
+ * Append a shared block to a write queue, without copying its data.
+ *
+ * @param Queue Write queue.
+ * @param Block The block, see sendq_block_new().
+ * @returns true on success, false if out of memory (the queue is
+ *	    left unchanged then).
+ */
+GLOBAL bool
+sendq_append_block(SENDQ *Queue, SENDQ_BLOCK *Block)
+{
+	SENDQ_CHUNK *chunk;
+
+	assert(Queue != NULL);
+	assert(Block != NULL);
+
+	chunk = Ref_New(Block);
+	if (!chunk)
+		return false;
+
+	if (Queue->last)
+		Queue->last->next = chunk;
+	else
+		Queue->first = chunk;
+	Queue->last = chunk;
+	Queue->bytes += Block->len;
+	return true;
+} /* sendq_append_block */
+
+/**
+ * Describe the queued data as an I/O vector suitable for writev(2).
+ *
+ * @param Queue Write queue.
+ * @param Iov Array of (at least) Max I/O vector elements to fill in.
+ * @param Max Maximum number of elements to use.
+ * @param Len Receives the number of bytes described by the vector.
+ * @returns Number of elements filled in.
+ */
+GLOBAL int
+sendq_iovec(SENDQ *Queue, struct iovec *Iov, int Max, size_t *Len)
+{
+	SENDQ_CHUNK *chunk;
+	int cnt = 0;
+
+	assert(Queue != NULL);
+	assert(Len != NULL);
+
+	*Len = 0;
+	for (chunk = Queue->first; chunk && cnt < Max; chunk = chunk->next) {
+		if (chunk->used == chunk->start)
+			continue;
+		Iov[cnt].iov_base = chunk->data + chunk->start;
+		Iov[cnt].iov_len = chunk->used - chunk->start;
+		*Len += Iov[cnt].iov_len;
+		cnt++;
+	}
+	return cnt;
+} /* sendq_iovec */
+
+/**
+ * Remove data that has been sent from the front of a write queue.
+ *
+ * @param Queue Write queue.
+ * @param Len Number of bytes to remove.
+ */
+GLOBAL void
+sendq_consume(SENDQ *Queue, size_t Len)
+{
+	SENDQ_CHUNK *chunk;
+	size_t len;
+
+	assert(Queue != NULL);
+	assert(Len <= Queue->bytes);
+
+	Queue->bytes -= Len;
+	while ((chunk = Queue->first)) {
+		len = chunk->used - chunk->start;
+		if (Len < len) {
+			chunk->start += Len;
+			return;
+		}
+		Len -= len;
+		if (chunk == Queue->last) {
+			if (!chunk->block) {
+				/* Keep the last chunk, it most probably will
+				 * be appended to again soon. */
+				chunk->start = chunk->used = 0;
+				return;
+			}
+			Queue->last = NULL;
+		}
+		Queue->first = chunk->next;
+		Chunk_Release(chunk);
+	}
+} /* sendq_consume */
+
+/**
+ * Free all chunks of a write queue.
+ *
+ * @param Queue Write queue.
+ */
+GLOBAL void
+sendq_free(SENDQ *Queue)
+{
+	SENDQ_CHUNK *chunk;
+
+	assert(Queue != NULL);
+
+	while ((chunk = Queue->first)) {
+		Queue->first = chunk->next;
+		Chunk_Release(chunk);
+	}
+	Queue->last = NULL;
+	Queue->bytes = 0;
+} /* sendq_free */
+
+/**
+ * Allocate a new block to be shared by write queues.
+ *
+ * The caller holds the first reference and fills in the data, see
+ * Conn_NewLine(); the block must not be changed after it has been
+ * appended to a queue.
+ *
+ * @returns Pointer to the new block or NULL if out of memory.
+ */
+GLOBAL SENDQ_BLOCK *
+sendq_block_new(void)
+{
+	SENDQ_BLOCK *block;
+
+	block = (SENDQ_BLOCK *)malloc(sizeof(SENDQ_BLOCK));
+	if (!block)
+		return NULL;
+	block->refcnt = 1;
+	block->len = 0;
+	return block;
+} /* sendq_block_new */
+
+/**
+ * Release a reference to a shared block, and free it when it was the last.
+ *
+ * @param Block The block.
+ */
+GLOBAL void
+sendq_block_release(SENDQ_BLOCK *Block)
+{
+	assert(Block != NULL);
+	assert(Block->refcnt > 0);
+
+	if (--Block->refcnt == 0)
+		free(Block);
+} /* sendq_block_release */
+
+/* -eof- */
@@ -0,0 +1,65 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#ifndef __sendq_h__
+#define __sendq_h__
+
+/**
+ * @file
+ * Chained write queues of connections (header)
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "portab.h"
+#include "defines.h"
+
+typedef struct _SendQ_Block
+{
+	unsigned int refcnt;		/* Number of users of the block */
+	size_t len;			/* Length of "data" */
+	char data[COMMAND_LEN];		/* Message line, including CR+LF */
+} SENDQ_BLOCK;
+
+typedef struct _SendQ_Chunk
+{
+	struct _SendQ_Chunk *next;	/* Next chunk in queue or NULL */
+	char *data;			/* Queued data */
+	size_t start;			/* Offset of first unsent byte */
+	size_t used;			/* Bytes used in "data" */
+	SENDQ_BLOCK *block;		/* Shared block "data" belongs to, or
+					   NULL for a chunk with its own
+					   buffer of SENDQ_CHUNK_LEN bytes */
+} SENDQ_CHUNK;
+
+typedef struct _SendQ
+{
+	SENDQ_CHUNK *first;		/* Chunk to send from, or NULL */
+	SENDQ_CHUNK *last;		/* Chunk to append to, or NULL */
+	size_t bytes;			/* Total number of queued bytes */
+} SENDQ;
+
+#define sendq_bytes(q)	((q)->bytes)
+
+GLOBAL bool sendq_append PARAMS((SENDQ *Queue, const char *Data, size_t Len));
+GLOBAL bool sendq_append_block PARAMS((SENDQ *Queue, SENDQ_BLOCK *Block));
+GLOBAL int sendq_iovec PARAMS((SENDQ *Queue, struct iovec *Iov, int Max,
+			       size_t *Len));
+GLOBAL void sendq_consume PARAMS((SENDQ *Queue, size_t Len));
+GLOBAL void sendq_free PARAMS((SENDQ *Queue));
+
+GLOBAL SENDQ_BLOCK *sendq_block_new PARAMS((void));
+GLOBAL void sendq_block_release PARAMS((SENDQ_BLOCK *Block));
+
+#endif
+
+/* -eof- */
@@ -37,6 +37,7 @@
 #include "io.h"
 #include "log.h"
 #include "ngircd.h"
+#include "parse.h"
 
 #include "sighandlers.h"
 
@@ -60,6 +61,7 @@ Dump_State(void)
 	Conf_DebugDump();
 	Conn_DebugDump();
 	Client_DebugDump();
+	Parse_DebugDump();
 	LogDebug("--- End of state dump ---");
 } /* Dump_State */
 
@@ -0,0 +1,339 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#include "portab.h"
+
+/**
+ * @file
+ * Slab allocator for objects of fixed size
+ *
+ * Objects of one type (clients, channels, ...) are allocated from blocks
+ * of SLAB_LEN bytes ("slabs") holding a fixed number of them, instead of
+ * allocating each object on its own: this keeps objects of the same type
+ * together and doesn't fragment the heap when lots of them are allocated
+ * and freed again, like on netsplits and rejoins.
+ *
+ * Each slab keeps a list of its free objects and counts the objects in
+ * use; objects are allocated from slabs which are in use already, and
+ * slabs which become unused are released again (except for one, to not
+ * allocate and release a slab over and over again).
+ *
+ * Every object is preceded by a header pointing to its slab, so the slab
+ * of an object to free is found in constant time.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+#include "log.h"
+
+#include "slab.h"
+
+/** Header of a slab, followed by its objects. */
+typedef struct _Slab
+{
+	struct _Slab *next;		/* Next slab with free objects */
+	struct _Slab *prev;		/* Previous slab with free objects */
+	SLAB_CACHE *cache;		/* Cache this slab belongs to */
+	void *free;			/* First free object, or NULL */
+	unsigned int used;		/* Number of objects in use */
+} SLAB;
+
+/** Header of an object, suitably aligned for any object. */
+typedef union _Slab_Header
+{
+	SLAB *slab;
+	long l;
+	double d;
+	void *p;
+} SLAB_HEADER;
+
+/** Round up to a multiple of the size of the object header. */
+#define SLAB_ALIGN(n) \
+	(((n) + sizeof(SLAB_HEADER) - 1) / sizeof(SLAB_HEADER) \
+	 * sizeof(SLAB_HEADER))
+
+static SLAB_CACHE *My_Caches;
+
+static SLAB *New_Slab PARAMS((SLAB_CACHE *Cache));
+static void Unlink_Slab PARAMS((SLAB *Slab));
+
+/**
+ * Initialize a cache for objects of one type.
+ *
+ * @param Cache The cache to initialize.
+ * @param Name Name of the object type (for statistics).
+ * @param Size Size of the objects.
+ */
+GLOBAL void
+Slab_Init(SLAB_CACHE *Cache, const char *Name, size_t Size)
+{
+	SLAB_CACHE *c;
+
+	assert(Cache != NULL);
+	assert(Name != NULL);
+	assert(Size > 0);
+
+	Cache->name = Name;
+	Cache->size = Size;
+	Cache->slot_size = sizeof(SLAB_HEADER) + SLAB_ALIGN(Size);
+	Cache->per_slab = (unsigned int)((SLAB_LEN - SLAB_ALIGN(sizeof(SLAB)))
+					 / Cache->slot_size);
+	if (Cache->per_slab < SLAB_OBJECTS_MIN)
+		Cache->per_slab = SLAB_OBJECTS_MIN;
+	Cache->partial = NULL;
+	Cache->empty = NULL;
+	Cache->slabs = Cache->slabs_full = 0;
+	Cache->live = 0;
+
+	/* Add the cache to the list of all caches, if not listed already
+	 * (on restart, for example) */
+	for (c = My_Caches; c; c = c->next) {
+		if (c == Cache)
+			return;
+	}
+	Cache->next = My_Caches;
+	My_Caches = Cache;
+} /* Slab_Init */
+
+/**
+ * Release all slabs of a cache.
+ *
+ * All objects must have been freed already, the cache can be initialized
+ * again afterwards.
+ *
+ * @param Cache The cache.
+ */
+GLOBAL void
+Slab_Exit(SLAB_CACHE *Cache)
+{
+	SLAB *slab;
+
+	assert(Cache != NULL);
+
+	if (Cache->live > 0)
+		Log(LOG_WARNING, "%lu object%s of type \"%s\" still in use!",
+		    Cache->live, Cache->live == 1 ? "" : "s", Cache->name);
+
+	while (Cache->partial) {
+		slab = Cache->partial;
+		Unlink_Slab(slab);
+		free(slab);
+	}
+	if (Cache->empty)
+		free(Cache->empty);
+	Cache->empty = NULL;
+	Cache->slabs = Cache->slabs_full = 0;
+	Cache->live = 0;
+} /* Slab_Exit */
+
+/**
+ * Allocate an object.
+ *
+ * @param Cache The cache of the object type.
+ * @returns Pointer to the (uninitialized) object, or NULL if out of memory.
+ */
+GLOBAL void *
+Slab_Alloc(SLAB_CACHE *Cache)
+{
+	SLAB *slab;
+	void *obj;
+
+	assert(Cache != NULL);
+
+	slab = Cache->partial;
+	if (!slab) {
+		/* No free objects left: use the unused slab, if any, or
+		 * allocate a new one */
+		if (Cache->empty) {
+			slab = Cache->empty;
+			Cache->empty = NULL;
+		} else {
+			slab = New_Slab(Cache);
+			if (!slab)
+				return NULL;
+		}
+		slab->prev = NULL;
+		slab->next = NULL;
+		Cache->partial = slab;
+	}
+
+	obj = slab->free;
+	assert(obj != NULL);
+	slab->free = *(void **)obj;
+	slab->used++;
+	Cache->live++;
+
+	if (slab->used == Cache->per_slab) {
+		/* Slab is completely used now */
+		Unlink_Slab(slab);
+		Cache->slabs_full++;
+	}
+	return obj;
+} /* Slab_Alloc */
+
+/**
+ * Free an object.
+ *
+ * @param Cache The cache of the object type.
+ * @param Object The object, allocated using Slab_Alloc() from this cache.
+ */
+GLOBAL void
+Slab_Free(SLAB_CACHE *Cache, void *Object)
+{
+	SLAB *slab;
+
+	assert(Cache != NULL);
+	assert(Object != NULL);
+
+	slab = ((SLAB_HEADER *)Object - 1)->slab;
+	assert(slab->cache == Cache);
+	assert(slab->used > 0);
+
+	if (slab->used == Cache->per_slab) {
+		/* Slab has been completely used: it has free objects again */
+		Cache->slabs_full--;
+		slab->prev = NULL;
+		slab->next = Cache->partial;
+		if (Cache->partial)
+			Cache->partial->prev = slab;
+		Cache->partial = slab;
+	}
+
+	*(void **)Object = slab->free;
+	slab->free = Object;
+	slab->used--;
+	Cache->live--;
+
+	if (slab->used > 0)
+		return;
+
+	/* Slab is completely unused now: keep it for reuse, if there is
+	 * no unused slab already, or release it. */
+	Unlink_Slab(slab);
+	if (!Cache->empty) {
+		Cache->empty = slab;
+		return;
+	}
+	free(slab);
+	Cache->slabs--;
+} /* Slab_Free */
+
+/**
+ * Get the first cache of the list of all caches.
+ */
+GLOBAL SLAB_CACHE *
+Slab_First(void)
+{
+	return My_Caches;
+} /* Slab_First */
+
+/**
+ * Get the next cache of the list of all caches.
+ */
+GLOBAL SLAB_CACHE *
+Slab_Next(SLAB_CACHE *Cache)
+{
+	assert(Cache != NULL);
+	return Cache->next;
+} /* Slab_Next */
+
+/**
+ * Describe the usage of a cache: objects in use and free objects, the
+ * number of completely used, partially used and unused slabs, and how many
+ * of the partially used slabs have less than 1/4, 2/4, 3/4 and all of
+ * their objects in use.
+ *
+ * @param Cache The cache.
+ * @param Buf Buffer for the result.
+ * @param Len Size of the buffer.
+ * @returns Pointer to the buffer.
+ */
+GLOBAL char *
+Slab_Stats(SLAB_CACHE *Cache, char *Buf, size_t Len)
+{
+	unsigned long partial = 0, quarters[4] = { 0, 0, 0, 0 };
+	SLAB *slab;
+
+	assert(Cache != NULL);
+	assert(Buf != NULL);
+
+	for (slab = Cache->partial; slab; slab = slab->next) {
+		quarters[slab->used * 4 / Cache->per_slab]++;
+		partial++;
+	}
+	snprintf(Buf, Len,
+		 "%s: %lu live, %lu free, %lu slab%s (%lu full, %lu partial [%lu/%lu/%lu/%lu], %d empty) of %u objects, %lu bytes each",
+		 Cache->name, Cache->live,
+		 Cache->slabs * Cache->per_slab - Cache->live,
+		 Cache->slabs, Cache->slabs == 1 ? "" : "s",
+		 Cache->slabs_full, partial, quarters[0], quarters[1],
+		 quarters[2], quarters[3], Cache->empty ? 1 : 0,
+		 Cache->per_slab, (unsigned long)Cache->size);
+	return Buf;
+} /* Slab_Stats */
+
+/**
+ * Allocate a new slab and put all of its objects on its list of free
+ * objects.
+ */
+static SLAB *
+New_Slab(SLAB_CACHE *Cache)
+{
+	SLAB *slab;
+	char *slot;
+	unsigned int i;
+
+	slab = (SLAB *)malloc(SLAB_ALIGN(sizeof(SLAB))
+			      + Cache->per_slab * Cache->slot_size);
+	if (!slab) {
+		Log(LOG_EMERG, "Can't allocate memory! [New_Slab]");
+		return NULL;
+	}
+	slab->cache = Cache;
+	slab->used = 0;
+	slab->free = NULL;
+
+	/* Link the objects in reverse order, so that they are allocated
+	 * in order of their addresses */
+	slot = (char *)slab + SLAB_ALIGN(sizeof(SLAB))
+	       + Cache->per_slab * Cache->slot_size;
+	for (i = 0; i < Cache->per_slab; i++) {
+		slot -= Cache->slot_size;
+		((SLAB_HEADER *)slot)->slab = slab;
+		*(void **)(slot + sizeof(SLAB_HEADER)) = slab->free;
+		slab->free = slot + sizeof(SLAB_HEADER);
+	}
+
+	Cache->slabs++;
+	return slab;
+} /* New_Slab */
+
+/**
+ * Remove a slab from the list of slabs with free objects of its cache.
+ */
+static void
+Unlink_Slab(SLAB *Slab)
+{
+	SLAB_CACHE *cache = Slab->cache;
+
+	if (Slab->prev)
+		Slab->prev->next = Slab->next;
+	else
+		cache->partial = Slab->next;
+	if (Slab->next)
+		Slab->next->prev = Slab->prev;
+	Slab->next = Slab->prev = NULL;
+} /* Unlink_Slab */
+
+/* -eof- */
@@ -0,0 +1,50 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#ifndef __slab_h__
+#define __slab_h__
+
+/**
+ * @file
+ * Slab allocator for objects of fixed size (header)
+ */
+
+#include "portab.h"
+
+/** Allocator ("cache") for objects of one type, see slab.c. */
+typedef struct _Slab_Cache
+{
+	struct _Slab_Cache *next;	/* Next cache in list of all caches */
+	const char *name;		/* Name of the object type */
+	size_t size;			/* Size of the objects */
+	size_t slot_size;		/* Size of objects including header */
+	unsigned int per_slab;		/* Number of objects per slab */
+	struct _Slab *partial;		/* Slabs with free objects */
+	struct _Slab *empty;		/* Completely unused slab, or NULL */
+	unsigned long slabs;		/* Number of slabs */
+	unsigned long slabs_full;	/* Number of completely used slabs */
+	unsigned long live;		/* Number of objects in use */
+} SLAB_CACHE;
+
+GLOBAL void Slab_Init PARAMS((SLAB_CACHE *Cache, const char *Name,
+			      size_t Size));
+GLOBAL void Slab_Exit PARAMS((SLAB_CACHE *Cache));
+
+GLOBAL void *Slab_Alloc PARAMS((SLAB_CACHE *Cache));
+GLOBAL void Slab_Free PARAMS((SLAB_CACHE *Cache, void *Object));
+
+GLOBAL SLAB_CACHE *Slab_First PARAMS((void));
+GLOBAL SLAB_CACHE *Slab_Next PARAMS((SLAB_CACHE *Cache));
+GLOBAL char *Slab_Stats PARAMS((SLAB_CACHE *Cache, char *Buf, size_t Len));
+
+#endif
+
+/* -eof- */
@@ -0,0 +1,345 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#include "portab.h"
+
+/**
+ * @file
+ * Timer wheel for scheduled events
+ *
+ * All timers are kept in a "hashed timer wheel" with a resolution of one
+ * second: the timers expiring in a particular second are linked into the
+ * slot of that second (modulo the number of slots), so setting and
+ * stopping a timer is O(1), and handling the expired timers only needs to
+ * look at the slots of the seconds that passed since the last run. Timers
+ * expiring farther in the future than the wheel covers simply stay in
+ * their slot for additional rounds.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "log.h"
+
+#include "timer.h"
+
+/** Number of slots of the timer wheel, must be a power of two. */
+#define TIMER_SLOTS 512
+
+#define SLOT(t) ((size_t)(t) & (TIMER_SLOTS - 1))
+
+static TIMER *Timer_Wheel[TIMER_SLOTS];
+
+/** Last second handled by Timer_Run(). */
+static time_t Wheel_Time = 0;
+
+/** Cached result of Timer_NextExpiration(), 0 when it must be recalculated
+ * (a too early value doesn't matter, it only results in a needless run). */
+static time_t Next_Expiration = 0;
+
+/** Limit of the result of Timer_DiffMs(), in seconds. */
+#define DIFF_MAX_SEC (LONG_MAX / 1000 - 1)
+
+/** Number of timers set. */
+static unsigned long Timers_Set = 0;
+
+/**
+ * Create a new timer, which isn't set yet.
+ *
+ * @param Callback Function to call when the timer expires.
+ * @param Arg Argument to pass to the callback function.
+ * @returns Pointer to the new timer or NULL if out of memory.
+ */
+GLOBAL TIMER *
+Timer_New(void (*Callback)(int Arg), int Arg)
+{
+	TIMER *timer;
+
+	assert(Callback != NULL);
+
+	timer = (TIMER *)malloc(sizeof(TIMER));
+	if (!timer) {
+		Log(LOG_EMERG, "Can't allocate memory! [Timer_New]");
+		return NULL;
+	}
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->callback = Callback;
+	timer->arg = Arg;
+	return timer;
+} /* Timer_New */
+
+/**
+ * Stop and free a timer.
+ *
+ * It is safe to call this function from the callback of the timer itself.
+ *
+ * @param Timer The timer or NULL.
+ */
+GLOBAL void
+Timer_Free(TIMER *Timer)
+{
+	if (!Timer)
+		return;
+
+	Timer_Stop(Timer);
+	free(Timer);
+} /* Timer_Free */
+
+/**
+ * Set (or reset) a timer to expire at a given time.
+ *
+ * A timer expires only once, but can be set again (for example by its
+ * callback function).
+ *
+ * @param Timer The timer.
+ * @param When Expiration time; times in the past expire on the next run,
+ *	       see Timer_Run().
+ */
+GLOBAL void
+Timer_Set(TIMER *Timer, time_t When)
+{
+	TIMER **slot;
+
+	assert(Timer != NULL);
+
+	Timer_Stop(Timer);
+
+	/* Timers which are already due go into the slot which is handled
+	 * next, so that they can't get lost on the wheel. */
+	slot = &Timer_Wheel[SLOT(When > Wheel_Time ? When : Wheel_Time + 1)];
+	Timer->expires = When;
+	Timer->next = *slot;
+	if (Timer->next)
+		Timer->next->pprev = &Timer->next;
+	Timer->pprev = slot;
+	*slot = Timer;
+	Timers_Set++;
+
+	if (Next_Expiration && When < Next_Expiration)
+		Next_Expiration = When;
+} /* Timer_Set */
+
+/**
+ * Set a timer to expire at a given time, unless it is already set to expire
+ * earlier.
+ *
+ * @param Timer The timer.
+ * @param When Expiration time.
+ */
+GLOBAL void
+Timer_SetEarlier(TIMER *Timer, time_t When)
+{
+	assert(Timer != NULL);
+
+	if (Timer->pprev && Timer->expires <= When)
+		return;
+	Timer_Set(Timer, When);
+} /* Timer_SetEarlier */
+
+/**
+ * Stop a timer. Nothing happens if the timer isn't set.
+ *
+ * @param Timer The timer.
+ */
+GLOBAL void
+Timer_Stop(TIMER *Timer)
+{
+	assert(Timer != NULL);
+
+	if (!Timer->pprev)
+		return;
+
+	*Timer->pprev = Timer->next;
+	if (Timer->next)
+		Timer->next->pprev = Timer->pprev;
+	Timer->next = NULL;
+	Timer->pprev = NULL;
+	assert(Timers_Set > 0);
+	Timers_Set--;
+
+	if (Timer->expires == Next_Expiration)
+		Next_Expiration = 0;
+} /* Timer_Stop */
+
+/**
+ * Call the callback functions of all expired timers.
+ *
+ * Callback functions can set, stop and free any timer, including their own.
+ * Timers which they set to expire "now" (or earlier) are not run before
+ * the next call of this function.
+ *
+ * @param Now Current time.
+ */
+GLOBAL void
+Timer_Run(time_t Now)
+{
+	TIMER *timer, *next, *due = NULL;
+	time_t second;
+
+	if (Now > Wheel_Time) {
+		/* Handle every slot only once, even if a lot of time passed. */
+		second = Wheel_Time + 1;
+		if (Now - Wheel_Time > TIMER_SLOTS)
+			second = Now - TIMER_SLOTS + 1;
+
+		for (; second <= Now; second++) {
+			/* Timers set to expire "now" by callback functions go
+			 * into the next slot, see Timer_Set(). */
+			Wheel_Time = second;
+
+			timer = Timer_Wheel[SLOT(second)];
+			while (timer) {
+				if (timer->expires > Now) {
+					/* Expires in a later round */
+					timer = timer->next;
+					continue;
+				}
+				Timer_Stop(timer);
+				Next_Expiration = 0;
+				timer->callback(timer->arg);
+
+				/* The callback function could have changed
+				 * this slot in any way, so start over. */
+				timer = Timer_Wheel[SLOT(second)];
+			}
+		}
+	}
+
+	/* Timers which have been set to expire "now" since the last run are
+	 * in the slot of the next second, see Timer_Set(): move the expired
+	 * ones to a list of their own and run them right away, instead of
+	 * waiting for the next second. */
+	for (timer = Timer_Wheel[SLOT(Wheel_Time + 1)]; timer; timer = next) {
+		next = timer->next;
+		if (timer->expires > Now)
+			continue;
+		*timer->pprev = next;
+		if (next)
+			next->pprev = timer->pprev;
+		timer->next = due;
+		if (due)
+			due->pprev = &timer->next;
+		timer->pprev = &due;
+		due = timer;
+	}
+	while (due) {
+		/* Callback functions can stop or free timers of this list,
+		 * Timer_Stop() unlinks them from it, too. */
+		timer = due;
+		Timer_Stop(timer);
+		Next_Expiration = 0;
+		timer->callback(timer->arg);
+	}
+} /* Timer_Run */
+
+/**
+ * Get the expiration time of the timer that expires next.
+ *
+ * @returns Expiration time or 0 if no timer is set.
+ */
+GLOBAL time_t
+Timer_NextExpiration(void)
+{
+	TIMER *timer;
+	time_t second, earliest = 0;
+	size_t i;
+
+	if (Next_Expiration || Timers_Set == 0)
+		return Next_Expiration;
+
+	/* Walk the wheel starting with the slot handled next: the first timer
+	 * found that expires in the current round of the wheel is the next
+	 * one, otherwise it's the earliest timer of all later rounds. */
+	for (i = 0; i < TIMER_SLOTS; i++) {
+		second = Wheel_Time + 1 + (time_t)i;
+		for (timer = Timer_Wheel[SLOT(second)]; timer;
+		     timer = timer->next) {
+			if (!earliest || timer->expires < earliest)
+				earliest = timer->expires;
+		}
+		if (earliest && earliest <= second)
+			break;
+	}
+
+	Next_Expiration = earliest;
+	return earliest;
+} /* Timer_NextExpiration */
+
+/**
+ * Get a timestamp with sub-second resolution for measuring time intervals.
+ *
+ * A monotonic clock is used when available, so that changes of the system
+ * time don't affect the intervals. Therefore the timestamps must not be
+ * compared to the result of time(NULL) and are only useful for differences.
+ *
+ * @param Now Receives the timestamp.
+ */
+GLOBAL void
+Timer_Now(struct timeval *Now)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		Now->tv_sec = ts.tv_sec;
+		Now->tv_usec = ts.tv_nsec / 1000;
+		return;
+	}
+#endif
+	gettimeofday(Now, NULL);
+} /* Timer_Now */
+
+/**
+ * Calculate the difference of two timestamps in milliseconds.
+ *
+ * The result is clipped when it doesn't fit into a long integer.
+ *
+ * @param A Timestamp, see Timer_Now().
+ * @param B Timestamp to subtract from A.
+ * @returns Difference A - B in milliseconds.
+ */
+GLOBAL long
+Timer_DiffMs(const struct timeval *A, const struct timeval *B)
+{
+	time_t sec = A->tv_sec - B->tv_sec;
+
+	if (sec > DIFF_MAX_SEC)
+		sec = DIFF_MAX_SEC;
+	else if (sec < -DIFF_MAX_SEC)
+		sec = -DIFF_MAX_SEC;
+	return (long)sec * 1000 + (long)(A->tv_usec - B->tv_usec) / 1000;
+} /* Timer_DiffMs */
+
+/**
+ * Add a number of milliseconds to a timestamp.
+ *
+ * @param Time Timestamp to change, see Timer_Now().
+ * @param Ms Milliseconds to add (must not be negative).
+ */
+GLOBAL void
+Timer_AddMs(struct timeval *Time, long Ms)
+{
+	assert(Ms >= 0);
+
+	Time->tv_sec += Ms / 1000;
+	Time->tv_usec += (Ms % 1000) * 1000;
+	if (Time->tv_usec >= 1000000) {
+		Time->tv_sec++;
+		Time->tv_usec -= 1000000;
+	}
+} /* Timer_AddMs */
+
+/* -eof- */
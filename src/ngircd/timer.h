@@ -0,0 +1,54 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#ifndef __timer_h__
+#define __timer_h__
+
+/**
+ * @file
+ * Timer wheel for scheduled events (header)
+ */
+
+#include <sys/time.h>
+#include <time.h>
+
+#include "portab.h"
+
+/** A timer, see Timer_New(). */
+typedef struct _Timer
+{
+	struct _Timer *next;		/**< Next timer in wheel slot */
+	struct _Timer **pprev;		/**< Link pointing to this timer or
+					     NULL when the timer isn't set */
+	time_t expires;			/**< Expiration time */
+	void (*callback) PARAMS((int Arg));
+					/**< Function to call on expiration */
+	int arg;			/**< Argument for callback function */
+} TIMER;
+
+GLOBAL TIMER *Timer_New PARAMS((void (*Callback)(int Arg), int Arg));
+GLOBAL void Timer_Free PARAMS((TIMER *Timer));
+
+GLOBAL void Timer_Set PARAMS((TIMER *Timer, time_t When));
+GLOBAL void Timer_SetEarlier PARAMS((TIMER *Timer, time_t When));
+GLOBAL void Timer_Stop PARAMS((TIMER *Timer));
+
+GLOBAL void Timer_Run PARAMS((time_t Now));
+GLOBAL time_t Timer_NextExpiration PARAMS((void));
+
+GLOBAL void Timer_Now PARAMS((struct timeval *Now));
+GLOBAL long Timer_DiffMs PARAMS((const struct timeval *A,
+				 const struct timeval *B));
+GLOBAL void Timer_AddMs PARAMS((struct timeval *Time, long Ms));
+
+#endif
+
+/* -eof- */
@@ -0,0 +1,117 @@
+# ngIRCd test suite
+# server burst benchmark
+#
+# Usage: expect burst-bench.e <users> <channels> <members>
+#
+# A first emulated server ("ngircd.test.server3") introduces <users> users
+# and <channels> channels with <members> members each to the running test
+# server 1. Then a second emulated server ("ngircd.test.server2") logs in
+# and the time the test server takes to send its server burst is measured.
+
+set users [lindex $argv 0]
+set channels [lindex $argv 1]
+set members [lindex $argv 2]
+
+# Open server connection and register as server
+proc server_login { name } {
+	set sock [socket 127.0.0.1 6789]
+	fconfigure $sock -translation crlf -buffering full -encoding binary
+	puts $sock "PASS pwd1 0210-IRC+ ngIRCd|testsuite0:CHLMSX P"
+	puts $sock "SERVER $name :Testsuite Server Emulation"
+	flush $sock
+	wait_for $sock " 376 "
+	return $sock
+}
+
+# Read lines until one contains the given text
+proc wait_for { sock text } {
+	while { [gets $sock line] >= 0 } {
+		if { [string first $text $line] >= 0 } {
+			return $line
+		}
+	}
+	puts "connection closed while waiting for \"$text\"!"
+	exit 1
+}
+
+# Emulate the network burst of the first server
+set sock1 [server_login ngircd.test.server3]
+puts $sock1 ":ngircd.test.server3 376 ngircd.test.server :End of MOTD command"
+flush $sock1
+wait_for $sock1 "PING :ngircd.test.server"
+
+for { set i 0 } { $i < $users } { incr i } {
+	puts $sock1 ":ngircd.test.server3 NICK b$i 1 ~bench localhost 1 + :Bench"
+}
+for { set c 0 } { $c < $channels } { incr c } {
+	set list {}
+	for { set m 0 } { $m < $members } { incr m } {
+		set i [expr { ($c * 7 + $m) % $users }]
+		if { $m % 10 == 0 } {
+			lappend list "@b$i"
+		} elseif { $m % 7 == 0 } {
+			lappend list "+b$i"
+		} else {
+			lappend list "b$i"
+		}
+		if { [llength $list] >= 40 } {
+			puts $sock1 ":ngircd.test.server3 NJOIN #bench$c :[join $list ,]"
+			set list {}
+		}
+	}
+	if { [llength $list] > 0 } {
+		puts $sock1 ":ngircd.test.server3 NJOIN #bench$c :[join $list ,]"
+	}
+}
+puts $sock1 ":ngircd.test.server3 PONG :ngircd.test.server"
+flush $sock1
+
+# Make sure that the test server has handled everything
+puts $sock1 ":ngircd.test.server3 PING :bench"
+flush $sock1
+wait_for $sock1 "PONG"
+
+# Now log in as second server and measure the burst, starting with its
+# first line (the end of the login can be delayed by flood control)
+set sock2 [server_login ngircd.test.server2]
+puts $sock2 ":ngircd.test.server2 376 ngircd.test.server :End of MOTD command"
+flush $sock2
+
+set bytes 0
+set nicks 0
+set joins 0
+set start 0
+while { [gets $sock2 line] >= 0 } {
+	if { $start == 0 } {
+		set start [clock milliseconds]
+	}
+	incr bytes [expr { [string length $line] + 2 }]
+	set cmd [lindex [split $line " "] 1]
+	if { $cmd == "NICK" } {
+		incr nicks
+	} elseif { $cmd == "NJOIN" } {
+		set list [string range $line [expr { [string first " :" $line] + 2 }] end]
+		incr joins [llength [split $list ,]]
+	} elseif { $cmd == "PING" } {
+		break
+	}
+}
+set ms [expr { [clock milliseconds] - $start }]
+
+puts "burst: $nicks users, $joins channel memberships, $bytes bytes in $ms ms."
+
+# Logout
+puts $sock2 ":ngircd.test.server2 SQUIT ngircd.test.server2 :Done"
+puts $sock1 ":ngircd.test.server3 SQUIT ngircd.test.server3 :Done"
+flush $sock2
+flush $sock1
+close $sock2
+close $sock1
+
+if { $joins < $channels * $members } {
+	puts "memberships missing in burst!"
+	exit 1
+}
+exit 0
+
+# -eof-
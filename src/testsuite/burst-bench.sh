@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# ngIRCd Test Suite
+# Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+# Please read the file COPYING, README and AUTHORS for more information.
+#
+
+# parse command line
+[ "$1" -gt 0 ] 2>/dev/null && USERS="$1" || USERS=1000
+[ "$2" -gt 0 ] 2>/dev/null && CHANNELS="$2" || CHANNELS=100
+[ "$3" -gt 0 ] 2>/dev/null && MEMBERS="$3" || MEMBERS=1000
+[ $MEMBERS -gt $USERS ] && MEMBERS=$USERS
+
+# detect source directory
+[ -z "$srcdir" ] && srcdir=`dirname "$0"`
+set -u
+
+# get our name
+name=`basename "$0"`
+
+# test for required external tools
+type expect >/dev/null 2>&1
+if [ $? -ne 0 ]; then
+	echo "${name}: \"expect\" not found."
+	exit 77
+fi
+
+# hello world! :-)
+echo "benchmarking server burst with $USERS users, $CHANNELS channels and $MEMBERS members each:"
+
+expect "${srcdir}/burst-bench.e" $USERS $CHANNELS $MEMBERS
+exit $?
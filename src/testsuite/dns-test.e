@@ -0,0 +1,59 @@
+# ngIRCd test suite
+# DNS client test
+#
+# Clients connect to test server 4 from different loopback addresses, which
+# the emulated name server (dnsstub, see dns-test.zone) resolves in different
+# ways, and the host names announced in the welcome message are checked.
+
+# Log in from the given address, and check the host name and the time (in
+# milliseconds) the login took
+proc check { addr nick host { min 0 } { max 1000 } } {
+	set start [clock milliseconds]
+	spawn telnet -b $addr 127.0.0.1 6791
+	expect {
+		timeout { exit 1 }
+		eof { puts "can't connect from $addr!"; exit 77 }
+		"Connected"
+	}
+	send "nick $nick\r"
+	send "user user 0 * :DNS test\r"
+	expect {
+		timeout { exit 1 }
+		-re " 001 $nick \[^\r\]*!~user@(\[^ \r\]+)\r"
+	}
+	set took [expr { [clock milliseconds] - $start }]
+	set got $expect_out(1,string)
+	puts "$addr: $got ($took ms)"
+	if { $got ne $host } {
+		puts "$addr: got host name \"$got\", expected \"$host\"!"
+		exit 1
+	}
+	if { $took < $min || $took > $max } {
+		puts "$addr: login took $took ms, expected $min to $max ms!"
+		exit 1
+	}
+	send "quit\r"
+	expect {
+		timeout { exit 1 }
+		"ERROR :Closing connection"
+	}
+}
+
+# Reverse lookup, confirmed by the forward lookup
+check 127.0.0.2 good good.example.test
+
+# Forward lookup points to a different address: forgery
+check 127.0.0.3 forged 127.0.0.3
+
+# Truncated answer: fail without waiting for the timeout
+check 127.0.0.5 truncated 127.0.0.5
+
+# Short names are looked up in the search domain first
+check 127.0.0.6 short short
+
+# Names with dots are looked up as they are first, then in the search domain
+check 127.0.0.7 subhost sub.host
+
+# No answer: fail after the timeout (1 second, see dns-test.sh)
+check 127.0.0.4 timeout 127.0.0.4 900 5000
+
@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# ngIRCd Test Suite
+# Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+# Please read the file COPYING, README and AUTHORS for more information.
+#
+
+# detect source directory
+[ -z "$srcdir" ] && srcdir=`dirname "$0"`
+set -u
+
+# read in functions
+. "${srcdir}/functions.inc"
+
+# get our name
+name=`basename "$0"`
+test=`echo ${name} | cut -d '.' -f 1`
+[ -d logs ] || mkdir logs
+
+# test for required external tools
+type expect >/dev/null 2>&1
+if [ $? -ne 0 ]; then
+	echo "$test: \"expect\" not found" >>tests-skipped.lst
+	echo "${name}: \"expect\" not found."
+	exit 77
+fi
+type telnet >/dev/null 2>&1
+if [ $? -ne 0 ]; then
+	echo "$test: \"telnet\" not found" >>tests-skipped.lst
+	echo "${name}: \"telnet\" not found."
+	exit 77
+fi
+if [ ! -x ./dnsstub ]; then
+	echo "$test: \"dnsstub\" not found" >>tests-skipped.lst
+	echo "${name}: \"dnsstub\" not found."
+	exit 77
+fi
+
+# generate resolver configuration for test server 4, see ngircd-test4.conf
+cat >ngircd-test4.resolv <<EOF
+nameserver 127.0.0.1 6792
+search example.test
+options timeout:1 attempts:1
+EOF
+
+# start the emulated name server and test server 4 using it
+./dnsstub 6792 "${srcdir}/dns-test.zone" >logs/dnsstub.log 2>&1 &
+stub=$!
+"${srcdir}/start-server.sh" 4; r=$?
+
+if [ $r -eq 0 ]; then
+	echo_n "running ${test} ..."
+	expect "${srcdir}/${test}.e" >logs/${test}.log; r=$?
+	case $r in
+		0) echo " ok." ;;
+		77) echo " skipped."
+		    echo "$test: can't use 127.0.0.x addresses" >>tests-skipped.lst ;;
+		*) echo " failure!" ;;
+	esac
+	"${srcdir}/stop-server.sh" 4 || r=1
+fi
+kill $stub >/dev/null 2>&1
+exit $r
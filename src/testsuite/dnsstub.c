@@ -0,0 +1,264 @@
+/*
+ * ngIRCd -- The Next Generation IRC Daemon
+ * Copyright (c)2001-2026 Alexander Barton (alex@barton.de) and Contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * Please read the file COPYING, README and AUTHORS for more information.
+ */
+
+#include "portab.h"
+
+/**
+ * @file
+ * Minimal name server for testing the DNS client of ngIRCd
+ *
+ * Usage: dnsstub <port> <zone file>
+ *
+ * The name server listens on 127.0.0.1 and answers queries using the
+ * records of the zone file. Each line of it consists of a name, a type and
+ * the data of the record:
+ *
+ *	<name> A <IPv4 address>
+ *	<name> PTR <host name>
+ *	<name> DROP		(don't answer queries for this name)
+ *	<name> TC		(answer with the "truncated" flag set)
+ *
+ * Queries for names not listed in the zone file are answered with "name
+ * error" (NXDOMAIN). The name server terminates after DNSSTUB_LIFETIME
+ * seconds, so that it doesn't keep running when a test fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DNSSTUB_LIFETIME 120		/** Max. run time in seconds */
+#define DNSSTUB_RECORDS 64		/** Max. number of records */
+#define DNSSTUB_NAME_LEN 256		/** Max. length of names */
+#define DNSSTUB_MSG_LEN 512		/** Max. length of messages */
+
+#define TYPE_A 1
+#define TYPE_PTR 12
+#define TYPE_DROP 1000
+#define TYPE_TC 1001
+
+typedef struct _Record
+{
+	char name[DNSSTUB_NAME_LEN];
+	int type;
+	char data[DNSSTUB_NAME_LEN];
+} RECORD;
+
+static RECORD Records[DNSSTUB_RECORDS];
+static int Record_Count;
+
+static void
+Panic(const char *Reason)
+{
+	perror(Reason);
+	exit(1);
+} /* Panic */
+
+static void
+Read_Zone(const char *File)
+{
+	char line[1024], *name, *type, *data;
+	RECORD *r;
+	FILE *fd;
+
+	fd = fopen(File, "r");
+	if (!fd)
+		Panic(File);
+	while (fgets(line, (int)sizeof(line), fd)) {
+		name = strtok(line, " \t\r\n");
+		if (!name || *name == '#')
+			continue;
+		type = strtok(NULL, " \t\r\n");
+		data = strtok(NULL, " \t\r\n");
+		if (!type || Record_Count >= DNSSTUB_RECORDS)
+			continue;
+
+		r = &Records[Record_Count++];
+		snprintf(r->name, sizeof(r->name), "%s", name);
+		snprintf(r->data, sizeof(r->data), "%s", data ? data : "");
+		if (strcmp(type, "A") == 0)
+			r->type = TYPE_A;
+		else if (strcmp(type, "PTR") == 0)
+			r->type = TYPE_PTR;
+		else if (strcmp(type, "DROP") == 0)
+			r->type = TYPE_DROP;
+		else if (strcmp(type, "TC") == 0)
+			r->type = TYPE_TC;
+		else
+			Record_Count--;
+	}
+	fclose(fd);
+} /* Read_Zone */
+
+/**
+ * Decode the (uncompressed) name of the question section.
+ * @returns Position after the name or 0 on error.
+ */
+static size_t
+Get_Name(const unsigned char *Msg, size_t Len, char *Name)
+{
+	size_t pos = 12, out = 0;
+	unsigned int label;
+
+	while (pos < Len && (label = Msg[pos++]) != 0) {
+		if (label > 63 || pos + label > Len
+		    || out + label + 2 > DNSSTUB_NAME_LEN)
+			return 0;
+		if (out > 0)
+			Name[out++] = '.';
+		memcpy(Name + out, Msg + pos, label);
+		out += label;
+		pos += label;
+	}
+	Name[out] = '\0';
+	return pos;
+} /* Get_Name */
+
+/**
+ * Encode a name.
+ * @returns Length of the encoded name.
+ */
+static size_t
+Put_Name(const char *Name, unsigned char *Buf)
+{
+	const char *dot;
+	size_t len, pos = 0;
+
+	while (*Name) {
+		dot = strchr(Name, '.');
+		len = dot ? (size_t)(dot - Name) : strlen(Name);
+		Buf[pos++] = (unsigned char)len;
+		memcpy(Buf + pos, Name, len);
+		pos += len;
+		Name += len;
+		if (*Name == '.')
+			Name++;
+	}
+	Buf[pos++] = 0;
+	return pos;
+} /* Put_Name */
+
+/**
+ * Build the answer to a query (received from the given port).
+ * @returns Length of the answer or 0 if the query shouldn't be answered.
+ */
+static size_t
+Answer(unsigned char *Msg, size_t Len, unsigned int Port)
+{
+	char name[DNSSTUB_NAME_LEN];
+	unsigned char *rr;
+	size_t pos, rdlen;
+	unsigned int type, count = 0;
+	bool exists = false;
+	int i;
+
+	if (Len < 12 || (Msg[2] & 0x80))
+		return 0;
+	pos = Get_Name(Msg, Len, name);
+	if (pos == 0 || pos + 4 > Len)
+		return 0;
+	type = (unsigned int)(Msg[pos] << 8 | Msg[pos + 1]);
+	pos += 4;
+
+	Msg[2] = (Msg[2] & 0x01) | 0x84;	/* QR, AA, RD */
+	Msg[3] = 0x80;				/* RA, no error */
+	memset(Msg + 6, 0, 6);
+	Msg[5] = 1;				/* one question */
+	printf("query: %s (type %u) from port %u\n", name, type, Port);
+
+	for (i = 0; i < Record_Count; i++) {
+		if (strcasecmp(Records[i].name, name) != 0)
+			continue;
+		exists = true;
+		if (Records[i].type == TYPE_DROP)
+			return 0;
+		if (Records[i].type == TYPE_TC) {
+			Msg[2] |= 0x02;
+			return pos;
+		}
+		if ((unsigned int)Records[i].type != type)
+			continue;
+
+		rr = Msg + pos;
+		rr[0] = 0xc0;			/* pointer to the question */
+		rr[1] = 12;
+		rr[2] = 0;
+		rr[3] = (unsigned char)type;
+		rr[4] = 0;
+		rr[5] = 1;			/* class IN */
+		rr[6] = rr[7] = rr[8] = 0;
+		rr[9] = 60;			/* TTL */
+		if (type == TYPE_A) {
+			if (inet_pton(AF_INET, Records[i].data, rr + 12) != 1)
+				continue;
+			rdlen = 4;
+		} else
+			rdlen = Put_Name(Records[i].data, rr + 12);
+		rr[10] = (unsigned char)(rdlen >> 8);
+		rr[11] = (unsigned char)rdlen;
+		pos += 12 + rdlen;
+		count++;
+	}
+
+	if (!exists)
+		Msg[3] |= 3;			/* name error */
+	Msg[7] = (unsigned char)count;
+	return pos;
+} /* Answer */
+
+int
+main(int argc, char *argv[])
+{
+	unsigned char msg[DNSSTUB_MSG_LEN * 2];
+	struct sockaddr_in addr, from;
+	socklen_t from_len;
+	ssize_t len;
+	size_t answer_len;
+	int sock;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <port> <zone file>\n", argv[0]);
+		exit(2);
+	}
+	Read_Zone(argv[2]);
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0)
+		Panic("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((unsigned short)atoi(argv[1]));
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		Panic("bind");
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	alarm(DNSSTUB_LIFETIME);
+
+	for (;;) {
+		from_len = (socklen_t)sizeof(from);
+		len = recvfrom(sock, msg, DNSSTUB_MSG_LEN, 0,
+			       (struct sockaddr *)&from, &from_len);
+		if (len < 0)
+			continue;
+		answer_len = Answer(msg, (size_t)len, ntohs(from.sin_port));
+		if (answer_len > 0)
+			sendto(sock, msg, answer_len, 0,
+			       (struct sockaddr *)&from, from_len);
+	}
+} /* main */
+
+/* -eof- */
@@ -0,0 +1,129 @@
+# ngIRCd test suite
+# server burst test
+#
+# A local client connects but doesn't register before a first emulated
+# server ("ngircd.test.server3") introduces a lot of users, so the client
+# comes after all of them in the list of clients of the test server. Then a
+# second emulated server ("ngircd.test.server2") logs in and doesn't read
+# its burst, which stalls as soon as the socket buffers are full, and the
+# local client registers in the meantime: it must be announced to the new
+# server exactly once, either by the burst or right on registration.
+
+set timeout 30
+
+set users 16000
+set user [string repeat "u" 18]
+set host [string repeat "h" 52].burst.test
+set info [string repeat "Burst " 21]
+
+# Local client, not registered yet
+spawn telnet 127.0.0.1 6789
+set client $spawn_id
+expect {
+	timeout { exit 1 }
+	"Connected"
+}
+send "nick latecomer\r"
+
+# Register first server
+spawn telnet 127.0.0.1 6789
+expect {
+	timeout { exit 1 }
+	"Connected"
+}
+send "PASS pwd1 0210-IRC+ ngIRCd|testsuite0:CHLMSX P\r"
+send "SERVER ngircd.test.server3 :Testsuite Server Emulation\r"
+expect {
+	timeout { exit 1 }
+	":ngircd.test.server 376 "
+}
+send ":ngircd.test.server3 376 ngircd.test.server :End of MOTD command\r"
+expect {
+	timeout { exit 1 }
+	":ngircd.test.server PING :ngircd.test.server"
+}
+
+# Emulate network burst with lots of users, and read the replies of the
+# test server now and then
+for { set i 0 } { $i < $users } { incr i } {
+	send ":ngircd.test.server3 NICK b$i 1 ~$user $host 1 + :$info\r"
+	send ":ngircd.test.server3 METADATA b$i cloakhost :$host\r"
+	if { $i % 1000 == 999 } {
+		send ":ngircd.test.server3 PING :b$i\r"
+		expect {
+			timeout { exit 1 }
+			":ngircd.test.server PONG ngircd.test.server3 :b"
+		}
+	}
+}
+
+# End of burst
+send ":ngircd.test.server3 PONG :ngircd.test.server\r"
+set server3 $spawn_id
+
+# Register second server, and let the local client register as soon as
+# the burst has been started
+spawn telnet 127.0.0.1 6789
+set server2 $spawn_id
+expect {
+	timeout { exit 1 }
+	"Connected"
+}
+send "PASS pwd1 0210-IRC+ ngIRCd|testsuite0:CHLMSX P\r"
+send "SERVER ngircd.test.server2 :Testsuite Server Emulation\r"
+expect {
+	timeout { exit 1 }
+	":ngircd.test.server 376 "
+}
+send ":ngircd.test.server2 376 ngircd.test.server :End of MOTD command\r"
+expect {
+	timeout { exit 1 }
+	" NICK "
+}
+send -i $client "user user 0 * :Latecomer\r"
+expect -i $client {
+	timeout { exit 1 }
+	":ngircd.test.server 001 latecomer "
+}
+
+# Read the rest of the burst (up to its final PING) and everything sent
+# up to the reply to our own PING, and count the announcements of the
+# local client
+set announced 0
+expect {
+	timeout { exit 1 }
+	" NICK latecomer " { incr announced; exp_continue }
+	":ngircd.test.server PING :ngircd.test.server" { }
+	-re "\[^\n\]*\n" { exp_continue }
+}
+send ":ngircd.test.server2 PONG :ngircd.test.server\r"
+send ":ngircd.test.server2 PING :ngircd.test.server2\r"
+expect {
+	timeout { exit 1 }
+	" NICK latecomer " { incr announced; exp_continue }
+	":ngircd.test.server PONG ngircd.test.server2 :" { }
+	-re "\[^\n\]*\n" { exp_continue }
+}
+if { $announced != 1 } {
+	puts "local client has been announced $announced times!"
+	exit 1
+}
+
+# Logout
+send -i $client "quit\r"
+expect -i $client {
+	timeout { exit 1 }
+	"ERROR :Closing connection"
+}
+send -i $server2 ":ngircd.test.server2 SQUIT ngircd.test.server2 :Done\r"
+expect -i $server2 {
+	timeout { exit 1 }
+	"ERROR :Closing connection"
+}
+send -i $server3 ":ngircd.test.server3 SQUIT ngircd.test.server3 :Done\r"
+expect -i $server3 {
+	timeout { exit 1 }
+	"ERROR :Closing connection"
+}
+
+# -eof-
@@ -0,0 +1,102 @@
+# ngIRCd test suite
+# K-Line and G-Line test
+#
+# Clients connect from different loopback addresses, and an IRC operator
+# sets K-Lines and G-Lines for address ranges in CIDR notation: only the
+# clients within the ranges must be disconnected.
+
+# Log in from the given address and return the spawn ID
+proc login { addr nick } {
+	spawn telnet -b $addr 127.0.0.1 6789
+	expect {
+		timeout { exit 1 }
+		eof { puts "can't connect from $addr!"; exit 77 }
+		"Connected"
+	}
+	send "nick $nick\r"
+	send "user user . . :User\r"
+	expect {
+		timeout { exit 1 }
+		"376"
+	}
+	return $spawn_id
+}
+
+# Check that a client is still connected
+proc alive { id } {
+	send -i $id "ping :alive\r"
+	expect -i $id {
+		timeout { exit 1 }
+		eof { exit 1 }
+		":ngircd.test.server PONG ngircd.test.server :alive"
+	}
+}
+
+# Check that a client has been disconnected for the given reason
+proc killed { id reason } {
+	expect -i $id {
+		timeout { exit 1 }
+		"ERROR :Closing connection: *($reason)"
+	}
+}
+
+spawn telnet 127.0.0.1 6789
+set oper $spawn_id
+expect {
+	timeout { exit 1 }
+	"Connected"
+}
+send "nick nick\r"
+send "user user . . :Operator\r"
+expect {
+	timeout { exit 1 }
+	"376"
+}
+send "oper TestOp 123\r"
+expect {
+	timeout { exit 1 }
+	" 381 nick"
+}
+
+set c5 [login 127.0.0.5 five]
+set c9 [login 127.0.0.9 nine]
+
+# "010" is not octal (127.0.0.8/30): this isn't an address range at all
+send -i $oper "kline *!*@127.0.0.010/30 0 :Octal\r"
+alive $oper
+alive $c9
+
+# 127.0.0.4 to 127.0.0.7
+send -i $oper "kline *!*@127.0.0.4/30 0 :Range\r"
+alive $oper
+killed $c5 "K-Line by \"nick\": \"Range\""
+alive $c9
+
+# 127.0.0.8 to 127.0.0.15
+send -i $oper "gline *!*@127.0.0.8/29 0 :Global\r"
+alive $oper
+killed $c9 "G-Line by \"nick\": \"Global\""
+
+# Clients from other addresses still can log in
+set c3 [login 127.0.0.3 three]
+alive $c3
+send -i $c3 "quit\r"
+expect -i $c3 {
+	timeout { exit 1 }
+	"ERROR :Closing connection"
+}
+
+# Remove all entries again
+send -i $oper "kline *!*@127.0.0.010/30\r"
+send -i $oper "kline *!*@127.0.0.4/30\r"
+send -i $oper "gline *!*@127.0.0.8/29\r"
+alive $oper
+set c5 [login 127.0.0.5 five]
+set c9 [login 127.0.0.9 nine]
+foreach id [list $c5 $c9 $oper] {
+	send -i $id "quit\r"
+	expect -i $id {
+		timeout { exit 1 }
+		"ERROR :Closing connection"
+	}
+}